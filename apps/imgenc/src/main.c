@@ -0,0 +1,324 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Host tool for making encoded images (struct image_enc_header), which the
+ * image manager decodes while they are uploaded.
+ *
+ *     imgenc [-z] [-d base_image] image output
+ *
+ * -z compresses the payload.  -d makes a delta against base_image, which
+ * must be the image running on the target.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <bootutil/image.h>
+#include <util/lzss.h>
+
+#define IMGENC_BLK              8
+#define IMGENC_HASH_BITS        16
+#define IMGENC_MAX_CHAIN        64
+#define IMGENC_MIN_COPY         16
+
+static const char *progname;
+
+static void
+usage(int rc)
+{
+    printf("%s [-z] [-d base_image] image output\n", progname);
+    printf("  Tool for making compressed or delta images\n");
+    printf("   -z: compress the image\n");
+    printf("   -d: make a delta against base_image\n");
+    exit(rc);
+}
+
+static void
+fail(const char *msg, const char *arg)
+{
+    fprintf(stderr, "%s: %s%s%s\n", progname, msg, arg ? ": " : "",
+            arg ? arg : "");
+    exit(1);
+}
+
+static uint8_t *
+read_file(const char *path, uint32_t *len)
+{
+    uint8_t *buf;
+    FILE *fp;
+    long sz;
+
+    fp = fopen(path, "rb");
+    if (!fp) {
+        fail("can't open", path);
+    }
+    if (fseek(fp, 0, SEEK_END) || (sz = ftell(fp)) < 0 ||
+        fseek(fp, 0, SEEK_SET)) {
+        fail("can't read", path);
+    }
+    buf = malloc(sz + 1);
+    assert(buf != NULL);
+    if (fread(buf, 1, sz, fp) != (size_t)sz) {
+        fail("can't read", path);
+    }
+    fclose(fp);
+    *len = sz;
+    return buf;
+}
+
+/*
+ * Returns the image header, after checking that the image fits in the
+ * file.  The size of the image is returned in 'len'.
+ */
+static struct image_header *
+image_check(uint8_t *img, uint32_t *len, const char *path)
+{
+    struct image_header *hdr;
+
+    hdr = (struct image_header *)img;
+    if (*len < sizeof(*hdr) || hdr->ih_magic != IMAGE_MAGIC ||
+        hdr->ih_hdr_size < sizeof(*hdr) || IMAGE_SIZE(hdr) > *len) {
+        fail("not an image", path);
+    }
+    *len = IMAGE_SIZE(hdr);
+    return hdr;
+}
+
+/*
+ * Finds the SHA256 TLV of an image; the target compares it with the
+ * image it's running before applying a delta.
+ */
+static void
+image_hash(uint8_t *img, uint8_t *hash, const char *path)
+{
+    struct image_header *hdr;
+    struct image_tlv tlv;
+    uint32_t off;
+    uint32_t end;
+
+    hdr = (struct image_header *)img;
+    off = hdr->ih_hdr_size + hdr->ih_img_size;
+    end = off + hdr->ih_tlv_size;
+    while (off + sizeof(tlv) <= end) {
+        memcpy(&tlv, img + off, sizeof(tlv));
+        off += sizeof(tlv);
+        if (tlv.it_type == IMAGE_TLV_SHA256 && tlv.it_len == 32 &&
+            off + tlv.it_len <= end) {
+            memcpy(hash, img + off, 32);
+            return;
+        }
+        off += tlv.it_len;
+    }
+    fail("image has no SHA256 TLV", path);
+}
+
+static uint32_t
+blk_hash(const uint8_t *p)
+{
+    uint32_t h;
+    int i;
+
+    h = 2166136261u;
+    for (i = 0; i < IMGENC_BLK; i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h >> (32 - IMGENC_HASH_BITS);
+}
+
+static uint8_t *
+put_le32(uint8_t *p, uint32_t val)
+{
+    p[0] = val;
+    p[1] = val >> 8;
+    p[2] = val >> 16;
+    p[3] = val >> 24;
+    return p + 4;
+}
+
+static uint8_t *
+op_data(uint8_t *op, const uint8_t *data, uint32_t len)
+{
+    if (len == 0) {
+        return op;
+    }
+    *op++ = IMAGE_DELTA_DATA;
+    op = put_le32(op, len);
+    memcpy(op, data, len);
+    return op + len;
+}
+
+static uint8_t *
+op_copy(uint8_t *op, uint32_t off, uint32_t len)
+{
+    *op++ = IMAGE_DELTA_COPY;
+    op = put_le32(op, off);
+    return put_le32(op, len);
+}
+
+/*
+ * Makes delta ops which build 'tgt' from pieces of 'base', and literal
+ * data.  Blocks of base are indexed by hash; at each position in tgt, the
+ * longest match among the candidates is taken if it's worth a COPY op.
+ * Returns the length of the ops.
+ */
+static uint32_t
+delta_build(const uint8_t *base, uint32_t base_len, const uint8_t *tgt,
+            uint32_t tgt_len, uint8_t *ops)
+{
+    int32_t *head;
+    int32_t *next;
+    uint32_t best_off;
+    uint32_t best;
+    uint32_t lit;
+    uint32_t max;
+    uint32_t len;
+    uint32_t t;
+    uint8_t *op;
+    int32_t c;
+    int chain;
+
+    head = malloc(sizeof(*head) << IMGENC_HASH_BITS);
+    next = malloc(sizeof(*next) * (base_len + 1));
+    assert(head != NULL && next != NULL);
+    memset(head, 0xff, sizeof(*head) << IMGENC_HASH_BITS);
+    for (t = 0; t + IMGENC_BLK <= base_len; t++) {
+        next[t] = head[blk_hash(base + t)];
+        head[blk_hash(base + t)] = t;
+    }
+
+    op = ops;
+    lit = 0;
+    t = 0;
+    while (t + IMGENC_BLK <= tgt_len) {
+        best = 0;
+        best_off = 0;
+        chain = 0;
+        for (c = head[blk_hash(tgt + t)]; c >= 0 && chain < IMGENC_MAX_CHAIN;
+             c = next[c], chain++) {
+            max = base_len - c;
+            if (max > tgt_len - t) {
+                max = tgt_len - t;
+            }
+            for (len = 0; len < max && base[c + len] == tgt[t + len]; len++) {
+            }
+            if (len > best) {
+                best = len;
+                best_off = c;
+            }
+        }
+        if (best < IMGENC_MIN_COPY) {
+            t++;
+            continue;
+        }
+        op = op_data(op, tgt + lit, t - lit);
+        op = op_copy(op, best_off, best);
+        t += best;
+        lit = t;
+    }
+    op = op_data(op, tgt + lit, tgt_len - lit);
+
+    free(head);
+    free(next);
+    return op - ops;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct image_enc_header eh;
+    struct image_header *hdr;
+    const char *base_path;
+    uint8_t *payload;
+    uint8_t *base;
+    uint8_t *comp;
+    uint8_t *img;
+    uint32_t base_len;
+    uint32_t img_len;
+    uint32_t len;
+    FILE *fp;
+    int rc;
+    int ch;
+
+    progname = argv[0];
+    base_path = NULL;
+    memset(&eh, 0, sizeof(eh));
+    eh.ieh_magic = IMAGE_ENC_MAGIC;
+
+    while ((ch = getopt(argc, argv, "d:z")) != -1) {
+        switch (ch) {
+        case 'd':
+            base_path = optarg;
+            eh.ieh_flags |= IMAGE_ENC_F_DELTA;
+            break;
+        case 'z':
+            eh.ieh_flags |= IMAGE_ENC_F_LZSS;
+            break;
+        case '?':
+        default:
+            usage(1);
+        }
+    }
+    if (argc - optind != 2 || eh.ieh_flags == 0) {
+        usage(1);
+    }
+
+    img = read_file(argv[optind], &img_len);
+    hdr = image_check(img, &img_len, argv[optind]);
+    memcpy(&eh.ieh_hdr, hdr, sizeof(eh.ieh_hdr));
+
+    /* Payload decodes to what follows the image header. */
+    payload = img + sizeof(*hdr);
+    len = img_len - sizeof(*hdr);
+
+    if (base_path) {
+        base = read_file(base_path, &base_len);
+        image_check(base, &base_len, base_path);
+        image_hash(base, eh.ieh_base_hash, base_path);
+        payload = malloc(len * 2 + 64);
+        assert(payload != NULL);
+        len = delta_build(base, base_len, img + sizeof(*hdr), len, payload);
+    }
+
+    if (eh.ieh_flags & IMAGE_ENC_F_LZSS) {
+        comp = malloc(len + len / 8 + 16);
+        assert(comp != NULL);
+        rc = lzss_encode(payload, len, comp, len + len / 8 + 16);
+        assert(rc >= 0);
+        payload = comp;
+        len = rc;
+    }
+
+    fp = fopen(argv[optind + 1], "wb");
+    if (!fp) {
+        fail("can't open", argv[optind + 1]);
+    }
+    if (fwrite(&eh, sizeof(eh), 1, fp) != 1 ||
+        fwrite(payload, 1, len, fp) != len || fclose(fp)) {
+        fail("can't write", argv[optind + 1]);
+    }
+
+    printf("%s: %u -> %u bytes\n", argv[optind + 1], (unsigned)img_len,
+           (unsigned)(sizeof(eh) + len));
+    return 0;
+}
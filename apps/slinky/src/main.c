@@ -80,6 +80,10 @@ os_stack_t shell_stack[SHELL_TASK_STACK_SIZE];
 #define NEWTMGR_TASK_STACK_SIZE (OS_STACK_ALIGN(896))
 os_stack_t newtmgr_stack[NEWTMGR_TASK_STACK_SIZE];
 
+/* Runs slow newtmgr commands (uploads, log reads). */
+#define NEWTMGR_WORKER_PRIO (5)
+os_stack_t newtmgr_worker_stack[NEWTMGR_TASK_STACK_SIZE];
+
 struct log_handler log_cbmem_handler;
 struct log my_log;
 
@@ -396,6 +400,8 @@ main(int argc, char **argv)
                     SHELL_MAX_INPUT_LEN);
 
     nmgr_task_init(NEWTMGR_TASK_PRIO, newtmgr_stack, NEWTMGR_TASK_STACK_SIZE);
+    nmgr_worker_init(NEWTMGR_WORKER_PRIO, newtmgr_worker_stack,
+                     NEWTMGR_TASK_STACK_SIZE);
     imgmgr_module_init();
 
     stats_module_init();
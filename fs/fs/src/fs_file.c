@@ -16,6 +16,8 @@
  * specific language governing permissions and limitations
  * under the License.
  */
+#include <os/os.h>
+
 #include <fs/fs.h>
 #include <fs/fs_if.h>
 
@@ -39,6 +41,78 @@ fs_read(struct fs_file *file, uint32_t len, void *out_data, uint32_t *out_len)
     return fs_root_ops->f_read(file, len, out_data, out_len);
 }
 
+/**
+ * Reads from a file and appends the data to an mbuf chain.  File data is
+ * read directly into the data areas of the mbufs; the trailing space of
+ * the last mbuf is filled first, then new mbufs are taken from msys.
+ *
+ * @param file                  The file to read from.
+ * @param len                   The number of bytes to attempt to read.
+ * @param om                    The mbuf chain to append to.
+ * @param out_len               On success, the number of bytes actually
+ *                                  read gets written here.  Pass null if
+ *                                  you don't care.
+ *
+ * @return                      0 on success; FS_ENOMEM if msys ran out
+ *                                  of mbufs; other FS_Exxx on failure.
+ *                                  On failure, the data which was read
+ *                                  stays in the chain.
+ */
+int
+fs_read_mbuf(struct fs_file *file, uint32_t len, struct os_mbuf *om,
+  uint32_t *out_len)
+{
+    struct os_mbuf *last;
+    struct os_mbuf *m;
+    uint32_t total;
+    uint32_t chunk;
+    uint32_t cnt;
+    int rc;
+
+    last = om;
+    while (SLIST_NEXT(last, om_next) != NULL) {
+        last = SLIST_NEXT(last, om_next);
+    }
+
+    total = 0;
+    rc = 0;
+    while (total < len) {
+        m = last;
+        if (OS_MBUF_TRAILINGSPACE(m) == 0) {
+            m = os_msys_get(len - total, 0);
+            if (!m) {
+                rc = FS_ENOMEM;
+                break;
+            }
+        }
+
+        chunk = min(len - total, OS_MBUF_TRAILINGSPACE(m));
+        rc = fs_read(file, chunk, m->om_data + m->om_len, &cnt);
+        if (rc == 0 && cnt > 0) {
+            if (m != last) {
+                SLIST_NEXT(last, om_next) = m;
+                last = m;
+            }
+            m->om_len += cnt;
+            if (OS_MBUF_IS_PKTHDR(om)) {
+                OS_MBUF_PKTHDR(om)->omp_len += cnt;
+            }
+            total += cnt;
+        } else if (m != last) {
+            os_mbuf_free(m);
+        }
+        if (rc || cnt < chunk) {
+            /* Error, or end of file. */
+            break;
+        }
+    }
+
+    if (out_len) {
+        *out_len = total;
+    }
+    return rc;
+}
+
 int
 fs_write(struct fs_file *file, const void *data, int len)
 {
@@ -22,6 +22,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <errno.h>
+#include "os/os.h"
 #include "hal/hal_flash.h"
 #include "testutil/testutil.h"
 #include "fs/fs.h"
@@ -1143,6 +1144,90 @@ TEST_CASE(nffs_test_read)
     TEST_ASSERT(rc == 0);
 }
 
+TEST_CASE(nffs_test_read_mbuf)
+{
+#define NFFS_TEST_MBUF_CNT  8
+#define NFFS_TEST_MBUF_SZ   (sizeof(struct os_mbuf) + 64)
+    static os_membuf_t membuf[OS_MEMPOOL_SIZE(NFFS_TEST_MBUF_CNT,
+                                              NFFS_TEST_MBUF_SZ)];
+    static struct os_mempool mempool;
+    static struct os_mbuf_pool mbuf_pool;
+    static uint8_t data[300];
+    struct fs_file *file;
+    struct os_mbuf *om;
+    uint32_t bytes_read;
+    int rc;
+    int i;
+
+    rc = os_mempool_init(&mempool, NFFS_TEST_MBUF_CNT, NFFS_TEST_MBUF_SZ,
+                         membuf, "nffs_test_mbuf");
+    TEST_ASSERT_FATAL(rc == 0);
+    rc = os_mbuf_pool_init(&mbuf_pool, &mempool, NFFS_TEST_MBUF_SZ,
+                           NFFS_TEST_MBUF_CNT);
+    TEST_ASSERT_FATAL(rc == 0);
+    os_msys_reset();
+    rc = os_msys_register(&mbuf_pool);
+    TEST_ASSERT_FATAL(rc == 0);
+
+    rc = nffs_format(nffs_area_descs);
+    TEST_ASSERT(rc == 0);
+
+    for (i = 0; i < sizeof data; i++) {
+        data[i] = i;
+    }
+    nffs_test_util_create_file("/myfile.txt", (char *)data, sizeof data);
+
+    rc = fs_open("/myfile.txt", FS_ACCESS_READ, &file);
+    TEST_ASSERT_FATAL(rc == 0);
+
+    /*** Append to a chain which already holds some data. */
+    om = os_msys_get_pkthdr(0, 0);
+    TEST_ASSERT_FATAL(om != NULL);
+    rc = os_mbuf_append(om, "hdr", 3);
+    TEST_ASSERT(rc == 0);
+
+    rc = fs_read_mbuf(file, 200, om, &bytes_read);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(bytes_read == 200);
+    TEST_ASSERT(OS_MBUF_PKTLEN(om) == 203);
+    TEST_ASSERT(os_mbuf_cmpf(om, 0, "hdr", 3) == 0);
+    TEST_ASSERT(os_mbuf_cmpf(om, 3, data, 200) == 0);
+    TEST_ASSERT(fs_getpos(file) == 200);
+
+    /*** Read past the end; only the rest of the file is appended. */
+    rc = fs_read_mbuf(file, 200, om, &bytes_read);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(bytes_read == 100);
+    TEST_ASSERT(OS_MBUF_PKTLEN(om) == 303);
+    TEST_ASSERT(os_mbuf_cmpf(om, 3, data, sizeof data) == 0);
+
+    /*** Nothing left; no empty mbufs get chained. */
+    i = mempool.mp_num_free;
+    rc = fs_read_mbuf(file, 200, om, &bytes_read);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(bytes_read == 0);
+    TEST_ASSERT(mempool.mp_num_free == i);
+    os_mbuf_free_chain(om);
+
+    /*** Running out of mbufs keeps what was read. */
+    rc = fs_seek(file, 0);
+    TEST_ASSERT(rc == 0);
+    om = os_msys_get_pkthdr(0, 0);
+    TEST_ASSERT_FATAL(om != NULL);
+    while (mempool.mp_num_free > 2) {
+        TEST_ASSERT_FATAL(os_msys_get(0, 0) != NULL);
+    }
+    rc = fs_read_mbuf(file, sizeof data, om, &bytes_read);
+    TEST_ASSERT(rc == FS_ENOMEM);
+    TEST_ASSERT(bytes_read > 0 && bytes_read < sizeof data);
+    TEST_ASSERT(OS_MBUF_PKTLEN(om) == bytes_read);
+    TEST_ASSERT(os_mbuf_cmpf(om, 0, data, bytes_read) == 0);
+
+    rc = fs_close(file);
+    TEST_ASSERT(rc == 0);
+    os_msys_reset();
+}
+
 TEST_CASE(nffs_test_open)
 {
     struct fs_file *file;
@@ -2672,6 +2757,7 @@ nffs_test_gen(void)
     nffs_test_truncate();
     nffs_test_append();
     nffs_test_read();
+    nffs_test_read_mbuf();
     nffs_test_open();
     nffs_test_overwrite_one();
     nffs_test_overwrite_two();
@@ -73,6 +73,39 @@ struct image_tlv {
     uint16_t it_len;
 };
 
+/*
+ * Encoded image.  This is uploaded in place of a plain image, and decoded
+ * by the image manager as it arrives; the slot ends up holding the plain
+ * image.  ieh_hdr is the header of the decoded image, and the payload
+ * which follows decodes to the rest of it.
+ *
+ * With IMAGE_ENC_F_LZSS, the payload is compressed with util/lzss.  With
+ * IMAGE_ENC_F_DELTA, the (decompressed) payload is a sequence of delta
+ * ops against the image which is running; ieh_base_hash is the SHA256
+ * TLV of that image.
+ */
+#define IMAGE_ENC_MAGIC             0x96f3e4c0
+
+#define IMAGE_ENC_F_LZSS            0x01
+#define IMAGE_ENC_F_DELTA           0x02
+
+struct image_enc_header {
+    uint32_t ieh_magic;
+    uint8_t  ieh_flags;
+    uint8_t  _pad1[3];
+    uint8_t  ieh_base_hash[32];
+    struct image_header ieh_hdr;
+};
+
+/*
+ * Delta ops.  Op byte followed by little endian fields.
+ */
+#define IMAGE_DELTA_COPY            0   /* off, len: from base image */
+#define IMAGE_DELTA_DATA            1   /* len, followed by len bytes */
+
+#define IMAGE_DELTA_COPY_SZ         9
+#define IMAGE_DELTA_DATA_SZ         5
+
 _Static_assert(sizeof(struct image_header) == IMAGE_HEADER_SIZE,
                "struct image_header not required size");
 
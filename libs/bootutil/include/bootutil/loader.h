@@ -49,6 +49,12 @@ struct boot_req {
 
     /** Size of the image slot */
     uint32_t br_img_sz;
+
+    /**
+     * With BOOTUTIL_VALIDATE_SLOT0, nonzero to verify the signature of the
+     * image in the primary slot, even if it has been verified before.
+     */
+    uint8_t br_validate_full;
 };
 
 /**
@@ -30,4 +30,11 @@ struct bootutil_key {
 extern const struct bootutil_key bootutil_keys[];
 extern const int bootutil_key_cnt;
 
+/*
+ * With IMAGE_SEAL_TRUST, the secret which authenticates the boot loader's
+ * validation records.  It must not be known to anything that can write
+ * an image slot, so it should be unique per device.
+ */
+extern const struct bootutil_key bootutil_seal_key;
+
 #endif /* __BOOTUTIL_SIGN_KEY_H_ */
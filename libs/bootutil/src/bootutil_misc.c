@@ -287,6 +287,14 @@ boot_write_status(struct boot_status *bs)
     }
     off -= ((3 * bs->elem_sz) * bs->idx + bs->elem_sz * (bs->state + 1));
 
+    /*
+     * Status for skipped areas is written out of order, and can get written
+     * again after restart.
+     */
+    if (hal_flash_read(flash_id, off, &val, sizeof(val)) == 0 && val != 0xff) {
+        return 0;
+    }
+
     val = bs->state;
     hal_flash_write(flash_id, off, &val, sizeof(val));
 
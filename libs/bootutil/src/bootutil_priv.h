@@ -56,6 +56,37 @@ struct boot_img_trailer {
     uint16_t _pad;
 };
 
+/*
+ * Validation record; written by the boot loader after the TLVs of the
+ * image in the primary slot.
+ *
+ * IMAGE_SEAL_TRUST: the boot loader writes this record only after it has
+ * verified the image in the primary slot itself, and later boots trust
+ * it only for that slot, never for the secondary slot or for an image
+ * which was just uploaded.  The record carries an HMAC-SHA256 over the
+ * header and hash under bootutil_seal_key, so a record written by the
+ * image manager or copied in with an upload does not verify.
+ *
+ * The image is still hashed on every boot, so a change anywhere in it
+ * makes the record stale; a record only saves verifying the signature
+ * again.  Without IMAGE_SEAL_TRUST, or without image signatures, no
+ * record is written or trusted.  iv_magic is written last.
+ */
+#define IMAGE_VALID_MAGIC   0x7a11da7e
+
+struct image_valid {
+    uint32_t iv_magic;
+    struct image_header iv_hdr;
+    uint8_t iv_hash[32];        /* SHA-256 of the image */
+    uint8_t iv_mac[32];         /* HMAC-SHA256 of iv_hdr and iv_hash */
+};
+
+#define IMAGE_VALID_OFF(hdr)        ((IMAGE_SIZE(hdr) + 7) & ~7)
+
+int bootutil_img_validate_cached(struct image_header *hdr, uint8_t flash_id,
+  uint32_t addr, uint32_t max_sz, int force, uint8_t *tmp_buf,
+  uint32_t tmp_buf_sz);
+
 int bootutil_verify_sig(uint8_t *hash, uint32_t hlen, uint8_t *sig, int slen,
     uint8_t key_id);
 
@@ -73,5 +104,13 @@ void boot_scratch_magic(struct boot_img_trailer *bit);
 struct boot_req;
 void boot_req_set(struct boot_req *req);
 
+#ifdef MYNEWT_UNIT_TEST
+/*
+ * Number of flash erases/writes a swap may do before it fails as if power
+ * was lost; negative for no limit.
+ */
+extern int boot_power_fail_cnt;
+#endif
+
 #endif
 
@@ -73,12 +73,12 @@ bootutil_img_hash(struct image_header *hdr, uint8_t flash_id, uint32_t addr,
 }
 
 /*
- * Verify the integrity of the image.
- * Return non-zero if image could not be validated/does not validate.
+ * Check the image TLVs against 'hash', the hash of the image.  Without
+ * 'check_sig', the signature is not verified.
  */
-int
-bootutil_img_validate(struct image_header *hdr, uint8_t flash_id, uint32_t addr,
-  uint8_t *tmp_buf, uint32_t tmp_buf_sz)
+static int
+bootutil_img_check(struct image_header *hdr, uint8_t flash_id, uint32_t addr,
+  uint8_t *hash, int check_sig)
 {
     uint32_t off;
     uint32_t size;
@@ -89,7 +89,6 @@ bootutil_img_validate(struct image_header *hdr, uint8_t flash_id, uint32_t addr,
 #endif
     struct image_tlv tlv;
     uint8_t buf[256];
-    uint8_t hash[32];
     int rc;
 
 #ifdef IMAGE_SIGNATURES_RSA
@@ -106,11 +105,6 @@ bootutil_img_validate(struct image_header *hdr, uint8_t flash_id, uint32_t addr,
         return -1;
     }
 
-    rc = bootutil_img_hash(hdr, flash_id, addr, tmp_buf, tmp_buf_sz, hash);
-    if (rc) {
-        return rc;
-    }
-
     /*
      * After image there's TLVs.
      */
@@ -123,7 +117,7 @@ bootutil_img_validate(struct image_header *hdr, uint8_t flash_id, uint32_t addr,
             return rc;
         }
         if (tlv.it_type == IMAGE_TLV_SHA256) {
-            if (tlv.it_len != sizeof(hash)) {
+            if (tlv.it_len != 32) {
                 return -1;
             }
             sha_off = addr + off + sizeof(tlv);
@@ -154,15 +148,18 @@ bootutil_img_validate(struct image_header *hdr, uint8_t flash_id, uint32_t addr,
              */
             return -1;
         }
-        rc = hal_flash_read(flash_id, sha_off, buf, sizeof(hash));
+        rc = hal_flash_read(flash_id, sha_off, buf, 32);
         if (rc) {
             return rc;
         }
-        if (memcmp(hash, buf, sizeof(hash))) {
+        if (memcmp(hash, buf, 32)) {
             return -1;
         }
     }
 #if defined(IMAGE_SIGNATURES_RSA) || defined(IMAGE_SIGNATURES_EC)
+    if (!check_sig) {
+        return 0;
+    }
     if (!sig_off) {
         /*
          * Header said there should be PKCS1.v5 signature, no TLV
@@ -178,10 +175,164 @@ bootutil_img_validate(struct image_header *hdr, uint8_t flash_id, uint32_t addr,
     if (hdr->ih_key_id >= bootutil_key_cnt) {
         return -1;
     }
-    rc = bootutil_verify_sig(hash, sizeof(hash), buf, sig_len, hdr->ih_key_id);
+    rc = bootutil_verify_sig(hash, 32, buf, sig_len, hdr->ih_key_id);
     if (rc) {
         return -1;
     }
 #endif
     return 0;
 }
+
+/*
+ * Verify the integrity of the image.
+ * Return non-zero if image could not be validated/does not validate.
+ */
+int
+bootutil_img_validate(struct image_header *hdr, uint8_t flash_id, uint32_t addr,
+  uint8_t *tmp_buf, uint32_t tmp_buf_sz)
+{
+    uint8_t hash[32];
+    int rc;
+
+    rc = bootutil_img_hash(hdr, flash_id, addr, tmp_buf, tmp_buf_sz, hash);
+    if (rc) {
+        return rc;
+    }
+    return bootutil_img_check(hdr, flash_id, addr, hash, 1);
+}
+
+#if defined(IMAGE_SEAL_TRUST) && \
+  (defined(IMAGE_SIGNATURES_RSA) || defined(IMAGE_SIGNATURES_EC))
+/*
+ * HMAC-SHA256 of a validation record under the boot loader's seal key.
+ */
+static void
+bootutil_img_valid_mac(struct image_valid *rec, uint8_t *mac)
+{
+    mbedtls_sha256_context sha256_ctx;
+    const uint8_t *key;
+    uint8_t key_hash[32];
+    uint8_t pad[64];
+    uint32_t key_len;
+    int i;
+
+    key = bootutil_seal_key.key;
+    key_len = *bootutil_seal_key.len;
+    if (key_len > sizeof(pad)) {
+        mbedtls_sha256(key, key_len, key_hash, 0);
+        key = key_hash;
+        key_len = sizeof(key_hash);
+    }
+
+    memset(pad, 0x36, sizeof(pad));
+    for (i = 0; i < key_len; i++) {
+        pad[i] ^= key[i];
+    }
+    mbedtls_sha256_init(&sha256_ctx);
+    mbedtls_sha256_starts(&sha256_ctx, 0);
+    mbedtls_sha256_update(&sha256_ctx, pad, sizeof(pad));
+    mbedtls_sha256_update(&sha256_ctx, (uint8_t *)&rec->iv_hdr,
+      sizeof(rec->iv_hdr));
+    mbedtls_sha256_update(&sha256_ctx, rec->iv_hash, sizeof(rec->iv_hash));
+    mbedtls_sha256_finish(&sha256_ctx, mac);
+
+    for (i = 0; i < sizeof(pad); i++) {
+        pad[i] ^= 0x36 ^ 0x5c;
+    }
+    mbedtls_sha256_starts(&sha256_ctx, 0);
+    mbedtls_sha256_update(&sha256_ctx, pad, sizeof(pad));
+    mbedtls_sha256_update(&sha256_ctx, mac, 32);
+    mbedtls_sha256_finish(&sha256_ctx, mac);
+}
+
+/*
+ * Compare MACs in constant time.
+ */
+static int
+bootutil_img_mac_cmp(const uint8_t *a, const uint8_t *b)
+{
+    uint8_t diff;
+    int i;
+
+    diff = 0;
+    for (i = 0; i < 32; i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff;
+}
+#endif
+
+/*
+ * Verify the integrity of the image in the primary slot.  The image is
+ * always hashed; a validation record from an earlier call, for this
+ * header and this hash, saves verifying the signature again.  On success,
+ * the record is written if there's room for it before 'max_sz' and that
+ * flash is still erased.  With 'force', the signature is always verified.
+ * Records are only used with IMAGE_SEAL_TRUST and image signatures.
+ * Return non-zero if image could not be validated/does not validate.
+ */
+int
+bootutil_img_validate_cached(struct image_header *hdr, uint8_t flash_id,
+  uint32_t addr, uint32_t max_sz, int force, uint8_t *tmp_buf,
+  uint32_t tmp_buf_sz)
+{
+#if defined(IMAGE_SEAL_TRUST) && \
+  (defined(IMAGE_SIGNATURES_RSA) || defined(IMAGE_SIGNATURES_EC))
+    struct image_valid rec;
+    uint8_t hash[32];
+    uint8_t mac[32];
+    uint32_t off;
+    int trusted;
+    int rc;
+    int i;
+
+    off = IMAGE_VALID_OFF(hdr);
+    if (off + sizeof(rec) > max_sz) {
+        return bootutil_img_validate(hdr, flash_id, addr, tmp_buf,
+          tmp_buf_sz);
+    }
+    rc = bootutil_img_hash(hdr, flash_id, addr, tmp_buf, tmp_buf_sz, hash);
+    if (rc) {
+        return rc;
+    }
+    rc = hal_flash_read(flash_id, addr + off, &rec, sizeof(rec));
+    if (rc) {
+        return rc;
+    }
+    trusted = 0;
+    if (!force && rec.iv_magic == IMAGE_VALID_MAGIC &&
+      !memcmp(&rec.iv_hdr, hdr, sizeof(*hdr)) &&
+      !memcmp(rec.iv_hash, hash, sizeof(hash))) {
+        bootutil_img_valid_mac(&rec, mac);
+        trusted = !bootutil_img_mac_cmp(mac, rec.iv_mac);
+    }
+
+    rc = bootutil_img_check(hdr, flash_id, addr, hash, !trusted);
+    if (rc || trusted) {
+        return rc;
+    }
+
+    for (i = 0; i < sizeof(rec); i++) {
+        if (((uint8_t *)&rec)[i] != 0xff) {
+            return 0;
+        }
+    }
+    memcpy(&rec.iv_hdr, hdr, sizeof(*hdr));
+    memcpy(rec.iv_hash, hash, sizeof(hash));
+    bootutil_img_valid_mac(&rec, rec.iv_mac);
+    rec.iv_magic = IMAGE_VALID_MAGIC;
+    if (hal_flash_write(flash_id, addr + off + sizeof(rec.iv_magic),
+        &rec.iv_hdr, sizeof(rec) - sizeof(rec.iv_magic))) {
+        return 0;
+    }
+    hal_flash_write(flash_id, addr + off, &rec.iv_magic,
+      sizeof(rec.iv_magic));
+    return 0;
+#else
+    /*
+     * Without a key, anything that can write the slot could write a
+     * record, too; without a signature, there is nothing to skip.
+     */
+    return bootutil_img_validate(hdr, flash_id, addr, tmp_buf, tmp_buf_sz);
+#endif
+}
@@ -32,6 +32,11 @@
 /** Number of image slots in flash; currently limited to two. */
 #define BOOT_NUM_SLOTS              2
 
+/** Size of the buffer used when moving data between areas. */
+#ifndef BOOT_COPY_BUF_SZ
+#define BOOT_COPY_BUF_SZ            4096
+#endif
+
 /** The request object provided by the client. */
 static const struct boot_req *boot_req;
 
@@ -44,7 +49,14 @@ static struct boot_img {
 
 static struct boot_status boot_state;
 
+static uint8_t boot_copy_buf[BOOT_COPY_BUF_SZ];
+
+#ifdef MYNEWT_UNIT_TEST
+int boot_power_fail_cnt = -1;
+#endif
+
 static int boot_erase_area(int area_idx, uint32_t sz);
+static int boot_status_sz(void);
 static uint32_t boot_copy_sz(int max_idx, int *cnt);
 
 void
@@ -168,12 +180,16 @@ boot_image_info(void)
 }
 
 /*
- * Validate image hash/signature in a slot.
+ * Validate image hash/signature in a slot.  With 'cache', for the primary
+ * slot only, a validation record is kept with the image, so that its
+ * signature is verified only once.
  */
 static int
-boot_image_check(struct image_header *hdr, struct boot_image_location *loc)
+boot_image_check(struct image_header *hdr, struct boot_image_location *loc,
+  int cache)
 {
     static void *tmpbuf;
+    int rc;
 
     if (!tmpbuf) {
         tmpbuf = malloc(BOOT_TMPBUF_SZ);
@@ -181,8 +197,15 @@ boot_image_check(struct image_header *hdr, struct boot_image_location *loc)
             return BOOT_ENOMEM;
         }
     }
-    if (bootutil_img_validate(hdr, loc->bil_flash_id, loc->bil_address,
-        tmpbuf, BOOT_TMPBUF_SZ)) {
+    if (cache) {
+        rc = bootutil_img_validate_cached(hdr, loc->bil_flash_id,
+          loc->bil_address, boot_req->br_img_sz - boot_status_sz(),
+          boot_req->br_validate_full, tmpbuf, BOOT_TMPBUF_SZ);
+    } else {
+        rc = bootutil_img_validate(hdr, loc->bil_flash_id, loc->bil_address,
+          tmpbuf, BOOT_TMPBUF_SZ);
+    }
+    if (rc) {
         return BOOT_EBADIMAGE;
     }
     return 0;
@@ -219,7 +242,7 @@ boot_select_image_slot(void)
         b = &boot_img[i];
         boot_slot_magic(i, &bit);
         if (bit.bit_copy_start == BOOT_IMG_MAGIC) {
-            rc = boot_image_check(&b->hdr, &b->loc);
+            rc = boot_image_check(&b->hdr, &b->loc, 0);
             if (rc) {
                 /*
                  * Image fails integrity check. Erase it.
@@ -269,9 +292,68 @@ boot_copy_sz(int max_idx, int *cnt)
     return sz;
 }
 
+/*
+ * Called before each flash erase or write done while swapping.  Unit tests
+ * use this to cut power at a given point.
+ */
+static int
+boot_flash_op_ok(void)
+{
+#ifdef MYNEWT_UNIT_TEST
+    if (boot_power_fail_cnt == 0) {
+        return 0;
+    }
+    if (boot_power_fail_cnt > 0) {
+        boot_power_fail_cnt--;
+    }
+#endif
+    return 1;
+}
+
+static int
+boot_buf_is_erased(const uint8_t *buf, uint32_t len)
+{
+    uint32_t i;
+
+    for (i = 0; i < len; i++) {
+        if (buf[i] != 0xff) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Check whether the first sz bytes of an area are in erased state.
+ * Reading is much cheaper than erasing or writing, so this is used to
+ * skip work on parts of the slots which images don't occupy.
+ */
+static int
+boot_area_is_erased(int area_idx, uint32_t sz)
+{
+    const struct flash_area *area_desc;
+    uint32_t chunk_sz;
+    uint32_t off;
+
+    area_desc = boot_req->br_area_descs + area_idx;
+    for (off = 0; off < sz; off += chunk_sz) {
+        chunk_sz = sz - off;
+        if (chunk_sz > sizeof(boot_copy_buf)) {
+            chunk_sz = sizeof(boot_copy_buf);
+        }
+        if (hal_flash_read(area_desc->fa_flash_id, area_desc->fa_off + off,
+            boot_copy_buf, chunk_sz)) {
+            return 0;
+        }
+        if (!boot_buf_is_erased(boot_copy_buf, chunk_sz)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
 /**
- * Erase one area.  The destination area must
- * be erased prior to this function being called.
+ * Erase one area.  Does nothing if the area is already erased.
  *
  * @param area_idx            The index of the area.
  * @param sz                  The number of bytes to erase.
@@ -284,6 +366,13 @@ boot_erase_area(int area_idx, uint32_t sz)
     const struct flash_area *area_desc;
     int rc;
 
+    if (boot_area_is_erased(area_idx, sz)) {
+        return 0;
+    }
+    if (!boot_flash_op_ok()) {
+        return BOOT_EFLASH;
+    }
+
     area_desc = boot_req->br_area_descs + area_idx;
     rc = hal_flash_erase(area_desc->fa_flash_id, area_desc->fa_off, sz);
     if (rc != 0) {
@@ -294,7 +383,8 @@ boot_erase_area(int area_idx, uint32_t sz)
 
 /**
  * Copies the contents of one area to another.  The destination area must
- * be erased prior to this function being called.
+ * be erased prior to this function being called.  Chunks which are in
+ * erased state in the source are not written.
  *
  * @param from_area_idx       The index of the source area.
  * @param to_area_idx         The index of the destination area.
@@ -310,11 +400,11 @@ boot_copy_area(int from_area_idx, int to_area_idx, uint32_t sz)
     uint32_t from_addr;
     uint32_t to_addr;
     uint32_t off;
+    uint8_t *buf;
     int chunk_sz;
     int rc;
 
-    static uint8_t buf[1024];
-
+    buf = boot_copy_buf;
     from_area_desc = boot_req->br_area_descs + from_area_idx;
     to_area_desc = boot_req->br_area_descs + to_area_idx;
 
@@ -322,8 +412,8 @@ boot_copy_area(int from_area_idx, int to_area_idx, uint32_t sz)
 
     off = 0;
     while (off < sz) {
-        if (sz - off > sizeof buf) {
-            chunk_sz = sizeof buf;
+        if (sz - off > sizeof(boot_copy_buf)) {
+            chunk_sz = sizeof(boot_copy_buf);
         } else {
             chunk_sz = sz - off;
         }
@@ -334,6 +424,13 @@ boot_copy_area(int from_area_idx, int to_area_idx, uint32_t sz)
         if (rc != 0) {
             return rc;
         }
+        if (boot_buf_is_erased(buf, chunk_sz)) {
+            off += chunk_sz;
+            continue;
+        }
+        if (!boot_flash_op_ok()) {
+            return BOOT_EFLASH;
+        }
 
         to_addr = to_area_desc->fa_off + off;
         rc = hal_flash_write(to_area_desc->fa_flash_id, to_addr, buf,
@@ -363,9 +460,11 @@ boot_copy_area(int from_area_idx, int to_area_idx, uint32_t sz)
 static int
 boot_swap_areas(int idx, uint32_t sz, int end_area)
 {
+    struct boot_status bs;
     int area_idx_1;
     int area_idx_2;
     int rc;
+    int i;
 
     area_idx_1 = boot_req->br_slot_areas[0] + idx;
     area_idx_2 = boot_req->br_slot_areas[1] + idx;
@@ -373,6 +472,32 @@ boot_swap_areas(int idx, uint32_t sz, int end_area)
     assert(area_idx_1 != boot_req->br_scratch_area_idx);
     assert(area_idx_2 != boot_req->br_scratch_area_idx);
 
+    if (boot_state.state == 0 && !end_area &&
+      boot_area_is_erased(area_idx_1, sz) &&
+      boot_area_is_erased(area_idx_2, sz)) {
+        /*
+         * Both are empty; nothing to swap.  Status for the steps is written
+         * last to first, so that if interrupted, we start over with this
+         * area instead of copying stale data from scratch.
+         */
+        bs = boot_state;
+        bs.idx++;
+        for (i = 0; i < 3; i++) {
+            if (!boot_flash_op_ok()) {
+                return BOOT_EFLASH;
+            }
+            (void)boot_write_status(&bs);
+            if (bs.state == 0) {
+                bs.idx--;
+                bs.state = 2;
+            } else {
+                bs.state--;
+            }
+        }
+        boot_state.idx++;
+        return 0;
+    }
+
     if (boot_state.state == 0) {
         rc = boot_erase_area(boot_req->br_scratch_area_idx, sz);
         if (rc != 0) {
@@ -434,12 +559,16 @@ boot_copy_image(void)
     int end_area = 1;
     int cnt;
     int cur_idx;
+    int rc;
 
     for (i = boot_req->br_slot_areas[1], cur_idx = 0; i > 0; cur_idx++) {
         sz = boot_copy_sz(i, &cnt);
         i -= cnt;
         if (cur_idx >= boot_state.idx) {
-            boot_swap_areas(i, sz, end_area);
+            rc = boot_swap_areas(i, sz, end_area);
+            if (rc) {
+                return rc;
+            }
         }
         end_area = 0;
     }
@@ -476,6 +605,8 @@ boot_go(const struct boot_req *req, struct boot_rsp *rsp)
      * interrupted (i.e., the system was reset before the boot loader could
      * finish its task last time).
      */
+    boot_state.idx = 0;
+    boot_state.state = 0;
     if (boot_read_status(&boot_state)) {
         /* We are resuming an interrupted image copy. */
         rc = boot_copy_image();
@@ -485,26 +616,43 @@ boot_go(const struct boot_req *req, struct boot_rsp *rsp)
              */
             return rc;
         }
-    }
 
-    /*
-     * Check if we should initiate copy, or revert back to earlier image.
-     *
-     */
-    slot = boot_select_image_slot();
-    if (slot == -1) {
-        return BOOT_EBADIMAGE;
-    }
+        /* The swap was started on an earlier boot, which means the image
+         * now in the primary slot is the one chosen then; boot it.  The
+         * headers were read before the swap completed, so read them again.
+         */
+        boot_image_info();
+        slot = 0;
+    } else {
+        /*
+         * Check if we should initiate copy, or revert back to earlier image.
+         *
+         */
+        slot = boot_select_image_slot();
+        if (slot == -1) {
+            return BOOT_EBADIMAGE;
+        }
 
-    if (slot) {
-        boot_state.idx = 0;
-        boot_state.state = 0;
-        rc = boot_copy_image();
-        if (rc) {
-            return rc;
+        if (slot) {
+            boot_state.idx = 0;
+            boot_state.state = 0;
+            rc = boot_copy_image();
+            if (rc) {
+                return rc;
+            }
         }
     }
 
+#ifdef BOOTUTIL_VALIDATE_SLOT0
+    /* Don't run an image which does not validate.  It's hashed every time;
+     * its signature only until it has been verified for this hash.
+     */
+    rc = boot_image_check(&boot_img[slot].hdr, &boot_img[0].loc, 1);
+    if (rc) {
+        return rc;
+    }
+#endif
+
     /* Always boot from the primary slot. */
     rsp->br_flash_id = boot_img[0].loc.bil_flash_id;
     rsp->br_image_addr = boot_img[0].loc.bil_address;
@@ -32,6 +32,7 @@
 #include "bootutil/image.h"
 #include "bootutil/loader.h"
 #include "bootutil/bootutil_misc.h"
+#include "bootutil/sign_key.h"
 #include "../src/bootutil_priv.h"
 
 #include "mbedtls/sha256.h"
@@ -396,6 +397,100 @@ boot_test_util_verify_flash(const struct image_header *hdr0, int orig_slot_0,
     }
 }
 
+static void
+boot_test_util_verify_erased(int area_idx)
+{
+    const struct flash_area *area_desc;
+    uint8_t buf[256];
+    uint32_t off;
+    int i;
+    int rc;
+
+    area_desc = boot_test_area_descs + area_idx;
+    for (off = 0; off < area_desc->fa_size; off += sizeof(buf)) {
+        rc = flash_area_read(area_desc, off, buf, sizeof(buf));
+        TEST_ASSERT_FATAL(rc == 0);
+        for (i = 0; i < sizeof(buf); i++) {
+            TEST_ASSERT_FATAL(buf[i] == 0xff);
+        }
+    }
+}
+
+/*
+ * Swaps images of the given sizes, cutting power after every possible
+ * number of flash operations.  The next boot must complete the swap.
+ * Middle areas of the slots must stay empty, if images don't reach them.
+ */
+static void
+boot_test_util_power_fail(uint32_t img_sz0, uint32_t img_sz1)
+{
+    struct boot_rsp rsp;
+    int fail_cnt;
+    int rc;
+
+    struct image_header hdr0 = {
+        .ih_magic = IMAGE_MAGIC,
+        .ih_tlv_size = 4 + 32,
+        .ih_hdr_size = BOOT_TEST_HEADER_SIZE,
+        .ih_img_size = img_sz0,
+        .ih_flags = IMAGE_F_SHA256,
+        .ih_ver = { 0, 5, 21, 432 },
+    };
+
+    struct image_header hdr1 = {
+        .ih_magic = IMAGE_MAGIC,
+        .ih_tlv_size = 4 + 32,
+        .ih_hdr_size = BOOT_TEST_HEADER_SIZE,
+        .ih_img_size = img_sz1,
+        .ih_flags = IMAGE_F_SHA256,
+        .ih_ver = { 1, 2, 3, 432 },
+    };
+
+    struct boot_req req = {
+        .br_area_descs = boot_test_area_descs,
+        .br_slot_areas = boot_test_slot_areas,
+        .br_num_image_areas = BOOT_TEST_AREA_IDX_SCRATCH + 1,
+        .br_scratch_area_idx = BOOT_TEST_AREA_IDX_SCRATCH,
+        .br_img_sz = (384 * 1024),
+    };
+
+    for (fail_cnt = 0; ; fail_cnt++) {
+        boot_test_util_init_flash();
+        boot_test_util_write_image(&hdr0, 0);
+        boot_test_util_write_hash(&hdr0, 0);
+        boot_test_util_write_image(&hdr1, 1);
+        boot_test_util_write_hash(&hdr1, 1);
+
+        rc = boot_vect_write_test(FLASH_AREA_IMAGE_1);
+        TEST_ASSERT(rc == 0);
+
+        boot_power_fail_cnt = fail_cnt;
+        rc = boot_go(&req, &rsp);
+        boot_power_fail_cnt = -1;
+        if (rc == 0) {
+            /* Swap completed before power was cut. */
+            break;
+        }
+        TEST_ASSERT_FATAL(rc == BOOT_EFLASH);
+
+        rc = boot_go(&req, &rsp);
+        TEST_ASSERT_FATAL(rc == 0);
+
+        TEST_ASSERT(memcmp(rsp.br_hdr, &hdr1, sizeof hdr1) == 0);
+        boot_test_util_verify_flash(&hdr1, 1, &hdr0, 0);
+        boot_test_util_verify_status_clear();
+        if (img_sz0 < 64 * 1024 && img_sz1 < 64 * 1024) {
+            boot_test_util_verify_erased(1);
+            boot_test_util_verify_erased(4);
+        }
+    }
+    TEST_ASSERT(fail_cnt > 0);
+
+    TEST_ASSERT(memcmp(rsp.br_hdr, &hdr1, sizeof hdr1) == 0);
+    boot_test_util_verify_flash(&hdr1, 1, &hdr0, 0);
+    boot_test_util_verify_status_clear();
+}
+
 TEST_CASE(boot_test_setup)
 {
     int rc;
@@ -1157,6 +1252,149 @@ TEST_CASE(boot_test_invalid_hash)
     boot_test_util_verify_status_clear();
 }
 
+TEST_CASE(boot_test_power_fail)
+{
+    /* Middle areas empty in both slots. */
+    boot_test_util_power_fail(5 * 1024, 32 * 1024);
+
+    /* Images spanning two areas. */
+    boot_test_util_power_fail(150 * 1024, 190 * 1024);
+}
+
+/* Whether bootutil_img_validate_cached() keeps a validation record. */
+#if defined(IMAGE_SEAL_TRUST) && \
+  (defined(IMAGE_SIGNATURES_RSA) || defined(IMAGE_SIGNATURES_EC))
+#define BOOT_TEST_VALID_REC     1
+#else
+#define BOOT_TEST_VALID_REC     0
+#endif
+
+#ifdef IMAGE_SEAL_TRUST
+static const uint8_t boot_test_seal_key_data[] = {
+    0x5c, 0x1e, 0x0b, 0x94, 0x37, 0xe2, 0x70, 0x0d,
+    0xa8, 0x61, 0xf3, 0x2c, 0x9b, 0x46, 0xd5, 0x18,
+};
+static const unsigned int boot_test_seal_key_len =
+    sizeof(boot_test_seal_key_data);
+
+const struct bootutil_key bootutil_seal_key = {
+    .key = boot_test_seal_key_data,
+    .len = &boot_test_seal_key_len,
+};
+#endif
+
+TEST_CASE(boot_test_validate_cache)
+{
+    struct image_valid rec;
+    uint8_t buf[256];
+    uint8_t flash_id;
+    uint32_t addr;
+    uint32_t max_sz;
+    uint8_t zero;
+    int rc;
+#if !BOOT_TEST_VALID_REC
+    int i;
+#endif
+
+    struct image_header hdr0 = {
+        .ih_magic = IMAGE_MAGIC,
+        .ih_tlv_size = 4 + 32,
+        .ih_hdr_size = BOOT_TEST_HEADER_SIZE,
+        .ih_img_size = 12 * 1024,
+        .ih_flags = IMAGE_F_SHA256,
+        .ih_ver = { 0, 2, 3, 4 },
+    };
+    struct image_header hdr_other = hdr0;
+
+    hdr_other.ih_ver.iv_build_num++;
+    flash_id = boot_test_img_addrs[0].flash_id;
+    addr = boot_test_img_addrs[0].address;
+    max_sz = 384 * 1024;
+    zero = 0;
+
+    /* A record not written by the boot loader is not trusted. */
+    boot_test_util_init_flash();
+    boot_test_util_write_image(&hdr0, 0);
+    boot_test_util_write_hash(&hdr0, 0);
+    rc = hal_flash_write(flash_id, addr + sizeof(hdr0), &zero, 1);
+    TEST_ASSERT_FATAL(rc == 0);
+
+    memset(&rec, 0, sizeof(rec));
+    rec.iv_magic = IMAGE_VALID_MAGIC;
+    rec.iv_hdr = hdr0;
+    rc = hal_flash_read(flash_id, addr + IMAGE_SIZE(&hdr0) - 32, rec.iv_hash,
+      sizeof(rec.iv_hash));
+    TEST_ASSERT_FATAL(rc == 0);
+    rc = hal_flash_write(flash_id, addr + IMAGE_VALID_OFF(&hdr0), &rec,
+      sizeof(rec));
+    TEST_ASSERT_FATAL(rc == 0);
+
+    rc = bootutil_img_validate_cached(&hdr0, flash_id, addr, max_sz, 0,
+      buf, sizeof(buf));
+    TEST_ASSERT(rc != 0);
+
+    boot_test_util_init_flash();
+    boot_test_util_write_image(&hdr0, 0);
+    boot_test_util_write_hash(&hdr0, 0);
+
+    /* Validated in full; the record is written only with a key, and when
+     * there's a signature to skip next time.
+     */
+    rc = bootutil_img_validate_cached(&hdr0, flash_id, addr, max_sz, 0,
+      buf, sizeof(buf));
+    TEST_ASSERT_FATAL(rc == 0);
+    rc = hal_flash_read(flash_id, addr + IMAGE_VALID_OFF(&hdr0), &rec,
+      sizeof(rec));
+    TEST_ASSERT_FATAL(rc == 0);
+#if BOOT_TEST_VALID_REC
+    TEST_ASSERT(rec.iv_magic == IMAGE_VALID_MAGIC);
+    TEST_ASSERT(memcmp(&rec.iv_hdr, &hdr0, sizeof(hdr0)) == 0);
+#else
+    for (i = 0; i < sizeof(rec); i++) {
+        TEST_ASSERT(((uint8_t *)&rec)[i] == 0xff);
+    }
+#endif
+
+    /* Change a byte covered by the hash, behind the loader's back. */
+    rc = hal_flash_write(flash_id, addr + sizeof(hdr0), &zero, 1);
+    TEST_ASSERT_FATAL(rc == 0);
+
+    /* The image is hashed again; the change is caught with or without the
+     * record.
+     */
+    rc = bootutil_img_validate_cached(&hdr0, flash_id, addr, max_sz, 0,
+      buf, sizeof(buf));
+    TEST_ASSERT(rc != 0);
+    rc = bootutil_img_validate_cached(&hdr0, flash_id, addr, max_sz, 1,
+      buf, sizeof(buf));
+    TEST_ASSERT(rc != 0);
+
+    /* The record is for another header. */
+    rc = bootutil_img_validate_cached(&hdr_other, flash_id, addr, max_sz, 0,
+      buf, sizeof(buf));
+    TEST_ASSERT(rc != 0);
+
+#ifdef BOOTUTIL_VALIDATE_SLOT0
+    {
+        struct boot_rsp rsp;
+        struct boot_req req = {
+            .br_area_descs = boot_test_area_descs,
+            .br_slot_areas = boot_test_slot_areas,
+            .br_num_image_areas = BOOT_TEST_AREA_IDX_SCRATCH + 1,
+            .br_scratch_area_idx = BOOT_TEST_AREA_IDX_SCRATCH,
+            .br_img_sz = (384 * 1024),
+        };
+
+        rc = boot_go(&req, &rsp);
+        TEST_ASSERT(rc == BOOT_EBADIMAGE);
+
+        req.br_validate_full = 1;
+        rc = boot_go(&req, &rsp);
+        TEST_ASSERT(rc == BOOT_EBADIMAGE);
+    }
+#endif
+}
+
 TEST_SUITE(boot_test_main)
 {
     boot_test_setup();
@@ -1175,6 +1413,8 @@ TEST_SUITE(boot_test_main)
     boot_test_no_hash();
     boot_test_no_flag_has_hash();
     boot_test_invalid_hash();
+    boot_test_power_fail();
+    boot_test_validate_cache();
 }
 
 int
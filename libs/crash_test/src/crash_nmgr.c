@@ -57,7 +57,7 @@ crash_test_nmgr_write(struct nmgr_jbuf *njb)
     };
     int rc;
 
-    rc = json_read_object(&njb->njb_buf, attr);
+    rc = nmgr_read_object(njb, attr);
     if (rc) {
         rc = NMGR_ERR_EINVAL;
     } else {
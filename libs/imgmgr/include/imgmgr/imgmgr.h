@@ -28,6 +28,8 @@
 #define IMGMGR_NMGR_OP_BOOT2		5
 #define IMGMGR_NMGR_OP_CORELIST		6
 #define IMGMGR_NMGR_OP_CORELOAD		7
+#define IMGMGR_NMGR_OP_UPLOAD_BIN	8
+#define IMGMGR_NMGR_OP_FILE_BIN		9
 
 #define IMGMGR_NMGR_MAX_MSG		400
 #define IMGMGR_NMGR_MAX_NAME		64
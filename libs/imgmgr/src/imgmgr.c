@@ -37,21 +37,26 @@ static int imgr_list(struct nmgr_jbuf *);
 static int imgr_list2(struct nmgr_jbuf *);
 static int imgr_noop(struct nmgr_jbuf *);
 static int imgr_upload(struct nmgr_jbuf *);
+static int imgr_upload_bin(struct nmgr_jbuf *);
 
 static const struct nmgr_handler imgr_nmgr_handlers[] = {
     [IMGMGR_NMGR_OP_LIST] = {
         .nh_read = imgr_list,
-        .nh_write = imgr_noop
+        .nh_write = imgr_noop,
+        .nh_flags = NMGR_HANDLER_F_EXCL
     },
     [IMGMGR_NMGR_OP_UPLOAD] = {
         .nh_read = imgr_noop,
-        .nh_write = imgr_upload
+        .nh_write = imgr_upload,
+        .nh_flags = NMGR_HANDLER_F_SLOW
     },
     [IMGMGR_NMGR_OP_BOOT] = {
         .nh_read = imgr_boot_read,
-        .nh_write = imgr_boot_write
+        .nh_write = imgr_boot_write,
+        .nh_flags = NMGR_HANDLER_F_EXCL
     },
     [IMGMGR_NMGR_OP_FILE] = {
+        .nh_flags = NMGR_HANDLER_F_SLOW,
 #ifdef FS_PRESENT
         .nh_read = imgr_file_download,
         .nh_write = imgr_file_upload
@@ -62,13 +67,16 @@ static const struct nmgr_handler imgr_nmgr_handlers[] = {
     },
     [IMGMGR_NMGR_OP_LIST2] = {
         .nh_read = imgr_list2,
-        .nh_write = imgr_noop
+        .nh_write = imgr_noop,
+        .nh_flags = NMGR_HANDLER_F_EXCL
     },
     [IMGMGR_NMGR_OP_BOOT2] = {
         .nh_read = imgr_boot2_read,
-        .nh_write = imgr_boot2_write
+        .nh_write = imgr_boot2_write,
+        .nh_flags = NMGR_HANDLER_F_EXCL
     },
     [IMGMGR_NMGR_OP_CORELIST] = {
+        .nh_flags = NMGR_HANDLER_F_EXCL,
 #ifdef COREDUMP_PRESENT
         .nh_read = imgr_core_list,
         .nh_write = imgr_noop,
@@ -78,6 +86,7 @@ static const struct nmgr_handler imgr_nmgr_handlers[] = {
 #endif
     },
     [IMGMGR_NMGR_OP_CORELOAD] = {
+        .nh_flags = NMGR_HANDLER_F_SLOW,
 #ifdef COREDUMP_PRESENT
         .nh_read = imgr_core_load,
         .nh_write = imgr_core_erase,
@@ -85,6 +94,20 @@ static const struct nmgr_handler imgr_nmgr_handlers[] = {
         .nh_read = imgr_noop,
         .nh_write = imgr_noop
 #endif
+    },
+    [IMGMGR_NMGR_OP_UPLOAD_BIN] = {
+        .nh_read = imgr_noop,
+        .nh_write = imgr_upload_bin,
+        .nh_flags = NMGR_HANDLER_F_SLOW
+    },
+    [IMGMGR_NMGR_OP_FILE_BIN] = {
+        .nh_flags = NMGR_HANDLER_F_SLOW,
+#ifdef FS_PRESENT
+        .nh_read = imgr_file_download_bin,
+#else
+        .nh_read = imgr_noop,
+#endif
+        .nh_write = imgr_noop
     }
 };
 
@@ -307,12 +330,180 @@ imgr_noop(struct nmgr_jbuf *njb)
     return 0;
 }
 
+/*
+ * Starts a new upload: picks the slot to write the image described by
+ * 'hdr' into, and erases it.  'eh' is set if the upload is an encoded
+ * image; its payload is decoded into the slot as it arrives.
+ *
+ * Returns 0 on success, NMGR_ERR_[...] on failure.
+ */
+static int
+imgr_upload_start(struct image_header *hdr,
+  const struct image_enc_header *eh, uint32_t size)
+{
+    struct image_version ver;
+    int active;
+    int best;
+    int rc;
+    int i;
+
+    imgr_state.upload.off = 0;
+    imgr_state.upload.size = size;
+    imgr_state.upload.pend_cnt = 0;
+    imgr_state.upload.enc = 0;
+    active = bsp_imgr_current_slot();
+    best = -1;
+
+    for (i = FLASH_AREA_IMAGE_0; i <= FLASH_AREA_IMAGE_1; i++) {
+        rc = imgr_read_info(i, &ver, NULL);
+        if (rc < 0) {
+            continue;
+        }
+        if (rc == 0) {
+            if (!memcmp(&ver, &hdr->ih_ver, sizeof(ver))) {
+                if (active == i) {
+                    return NMGR_ERR_EINVAL;
+                } else {
+                    best = i;
+                    break;
+                }
+            }
+            /*
+             * Image in slot is ok.
+             */
+            if (active == i) {
+                /*
+                 * Slot is currently active one. Can't upload to this.
+                 */
+                continue;
+            } else {
+                /*
+                 * Not active slot, but image is ok. Use it if there are
+                 * no better candidates.
+                 */
+                best = i;
+            }
+            continue;
+        }
+        best = i;
+        break;
+    }
+    if (best < 0) {
+        /*
+         * No slot where to upload!
+         */
+        return NMGR_ERR_ENOMEM;
+    }
+
+    if (imgr_state.upload.fa) {
+        flash_area_close(imgr_state.upload.fa);
+        imgr_state.upload.fa = NULL;
+    }
+    rc = flash_area_open(best, &imgr_state.upload.fa);
+    if (rc) {
+        return NMGR_ERR_EINVAL;
+    }
+    if (IMAGE_SIZE(hdr) > imgr_state.upload.fa->fa_size) {
+        return NMGR_ERR_EINVAL;
+    }
+    /*
+     * XXXX only erase if needed.
+     */
+    flash_area_erase(imgr_state.upload.fa, 0, imgr_state.upload.fa->fa_size);
+
+    if (eh) {
+        if (size <= sizeof(*eh) || imgr_dec_start(eh)) {
+            flash_area_close(imgr_state.upload.fa);
+            imgr_state.upload.fa = NULL;
+            return NMGR_ERR_EINVAL;
+        }
+        imgr_state.upload.enc = 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Reads the image header from the first chunk of an upload, which starts
+ * with either a plain or an encoded image.  Fills 'eh' for the latter.
+ *
+ * Returns the image header, or NULL if there is none.
+ */
+static struct image_header *
+imgr_upload_hdr(uint8_t *data, int len, struct image_enc_header **eh)
+{
+    struct image_header *hdr;
+
+    *eh = NULL;
+    if (len < (int)sizeof(struct image_header)) {
+        /*
+         * Image header is the first thing in the image.
+         */
+        return NULL;
+    }
+    hdr = (struct image_header *)data;
+    if (hdr->ih_magic == IMAGE_ENC_MAGIC) {
+        if (len < (int)sizeof(**eh)) {
+            return NULL;
+        }
+        *eh = (struct image_enc_header *)data;
+        hdr = &(*eh)->ieh_hdr;
+    }
+    if (hdr->ih_magic != IMAGE_MAGIC) {
+        return NULL;
+    }
+    return hdr;
+}
+
+/*
+ * Stores upload data at offset 'off' of the upload.  Encoded uploads go
+ * through the decoder instead, which must be fed in order; their header
+ * was consumed when the upload was started.
+ */
+static int
+imgr_upload_write(uint32_t off, const uint8_t *data, uint32_t len)
+{
+    uint32_t skip;
+
+    if (!imgr_state.upload.enc) {
+        return flash_area_write(imgr_state.upload.fa, off, data, len);
+    }
+    skip = sizeof(struct image_enc_header);
+    if (off < skip) {
+        if (off + len <= skip) {
+            return 0;
+        }
+        data += skip - off;
+        len -= skip - off;
+    }
+    return imgr_dec_feed(data, len);
+}
+
+/*
+ * Called when the acked offset reaches the end of the upload.  Returns
+ * non-zero if an encoded upload did not decode to a complete image.
+ */
+static int
+imgr_upload_done(void)
+{
+    int rc;
+
+    rc = 0;
+    if (imgr_state.upload.enc) {
+        rc = imgr_dec_finish();
+    }
+    flash_area_close(imgr_state.upload.fa);
+    imgr_state.upload.fa = NULL;
+    return rc;
+}
+
 static int
 imgr_upload(struct nmgr_jbuf *njb)
 {
-    char img_data[BASE64_ENCODE_SIZE(IMGMGR_NMGR_MAX_MSG)];
+    char img_data[IMGMGR_NMGR_MAX_MSG];
     long long unsigned int off = UINT_MAX;
     long long unsigned int size = UINT_MAX;
+    int len;
     const struct json_attr_t off_attr[4] = {
         [0] = {
             .attribute = "off",
@@ -322,8 +513,9 @@ imgr_upload(struct nmgr_jbuf *njb)
         },
         [1] = {
             .attribute = "data",
-            .type = t_string,
-            .addr.string = img_data,
+            .type = t_bytes,
+            .addr.bytes.buf = (uint8_t *)img_data,
+            .addr.bytes.len = &len,
             .len = sizeof(img_data)
         },
         [2] = {
@@ -333,111 +525,27 @@ imgr_upload(struct nmgr_jbuf *njb)
             .nodefault = true
         }
     };
-    struct image_version ver;
+    struct image_enc_header *eh;
     struct image_header *hdr;
     struct json_encoder *enc;
     struct json_value jv;
-    int active;
-    int best;
     int rc;
-    int len;
-    int i;
 
-    rc = json_read_object(&njb->njb_buf, off_attr);
+    rc = nmgr_read_object(njb, off_attr);
     if (rc || off == UINT_MAX) {
         rc = NMGR_ERR_EINVAL;
         goto err;
     }
-    len = strlen(img_data);
-    if (len) {
-        len = base64_decode(img_data, img_data);
-        if (len < 0) {
-            rc = NMGR_ERR_EINVAL;
-            goto err;
-        }
-    }
 
     if (off == 0) {
-        if (len < sizeof(struct image_header)) {
-            /*
-             * Image header is the first thing in the image.
-             */
-            rc = NMGR_ERR_EINVAL;
-            goto err;
-        }
-        hdr = (struct image_header *)img_data;
-        if (hdr->ih_magic != IMAGE_MAGIC) {
+        hdr = imgr_upload_hdr((uint8_t *)img_data, len, &eh);
+        if (!hdr) {
             rc = NMGR_ERR_EINVAL;
             goto err;
         }
 
-        /*
-         * New upload.
-         */
-        imgr_state.upload.off = 0;
-        imgr_state.upload.size = size;
-        active = bsp_imgr_current_slot();
-        best = -1;
-
-        for (i = FLASH_AREA_IMAGE_0; i <= FLASH_AREA_IMAGE_1; i++) {
-            rc = imgr_read_info(i, &ver, NULL);
-            if (rc < 0) {
-                continue;
-            }
-            if (rc == 0) {
-                if (!memcmp(&ver, &hdr->ih_ver, sizeof(ver))) {
-                    if (active == i) {
-                        rc = NMGR_ERR_EINVAL;
-                        goto err;
-                    } else {
-                        best = i;
-                        break;
-                    }
-                }
-                /*
-                 * Image in slot is ok.
-                 */
-                if (active == i) {
-                    /*
-                     * Slot is currently active one. Can't upload to this.
-                     */
-                    continue;
-                } else {
-                    /*
-                     * Not active slot, but image is ok. Use it if there are
-                     * no better candidates.
-                     */
-                    best = i;
-                }
-                continue;
-            }
-            best = i;
-            break;
-        }
-        if (best >= 0) {
-            if (imgr_state.upload.fa) {
-                flash_area_close(imgr_state.upload.fa);
-                imgr_state.upload.fa = NULL;
-            }
-            rc = flash_area_open(best, &imgr_state.upload.fa);
-            if (rc) {
-                rc = NMGR_ERR_EINVAL;
-                goto err;
-            }
-	    if (IMAGE_SIZE(hdr) > imgr_state.upload.fa->fa_size) {
-                rc = NMGR_ERR_EINVAL;
-                goto err;
-            }
-            /*
-             * XXXX only erase if needed.
-             */
-            rc = flash_area_erase(imgr_state.upload.fa, 0,
-              imgr_state.upload.fa->fa_size);
-        } else {
-            /*
-             * No slot where to upload!
-             */
-            rc = NMGR_ERR_ENOMEM;
+        rc = imgr_upload_start(hdr, eh, size);
+        if (rc) {
             goto err;
         }
     } else if (off != imgr_state.upload.off) {
@@ -453,8 +561,8 @@ imgr_upload(struct nmgr_jbuf *njb)
         goto err;
     }
     if (len) {
-        rc = flash_area_write(imgr_state.upload.fa, imgr_state.upload.off,
-          img_data, len);
+        rc = imgr_upload_write(imgr_state.upload.off, (uint8_t *)img_data,
+          len);
         if (rc) {
             rc = NMGR_ERR_EINVAL;
             goto err_close;
@@ -462,8 +570,10 @@ imgr_upload(struct nmgr_jbuf *njb)
         imgr_state.upload.off += len;
         if (imgr_state.upload.size == imgr_state.upload.off) {
             /* Done */
-            flash_area_close(imgr_state.upload.fa);
-            imgr_state.upload.fa = NULL;
+            if (imgr_upload_done()) {
+                rc = NMGR_ERR_EINVAL;
+                goto err;
+            }
         }
     }
 out:
@@ -488,6 +598,236 @@ err:
     return 0;
 }
 
+uint32_t
+imgr_get_le32(const uint8_t *buf)
+{
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+void
+imgr_put_le32(uint8_t *buf, uint32_t val)
+{
+    buf[0] = val;
+    buf[1] = val >> 8;
+    buf[2] = val >> 16;
+    buf[3] = val >> 24;
+}
+
+/*
+ * Returns 1 if [off, off + len) overlaps a chunk that was received ahead
+ * of the acked offset.
+ */
+static int
+imgr_upload_pend_overlaps(uint32_t off, uint32_t len)
+{
+    int i;
+
+    for (i = 0; i < imgr_state.upload.pend_cnt; i++) {
+        if (off < imgr_state.upload.pend[i].off +
+                  imgr_state.upload.pend[i].len &&
+            imgr_state.upload.pend[i].off < off + len) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Moves the acked offset past chunks that were received ahead of it and
+ * are now contiguous.
+ */
+static void
+imgr_upload_pend_merge(void)
+{
+    int i;
+
+    i = 0;
+    while (i < imgr_state.upload.pend_cnt) {
+        if (imgr_state.upload.pend[i].off != imgr_state.upload.off) {
+            i++;
+            continue;
+        }
+        imgr_state.upload.off += imgr_state.upload.pend[i].len;
+        imgr_state.upload.pend[i] =
+            imgr_state.upload.pend[--imgr_state.upload.pend_cnt];
+        i = 0;
+    }
+}
+
+/*
+ * Returns 1 if the first chunk of an upload matches what's already in
+ * flash, i.e. it is a late duplicate for the upload in progress.
+ */
+static int
+imgr_upload_bin_is_dup(struct nmgr_jbuf *njb, uint32_t size)
+{
+    uint8_t buf[sizeof(struct image_enc_header)];
+    struct image_header cur;
+    struct image_enc_header *eh;
+    struct image_header *hdr;
+    uint16_t off;
+    int len;
+
+    if (!imgr_state.upload.fa || imgr_state.upload.off == 0 ||
+        imgr_state.upload.size != size) {
+        return 0;
+    }
+
+    len = njb->njb_end - njb->njb_off;
+    if (len > sizeof(buf)) {
+        len = sizeof(buf);
+    }
+    off = njb->njb_off;
+    njb->njb_buf.jb_readn(&njb->njb_buf, (char *)buf, len);
+    njb->njb_off = off;
+    hdr = imgr_upload_hdr(buf, len, &eh);
+    if (!hdr || (eh != NULL) != imgr_state.upload.enc) {
+        return 0;
+    }
+
+    if (imgr_state.upload.enc && imgr_state.upload.dec.out_off == 0) {
+        /* Decoded header hasn't made it to flash yet. */
+        memcpy(&cur, imgr_state.upload.dec.buf, sizeof(cur));
+    } else if (flash_area_read(imgr_state.upload.fa, 0, &cur, sizeof(cur))) {
+        return 0;
+    }
+    return !memcmp(hdr, &cur, sizeof(cur));
+}
+
+/*
+ * Binary, windowed upload.  Chunks carry raw image bytes, so they can be
+ * as large as the transport allows, and several may be in flight: a chunk
+ * within IMGMGR_UPLOAD_WIN_SIZE bytes past the acked offset is written
+ * to flash right away and remembered until the gap before it is filled.
+ * The response carries the cumulative ack; the client resends from there.
+ * Sending an empty chunk just returns the ack, which is how an upload is
+ * resumed after a disconnect.
+ *
+ * Request:  le32 off, le32 image size (used when off is 0), data.
+ * Response: u8 rc, le32 acked offset.
+ *
+ * The first chunk (off 0) starts a new upload and must be acked before
+ * any other chunk is sent.  Encoded images are decoded as they arrive, so
+ * only the chunk at the acked offset is taken for those.
+ */
+static int
+imgr_upload_bin(struct nmgr_jbuf *njb)
+{
+    uint8_t buf[IMGMGR_UPLOAD_BIN_BUF];
+    struct image_enc_header *eh;
+    struct image_header *hdr;
+    uint32_t size;
+    uint32_t off;
+    uint32_t end;
+    uint32_t lim;
+    int len;
+    int cnt;
+    int rc;
+
+    len = njb->njb_end - njb->njb_off - IMGMGR_UPLOAD_BIN_HDR;
+    if (len < 0) {
+        rc = NMGR_ERR_EINVAL;
+        goto out;
+    }
+    njb->njb_buf.jb_readn(&njb->njb_buf, (char *)buf, IMGMGR_UPLOAD_BIN_HDR);
+    off = imgr_get_le32(buf);
+    size = imgr_get_le32(buf + 4);
+    rc = 0;
+
+    if (len == 0) {
+        goto out;
+    }
+
+    /*
+     * The chunk must lie within the image; checked without computing
+     * off + len, which a crafted offset could wrap.
+     */
+    lim = (off == 0) ? size : imgr_state.upload.size;
+    if (off > lim || len > lim - off) {
+        rc = NMGR_ERR_EINVAL;
+        goto out;
+    }
+
+    if (off == 0 && !imgr_upload_bin_is_dup(njb, size)) {
+        cnt = njb->njb_off;
+        njb->njb_buf.jb_readn(&njb->njb_buf, (char *)buf,
+                              min(len, sizeof(struct image_enc_header)));
+        njb->njb_off = cnt;
+        hdr = imgr_upload_hdr(buf, len, &eh);
+        if (!hdr) {
+            rc = NMGR_ERR_EINVAL;
+            goto out;
+        }
+        rc = imgr_upload_start(hdr, eh, size);
+        if (rc) {
+            goto out;
+        }
+    }
+
+    /* Drop what was acked already; the upload may be complete. */
+    end = off + len;
+    if (size == imgr_state.upload.size && end <= imgr_state.upload.off) {
+        goto out;
+    }
+
+    if (!imgr_state.upload.fa || end > imgr_state.upload.size) {
+        rc = NMGR_ERR_EINVAL;
+        goto out;
+    }
+
+    /* Drop anything past the window, or duplicating a pending chunk. */
+    if (end > imgr_state.upload.off + IMGMGR_UPLOAD_WIN_SIZE) {
+        goto out;
+    }
+    if (off < imgr_state.upload.off) {
+        njb->njb_off += imgr_state.upload.off - off;
+        off = imgr_state.upload.off;
+    }
+    if (imgr_upload_pend_overlaps(off, end - off)) {
+        goto out;
+    }
+    if (off != imgr_state.upload.off &&
+        (imgr_state.upload.enc ||
+         imgr_state.upload.pend_cnt >= IMGMGR_UPLOAD_WIN_CNT)) {
+        goto out;
+    }
+
+    while (njb->njb_off < njb->njb_end) {
+        cnt = njb->njb_buf.jb_readn(&njb->njb_buf, (char *)buf, sizeof(buf));
+        rc = imgr_upload_write(end - (njb->njb_end - njb->njb_off) - cnt,
+                               buf, cnt);
+        if (rc) {
+            goto err_close;
+        }
+    }
+
+    if (off == imgr_state.upload.off) {
+        imgr_state.upload.off = end;
+        imgr_upload_pend_merge();
+    } else {
+        imgr_state.upload.pend[imgr_state.upload.pend_cnt].off = off;
+        imgr_state.upload.pend[imgr_state.upload.pend_cnt].len = end - off;
+        imgr_state.upload.pend_cnt++;
+    }
+
+    if (imgr_state.upload.off == imgr_state.upload.size) {
+        /* Done */
+        if (imgr_upload_done()) {
+            rc = NMGR_ERR_EINVAL;
+        }
+    }
+    goto out;
+
+err_close:
+    flash_area_close(imgr_state.upload.fa);
+    imgr_state.upload.fa = NULL;
+    rc = NMGR_ERR_EINVAL;
+out:
+    buf[0] = rc;
+    imgr_put_le32(buf + 1, imgr_state.upload.off);
+    return nmgr_rsp_extend(njb->njb_hdr, njb->njb_out_m, buf, 5);
+}
+
 int
 imgmgr_module_init(void)
 {
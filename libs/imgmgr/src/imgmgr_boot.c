@@ -122,7 +122,7 @@ imgr_boot_write(struct nmgr_jbuf *njb)
     int rc;
     struct image_version ver;
 
-    rc = json_read_object(&njb->njb_buf, boot_write_attr);
+    rc = nmgr_read_object(njb, boot_write_attr);
     if (rc) {
         rc = NMGR_ERR_EINVAL;
         goto err;
@@ -224,7 +224,7 @@ imgr_boot2_write(struct nmgr_jbuf *njb)
     int rc;
     struct image_version ver;
 
-    rc = json_read_object(&njb->njb_buf, boot_write_attr);
+    rc = nmgr_read_object(njb, boot_write_attr);
     if (rc) {
         rc = NMGR_ERR_EINVAL;
         goto err;
@@ -23,7 +23,6 @@
 #include <hal/flash_map.h>
 #include <newtmgr/newtmgr.h>
 #include <coredump/coredump.h>
-#include <util/base64.h>
 
 #include "imgmgr/imgmgr.h"
 #include "imgmgr_priv.h"
@@ -76,14 +75,13 @@ imgr_core_load(struct nmgr_jbuf *njb)
     int sz;
     const struct flash_area *fa;
     char data[IMGMGR_NMGR_MAX_MSG];
-    char encoded[BASE64_ENCODE_SIZE(IMGMGR_NMGR_MAX_MSG)];
     struct coredump_header *hdr;
     struct json_encoder *enc;
     struct json_value jv;
 
     hdr = (struct coredump_header *)data;
 
-    rc = json_read_object(&njb->njb_buf, dload_attr);
+    rc = nmgr_read_object(njb, dload_attr);
     if (rc || off == UINT_MAX) {
         rc = NMGR_ERR_EINVAL;
         goto err;
@@ -118,8 +116,6 @@ imgr_core_load(struct nmgr_jbuf *njb)
         goto err_close;
     }
 
-    sz = base64_encode(data, sz, encoded, 1);
-
     enc = &njb->njb_enc;
 
     json_encode_object_start(enc);
@@ -129,7 +125,7 @@ imgr_core_load(struct nmgr_jbuf *njb)
     JSON_VALUE_INT(&jv, off);
     json_encode_object_entry(enc, "off", &jv);
 
-    JSON_VALUE_STRINGN(&jv, encoded, sz);
+    JSON_VALUE_BYTES(&jv, data, sz);
     json_encode_object_entry(enc, "data", &jv);
     json_encode_object_finish(enc);
 
@@ -0,0 +1,281 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string.h>
+#include <hal/hal_bsp.h>
+#include <hal/flash_map.h>
+#include <newtmgr/newtmgr.h>
+#include <util/lzss.h>
+
+#include <bootutil/image.h>
+
+#include "imgmgr/imgmgr.h"
+#include "imgmgr_priv.h"
+
+/*
+ * Decoding of encoded uploads.  Data goes through up to three stages, each
+ * with bounded RAM: LZSS decompression (LZSS_WINDOW_SIZE bytes of window),
+ * delta ops against the running image (one op header), and a write buffer
+ * of IMGMGR_DEC_BUF bytes in front of flash.
+ */
+
+static int
+imgr_dec_flush(struct imgr_dec *dec)
+{
+    int rc;
+
+    if (dec->buf_len == 0) {
+        return 0;
+    }
+    rc = flash_area_write(imgr_state.upload.fa, dec->out_off, dec->buf,
+                          dec->buf_len);
+    if (rc) {
+        return rc;
+    }
+    dec->out_off += dec->buf_len;
+    dec->buf_len = 0;
+    return 0;
+}
+
+/*
+ * Appends decoded data to the image.
+ */
+static int
+imgr_dec_out(struct imgr_dec *dec, const uint8_t *data, uint32_t len)
+{
+    uint32_t cnt;
+    int rc;
+
+    if (dec->out_off + dec->buf_len + len > dec->size) {
+        return -1;
+    }
+    while (len) {
+        cnt = sizeof(dec->buf) - dec->buf_len;
+        if (cnt > len) {
+            cnt = len;
+        }
+        memcpy(dec->buf + dec->buf_len, data, cnt);
+        dec->buf_len += cnt;
+        data += cnt;
+        len -= cnt;
+        if (dec->buf_len == sizeof(dec->buf)) {
+            rc = imgr_dec_flush(dec);
+            if (rc) {
+                return rc;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * Appends a range of the base image to the image.
+ */
+static int
+imgr_dec_copy(struct imgr_dec *dec, uint32_t off, uint32_t len)
+{
+    uint8_t buf[IMGMGR_UPLOAD_BIN_BUF];
+    uint32_t cnt;
+    int rc;
+
+    if (off > dec->base->fa_size || len > dec->base->fa_size - off) {
+        return -1;
+    }
+    while (len) {
+        cnt = len;
+        if (cnt > sizeof(buf)) {
+            cnt = sizeof(buf);
+        }
+        rc = flash_area_read(dec->base, off, buf, cnt);
+        if (rc) {
+            return rc;
+        }
+        rc = imgr_dec_out(dec, buf, cnt);
+        if (rc) {
+            return rc;
+        }
+        off += cnt;
+        len -= cnt;
+    }
+    return 0;
+}
+
+/*
+ * Applies delta ops.  Op headers may be split across calls; so may the
+ * data of a DATA op.
+ */
+static int
+imgr_dec_delta(struct imgr_dec *dec, const uint8_t *data, int len)
+{
+    uint32_t cnt;
+    int need;
+    int rc;
+
+    while (len > 0) {
+        if (dec->data_len) {
+            cnt = dec->data_len;
+            if (cnt > len) {
+                cnt = len;
+            }
+            rc = imgr_dec_out(dec, data, cnt);
+            if (rc) {
+                return rc;
+            }
+            dec->data_len -= cnt;
+            data += cnt;
+            len -= cnt;
+            continue;
+        }
+
+        dec->op[dec->op_len++] = *data++;
+        len--;
+        switch (dec->op[0]) {
+        case IMAGE_DELTA_COPY:
+            need = IMAGE_DELTA_COPY_SZ;
+            break;
+        case IMAGE_DELTA_DATA:
+            need = IMAGE_DELTA_DATA_SZ;
+            break;
+        default:
+            return -1;
+        }
+        if (dec->op_len < need) {
+            continue;
+        }
+        dec->op_len = 0;
+        if (dec->op[0] == IMAGE_DELTA_COPY) {
+            rc = imgr_dec_copy(dec, imgr_get_le32(dec->op + 1),
+                               imgr_get_le32(dec->op + 5));
+            if (rc) {
+                return rc;
+            }
+        } else {
+            dec->data_len = imgr_get_le32(dec->op + 1);
+        }
+    }
+    return 0;
+}
+
+static int
+imgr_dec_payload(void *arg, const uint8_t *data, int len)
+{
+    struct imgr_dec *dec;
+
+    dec = arg;
+    if (dec->flags & IMAGE_ENC_F_DELTA) {
+        return imgr_dec_delta(dec, data, len);
+    } else {
+        return imgr_dec_out(dec, data, len);
+    }
+}
+
+/**
+ * Starts decoding an encoded upload into imgr_state.upload.fa, which
+ * must have been erased.  For a delta, checks that the running image is
+ * the one the delta was made against.
+ *
+ * @param eh                    Header of the encoded image.
+ *
+ * @return                      0 on success; non-zero on failure.
+ */
+int
+imgr_dec_start(const struct image_enc_header *eh)
+{
+    struct imgr_dec *dec;
+    struct image_version ver;
+    uint8_t hash[IMGMGR_HASH_LEN];
+    int rc;
+
+    dec = &imgr_state.upload.dec;
+    if (dec->base) {
+        flash_area_close(dec->base);
+    }
+    memset(dec, 0, sizeof(*dec));
+    dec->flags = eh->ieh_flags;
+    dec->size = IMAGE_SIZE(&eh->ieh_hdr);
+    lzss_rdec_init(&dec->lzss);
+
+    if (dec->flags & ~(IMAGE_ENC_F_LZSS | IMAGE_ENC_F_DELTA)) {
+        return -1;
+    }
+    if (dec->flags & IMAGE_ENC_F_DELTA) {
+        rc = imgr_read_info(bsp_imgr_current_slot(), &ver, hash);
+        if (rc != 0 || memcmp(hash, eh->ieh_base_hash, sizeof(hash))) {
+            return -1;
+        }
+        rc = flash_area_open(bsp_imgr_current_slot(), &dec->base);
+        if (rc) {
+            return rc;
+        }
+    }
+
+    /* Payload decodes to what follows the image header. */
+    return imgr_dec_out(dec, (const uint8_t *)&eh->ieh_hdr,
+                        sizeof(eh->ieh_hdr));
+}
+
+/**
+ * Decodes the next piece of the payload of an encoded upload.
+ *
+ * @param data                  Payload bytes.
+ * @param len                   Number of bytes.
+ *
+ * @return                      0 on success; non-zero if the payload is
+ *                                  corrupt, or writing to flash failed.
+ */
+int
+imgr_dec_feed(const uint8_t *data, int len)
+{
+    struct imgr_dec *dec;
+
+    dec = &imgr_state.upload.dec;
+    if (dec->flags & IMAGE_ENC_F_LZSS) {
+        return lzss_rdec_feed(&dec->lzss, data, len, imgr_dec_payload, dec);
+    } else {
+        return imgr_dec_payload(dec, data, len);
+    }
+}
+
+/**
+ * Finishes an encoded upload, once all of the payload has been fed to
+ * the decoder.
+ *
+ * @return                      0 if the whole image was decoded;
+ *                                  non-zero otherwise.
+ */
+int
+imgr_dec_finish(void)
+{
+    struct imgr_dec *dec;
+    int rc;
+
+    dec = &imgr_state.upload.dec;
+    rc = imgr_dec_flush(dec);
+    if (dec->base) {
+        flash_area_close(dec->base);
+        dec->base = NULL;
+    }
+    if (rc) {
+        return rc;
+    }
+    if (dec->out_off != dec->size || dec->op_len || dec->data_len) {
+        return -1;
+    }
+    return 0;
+}
@@ -29,7 +29,6 @@
 #include <bootutil/image.h>
 #include <fs/fs.h>
 #include <json/json.h>
-#include <util/base64.h>
 #include <bsp/bsp.h>
 
 #include "imgmgr/imgmgr.h"
@@ -40,7 +39,6 @@ imgr_file_download(struct nmgr_jbuf *njb)
 {
     long long unsigned int off = UINT_MAX;
     char tmp_str[IMGMGR_NMGR_MAX_NAME + 1];
-    char img_data[BASE64_ENCODE_SIZE(IMGMGR_NMGR_MAX_MSG)];
     const struct json_attr_t dload_attr[3] = {
         [0] = {
             .attribute = "off",
@@ -60,7 +58,7 @@ imgr_file_download(struct nmgr_jbuf *njb)
     struct json_encoder *enc;
     struct json_value jv;
 
-    rc = json_read_object(&njb->njb_buf, dload_attr);
+    rc = nmgr_read_object(njb, dload_attr);
     if (rc || off == UINT_MAX) {
         rc = NMGR_ERR_EINVAL;
         goto err;
@@ -83,15 +81,13 @@ imgr_file_download(struct nmgr_jbuf *njb)
         goto err_close;
     }
 
-    out_len = base64_encode(tmp_str, out_len, img_data, 1);
-
     enc = &njb->njb_enc;
 
     json_encode_object_start(enc);
 
     JSON_VALUE_UINT(&jv, off);
     json_encode_object_entry(enc, "off", &jv);
-    JSON_VALUE_STRINGN(&jv, img_data, out_len);
+    JSON_VALUE_BYTES(&jv, tmp_str, out_len);
     json_encode_object_entry(enc, "data", &jv);
     if (off == 0) {
         rc = fs_filelen(file, &out_len);
@@ -114,13 +110,118 @@ err:
     return 0;
 }
 
+/*
+ * Binary file download.  File data is read from the file system straight
+ * into msys mbufs, which are chained to the response and handed to the
+ * transport as they are; there's no staging buffer and no base64, and a
+ * chunk can be as large as the transport takes.
+ *
+ * Request:  le32 off, le32 max data length, file name.
+ * Response: u8 rc, le32 off, le32 file length, data.
+ */
+int
+imgr_file_download_bin(struct nmgr_jbuf *njb)
+{
+    char name[IMGMGR_NMGR_MAX_NAME + 1];
+    uint8_t buf[IMGMGR_FILE_BIN_RSP];
+    struct fs_file *file;
+    struct os_mbuf *tail;
+    uint16_t tail_len;
+    uint32_t flen;
+    uint32_t off;
+    uint32_t len;
+    uint32_t cnt;
+    int rsp_off;
+    int rc;
+
+    file = NULL;
+    off = 0;
+    flen = 0;
+    len = njb->njb_end - njb->njb_off;
+    if (len <= IMGMGR_FILE_BIN_HDR ||
+        len - IMGMGR_FILE_BIN_HDR > IMGMGR_NMGR_MAX_NAME) {
+        rc = NMGR_ERR_EINVAL;
+        goto err;
+    }
+    njb->njb_buf.jb_readn(&njb->njb_buf, (char *)buf, IMGMGR_FILE_BIN_HDR);
+    off = imgr_get_le32(buf);
+    len -= IMGMGR_FILE_BIN_HDR;
+    njb->njb_buf.jb_readn(&njb->njb_buf, name, len);
+    name[len] = '\0';
+    len = min(imgr_get_le32(buf + 4), IMGMGR_FILE_BIN_MAX);
+
+    rc = fs_open(name, FS_ACCESS_READ, &file);
+    if (rc || !file) {
+        file = NULL;
+        rc = NMGR_ERR_ENOENT;
+        goto err;
+    }
+    rc = fs_filelen(file, &flen);
+    if (rc == 0 && off > flen) {
+        rc = FS_EOFFSET;
+    }
+    if (rc == 0) {
+        rc = fs_seek(file, off);
+    }
+    if (rc) {
+        rc = NMGR_ERR_EINVAL;
+        goto err;
+    }
+
+    rsp_off = OS_MBUF_PKTLEN(njb->njb_out_m);
+    buf[0] = NMGR_ERR_EOK;
+    imgr_put_le32(buf + 1, off);
+    imgr_put_le32(buf + 5, flen);
+    rc = nmgr_rsp_extend(njb->njb_hdr, njb->njb_out_m, buf, sizeof(buf));
+    if (rc) {
+        goto err_close;
+    }
+
+    /* Remember where the response ends, to cut a partial read off. */
+    tail = njb->njb_out_m;
+    while (SLIST_NEXT(tail, om_next) != NULL) {
+        tail = SLIST_NEXT(tail, om_next);
+    }
+    tail_len = tail->om_len;
+
+    rc = fs_read_mbuf(file, min(len, flen - off), njb->njb_out_m, &cnt);
+    if (rc) {
+        /* Take the partial data back out, freeing the mbufs it was read
+         * into, and report the error.
+         */
+        os_mbuf_free_chain(SLIST_NEXT(tail, om_next));
+        SLIST_NEXT(tail, om_next) = NULL;
+        tail->om_len = tail_len;
+        OS_MBUF_PKTHDR(njb->njb_out_m)->omp_len -= cnt;
+        buf[0] = (rc == FS_ENOMEM) ? NMGR_ERR_ENOMEM : NMGR_ERR_EUNKNOWN;
+        os_mbuf_copyinto(njb->njb_out_m, rsp_off, buf, 1);
+        cnt = 0;
+    }
+    njb->njb_hdr->nh_len += cnt;
+    fs_close(file);
+
+    return 0;
+
+err:
+    buf[0] = rc;
+    imgr_put_le32(buf + 1, off);
+    imgr_put_le32(buf + 5, flen);
+    rc = nmgr_rsp_extend(njb->njb_hdr, njb->njb_out_m, buf, sizeof(buf));
+err_close:
+    if (file) {
+        fs_close(file);
+    }
+    return rc;
+}
+
 int
 imgr_file_upload(struct nmgr_jbuf *njb)
 {
-    char img_data[BASE64_ENCODE_SIZE(IMGMGR_NMGR_MAX_MSG)];
+    char img_data[IMGMGR_NMGR_MAX_MSG];
     char file_name[IMGMGR_NMGR_MAX_NAME + 1];
     long long unsigned int off = UINT_MAX;
     long long unsigned int size = UINT_MAX;
+    int len;
     const struct json_attr_t off_attr[5] = {
         [0] = {
             .attribute = "off",
@@ -130,8 +231,9 @@ imgr_file_upload(struct nmgr_jbuf *njb)
         },
         [1] = {
             .attribute = "data",
-            .type = t_string,
-            .addr.string = img_data,
+            .type = t_bytes,
+            .addr.bytes.buf = (uint8_t *)img_data,
+            .addr.bytes.len = &len,
             .len = sizeof(img_data)
         },
         [2] = {
@@ -150,21 +252,12 @@ imgr_file_upload(struct nmgr_jbuf *njb)
     struct json_encoder *enc;
     struct json_value jv;
     int rc;
-    int len;
 
-    rc = json_read_object(&njb->njb_buf, off_attr);
+    rc = nmgr_read_object(njb, off_attr);
     if (rc || off == UINT_MAX) {
         rc = NMGR_ERR_EINVAL;
         goto err;
     }
-    len = strlen(img_data);
-    if (len) {
-        len = base64_decode(img_data, img_data);
-        if (len < 0) {
-            rc = NMGR_ERR_EINVAL;
-            goto err;
-        }
-    }
 
     if (off == 0) {
         /*
@@ -21,11 +21,43 @@
 #define __IMGMGR_PRIV_H_
 
 #include <stdint.h>
+#include <util/lzss.h>
+#include <bootutil/image.h>
 
 #define IMGMGR_MAX_IMGS		2
 
 #define IMGMGR_HASH_STR		48
 
+/*
+ * Binary upload: how far past the acked offset chunks are accepted, and
+ * how many chunks can be held ahead of it.
+ */
+#ifndef IMGMGR_UPLOAD_WIN_SIZE
+#define IMGMGR_UPLOAD_WIN_SIZE	(8 * 1024)
+#endif
+#ifndef IMGMGR_UPLOAD_WIN_CNT
+#define IMGMGR_UPLOAD_WIN_CNT	8
+#endif
+#define IMGMGR_UPLOAD_BIN_HDR	8
+#define IMGMGR_UPLOAD_BIN_BUF	128
+
+/*
+ * Binary file download: the most file data returned in one response.
+ */
+#ifndef IMGMGR_FILE_BIN_MAX
+#define IMGMGR_FILE_BIN_MAX	512
+#endif
+#define IMGMGR_FILE_BIN_HDR	8
+#define IMGMGR_FILE_BIN_RSP	9
+
+/*
+ * Encoded upload: decoded image data is collected in a buffer of this
+ * size before it's written to flash.
+ */
+#ifndef IMGMGR_DEC_BUF
+#define IMGMGR_DEC_BUF		128
+#endif
+
 /*
  * When accompanied by image, it's this structure followed by data.
  * Response contains just the offset.
@@ -81,12 +113,38 @@ struct imgmgr_upload_cmd {
 struct nmgr_hdr;
 struct os_mbuf;
 struct fs_file;
+struct image_enc_header;
+
+/*
+ * Decoder for encoded uploads (struct image_enc_header).
+ */
+struct imgr_dec {
+    struct lzss_rdec lzss;
+    const struct flash_area *base;
+    uint32_t size;              /* Size of the decoded image. */
+    uint32_t out_off;           /* Decoded bytes written to flash. */
+    uint32_t data_len;          /* Bytes left in current DATA op. */
+    uint8_t flags;              /* IMAGE_ENC_F_xxx */
+    uint8_t op_len;             /* Bytes of op header collected. */
+    uint8_t op[IMAGE_DELTA_COPY_SZ];
+    uint16_t buf_len;
+    uint8_t buf[IMGMGR_DEC_BUF];
+};
 
 struct imgr_state {
     struct {
         uint32_t off;
         uint32_t size;
         const struct flash_area *fa;
+        /* Binary upload chunks received past off. */
+        struct {
+            uint32_t off;
+            uint32_t len;
+        } pend[IMGMGR_UPLOAD_WIN_CNT];
+        uint8_t pend_cnt;
+        /* Upload is an encoded image, being decoded into the slot. */
+        uint8_t enc;
+        struct imgr_dec dec;
 #ifdef FS_PRESENT
         struct fs_file *file;
 #endif
@@ -101,10 +159,18 @@ int imgr_boot2_read(struct nmgr_jbuf *);
 int imgr_boot2_write(struct nmgr_jbuf *);
 int imgr_file_upload(struct nmgr_jbuf *);
 int imgr_file_download(struct nmgr_jbuf *);
+int imgr_file_download_bin(struct nmgr_jbuf *);
 int imgr_core_list(struct nmgr_jbuf *);
 int imgr_core_load(struct nmgr_jbuf *);
 int imgr_core_erase(struct nmgr_jbuf *);
 
+uint32_t imgr_get_le32(const uint8_t *buf);
+void imgr_put_le32(uint8_t *buf, uint32_t val);
+
+int imgr_dec_start(const struct image_enc_header *eh);
+int imgr_dec_feed(const uint8_t *data, int len);
+int imgr_dec_finish(void);
+
 int imgr_find_by_ver(struct image_version *find, uint8_t *hash);
 int imgr_find_by_hash(uint8_t *find, struct image_version *ver);
 
@@ -0,0 +1,869 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string.h>
+#include "testutil/testutil.h"
+#include "os/os.h"
+#include "os/endian.h"
+#include "hal/hal_flash.h"
+#include "hal/flash_map.h"
+#include "bootutil/image.h"
+#include "mbedtls/sha256.h"
+#include "util/lzss.h"
+#include "newtmgr/newtmgr.h"
+#include "imgmgr/imgmgr.h"
+#ifdef FS_PRESENT
+#include "fs/fs.h"
+#include "fs/fs_if.h"
+#endif
+
+#define IMGR_TEST_BUF_SIZE      (256)
+#define IMGR_TEST_BUF_COUNT     (32)
+#define IMGR_TEST_IMG_SIZE      (6000)
+#define IMGR_TEST_MTU           (200)
+#define IMGR_TEST_INFLIGHT      (6)
+#define IMGR_TEST_TLV_SIZE      (sizeof(struct image_tlv) + 32)
+#define IMGR_TEST_ENC_SIZE      (IMGR_TEST_IMG_SIZE * 2)
+#define IMGR_TEST_RSP_SIZE      (1024)
+
+static os_membuf_t imgr_test_membuf[OS_MEMPOOL_SIZE(IMGR_TEST_BUF_COUNT,
+        IMGR_TEST_BUF_SIZE)];
+static struct os_mempool imgr_test_mempool;
+static struct os_mbuf_pool imgr_test_mbuf_pool;
+
+static os_stack_t imgr_test_nmgr_stack[OS_STACK_ALIGN(1024)];
+static struct nmgr_transport imgr_test_nt;
+
+static uint8_t imgr_test_img[IMGR_TEST_IMG_SIZE];
+static uint8_t imgr_test_base[IMGR_TEST_IMG_SIZE];
+static uint8_t imgr_test_enc[IMGR_TEST_ENC_SIZE];
+static uint8_t imgr_test_ops[IMGR_TEST_ENC_SIZE];
+
+/* What is being uploaded; the test image unless sending an encoded one. */
+static const uint8_t *imgr_test_tx;
+static uint32_t imgr_test_tx_len;
+static uint8_t imgr_test_rsp_rc;
+static uint32_t imgr_test_rsp_ack;
+static int imgr_test_rsp_cnt;
+static uint8_t imgr_test_rsp[IMGR_TEST_RSP_SIZE];
+static int imgr_test_rsp_len;
+static uint32_t imgr_test_rand_state;
+
+static int
+imgr_test_out(struct nmgr_transport *nt, struct os_mbuf *m)
+{
+    uint8_t buf[sizeof(struct nmgr_hdr) + 5];
+    int rc;
+
+    rc = os_mbuf_copydata(m, 0, sizeof(buf), buf);
+    TEST_ASSERT(rc == 0);
+    imgr_test_rsp_len = OS_MBUF_PKTLEN(m);
+    TEST_ASSERT_FATAL(imgr_test_rsp_len <= sizeof(imgr_test_rsp));
+    os_mbuf_copydata(m, 0, imgr_test_rsp_len, imgr_test_rsp);
+    os_mbuf_free_chain(m);
+
+    imgr_test_rsp_rc = buf[sizeof(struct nmgr_hdr)];
+    imgr_test_rsp_ack = buf[sizeof(struct nmgr_hdr) + 1] |
+        (buf[sizeof(struct nmgr_hdr) + 2] << 8) |
+        (buf[sizeof(struct nmgr_hdr) + 3] << 16) |
+        ((uint32_t)buf[sizeof(struct nmgr_hdr) + 4] << 24);
+    imgr_test_rsp_cnt++;
+
+    return 0;
+}
+
+static void
+imgr_test_setup(void)
+{
+    static int initialized;
+    int rc;
+
+    rc = os_mempool_init(&imgr_test_mempool, IMGR_TEST_BUF_COUNT,
+            IMGR_TEST_BUF_SIZE, imgr_test_membuf, "imgr_test");
+    TEST_ASSERT_FATAL(rc == 0);
+
+    rc = os_mbuf_pool_init(&imgr_test_mbuf_pool, &imgr_test_mempool,
+            IMGR_TEST_BUF_SIZE, IMGR_TEST_BUF_COUNT);
+    TEST_ASSERT_FATAL(rc == 0);
+
+    if (!initialized) {
+        rc = os_msys_register(&imgr_test_mbuf_pool);
+        TEST_ASSERT_FATAL(rc == 0);
+
+        rc = hal_flash_init();
+        TEST_ASSERT_FATAL(rc == 0);
+
+        rc = nmgr_task_init(10, imgr_test_nmgr_stack,
+                sizeof(imgr_test_nmgr_stack) / sizeof(os_stack_t));
+        TEST_ASSERT_FATAL(rc == 0);
+        nmgr_jbuf_init(&nmgr_task_jbuf);
+
+        rc = imgmgr_module_init();
+        TEST_ASSERT_FATAL(rc == 0);
+
+        rc = nmgr_transport_init(&imgr_test_nt, imgr_test_out);
+        TEST_ASSERT_FATAL(rc == 0);
+        initialized = 1;
+    }
+}
+
+static void
+imgr_test_img_hash(uint8_t *img)
+{
+    struct image_header *hdr;
+    struct image_tlv tlv;
+    int end;
+
+    hdr = (struct image_header *)img;
+    end = hdr->ih_hdr_size + hdr->ih_img_size;
+    memset(&tlv, 0, sizeof(tlv));
+    tlv.it_type = IMAGE_TLV_SHA256;
+    tlv.it_len = 32;
+    memcpy(img + end, &tlv, sizeof(tlv));
+    mbedtls_sha256(img, end, img + end + sizeof(tlv), 0);
+}
+
+/*
+ * Image with a valid header, followed by a pattern and a SHA256 TLV.
+ * With bad_hash, the TLV does not match the image.
+ */
+static void
+imgr_test_img_build(uint16_t build_num, int bad_hash)
+{
+    struct image_header hdr;
+    int end;
+    int i;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.ih_magic = IMAGE_MAGIC;
+    hdr.ih_hdr_size = sizeof(hdr);
+    hdr.ih_img_size = IMGR_TEST_IMG_SIZE - sizeof(hdr) - IMGR_TEST_TLV_SIZE;
+    hdr.ih_tlv_size = IMGR_TEST_TLV_SIZE;
+    hdr.ih_flags = IMAGE_F_SHA256;
+    hdr.ih_ver.iv_major = 1;
+    hdr.ih_ver.iv_build_num = build_num;
+    memcpy(imgr_test_img, &hdr, sizeof(hdr));
+
+    end = hdr.ih_hdr_size + hdr.ih_img_size;
+    for (i = sizeof(hdr); i < end; i++) {
+        imgr_test_img[i] = i * 7 + (i >> 8);
+    }
+
+    imgr_test_img_hash(imgr_test_img);
+    if (bad_hash) {
+        imgr_test_img[end + sizeof(struct image_tlv)] ^= 1;
+    }
+    imgr_test_tx = imgr_test_img;
+    imgr_test_tx_len = IMGR_TEST_IMG_SIZE;
+}
+
+static uint32_t
+imgr_test_rand(void)
+{
+    imgr_test_rand_state = imgr_test_rand_state * 1103515245 + 12345;
+    return imgr_test_rand_state >> 16;
+}
+
+/*
+ * Sends 'len' bytes of 'data' as the chunk at 'off'; returns 1 if a
+ * response came back.
+ */
+static int
+imgr_test_send_data(uint32_t off, const uint8_t *data, int len)
+{
+    struct nmgr_hdr hdr;
+    struct os_mbuf *m;
+    uint8_t buf[8];
+    int cnt;
+    int rc;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.nh_op = NMGR_OP_WRITE;
+    hdr.nh_len = htons(sizeof(buf) + len);
+    hdr.nh_group = htons(NMGR_GROUP_ID_IMAGE);
+    hdr.nh_id = IMGMGR_NMGR_OP_UPLOAD_BIN;
+
+    buf[0] = off;
+    buf[1] = off >> 8;
+    buf[2] = off >> 16;
+    buf[3] = off >> 24;
+    buf[4] = imgr_test_tx_len;
+    buf[5] = imgr_test_tx_len >> 8;
+    buf[6] = imgr_test_tx_len >> 16;
+    buf[7] = imgr_test_tx_len >> 24;
+
+    m = os_msys_get_pkthdr(0, 0);
+    TEST_ASSERT_FATAL(m != NULL);
+    rc = os_mbuf_append(m, &hdr, sizeof(hdr));
+    TEST_ASSERT_FATAL(rc == 0);
+    rc = os_mbuf_append(m, buf, sizeof(buf));
+    TEST_ASSERT_FATAL(rc == 0);
+    rc = os_mbuf_append(m, data, len);
+    TEST_ASSERT_FATAL(rc == 0);
+
+    cnt = imgr_test_rsp_cnt;
+    rc = nmgr_rx_req(&imgr_test_nt, m);
+    TEST_ASSERT_FATAL(rc == 0);
+    nmgr_process(&imgr_test_nt);
+
+    return imgr_test_rsp_cnt != cnt;
+}
+
+/*
+ * Sends one chunk of the image being uploaded; returns 1 if a response
+ * came back.
+ */
+static int
+imgr_test_send(uint32_t off, int len)
+{
+    return imgr_test_send_data(off, imgr_test_tx + off, len);
+}
+
+/*
+ * Pushes the image from the acked offset, with several chunks in flight
+ * per round.  The link drops about one chunk in five, and delivers a
+ * round in reverse order every other time.  Stops after max_rounds, or
+ * when the whole image has been acked.
+ */
+static uint32_t
+imgr_test_upload(uint32_t ack, int max_rounds)
+{
+    uint32_t offs[IMGR_TEST_INFLIGHT];
+    uint32_t off;
+    int round;
+    int cnt;
+    int len;
+    int i;
+
+    for (round = 0; round < max_rounds && ack < imgr_test_tx_len;
+         round++) {
+        cnt = 0;
+        off = ack;
+        while (cnt < IMGR_TEST_INFLIGHT && off < imgr_test_tx_len) {
+            offs[cnt++] = off;
+            off += IMGR_TEST_MTU;
+            if (ack == 0) {
+                /* First chunk goes alone. */
+                break;
+            }
+        }
+        for (i = 0; i < cnt; i++) {
+            off = (round & 1) ? offs[cnt - i - 1] : offs[i];
+            if (imgr_test_rand() % 5 == 0) {
+                continue;
+            }
+            len = imgr_test_tx_len - off;
+            if (len > IMGR_TEST_MTU) {
+                len = IMGR_TEST_MTU;
+            }
+            TEST_ASSERT_FATAL(imgr_test_send(off, len));
+            TEST_ASSERT(imgr_test_rsp_rc == 0);
+            TEST_ASSERT(imgr_test_rsp_ack >= ack);
+            ack = imgr_test_rsp_ack;
+        }
+    }
+    return ack;
+}
+
+static int
+imgr_test_slot_matches(int slot)
+{
+    const struct flash_area *fa;
+    uint8_t buf[IMGR_TEST_MTU];
+    int off;
+    int len;
+    int rc;
+
+    rc = flash_area_open(slot, &fa);
+    TEST_ASSERT_FATAL(rc == 0);
+    for (off = 0; off < IMGR_TEST_IMG_SIZE; off += len) {
+        len = IMGR_TEST_IMG_SIZE - off;
+        if (len > sizeof(buf)) {
+            len = sizeof(buf);
+        }
+        rc = flash_area_read(fa, off, buf, len);
+        TEST_ASSERT_FATAL(rc == 0);
+        if (memcmp(buf, imgr_test_img + off, len)) {
+            break;
+        }
+    }
+    flash_area_close(fa);
+    return off >= IMGR_TEST_IMG_SIZE;
+}
+
+/*
+ * Returns the slot which holds the test image, or -1.
+ */
+static int
+imgr_test_slot_find(void)
+{
+    if (imgr_test_slot_matches(FLASH_AREA_IMAGE_0)) {
+        return FLASH_AREA_IMAGE_0;
+    }
+    if (imgr_test_slot_matches(FLASH_AREA_IMAGE_1)) {
+        return FLASH_AREA_IMAGE_1;
+    }
+    return -1;
+}
+
+TEST_CASE(imgr_test_upload_bin_lossy)
+{
+    uint32_t ack;
+
+    imgr_test_setup();
+    imgr_test_img_build(2, 0);
+    imgr_test_rand_state = 1;
+
+    /* Part of the image, then the link goes away. */
+    ack = imgr_test_upload(0, 6);
+    TEST_ASSERT_FATAL(ack > 0 && ack < IMGR_TEST_IMG_SIZE);
+
+    /* Reconnect: an empty chunk returns where to resume from. */
+    TEST_ASSERT_FATAL(imgr_test_send(0, 0));
+    TEST_ASSERT(imgr_test_rsp_rc == 0);
+    TEST_ASSERT(imgr_test_rsp_ack == ack);
+
+    ack = imgr_test_upload(ack, 1000);
+    TEST_ASSERT(ack == IMGR_TEST_IMG_SIZE);
+
+    TEST_ASSERT(imgr_test_slot_matches(FLASH_AREA_IMAGE_0) ||
+      imgr_test_slot_matches(FLASH_AREA_IMAGE_1));
+}
+
+TEST_CASE(imgr_test_upload_bin_window)
+{
+    imgr_test_setup();
+    imgr_test_img_build(1, 0);
+
+    TEST_ASSERT_FATAL(imgr_test_send(0, IMGR_TEST_MTU));
+    TEST_ASSERT(imgr_test_rsp_ack == IMGR_TEST_MTU);
+
+    /* Out of order within the window: held until the gap is filled. */
+    TEST_ASSERT_FATAL(imgr_test_send(3 * IMGR_TEST_MTU, IMGR_TEST_MTU));
+    TEST_ASSERT(imgr_test_rsp_ack == IMGR_TEST_MTU);
+    TEST_ASSERT_FATAL(imgr_test_send(2 * IMGR_TEST_MTU, IMGR_TEST_MTU));
+    TEST_ASSERT(imgr_test_rsp_ack == IMGR_TEST_MTU);
+    TEST_ASSERT_FATAL(imgr_test_send(IMGR_TEST_MTU, IMGR_TEST_MTU));
+    TEST_ASSERT(imgr_test_rsp_ack == 4 * IMGR_TEST_MTU);
+
+    /* Retransmitted first chunk doesn't restart the upload. */
+    TEST_ASSERT_FATAL(imgr_test_send(0, IMGR_TEST_MTU));
+    TEST_ASSERT(imgr_test_rsp_rc == 0);
+    TEST_ASSERT(imgr_test_rsp_ack == 4 * IMGR_TEST_MTU);
+
+    /* Overlapping the acked offset; only the new part is taken. */
+    TEST_ASSERT_FATAL(imgr_test_send(4 * IMGR_TEST_MTU - 50, IMGR_TEST_MTU));
+    TEST_ASSERT(imgr_test_rsp_ack == 5 * IMGR_TEST_MTU - 50);
+
+    /* Past the end of the image. */
+    TEST_ASSERT_FATAL(imgr_test_send(IMGR_TEST_IMG_SIZE - 10, 20));
+    TEST_ASSERT(imgr_test_rsp_rc != 0);
+    TEST_ASSERT(imgr_test_rsp_ack == 5 * IMGR_TEST_MTU - 50);
+
+    /* Offset so large that off + len wraps to just past the ack. */
+    TEST_ASSERT_FATAL(imgr_test_send_data(0xffffffff - 55, imgr_test_img,
+                                          5 * IMGR_TEST_MTU + 50));
+    TEST_ASSERT(imgr_test_rsp_rc != 0);
+    TEST_ASSERT(imgr_test_rsp_ack == 5 * IMGR_TEST_MTU - 50);
+    TEST_ASSERT_FATAL(imgr_test_send_data(0xffffffff, imgr_test_img, 2));
+    TEST_ASSERT(imgr_test_rsp_rc != 0);
+    TEST_ASSERT(imgr_test_rsp_ack == 5 * IMGR_TEST_MTU - 50);
+
+    /* The upload carries on as if nothing happened. */
+    TEST_ASSERT(imgr_test_upload(5 * IMGR_TEST_MTU - 50, 1000) ==
+                IMGR_TEST_IMG_SIZE);
+    TEST_ASSERT(imgr_test_slot_find() >= 0);
+}
+
+/*
+ * Returns the result of validating the image in slot against the test
+ * image header.
+ */
+static int
+imgr_test_slot_validate(int slot)
+{
+    const struct flash_area *fa;
+    uint8_t buf[64];
+    int rc;
+
+    rc = flash_area_open(slot, &fa);
+    TEST_ASSERT_FATAL(rc == 0);
+    rc = bootutil_img_validate((struct image_header *)imgr_test_img,
+      fa->fa_flash_id, fa->fa_off, buf, sizeof(buf));
+    flash_area_close(fa);
+    return rc;
+}
+
+TEST_CASE(imgr_test_upload_validate)
+{
+    int slot;
+
+    imgr_test_setup();
+
+    /* Data arrives intact; image validates. */
+    imgr_test_img_build(3, 0);
+    imgr_test_rand_state = 3;
+    TEST_ASSERT_FATAL(imgr_test_upload(0, 1000) == IMGR_TEST_IMG_SIZE);
+    slot = imgr_test_slot_find();
+    TEST_ASSERT_FATAL(slot >= 0);
+    TEST_ASSERT(imgr_test_slot_validate(slot) == 0);
+
+    /*
+     * TLV does not match the data.  The upload itself does not check it;
+     * the boot loader does.
+     */
+    imgr_test_img_build(4, 1);
+    TEST_ASSERT_FATAL(imgr_test_upload(0, 1000) == IMGR_TEST_IMG_SIZE);
+    slot = imgr_test_slot_find();
+    TEST_ASSERT_FATAL(slot >= 0);
+    TEST_ASSERT(imgr_test_slot_validate(slot) != 0);
+}
+
+static void
+imgr_test_put_le32(uint8_t *buf, uint32_t val)
+{
+    buf[0] = val;
+    buf[1] = val >> 8;
+    buf[2] = val >> 16;
+    buf[3] = val >> 24;
+}
+
+static int
+imgr_test_op_copy(uint8_t *op, uint32_t off, uint32_t len)
+{
+    op[0] = IMAGE_DELTA_COPY;
+    imgr_test_put_le32(op + 1, off);
+    imgr_test_put_le32(op + 5, len);
+    return IMAGE_DELTA_COPY_SZ;
+}
+
+static int
+imgr_test_op_data(uint8_t *op, uint32_t off, uint32_t len)
+{
+    op[0] = IMAGE_DELTA_DATA;
+    imgr_test_put_le32(op + 1, len);
+    memcpy(op + IMAGE_DELTA_DATA_SZ, imgr_test_img + off, len);
+    return IMAGE_DELTA_DATA_SZ + len;
+}
+
+/*
+ * Encodes the test image: the payload is either the image body, or
+ * 'ops_len' bytes of delta ops; compressed with IMAGE_ENC_F_LZSS.
+ */
+static void
+imgr_test_enc_build(uint8_t flags, int ops_len)
+{
+    struct image_enc_header eh;
+    const uint8_t *src;
+    int len;
+
+    memset(&eh, 0, sizeof(eh));
+    eh.ieh_magic = IMAGE_ENC_MAGIC;
+    eh.ieh_flags = flags;
+    memcpy(eh.ieh_base_hash, imgr_test_base + IMGR_TEST_IMG_SIZE - 32, 32);
+    memcpy(&eh.ieh_hdr, imgr_test_img, sizeof(eh.ieh_hdr));
+    memcpy(imgr_test_enc, &eh, sizeof(eh));
+
+    if (flags & IMAGE_ENC_F_DELTA) {
+        src = imgr_test_ops;
+        len = ops_len;
+    } else {
+        src = imgr_test_img + sizeof(eh.ieh_hdr);
+        len = IMGR_TEST_IMG_SIZE - sizeof(eh.ieh_hdr);
+    }
+    if (flags & IMAGE_ENC_F_LZSS) {
+        len = lzss_encode(src, len, imgr_test_enc + sizeof(eh),
+                          sizeof(imgr_test_enc) - sizeof(eh));
+        TEST_ASSERT_FATAL(len > 0);
+    } else {
+        memcpy(imgr_test_enc + sizeof(eh), src, len);
+    }
+    imgr_test_tx = imgr_test_enc;
+    imgr_test_tx_len = sizeof(eh) + len;
+}
+
+/*
+ * Puts an older build of the test image in the running slot: 50 bytes
+ * differ at 2000, and from 3000 on, it's 4 bytes ahead.  Returns delta
+ * ops which turn it into the test image.
+ */
+static int
+imgr_test_base_build(void)
+{
+    const struct flash_area *fa;
+    struct image_header *hdr;
+    uint8_t *op;
+    int end;
+    int rc;
+    int i;
+
+    memcpy(imgr_test_base, imgr_test_img, IMGR_TEST_IMG_SIZE);
+    hdr = (struct image_header *)imgr_test_base;
+    hdr->ih_ver.iv_build_num--;
+    end = hdr->ih_hdr_size + hdr->ih_img_size;
+    for (i = 2000; i < 2050; i++) {
+        imgr_test_base[i] ^= 0x55;
+    }
+    memmove(imgr_test_base + 3000, imgr_test_img + 3004, end - 3004);
+    imgr_test_img_hash(imgr_test_base);
+
+    rc = flash_area_open(FLASH_AREA_IMAGE_0, &fa);
+    TEST_ASSERT_FATAL(rc == 0);
+    rc = flash_area_erase(fa, 0, fa->fa_size);
+    TEST_ASSERT_FATAL(rc == 0);
+    rc = flash_area_write(fa, 0, imgr_test_base, IMGR_TEST_IMG_SIZE);
+    TEST_ASSERT_FATAL(rc == 0);
+    flash_area_close(fa);
+
+    op = imgr_test_ops;
+    op += imgr_test_op_copy(op, 32, 2000 - 32);
+    op += imgr_test_op_data(op, 2000, 50);
+    op += imgr_test_op_copy(op, 2050, 950);
+    op += imgr_test_op_data(op, 3000, 4);
+    op += imgr_test_op_copy(op, 3000, end - 3004);
+    op += imgr_test_op_data(op, end, IMGR_TEST_IMG_SIZE - end);
+    return op - imgr_test_ops;
+}
+
+/*
+ * Checks that the slot holds the test image, and that it validates.
+ */
+static void
+imgr_test_enc_verify(void)
+{
+    int slot;
+
+    slot = imgr_test_slot_find();
+    TEST_ASSERT_FATAL(slot >= 0);
+    TEST_ASSERT(imgr_test_slot_validate(slot) == 0);
+}
+
+/*
+ * Sends the upload in order; returns the last response code.
+ */
+static int
+imgr_test_upload_seq(void)
+{
+    uint32_t off;
+    int len;
+
+    for (off = 0; off < imgr_test_tx_len; off += len) {
+        len = min(imgr_test_tx_len - off, IMGR_TEST_MTU);
+        TEST_ASSERT_FATAL(imgr_test_send(off, len));
+        if (imgr_test_rsp_rc != 0) {
+            break;
+        }
+    }
+    return imgr_test_rsp_rc;
+}
+
+TEST_CASE(imgr_test_upload_enc)
+{
+    uint32_t ack;
+    int ops_len;
+
+    imgr_test_setup();
+
+    /* Compressed; lossy link, chunks ahead of the ack get dropped. */
+    imgr_test_img_build(6, 0);
+    imgr_test_enc_build(IMAGE_ENC_F_LZSS, 0);
+    imgr_test_rand_state = 6;
+    ack = imgr_test_upload(0, 1000);
+    TEST_ASSERT_FATAL(ack == imgr_test_tx_len);
+    imgr_test_enc_verify();
+
+    /* Delta against the running image, plain and compressed. */
+    imgr_test_img_build(8, 0);
+    ops_len = imgr_test_base_build();
+    imgr_test_enc_build(IMAGE_ENC_F_DELTA, ops_len);
+    TEST_ASSERT(imgr_test_upload_seq() == 0);
+    imgr_test_enc_verify();
+
+    imgr_test_img_build(9, 0);
+    ops_len = imgr_test_base_build();
+    imgr_test_enc_build(IMAGE_ENC_F_DELTA | IMAGE_ENC_F_LZSS, ops_len);
+    TEST_ASSERT(imgr_test_tx_len < IMGR_TEST_IMG_SIZE / 4);
+    imgr_test_rand_state = 9;
+    ack = imgr_test_upload(0, 1000);
+    TEST_ASSERT_FATAL(ack == imgr_test_tx_len);
+    imgr_test_enc_verify();
+
+    /* Delta against some other image. */
+    imgr_test_enc_build(IMAGE_ENC_F_DELTA | IMAGE_ENC_F_LZSS, ops_len);
+    imgr_test_enc[sizeof(uint32_t) * 2] ^= 1;
+    TEST_ASSERT_FATAL(imgr_test_send(0, IMGR_TEST_MTU));
+    TEST_ASSERT(imgr_test_rsp_rc != 0);
+    TEST_ASSERT(imgr_test_rsp_ack == 0);
+
+    /* Copy from past the end of the base slot. */
+    imgr_test_op_copy(imgr_test_ops, 0xfffffff0, 0x20);
+    imgr_test_enc_build(IMAGE_ENC_F_DELTA, ops_len);
+    TEST_ASSERT(imgr_test_upload_seq() != 0);
+
+    /* Stream which ends short of the image. */
+    ops_len = imgr_test_base_build();
+    imgr_test_enc_build(IMAGE_ENC_F_DELTA, ops_len - 10);
+    TEST_ASSERT(imgr_test_upload_seq() != 0);
+    TEST_ASSERT(imgr_test_slot_find() < 0);
+}
+
+TEST_SUITE(imgr_upload_bin_test_suite)
+{
+    imgr_test_upload_bin_window();
+    imgr_test_upload_bin_lossy();
+    imgr_test_upload_validate();
+    imgr_test_upload_enc();
+}
+
+#ifdef FS_PRESENT
+
+#define IMGR_TEST_FILE_SIZE     (1000)
+#define IMGR_TEST_FILE_NAME     "/test/file"
+
+/*
+ * File system holding one file, for the binary file download.  Reads at
+ * or past imgr_test_file_fail fail.
+ */
+struct fs_file {
+    uint32_t pos;
+};
+
+static struct fs_file imgr_test_file;
+static uint8_t imgr_test_file_data[IMGR_TEST_FILE_SIZE];
+static uint32_t imgr_test_file_fail;
+
+static int
+imgr_test_fs_open(const char *name, uint8_t access, struct fs_file **out)
+{
+    if (strcmp(name, IMGR_TEST_FILE_NAME)) {
+        return FS_ENOENT;
+    }
+    imgr_test_file.pos = 0;
+    *out = &imgr_test_file;
+    return 0;
+}
+
+static int
+imgr_test_fs_close(struct fs_file *file)
+{
+    return 0;
+}
+
+static int
+imgr_test_fs_read(struct fs_file *file, uint32_t len, void *data,
+  uint32_t *out_len)
+{
+    if (file->pos >= imgr_test_file_fail) {
+        return FS_EHW;
+    }
+    if (len > IMGR_TEST_FILE_SIZE - file->pos) {
+        len = IMGR_TEST_FILE_SIZE - file->pos;
+    }
+    memcpy(data, imgr_test_file_data + file->pos, len);
+    file->pos += len;
+    *out_len = len;
+    return 0;
+}
+
+static int
+imgr_test_fs_seek(struct fs_file *file, uint32_t off)
+{
+    if (off > IMGR_TEST_FILE_SIZE) {
+        return FS_EOFFSET;
+    }
+    file->pos = off;
+    return 0;
+}
+
+static uint32_t
+imgr_test_fs_getpos(const struct fs_file *file)
+{
+    return file->pos;
+}
+
+static int
+imgr_test_fs_filelen(const struct fs_file *file, uint32_t *out_len)
+{
+    *out_len = IMGR_TEST_FILE_SIZE;
+    return 0;
+}
+
+static const struct fs_ops imgr_test_fs_ops = {
+    .f_open = imgr_test_fs_open,
+    .f_close = imgr_test_fs_close,
+    .f_read = imgr_test_fs_read,
+    .f_seek = imgr_test_fs_seek,
+    .f_getpos = imgr_test_fs_getpos,
+    .f_filelen = imgr_test_fs_filelen,
+    .f_name = "imgr_test"
+};
+
+static void
+imgr_test_file_setup(void)
+{
+    static int initialized;
+    int rc;
+    int i;
+
+    imgr_test_setup();
+    if (!initialized) {
+        rc = fs_register(&imgr_test_fs_ops);
+        TEST_ASSERT_FATAL(rc == 0);
+        initialized = 1;
+    }
+    for (i = 0; i < IMGR_TEST_FILE_SIZE; i++) {
+        imgr_test_file_data[i] = i * 3 + (i >> 8);
+    }
+    imgr_test_file_fail = UINT32_MAX;
+}
+
+/*
+ * Asks for up to 'len' bytes of the test file from 'off', and checks that
+ * the response carries 'rc' and the data, and that no mbufs were leaked.
+ * Returns the number of data bytes in the response.
+ */
+static int
+imgr_test_file_get(uint32_t off, uint32_t len, uint8_t rc)
+{
+    struct nmgr_hdr hdr;
+    struct os_mbuf *m;
+    uint8_t buf[8 + sizeof(IMGR_TEST_FILE_NAME) - 1];
+    uint8_t *rsp;
+    uint32_t val;
+    int num_free;
+    int cnt;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.nh_op = NMGR_OP_READ;
+    hdr.nh_len = htons(sizeof(buf));
+    hdr.nh_group = htons(NMGR_GROUP_ID_IMAGE);
+    hdr.nh_id = IMGMGR_NMGR_OP_FILE_BIN;
+
+    buf[0] = off;
+    buf[1] = off >> 8;
+    buf[2] = off >> 16;
+    buf[3] = off >> 24;
+    buf[4] = len;
+    buf[5] = len >> 8;
+    buf[6] = len >> 16;
+    buf[7] = len >> 24;
+    memcpy(buf + 8, IMGR_TEST_FILE_NAME, sizeof(buf) - 8);
+
+    num_free = imgr_test_mempool.mp_num_free;
+    m = os_msys_get_pkthdr(0, 0);
+    TEST_ASSERT_FATAL(m != NULL);
+    TEST_ASSERT_FATAL(os_mbuf_append(m, &hdr, sizeof(hdr)) == 0);
+    TEST_ASSERT_FATAL(os_mbuf_append(m, buf, sizeof(buf)) == 0);
+
+    cnt = imgr_test_rsp_cnt;
+    TEST_ASSERT_FATAL(nmgr_rx_req(&imgr_test_nt, m) == 0);
+    nmgr_process(&imgr_test_nt);
+    TEST_ASSERT_FATAL(imgr_test_rsp_cnt == cnt + 1);
+    TEST_ASSERT(imgr_test_mempool.mp_num_free == num_free);
+
+    memcpy(&hdr, imgr_test_rsp, sizeof(hdr));
+    rsp = imgr_test_rsp + sizeof(hdr);
+    cnt = imgr_test_rsp_len - sizeof(hdr) - 9;
+    TEST_ASSERT_FATAL(cnt >= 0);
+    TEST_ASSERT(ntohs(hdr.nh_len) == 9 + cnt);
+    TEST_ASSERT(imgr_test_rsp_rc == rc);
+    TEST_ASSERT(imgr_test_rsp_ack == off);
+    val = rsp[5] | (rsp[6] << 8) | (rsp[7] << 16) |
+        ((uint32_t)rsp[8] << 24);
+    TEST_ASSERT(val == IMGR_TEST_FILE_SIZE);
+    TEST_ASSERT(memcmp(rsp + 9, imgr_test_file_data + off, cnt) == 0);
+
+    return cnt;
+}
+
+TEST_CASE(imgr_test_file_bin_read)
+{
+    uint32_t off;
+    int cnt;
+
+    imgr_test_file_setup();
+
+    /* Data spans several mbufs; the file takes two requests. */
+    off = 0;
+    cnt = imgr_test_file_get(off, 600, NMGR_ERR_EOK);
+    TEST_ASSERT(cnt > IMGR_TEST_BUF_SIZE && cnt < IMGR_TEST_FILE_SIZE);
+    off += cnt;
+    cnt = imgr_test_file_get(off, 600, NMGR_ERR_EOK);
+    TEST_ASSERT(off + cnt == IMGR_TEST_FILE_SIZE);
+
+    /* Shorter than asked for. */
+    TEST_ASSERT(imgr_test_file_get(100, 10, NMGR_ERR_EOK) == 10);
+}
+
+TEST_CASE(imgr_test_file_bin_eof)
+{
+    imgr_test_file_setup();
+
+    TEST_ASSERT(imgr_test_file_get(IMGR_TEST_FILE_SIZE, 600,
+        NMGR_ERR_EOK) == 0);
+    TEST_ASSERT(imgr_test_file_get(IMGR_TEST_FILE_SIZE + 1, 600,
+        NMGR_ERR_EINVAL) == 0);
+}
+
+TEST_CASE(imgr_test_file_bin_read_fail)
+{
+    imgr_test_file_setup();
+
+    /*
+     * The first reads fill the response mbuf and a new one; the next
+     * fails.  The partial data comes back out of the chain.
+     */
+    imgr_test_file_fail = IMGR_TEST_BUF_SIZE;
+    TEST_ASSERT(imgr_test_file_get(0, 600, NMGR_ERR_EUNKNOWN) == 0);
+
+    /* A read error at the start. */
+    imgr_test_file_fail = 0;
+    TEST_ASSERT(imgr_test_file_get(0, 600, NMGR_ERR_EUNKNOWN) == 0);
+
+    /* Reading recovers afterwards. */
+    imgr_test_file_fail = UINT32_MAX;
+    TEST_ASSERT(imgr_test_file_get(0, 600, NMGR_ERR_EOK) > 0);
+}
+
+TEST_SUITE(imgr_file_bin_test_suite)
+{
+    imgr_test_file_bin_read();
+    imgr_test_file_bin_eof();
+    imgr_test_file_bin_read_fail();
+}
+
+#endif
+
+#ifdef MYNEWT_SELFTEST
+
+int
+main(int argc, char **argv)
+{
+    tu_config.tc_print_results = 1;
+    tu_init();
+
+    imgr_upload_bin_test_suite();
+#ifdef FS_PRESENT
+    imgr_file_bin_test_suite();
+#endif
+
+    return tu_any_failed;
+}
+
+#endif
@@ -33,6 +33,7 @@
 #define JSON_VALUE_TYPE_STRING (3)
 #define JSON_VALUE_TYPE_ARRAY  (4)
 #define JSON_VALUE_TYPE_OBJECT (5)
+#define JSON_VALUE_TYPE_BYTES  (6)
 
 /**
  * For encode.  The contents of a JSON value to encode.
@@ -63,6 +64,12 @@ struct json_value {
     (__jv)->jv_len = (uint16_t) (__len);                    \
     (__jv)->jv_val.str = (__str);
 
+/* Binary data; base64 encoded in JSON, a byte string in CBOR. */
+#define JSON_VALUE_BYTES(__jv, __buf, __len)  \
+    (__jv)->jv_type = JSON_VALUE_TYPE_BYTES;  \
+    (__jv)->jv_len = (uint16_t) (__len);      \
+    (__jv)->jv_val.str = (char *) (__buf);
+
 #define JSON_VALUE_BOOL(__jv, __v)            \
     (__jv)->jv_type = JSON_VALUE_TYPE_BOOL;   \
     (__jv)->jv_val.u = (__v);
@@ -79,10 +86,16 @@ struct json_value {
 typedef int (*json_write_func_t)(void *buf, char *data,
         int len);
 
+/*
+ * Setting je_cbor makes the encoder emit the same data model as CBOR
+ * (RFC 7049) instead of JSON text: objects and arrays become
+ * indefinite-length maps and arrays, numbers are sent in binary.
+ */
 struct json_encoder {
     json_write_func_t je_write;
     void *je_arg;
     int je_wr_commas:1;
+    unsigned int je_cbor:1;
     char je_encode_buf[64];
 };
 
@@ -112,9 +125,15 @@ typedef enum {
     t_structobject,
     t_array,
     t_check,
-    t_ignore
+    t_ignore,
+    t_bytes
 } json_type;
 
+/*
+ * t_bytes reads binary data into addr.bytes.buf, at most len bytes, and
+ * stores the length in *addr.bytes.len.  JSON carries it base64 encoded.
+ */
+
 struct json_enum_t {
     char *name;
     long long int value;
@@ -161,6 +180,10 @@ struct json_attr_t {
         bool *boolean;
         char *character;
         struct json_array_t array;
+        struct {
+            uint8_t *buf;
+            int *len;
+        } bytes;
         size_t offset;
     } addr;
     union {
@@ -198,6 +221,7 @@ struct json_buffer {
 
 int json_read_object(struct json_buffer *, const struct json_attr_t *);
 int json_read_array(struct json_buffer *, const struct json_array_t *);
+int json_cbor_read_object(struct json_buffer *, const struct json_attr_t *);
 
 #define JSON_ERR_OBSTART     1   /* non-WS when expecting object start */
 #define JSON_ERR_ATTRSTART   2   /* non-WS when expecting attrib start */
@@ -222,6 +246,7 @@ int json_read_array(struct json_buffer *, const struct json_array_t *);
 #define JSON_ERR_MISC        20  /* other data conversion error */
 #define JSON_ERR_BADNUM      21  /* error while parsing a numerical argument */
 #define JSON_ERR_NULLPTR     22  /* unexpected null value or attribute pointer */
+#define JSON_ERR_CBOR        23  /* malformed or unsupported CBOR item */
 
 /*
  * Use the following macros to declare template initializers for structobject
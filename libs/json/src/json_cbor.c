@@ -0,0 +1,467 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string.h>
+
+#include "json/json.h"
+#include "json_cbor_priv.h"
+
+/*
+ * CBOR decoder for the attribute templates used by json_read_object().
+ *
+ * The input must be a map with text keys.  Values are matched against the
+ * attribute of the same name whose type fits the CBOR item: integers for
+ * t_integer/t_uinteger, text for t_string/t_character/t_check and
+ * enumerated attributes, byte strings for t_bytes, true/false for
+ * t_boolean, and arrays of integers or booleans for t_array.  Strings must
+ * be definite length; floats and nested objects are only accepted for
+ * t_ignore attributes, which skip any item.
+ */
+
+/* Nesting allowed when skipping an ignored item. */
+#define JSON_CBOR_MAX_DEPTH     (8)
+
+struct json_cbor_item {
+    uint8_t jci_major;
+    uint8_t jci_info;
+    uint64_t jci_val;
+};
+
+static int
+json_cbor_read(struct json_buffer *jb, void *buf, int len)
+{
+    if (len && jb->jb_readn(jb, buf, len) != len) {
+        return (JSON_ERR_CBOR);
+    }
+    return (0);
+}
+
+static int
+json_cbor_read_head(struct json_buffer *jb, struct json_cbor_item *item)
+{
+    uint8_t buf[8];
+    int len;
+    int rc;
+    int i;
+
+    rc = json_cbor_read(jb, buf, 1);
+    if (rc != 0) {
+        return (rc);
+    }
+    item->jci_major = buf[0] & JSON_CBOR_MAJOR_MASK;
+    item->jci_info = buf[0] & JSON_CBOR_INFO_MASK;
+    item->jci_val = item->jci_info;
+
+    if (item->jci_info < 24 || item->jci_info == JSON_CBOR_INDEF) {
+        return (0);
+    }
+    if (item->jci_info > 27) {
+        return (JSON_ERR_CBOR);
+    }
+
+    len = 1 << (item->jci_info - 24);
+    rc = json_cbor_read(jb, buf, len);
+    if (rc != 0) {
+        return (rc);
+    }
+    item->jci_val = 0;
+    for (i = 0; i < len; i++) {
+        item->jci_val = (item->jci_val << 8) | buf[i];
+    }
+
+    return (0);
+}
+
+static int
+json_cbor_is_break(struct json_cbor_item *item)
+{
+    return (item->jci_major == JSON_CBOR_SIMPLE &&
+            item->jci_info == JSON_CBOR_INDEF);
+}
+
+/*
+ * Reads a definite length string of item->jci_val bytes.  Text is NUL
+ * terminated, so it needs one byte more room than its length.
+ */
+static int
+json_cbor_read_str(struct json_buffer *jb, struct json_cbor_item *item,
+        char *buf, int size)
+{
+    int rc;
+
+    if (item->jci_info == JSON_CBOR_INDEF) {
+        return (JSON_ERR_CBOR);
+    }
+    if (item->jci_val + (item->jci_major == JSON_CBOR_TEXT) > size) {
+        return (JSON_ERR_STRLONG);
+    }
+    rc = json_cbor_read(jb, buf, item->jci_val);
+    if (rc != 0) {
+        return (rc);
+    }
+    if (item->jci_major == JSON_CBOR_TEXT) {
+        buf[item->jci_val] = '\0';
+    }
+
+    return (0);
+}
+
+static int
+json_cbor_skip(struct json_buffer *jb, struct json_cbor_item *item,
+        int depth)
+{
+    struct json_cbor_item sub;
+    uint64_t cnt;
+    uint8_t buf[16];
+    uint64_t left;
+    int rc;
+
+    if (depth > JSON_CBOR_MAX_DEPTH) {
+        return (JSON_ERR_CBOR);
+    }
+
+    switch (item->jci_major) {
+    case JSON_CBOR_BYTES:
+    case JSON_CBOR_TEXT:
+        if (item->jci_info == JSON_CBOR_INDEF) {
+            return (JSON_ERR_CBOR);
+        }
+        for (left = item->jci_val; left > 0; left -= cnt) {
+            cnt = left > sizeof(buf) ? sizeof(buf) : left;
+            rc = json_cbor_read(jb, buf, cnt);
+            if (rc != 0) {
+                return (rc);
+            }
+        }
+        return (0);
+
+    case JSON_CBOR_ARRAY:
+    case JSON_CBOR_MAP:
+        cnt = item->jci_val;
+        if (item->jci_major == JSON_CBOR_MAP) {
+            cnt *= 2;
+        }
+        while (item->jci_info == JSON_CBOR_INDEF || cnt-- > 0) {
+            rc = json_cbor_read_head(jb, &sub);
+            if (rc != 0) {
+                return (rc);
+            }
+            if (json_cbor_is_break(&sub)) {
+                return (item->jci_info == JSON_CBOR_INDEF ? 0 :
+                        JSON_ERR_CBOR);
+            }
+            rc = json_cbor_skip(jb, &sub, depth + 1);
+            if (rc != 0) {
+                return (rc);
+            }
+        }
+        return (0);
+
+    default:
+        /* Integers, simple values and floats carry no payload past the
+         * head.  Tags are not supported.
+         */
+        return (item->jci_major == JSON_CBOR_SIMPLE ||
+                item->jci_major <= JSON_CBOR_NEGINT ? 0 : JSON_ERR_CBOR);
+    }
+}
+
+static int
+json_cbor_fits(const struct json_attr_t *cursor, struct json_cbor_item *item)
+{
+    switch (cursor->type) {
+    case t_integer:
+        return (item->jci_major == JSON_CBOR_UINT ||
+                item->jci_major == JSON_CBOR_NEGINT ||
+                (cursor->map != NULL && item->jci_major == JSON_CBOR_TEXT));
+    case t_uinteger:
+        return (item->jci_major == JSON_CBOR_UINT);
+    case t_string:
+    case t_character:
+    case t_check:
+        return (item->jci_major == JSON_CBOR_TEXT);
+    case t_bytes:
+        return (item->jci_major == JSON_CBOR_BYTES);
+    case t_boolean:
+        return (item->jci_major == JSON_CBOR_SIMPLE &&
+                (item->jci_info == 20 || item->jci_info == 21));
+    case t_array:
+        return (item->jci_major == JSON_CBOR_ARRAY);
+    case t_ignore:
+        return (1);
+    default:
+        return (0);
+    }
+}
+
+static int
+json_cbor_read_int(struct json_cbor_item *item, long long int *val)
+{
+    if (item->jci_val > INT64_MAX) {
+        return (JSON_ERR_BADNUM);
+    }
+    if (item->jci_major == JSON_CBOR_NEGINT) {
+        *val = -1 - (long long int)item->jci_val;
+    } else {
+        *val = item->jci_val;
+    }
+    return (0);
+}
+
+static int
+json_cbor_read_array(struct json_buffer *jb, struct json_cbor_item *item,
+        const struct json_array_t *arr)
+{
+    struct json_cbor_item elem;
+    int cnt;
+    int rc;
+
+    for (cnt = 0; item->jci_info == JSON_CBOR_INDEF || cnt < item->jci_val;
+         cnt++) {
+        rc = json_cbor_read_head(jb, &elem);
+        if (rc != 0) {
+            return (rc);
+        }
+        if (json_cbor_is_break(&elem)) {
+            if (item->jci_info != JSON_CBOR_INDEF) {
+                return (JSON_ERR_CBOR);
+            }
+            break;
+        }
+        if (cnt >= arr->maxlen) {
+            return (JSON_ERR_SUBTOOLONG);
+        }
+
+        switch (arr->element_type) {
+        case t_integer:
+            if (elem.jci_major != JSON_CBOR_UINT &&
+                    elem.jci_major != JSON_CBOR_NEGINT) {
+                return (JSON_ERR_BADNUM);
+            }
+            rc = json_cbor_read_int(&elem, &arr->arr.integers.store[cnt]);
+            if (rc != 0) {
+                return (rc);
+            }
+            break;
+        case t_uinteger:
+            if (elem.jci_major != JSON_CBOR_UINT) {
+                return (JSON_ERR_BADNUM);
+            }
+            arr->arr.uintegers.store[cnt] = elem.jci_val;
+            break;
+        case t_boolean:
+            if (elem.jci_major != JSON_CBOR_SIMPLE ||
+                    (elem.jci_info != 20 && elem.jci_info != 21)) {
+                return (JSON_ERR_MISC);
+            }
+            arr->arr.booleans.store[cnt] = (elem.jci_info == 21);
+            break;
+        default:
+            return (JSON_ERR_SUBTYPE);
+        }
+    }
+
+    if (arr->count != NULL) {
+        *arr->count = cnt;
+    }
+    return (0);
+}
+
+static int
+json_cbor_read_value(struct json_buffer *jb, const struct json_attr_t *cursor,
+        struct json_cbor_item *item)
+{
+    char valbuf[JSON_ATTR_MAX + 1];
+    const struct json_enum_t *mp;
+    long long int ival;
+    int rc;
+
+    switch (cursor->type) {
+    case t_integer:
+        if (item->jci_major == JSON_CBOR_TEXT) {
+            rc = json_cbor_read_str(jb, item, valbuf, sizeof(valbuf));
+            if (rc != 0) {
+                return (rc);
+            }
+            for (mp = cursor->map; mp->name != NULL; mp++) {
+                if (strcmp(mp->name, valbuf) == 0) {
+                    break;
+                }
+            }
+            if (mp->name == NULL) {
+                return (JSON_ERR_BADENUM);
+            }
+            ival = mp->value;
+        } else {
+            rc = json_cbor_read_int(item, &ival);
+            if (rc != 0) {
+                return (rc);
+            }
+        }
+        if (cursor->addr.integer != NULL) {
+            *cursor->addr.integer = ival;
+        }
+        return (0);
+    case t_uinteger:
+        if (cursor->addr.uinteger != NULL) {
+            *cursor->addr.uinteger = item->jci_val;
+        }
+        return (0);
+    case t_string:
+        return (json_cbor_read_str(jb, item, cursor->addr.string,
+                    cursor->len));
+    case t_bytes:
+        rc = json_cbor_read_str(jb, item, (char *)cursor->addr.bytes.buf,
+                cursor->len);
+        if (rc == 0) {
+            *cursor->addr.bytes.len = item->jci_val;
+        }
+        return (rc);
+    case t_character:
+        rc = json_cbor_read_str(jb, item, valbuf, sizeof(valbuf));
+        if (rc != 0) {
+            return (rc);
+        }
+        if (item->jci_val > 1) {
+            return (JSON_ERR_STRLONG);
+        }
+        cursor->addr.character[0] = valbuf[0];
+        return (0);
+    case t_check:
+        rc = json_cbor_read_str(jb, item, valbuf, sizeof(valbuf));
+        if (rc != 0) {
+            return (rc == JSON_ERR_STRLONG ? JSON_ERR_CHECKFAIL : rc);
+        }
+        if (strcmp(cursor->dflt.check, valbuf) != 0) {
+            return (JSON_ERR_CHECKFAIL);
+        }
+        return (0);
+    case t_boolean:
+        *cursor->addr.boolean = (item->jci_info == 21);
+        return (0);
+    case t_array:
+        return (json_cbor_read_array(jb, item, &cursor->addr.array));
+    default:
+        return (json_cbor_skip(jb, item, 0));
+    }
+}
+
+static void
+json_cbor_set_defaults(const struct json_attr_t *attrs)
+{
+    const struct json_attr_t *cursor;
+
+    for (cursor = attrs; cursor->attribute != NULL; cursor++) {
+        if (cursor->nodefault) {
+            continue;
+        }
+        switch (cursor->type) {
+        case t_integer:
+            *cursor->addr.integer = cursor->dflt.integer;
+            break;
+        case t_uinteger:
+            *cursor->addr.uinteger = cursor->dflt.uinteger;
+            break;
+        case t_real:
+            *cursor->addr.real = cursor->dflt.real;
+            break;
+        case t_string:
+            cursor->addr.string[0] = '\0';
+            break;
+        case t_boolean:
+            *cursor->addr.boolean = cursor->dflt.boolean;
+            break;
+        case t_character:
+            cursor->addr.character[0] = cursor->dflt.character;
+            break;
+        case t_bytes:
+            *cursor->addr.bytes.len = 0;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+int
+json_cbor_read_object(struct json_buffer *jb, const struct json_attr_t *attrs)
+{
+    char attrbuf[JSON_ATTR_MAX + 1];
+    const struct json_attr_t *cursor;
+    struct json_cbor_item map;
+    struct json_cbor_item item;
+    uint64_t cnt;
+    int rc;
+
+    json_cbor_set_defaults(attrs);
+
+    rc = json_cbor_read_head(jb, &map);
+    if (rc != 0 || map.jci_major != JSON_CBOR_MAP) {
+        return (JSON_ERR_OBSTART);
+    }
+
+    for (cnt = 0; map.jci_info == JSON_CBOR_INDEF || cnt < map.jci_val;
+         cnt++) {
+        rc = json_cbor_read_head(jb, &item);
+        if (rc != 0) {
+            return (rc);
+        }
+        if (json_cbor_is_break(&item)) {
+            return (map.jci_info == JSON_CBOR_INDEF ? 0 : JSON_ERR_CBOR);
+        }
+        if (item.jci_major != JSON_CBOR_TEXT) {
+            return (JSON_ERR_ATTRSTART);
+        }
+        rc = json_cbor_read_str(jb, &item, attrbuf, sizeof(attrbuf));
+        if (rc != 0) {
+            return (rc == JSON_ERR_STRLONG ? JSON_ERR_ATTRLEN : rc);
+        }
+
+        rc = json_cbor_read_head(jb, &item);
+        if (rc != 0) {
+            return (rc);
+        }
+
+        /* As with JSON, an attribute may have several specs of different
+         * types; pick the one that fits the item.
+         */
+        for (cursor = attrs; cursor->attribute != NULL; cursor++) {
+            if (strcmp(cursor->attribute, attrbuf) == 0) {
+                break;
+            }
+        }
+        if (cursor->attribute == NULL) {
+            return (JSON_ERR_BADATTR);
+        }
+        while (!json_cbor_fits(cursor, &item)) {
+            if (cursor[1].attribute == NULL ||
+                    strcmp(cursor[1].attribute, attrbuf) != 0) {
+                return (JSON_ERR_CBOR);
+            }
+            cursor++;
+        }
+
+        rc = json_cbor_read_value(jb, cursor, &item);
+        if (rc != 0) {
+            return (rc);
+        }
+    }
+
+    return (0);
+}
@@ -0,0 +1,39 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#ifndef __JSON_CBOR_PRIV_H_
+#define __JSON_CBOR_PRIV_H_
+
+/* CBOR (RFC 7049) major types, in the top three bits of an item head */
+#define JSON_CBOR_UINT          (0 << 5)
+#define JSON_CBOR_NEGINT        (1 << 5)
+#define JSON_CBOR_BYTES         (2 << 5)
+#define JSON_CBOR_TEXT          (3 << 5)
+#define JSON_CBOR_ARRAY         (4 << 5)
+#define JSON_CBOR_MAP           (5 << 5)
+#define JSON_CBOR_SIMPLE        (7 << 5)
+
+#define JSON_CBOR_MAJOR_MASK    (0xe0)
+#define JSON_CBOR_INFO_MASK     (0x1f)
+
+#define JSON_CBOR_FALSE         (JSON_CBOR_SIMPLE | 20)
+#define JSON_CBOR_TRUE          (JSON_CBOR_SIMPLE | 21)
+#define JSON_CBOR_INDEF         (31)
+#define JSON_CBOR_BREAK         (0xff)
+
+#endif
@@ -3,6 +3,7 @@
 #include <assert.h>
 
 #include "json/json.h"
+#include "util/base64.h"
 
 /**
  * This file is based upon microjson, from Eric S Raymond.
@@ -132,6 +133,9 @@ json_target_address(const struct json_attr_t *cursor,
         case t_character:
             targetaddr = (char *)&cursor->addr.character[offset];
             break;
+        case t_bytes:
+            targetaddr = (char *)cursor->addr.bytes.buf;
+            break;
         default:
             targetaddr = NULL;
             break;
@@ -202,6 +206,9 @@ json_internal_read_object(struct json_buffer *jb,
                 case t_character:
                     lptr[0] = cursor->dflt.character;
                     break;
+                case t_bytes:
+                    *cursor->addr.bytes.len = 0;
+                    break;
                 case t_object:        /* silences a compiler warning */
                 case t_structobject:
                 case t_array:
@@ -258,7 +265,8 @@ json_internal_read_object(struct json_buffer *jb,
                     maxlen = (int)cursor->len - 1;
                 } else if (cursor->type == t_check) {
                     maxlen = (int)strlen(cursor->dflt.check);
-                } else if (cursor->type == t_ignore) {
+                } else if (cursor->type == t_ignore ||
+                           cursor->type == t_bytes) {
                     maxlen = JSON_VAL_MAX;
                 } else if (cursor->map != NULL) {
                     maxlen = (int)sizeof(valbuf) - 1;
@@ -381,7 +389,8 @@ json_internal_read_object(struct json_buffer *jb,
              */
             for (;;) {
                 int seeking = cursor->type;
-                if (value_quoted && (cursor->type == t_string)) {
+                if (value_quoted && (cursor->type == t_string ||
+                                     cursor->type == t_bytes)) {
                     break;
                 }
                 if ((strcmp(valbuf, "true")==0 || strcmp(valbuf, "false")==0)
@@ -409,12 +418,12 @@ json_internal_read_object(struct json_buffer *jb,
             if (value_quoted
                 && (cursor->type != t_string && cursor->type != t_character
                     && cursor->type != t_check && cursor->type != t_ignore
-                    && cursor->map == 0)) {
+                    && cursor->type != t_bytes && cursor->map == 0)) {
                 return JSON_ERR_QNONSTRING;
             }
             if (!value_quoted
                 && (cursor->type == t_string || cursor->type == t_check
-                    || cursor->map != 0)) {
+                    || cursor->type == t_bytes || cursor->map != 0)) {
                 return JSON_ERR_NONQSTRING;
             }
             if (cursor->map != 0) {
@@ -473,6 +482,16 @@ json_internal_read_object(struct json_buffer *jb,
                         lptr[0] = valbuf[0];
                     }
                     break;
+                case t_bytes:
+                    if (base64_decode_len(valbuf) > cursor->len) {
+                        return JSON_ERR_STRLONG;
+                    }
+                    n = base64_decode(valbuf, lptr);
+                    if (n < 0) {
+                        return JSON_ERR_BADSTRING;
+                    }
+                    *cursor->addr.bytes.len = n;
+                    break;
                 case t_ignore:        /* silences a compiler warning */
                 case t_object:        /* silences a compiler warning */
                 case t_structobject:
@@ -638,6 +657,7 @@ json_read_array(struct json_buffer *jb, const struct json_array_t *arr)
         case t_array:
         case t_check:
         case t_ignore:
+        case t_bytes:
             return JSON_ERR_SUBTYPE;
         }
         arrcount++;
@@ -21,6 +21,9 @@
 #include <string.h>
 
 #include <json/json.h>
+#include <util/base64.h>
+
+#include "json_cbor_priv.h"
 
 #define JSON_ENCODE_OBJECT_START(__e) \
     (__e)->je_write((__e)->je_arg, "{", sizeof("{")-1);
@@ -34,10 +37,135 @@
 #define JSON_ENCODE_ARRAY_END(__e) \
     (__e)->je_write((__e)->je_arg, "]", sizeof("]")-1);
 
+/* Raw bytes per base64 chunk; a multiple of 3, so only the last chunk
+ * gets padded.
+ */
+#define JSON_B64_CHUNK          (45)
+
+static void
+json_cbor_encode_byte(struct json_encoder *encoder, uint8_t byte)
+{
+    encoder->je_encode_buf[0] = byte;
+    encoder->je_write(encoder->je_arg, encoder->je_encode_buf, 1);
+}
+
+/*
+ * Writes the head of a CBOR item: the major type and its argument, in the
+ * shortest form that holds it.
+ */
+static void
+json_cbor_encode_head(struct json_encoder *encoder, uint8_t major,
+        uint64_t val)
+{
+    int len;
+    int i;
+
+    if (val < 24) {
+        encoder->je_encode_buf[0] = major | val;
+        len = 1;
+    } else if (val <= UINT8_MAX) {
+        encoder->je_encode_buf[0] = major | 24;
+        len = 2;
+    } else if (val <= UINT16_MAX) {
+        encoder->je_encode_buf[0] = major | 25;
+        len = 3;
+    } else if (val <= UINT32_MAX) {
+        encoder->je_encode_buf[0] = major | 26;
+        len = 5;
+    } else {
+        encoder->je_encode_buf[0] = major | 27;
+        len = 9;
+    }
+    for (i = len - 1; i > 0; i--) {
+        encoder->je_encode_buf[i] = val;
+        val >>= 8;
+    }
+    encoder->je_write(encoder->je_arg, encoder->je_encode_buf, len);
+}
+
+static void
+json_cbor_encode_str(struct json_encoder *encoder, uint8_t major,
+        char *str, int len)
+{
+    json_cbor_encode_head(encoder, major, len);
+    if (len) {
+        encoder->je_write(encoder->je_arg, str, len);
+    }
+}
+
+static int
+json_cbor_encode_value(struct json_encoder *encoder, struct json_value *jv)
+{
+    int64_t val;
+    int rc;
+    int i;
+
+    switch (jv->jv_type) {
+        case JSON_VALUE_TYPE_BOOL:
+            json_cbor_encode_byte(encoder,
+                    jv->jv_val.u > 0 ? JSON_CBOR_TRUE : JSON_CBOR_FALSE);
+            break;
+        case JSON_VALUE_TYPE_UINT64:
+            json_cbor_encode_head(encoder, JSON_CBOR_UINT, jv->jv_val.u);
+            break;
+        case JSON_VALUE_TYPE_INT64:
+            val = (int64_t) jv->jv_val.u;
+            if (val < 0) {
+                json_cbor_encode_head(encoder, JSON_CBOR_NEGINT,
+                        (uint64_t) -(val + 1));
+            } else {
+                json_cbor_encode_head(encoder, JSON_CBOR_UINT, val);
+            }
+            break;
+        case JSON_VALUE_TYPE_STRING:
+            json_cbor_encode_str(encoder, JSON_CBOR_TEXT, jv->jv_val.str,
+                    jv->jv_len);
+            break;
+        case JSON_VALUE_TYPE_BYTES:
+            json_cbor_encode_str(encoder, JSON_CBOR_BYTES, jv->jv_val.str,
+                    jv->jv_len);
+            break;
+        case JSON_VALUE_TYPE_ARRAY:
+            json_cbor_encode_head(encoder, JSON_CBOR_ARRAY, jv->jv_len);
+            for (i = 0; i < jv->jv_len; i++) {
+                rc = json_cbor_encode_value(encoder,
+                        jv->jv_val.composite.values[i]);
+                if (rc != 0) {
+                    goto err;
+                }
+            }
+            break;
+        case JSON_VALUE_TYPE_OBJECT:
+            json_cbor_encode_head(encoder, JSON_CBOR_MAP, jv->jv_len);
+            for (i = 0; i < jv->jv_len; i++) {
+                json_cbor_encode_str(encoder, JSON_CBOR_TEXT,
+                        jv->jv_val.composite.keys[i],
+                        strlen(jv->jv_val.composite.keys[i]));
+                rc = json_cbor_encode_value(encoder,
+                        jv->jv_val.composite.values[i]);
+                if (rc != 0) {
+                    goto err;
+                }
+            }
+            break;
+        default:
+            rc = -1;
+            goto err;
+    }
+
+    return (0);
+err:
+    return (rc);
+}
+
 
 int
 json_encode_object_start(struct json_encoder *encoder)
 {
+    if (encoder->je_cbor) {
+        json_cbor_encode_byte(encoder, JSON_CBOR_MAP | JSON_CBOR_INDEF);
+        return (0);
+    }
     if (encoder->je_wr_commas) {
         encoder->je_write(encoder->je_arg, ",", sizeof(",")-1);
         encoder->je_wr_commas = 0;
@@ -113,6 +241,20 @@ json_encode_value(struct json_encoder *encoder, struct json_value *jv)
             }
             encoder->je_write(encoder->je_arg, "\"", sizeof("\"")-1);
             break;
+        case JSON_VALUE_TYPE_BYTES:
+            encoder->je_write(encoder->je_arg, "\"", sizeof("\"")-1);
+            for (i = 0; i < jv->jv_len; i += JSON_B64_CHUNK) {
+                len = jv->jv_len - i;
+                if (len > JSON_B64_CHUNK) {
+                    len = JSON_B64_CHUNK;
+                }
+                len = base64_encode(&jv->jv_val.str[i], len,
+                        encoder->je_encode_buf, 1);
+                encoder->je_write(encoder->je_arg, encoder->je_encode_buf,
+                        len);
+            }
+            encoder->je_write(encoder->je_arg, "\"", sizeof("\"")-1);
+            break;
         case JSON_VALUE_TYPE_ARRAY:
             JSON_ENCODE_ARRAY_START(encoder);
             for (i = 0; i < jv->jv_len; i++) {
@@ -152,6 +294,10 @@ err:
 int
 json_encode_object_key(struct json_encoder *encoder, char *key)
 {
+    if (encoder->je_cbor) {
+        json_cbor_encode_str(encoder, JSON_CBOR_TEXT, key, strlen(key));
+        return (0);
+    }
     if (encoder->je_wr_commas) {
         encoder->je_write(encoder->je_arg, ",", sizeof(",")-1);
         encoder->je_wr_commas = 0;
@@ -171,6 +317,10 @@ json_encode_object_entry(struct json_encoder *encoder, char *key,
 {
     int rc;
 
+    if (encoder->je_cbor) {
+        json_cbor_encode_str(encoder, JSON_CBOR_TEXT, key, strlen(key));
+        return (json_cbor_encode_value(encoder, val));
+    }
     if (encoder->je_wr_commas) {
         encoder->je_write(encoder->je_arg, ",", sizeof(",")-1);
         encoder->je_wr_commas = 0;
@@ -194,6 +344,10 @@ err:
 int
 json_encode_object_finish(struct json_encoder *encoder)
 {
+    if (encoder->je_cbor) {
+        json_cbor_encode_byte(encoder, JSON_CBOR_BREAK);
+        return (0);
+    }
     JSON_ENCODE_OBJECT_END(encoder);
     /* Useful in case of nested objects. */
     encoder->je_wr_commas = 1;
@@ -210,6 +364,10 @@ json_encode_array_name(struct json_encoder *encoder, char *name)
 int
 json_encode_array_start(struct json_encoder *encoder)
 {
+    if (encoder->je_cbor) {
+        json_cbor_encode_byte(encoder, JSON_CBOR_ARRAY | JSON_CBOR_INDEF);
+        return (0);
+    }
     JSON_ENCODE_ARRAY_START(encoder);
     encoder->je_wr_commas = 0;
 
@@ -221,6 +379,9 @@ json_encode_array_value(struct json_encoder *encoder, struct json_value *jv)
 {
     int rc;
 
+    if (encoder->je_cbor) {
+        return (json_cbor_encode_value(encoder, jv));
+    }
     if (encoder->je_wr_commas) {
         encoder->je_write(encoder->je_arg, ",", sizeof(",")-1);
         encoder->je_wr_commas = 0;
@@ -241,6 +402,10 @@ err:
 int
 json_encode_array_finish(struct json_encoder *encoder)
 {
+    if (encoder->je_cbor) {
+        json_cbor_encode_byte(encoder, JSON_CBOR_BREAK);
+        return (0);
+    }
     encoder->je_wr_commas = 1;
     JSON_ENCODE_ARRAY_END(encoder);
 
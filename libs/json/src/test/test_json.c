@@ -23,6 +23,8 @@
 TEST_SUITE(test_json_suite) {
     test_json_simple_encode();
     test_json_simple_decode();
+    test_json_cbor_encode();
+    test_json_cbor_decode();
 }
 
 #ifdef MYNEWT_SELFTEST
@@ -22,6 +22,8 @@
 
 TEST_CASE_DECL(test_json_simple_encode);
 TEST_CASE_DECL(test_json_simple_decode);
+TEST_CASE_DECL(test_json_cbor_encode);
+TEST_CASE_DECL(test_json_cbor_decode);
 
 #endif /* TEST_JSON_H */
 
@@ -0,0 +1,277 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string.h>
+#include "testutil/testutil.h"
+#include "test_json.h"
+#include "json/json.h"
+
+static uint8_t cbor_buf[256];
+static int cbor_len;
+
+static const uint8_t cbor_expected[] = {
+    0xbf,
+    0x67, 'K', 'e', 'y', 'B', 'o', 'o', 'l', 0xf5,
+    0x66, 'K', 'e', 'y', 'I', 'n', 't', 0x39, 0x04, 0xd1,
+    0x67, 'K', 'e', 'y', 'U', 'i', 'n', 't', 0x1a, 0x00, 0x14, 0xa5, 0xfe,
+    0x69, 'K', 'e', 'y', 'S', 't', 'r', 'i', 'n', 'g',
+    0x66, 'f', 'o', 'o', 'b', 'a', 'r',
+    0x69, 'K', 'e', 'y', 'I', 'n', 't', 'A', 'r', 'r',
+    0x9f, 0x18, 0x99, 0x19, 0x09, 0xe4, 0x39, 0x01, 0x41, 0xff,
+    0x68, 'K', 'e', 'y', 'B', 'y', 't', 'e', 's', 0x43, 0x00, 0x01, 0xff,
+    0xff
+};
+
+static const uint8_t cbor_bytes[] = { 0x00, 0x01, 0xff };
+
+static int
+test_cbor_write(void *buf, char *data, int len)
+{
+    memcpy(cbor_buf + cbor_len, data, len);
+    cbor_len += len;
+    return len;
+}
+
+/* Binary input buffer; unlike the text one, it may hold NUL bytes. */
+struct test_cbor_buf {
+    /* json_buffer must be first element in the structure */
+    struct json_buffer tcb_buf;
+    const uint8_t *tcb_data;
+    int tcb_len;
+    int tcb_off;
+};
+
+static char
+test_cbor_read_next(struct json_buffer *jb)
+{
+    struct test_cbor_buf *tcb = (struct test_cbor_buf *)jb;
+
+    if (tcb->tcb_off >= tcb->tcb_len) {
+        return '\0';
+    }
+    return tcb->tcb_data[tcb->tcb_off++];
+}
+
+static char
+test_cbor_read_prev(struct json_buffer *jb)
+{
+    struct test_cbor_buf *tcb = (struct test_cbor_buf *)jb;
+
+    if (tcb->tcb_off == 0) {
+        return '\0';
+    }
+    return tcb->tcb_data[--tcb->tcb_off];
+}
+
+static int
+test_cbor_readn(struct json_buffer *jb, char *buf, int size)
+{
+    struct test_cbor_buf *tcb = (struct test_cbor_buf *)jb;
+
+    if (size > tcb->tcb_len - tcb->tcb_off) {
+        size = tcb->tcb_len - tcb->tcb_off;
+    }
+    memcpy(buf, tcb->tcb_data + tcb->tcb_off, size);
+    tcb->tcb_off += size;
+    return size;
+}
+
+static void
+test_cbor_buf_init(struct test_cbor_buf *tcb, const uint8_t *data, int len)
+{
+    tcb->tcb_buf.jb_read_next = test_cbor_read_next;
+    tcb->tcb_buf.jb_read_prev = test_cbor_read_prev;
+    tcb->tcb_buf.jb_readn = test_cbor_readn;
+    tcb->tcb_data = data;
+    tcb->tcb_len = len;
+    tcb->tcb_off = 0;
+}
+
+static void
+test_cbor_encode_sample(struct json_encoder *encoder)
+{
+    struct json_value value;
+
+    json_encode_object_start(encoder);
+    JSON_VALUE_BOOL(&value, 1);
+    json_encode_object_entry(encoder, "KeyBool", &value);
+    JSON_VALUE_INT(&value, -1234);
+    json_encode_object_entry(encoder, "KeyInt", &value);
+    JSON_VALUE_UINT(&value, 1353214);
+    json_encode_object_entry(encoder, "KeyUint", &value);
+    JSON_VALUE_STRING(&value, "foobar");
+    json_encode_object_entry(encoder, "KeyString", &value);
+    json_encode_array_name(encoder, "KeyIntArr");
+    json_encode_array_start(encoder);
+    JSON_VALUE_INT(&value, 153);
+    json_encode_array_value(encoder, &value);
+    JSON_VALUE_INT(&value, 2532);
+    json_encode_array_value(encoder, &value);
+    JSON_VALUE_INT(&value, -322);
+    json_encode_array_value(encoder, &value);
+    json_encode_array_finish(encoder);
+    JSON_VALUE_BYTES(&value, cbor_bytes, sizeof(cbor_bytes));
+    json_encode_object_entry(encoder, "KeyBytes", &value);
+    json_encode_object_finish(encoder);
+}
+
+TEST_CASE(test_json_cbor_encode)
+{
+    struct json_encoder encoder;
+    int json_len;
+
+    memset(&encoder, 0, sizeof(encoder));
+    encoder.je_write = test_cbor_write;
+
+    /* The same calls produce JSON text... */
+    cbor_len = 0;
+    test_cbor_encode_sample(&encoder);
+    cbor_buf[cbor_len] = '\0';
+    TEST_ASSERT(strstr((char *)cbor_buf, "\"KeyBytes\": \"AAH/\"") != NULL);
+    json_len = cbor_len;
+
+    /* ...or CBOR, which is smaller. */
+    memset(&encoder, 0, sizeof(encoder));
+    encoder.je_write = test_cbor_write;
+    encoder.je_cbor = 1;
+    cbor_len = 0;
+    test_cbor_encode_sample(&encoder);
+    TEST_ASSERT(cbor_len == sizeof(cbor_expected));
+    TEST_ASSERT(memcmp(cbor_buf, cbor_expected, cbor_len) == 0);
+    TEST_ASSERT(cbor_len < json_len);
+}
+
+TEST_CASE(test_json_cbor_decode)
+{
+    struct test_cbor_buf tcb;
+    long long unsigned int uint_val;
+    long long int int_val;
+    long long int intarr[4];
+    int array_count;
+    uint8_t bytes[4];
+    int bytes_len;
+    bool bool_val;
+    char string[8];
+    char small[4];
+    int rc;
+    const struct json_attr_t attrs[] = {
+        [0] = {
+            .attribute = "KeyBool",
+            .type = t_boolean,
+            .addr.boolean = &bool_val,
+            .nodefault = true
+        },
+        [1] = {
+            .attribute = "KeyInt",
+            .type = t_integer,
+            .addr.integer = &int_val,
+            .nodefault = true
+        },
+        [2] = {
+            .attribute = "KeyUint",
+            .type = t_uinteger,
+            .addr.uinteger = &uint_val,
+            .nodefault = true
+        },
+        [3] = {
+            .attribute = "KeyString",
+            .type = t_string,
+            .addr.string = string,
+            .len = sizeof(string)
+        },
+        [4] = {
+            .attribute = "KeyIntArr",
+            .type = t_array,
+            .addr.array = {
+                .element_type = t_integer,
+                .arr.integers.store = intarr,
+                .maxlen = sizeof intarr / sizeof intarr[0],
+                .count = &array_count,
+            },
+            .nodefault = true
+        },
+        [5] = {
+            .attribute = "KeyBytes",
+            .type = t_bytes,
+            .addr.bytes.buf = bytes,
+            .addr.bytes.len = &bytes_len,
+            .len = sizeof(bytes)
+        },
+        [6] = {
+            .attribute = NULL
+        }
+    };
+    const struct json_attr_t small_attrs[] = {
+        [0] = {
+            .attribute = "KeyString",
+            .type = t_string,
+            .addr.string = small,
+            .len = sizeof(small)
+        },
+        [1] = {
+            .attribute = "KeyBool",
+            .type = t_ignore,
+        },
+        [2] = {
+            .attribute = NULL
+        }
+    };
+    const uint8_t small_input[] = {
+        0xa2,
+        0x67, 'K', 'e', 'y', 'B', 'o', 'o', 'l', 0xf4,
+        0x69, 'K', 'e', 'y', 'S', 't', 'r', 'i', 'n', 'g', 0x63, 'a', 'b', 'c'
+    };
+    const uint8_t long_input[] = {
+        0xbf,
+        0x69, 'K', 'e', 'y', 'S', 't', 'r', 'i', 'n', 'g', 0x64, 'a', 'b', 'c',
+        'd',
+        0xff
+    };
+
+    test_cbor_buf_init(&tcb, cbor_expected, sizeof(cbor_expected));
+    rc = json_cbor_read_object(&tcb.tcb_buf, attrs);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(bool_val == true);
+    TEST_ASSERT(int_val == -1234);
+    TEST_ASSERT(uint_val == 1353214);
+    TEST_ASSERT(strcmp(string, "foobar") == 0);
+    TEST_ASSERT(array_count == 3);
+    TEST_ASSERT(intarr[0] == 153);
+    TEST_ASSERT(intarr[1] == 2532);
+    TEST_ASSERT(intarr[2] == -322);
+    TEST_ASSERT(bytes_len == sizeof(cbor_bytes));
+    TEST_ASSERT(memcmp(bytes, cbor_bytes, sizeof(cbor_bytes)) == 0);
+
+    /* Definite length map, ignored attribute, text filling the buffer. */
+    test_cbor_buf_init(&tcb, small_input, sizeof(small_input));
+    rc = json_cbor_read_object(&tcb.tcb_buf, small_attrs);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(strcmp(small, "abc") == 0);
+
+    /* Unknown attribute, text that does not fit, truncated input. */
+    test_cbor_buf_init(&tcb, cbor_expected, sizeof(cbor_expected));
+    rc = json_cbor_read_object(&tcb.tcb_buf, small_attrs);
+    TEST_ASSERT(rc == JSON_ERR_BADATTR);
+    test_cbor_buf_init(&tcb, long_input, sizeof(long_input));
+    rc = json_cbor_read_object(&tcb.tcb_buf, small_attrs);
+    TEST_ASSERT(rc == JSON_ERR_STRLONG);
+    test_cbor_buf_init(&tcb, small_input, sizeof(small_input) - 1);
+    rc = json_cbor_read_object(&tcb.tcb_buf, small_attrs);
+    TEST_ASSERT(rc == JSON_ERR_CBOR);
+}
@@ -48,6 +48,12 @@
 #define NMGR_OP_WRITE           (2)
 #define NMGR_OP_WRITE_RSP       (3)
 
+/*
+ * Header flags.  NMGR_F_CBOR selects CBOR instead of JSON for the request
+ * payload; the response is encoded the same way and carries the flag.
+ */
+#define NMGR_F_CBOR             (0x01)
+
 
 /**
  * Newtmgr JSON error codes
@@ -58,6 +64,7 @@
 #define NMGR_ERR_EINVAL   (3)
 #define NMGR_ERR_ETIMEOUT (4)
 #define NMGR_ERR_ENOENT   (5)
+#define NMGR_ERR_EBUSY    (6)
 #define NMGR_ERR_EPERUSER (256)
 
 
@@ -70,6 +77,23 @@
 #define NMGR_ID_MPSTATS         3
 #define NMGR_ID_DATETIME_STR    4
 #define NMGR_ID_RESET           5
+#define NMGR_ID_BATCH           6
+
+/*
+ * Batch read (NMGR_ID_BATCH, read only).  The request payload is a list
+ * of read commands, each a struct nmgr_hdr in network byte order followed
+ * by its payload.  As with top-level requests, each payload is padded to
+ * a multiple of 4 bytes; the padding of the last one may be left off.
+ * The commands are run in order, and the response payload is their
+ * responses, each a header and its payload packed back to back with no
+ * padding; each keeps the group, id and seq of its command.
+ *
+ * The response is filled up to the transport MTU.  Responses which don't
+ * fit are left out, along with the rest of the batch; the client sends
+ * what is missing again.  Writes, batches and commands of slow handlers
+ * aren't run; they get a response holding just NMGR_ERR_EINVAL, as does a
+ * command whose handler fails.
+ */
 
 struct nmgr_hdr {
     uint8_t  nh_op;             /* NMGR_OP_XXX */
@@ -89,9 +113,19 @@ struct nmgr_jbuf {
     struct nmgr_hdr *njb_hdr;
     uint16_t njb_off;
     uint16_t njb_end;
+    /* Input segment holding njb_off, and its offset in the packet; saves
+     * walking the chain from the head for every character.
+     */
+    struct os_mbuf *njb_in_cur;
+    uint16_t njb_in_cur_off;
+    /* Largest response the transport takes for this request. */
+    uint16_t njb_mtu;
 };
 int nmgr_jbuf_init(struct nmgr_jbuf *njb);
+int nmgr_jbuf_setibuf(struct nmgr_jbuf *njb, struct os_mbuf *m,
+        uint16_t off, uint16_t len);
 int nmgr_jbuf_setoerr(struct nmgr_jbuf *njb, int errcode);
+int nmgr_read_object(struct nmgr_jbuf *njb, const struct json_attr_t *attrs);
 extern struct nmgr_jbuf nmgr_task_jbuf;
 
 typedef int (*nmgr_handler_func_t)(struct nmgr_jbuf *);
@@ -100,9 +134,26 @@ typedef int (*nmgr_handler_func_t)(struct nmgr_jbuf *);
     int __name(struct nmgr_hdr *nmr, struct os_mbuf *req, uint16_t srcoff,  \
             struct os_mbuf *rsp)
 
+/*
+ * Handler flags.  NMGR_HANDLER_F_SLOW marks handlers which can take long
+ * (flash erases, file or log walks).  If the newtmgr worker task has been
+ * started, such commands are run there, so that they don't hold up
+ * others; their responses are sent separately, matched by nh_seq.  A
+ * request made up only of such commands gets no response of its own;
+ * the worker's responses are the only reply.
+ *
+ * NMGR_HANDLER_F_EXCL marks handlers which look at state that slow
+ * handlers change (e.g. image slots being erased).  They are not run
+ * while the worker task is running a command; the response is then
+ * NMGR_ERR_EBUSY, and the worker waits for them to finish.
+ */
+#define NMGR_HANDLER_F_SLOW     (0x01)
+#define NMGR_HANDLER_F_EXCL     (0x02)
+
 struct nmgr_handler {
     nmgr_handler_func_t nh_read;
     nmgr_handler_func_t nh_write;
+    uint8_t nh_flags;
 };
 
 struct nmgr_group {
@@ -120,17 +171,28 @@ struct nmgr_group {
 struct nmgr_transport;
 typedef int (*nmgr_transport_out_func_t)(struct nmgr_transport *nt, 
         struct os_mbuf *m);
+typedef uint16_t (*nmgr_transport_mtu_func_t)(struct nmgr_transport *nt,
+        struct os_mbuf *req);
 
 struct nmgr_transport {
     struct os_mqueue nt_imq;
+    /* Commands for slow handlers, waiting for the worker task. */
+    struct os_mqueue nt_slowq;
     nmgr_transport_out_func_t nt_output; 
+    /* Optional; returns the largest response which can be sent back for
+     * 'req', or 0 if unknown.  Without it, NMGR_MAX_MTU is used.
+     */
+    nmgr_transport_mtu_func_t nt_mtu;
 };
 
 
 int nmgr_task_init(uint8_t, os_stack_t *, uint16_t);
+int nmgr_worker_init(uint8_t, os_stack_t *, uint16_t);
 int nmgr_transport_init(struct nmgr_transport *nt,
         nmgr_transport_out_func_t output_func);
 int nmgr_rx_req(struct nmgr_transport *nt, struct os_mbuf *req);
+void nmgr_process(struct nmgr_transport *nt);
+void nmgr_worker_process(struct nmgr_transport *nt);
 int nmgr_rsp_extend(struct nmgr_hdr *, struct os_mbuf *, void *data, uint16_t);
 int nmgr_group_register(struct nmgr_group *group);
 
@@ -36,11 +36,25 @@ struct os_mutex g_nmgr_group_list_lock;
 struct os_eventq g_nmgr_evq;
 struct os_task g_nmgr_task;
 
+/* Worker task, which runs slow handlers. */
+struct os_eventq g_nmgr_worker_evq;
+struct os_task g_nmgr_worker_task;
+static uint8_t nmgr_worker_on;
+
+/* Serializes responses from the two tasks on a transport. */
+struct os_mutex g_nmgr_out_lock;
+
+/* Held by the worker task while it runs a command, and by handlers marked
+ * with NMGR_HANDLER_F_EXCL while they run.
+ */
+struct os_mutex g_nmgr_worker_lock;
+
 STAILQ_HEAD(, nmgr_group) g_nmgr_group_list =
     STAILQ_HEAD_INITIALIZER(g_nmgr_group_list);
 
 static int nmgr_def_echo(struct nmgr_jbuf *);
 static int nmgr_def_console_echo(struct nmgr_jbuf *);
+static int nmgr_def_batch(struct nmgr_jbuf *);
 
 static struct nmgr_group nmgr_def_group;
 /* ORDER MATTERS HERE.
@@ -53,12 +67,17 @@ static const struct nmgr_handler nmgr_def_group_handlers[] = {
     [NMGR_ID_MPSTATS] = {nmgr_def_mpstat_read, NULL},
     [NMGR_ID_DATETIME_STR] = {nmgr_datetime_get, nmgr_datetime_set},
     [NMGR_ID_RESET] = {NULL, nmgr_reset},
+    [NMGR_ID_BATCH] = {nmgr_def_batch, NULL},
 };
 
 /* JSON buffer for NMGR task
  */
 struct nmgr_jbuf nmgr_task_jbuf;
 
+/* JSON buffer for the worker task
+ */
+static struct nmgr_jbuf nmgr_worker_jbuf;
+
 static int
 nmgr_def_echo(struct nmgr_jbuf *njb)
 {
@@ -71,7 +90,7 @@ nmgr_def_echo(struct nmgr_jbuf *njb)
     struct json_value jv;
     int rc;
 
-    rc = json_read_object((struct json_buffer *) njb, attrs);
+    rc = nmgr_read_object(njb, attrs);
     if (rc != 0) {
         goto err;
     }
@@ -103,7 +122,7 @@ nmgr_def_console_echo(struct nmgr_jbuf *njb)
         }
     };
 
-    rc = json_read_object(&njb->njb_buf, attrs);
+    rc = nmgr_read_object(njb, attrs);
     if (rc) {
         return OS_EINVAL;
     }
@@ -246,12 +265,47 @@ err:
     return (rc);
 }
 
+/*
+ * Points njb_in_cur at the segment holding njb_off.  Moving forward
+ * continues from the current segment, so sequential reads cost O(1);
+ * only moving back past the segment start rewinds to the head.
+ *
+ * Returns a pointer to the byte at njb_off, or NULL if the chain ends
+ * first.
+ */
+static uint8_t *
+nmgr_jbuf_seek(struct nmgr_jbuf *njb)
+{
+    struct os_mbuf *om;
+    uint16_t om_off;
+
+    om = njb->njb_in_cur;
+    om_off = njb->njb_in_cur_off;
+    if (om == NULL || njb->njb_off < om_off) {
+        om = njb->njb_in_m;
+        om_off = 0;
+    }
+
+    while (om != NULL && njb->njb_off >= om_off + om->om_len) {
+        om_off += om->om_len;
+        om = SLIST_NEXT(om, om_next);
+    }
+
+    njb->njb_in_cur = om;
+    njb->njb_in_cur_off = om_off;
+    if (om == NULL) {
+        return (NULL);
+    }
+
+    return (om->om_data + (njb->njb_off - om_off));
+}
+
 static char
 nmgr_jbuf_read_next(struct json_buffer *jb)
 {
     struct nmgr_jbuf *njb;
+    uint8_t *u8p;
     char c;
-    int rc;
 
     njb = (struct nmgr_jbuf *) jb;
 
@@ -259,10 +313,8 @@ nmgr_jbuf_read_next(struct json_buffer *jb)
         return '\0';
     }
 
-    rc = os_mbuf_copydata(njb->njb_in_m, njb->njb_off, 1, &c);
-    if (rc == -1) {
-        c = '\0';
-    }
+    u8p = nmgr_jbuf_seek(njb);
+    c = u8p ? *u8p : '\0';
     ++njb->njb_off;
 
     return (c);
@@ -272,8 +324,7 @@ static char
 nmgr_jbuf_read_prev(struct json_buffer *jb)
 {
     struct nmgr_jbuf *njb;
-    char c;
-    int rc;
+    uint8_t *u8p;
 
     njb = (struct nmgr_jbuf *) jb;
 
@@ -282,35 +333,40 @@ nmgr_jbuf_read_prev(struct json_buffer *jb)
     }
 
     --njb->njb_off;
-    rc = os_mbuf_copydata(njb->njb_in_m, njb->njb_off, 1, &c);
-    if (rc == -1) {
-        c = '\0';
-    }
+    u8p = nmgr_jbuf_seek(njb);
 
-    return (c);
+    return (u8p ? *u8p : '\0');
 }
 
 static int
 nmgr_jbuf_readn(struct json_buffer *jb, char *buf, int size)
 {
     struct nmgr_jbuf *njb;
+    uint8_t *u8p;
     int read;
     int left;
-    int rc;
+    int cnt;
 
     njb = (struct nmgr_jbuf *) jb;
 
     left = njb->njb_end - njb->njb_off;
-    read = size > left ? left : size;
+    left = size > left ? left : size;
 
-    rc = os_mbuf_copydata(njb->njb_in_m, njb->njb_off, read, buf);
-    if (rc != 0) {
-        goto err;
+    /* Copy whole spans of each segment. */
+    for (read = 0; read < left; read += cnt) {
+        u8p = nmgr_jbuf_seek(njb);
+        if (u8p == NULL) {
+            break;
+        }
+        cnt = njb->njb_in_cur_off + njb->njb_in_cur->om_len - njb->njb_off;
+        if (cnt > left - read) {
+            cnt = left - read;
+        }
+        memcpy(buf + read, u8p, cnt);
+        njb->njb_off += cnt;
     }
 
     return (read);
-err:
-    return (rc);
 }
 
 int
@@ -346,13 +402,25 @@ nmgr_jbuf_init(struct nmgr_jbuf *njb)
     return (0);
 }
 
-static int
+/**
+ * Sets up the JSON buffer to read a request payload.
+ *
+ * @param njb                   The buffer to set up.
+ * @param m                     The mbuf chain holding the request.
+ * @param off                   Offset of the payload within the chain.
+ * @param len                   Length of the payload.
+ *
+ * @return                      0 on success.
+ */
+int
 nmgr_jbuf_setibuf(struct nmgr_jbuf *njb, struct os_mbuf *m,
         uint16_t off, uint16_t len)
 {
     njb->njb_off = off;
     njb->njb_end = off + len;
     njb->njb_in_m = m;
+    njb->njb_in_cur = m;
+    njb->njb_in_cur_off = 0;
     njb->njb_enc.je_wr_commas = 0;
 
     return (0);
@@ -368,6 +436,24 @@ nmgr_jbuf_setobuf(struct nmgr_jbuf *njb, struct nmgr_hdr *hdr,
     return (0);
 }
 
+/**
+ * Parses the request payload into the given attributes, from JSON or CBOR
+ * depending on how the request was encoded.
+ *
+ * @param njb                   The request being handled.
+ * @param attrs                 The attributes to fill in.
+ *
+ * @return                      0 on success; JSON_ERR_[...] on failure.
+ */
+int
+nmgr_read_object(struct nmgr_jbuf *njb, const struct json_attr_t *attrs)
+{
+    if (njb->njb_enc.je_cbor) {
+        return (json_cbor_read_object(&njb->njb_buf, attrs));
+    }
+    return (json_read_object(&njb->njb_buf, attrs));
+}
+
 int
 nmgr_jbuf_setoerr(struct nmgr_jbuf *njb, int errcode)
 {
@@ -381,8 +467,203 @@ nmgr_jbuf_setoerr(struct nmgr_jbuf *njb, int errcode)
     return (0);
 }
 
+/*
+ * Takes the worker lock for a handler marked with NMGR_HANDLER_F_EXCL.
+ * Returns NMGR_ERR_EBUSY if the worker task is running a command.
+ */
 static int
-nmgr_handle_req(struct nmgr_transport *nt, struct os_mbuf *req)
+nmgr_excl_lock(struct nmgr_handler *handler)
+{
+    if (!(handler->nh_flags & NMGR_HANDLER_F_EXCL) || !nmgr_worker_on ||
+      !os_started()) {
+        return (0);
+    }
+    if (os_mutex_pend(&g_nmgr_worker_lock, 0) != 0) {
+        return (NMGR_ERR_EBUSY);
+    }
+
+    return (0);
+}
+
+static void
+nmgr_excl_unlock(struct nmgr_handler *handler)
+{
+    if (!(handler->nh_flags & NMGR_HANDLER_F_EXCL) || !nmgr_worker_on ||
+      !os_started()) {
+        return;
+    }
+    os_mutex_release(&g_nmgr_worker_lock);
+}
+
+/*
+ * Runs the read commands packed in the payload of a batch command, and
+ * packs their responses into the batch response.  See NMGR_ID_BATCH for
+ * the framing.
+ */
+static int
+nmgr_def_batch(struct nmgr_jbuf *njb)
+{
+    struct nmgr_handler *handler;
+    struct nmgr_hdr *batch_hdr;
+    struct nmgr_hdr *rsp_hdr;
+    struct nmgr_hdr hdr;
+    struct os_mbuf *req;
+    struct os_mbuf *rsp;
+    uint32_t rsp_len;
+    uint16_t off;
+    uint16_t end;
+    uint8_t cbor;
+    int cmd_rc;
+    int rc;
+
+    req = njb->njb_in_m;
+    rsp = njb->njb_out_m;
+    batch_hdr = njb->njb_hdr;
+    cbor = njb->njb_enc.je_cbor;
+    off = njb->njb_off;
+    end = njb->njb_end;
+
+    rc = 0;
+    while (off < end) {
+        if (end - off < sizeof(hdr) ||
+          os_mbuf_copydata(req, off, sizeof(hdr), &hdr) != 0) {
+            rc = OS_EINVAL;
+            break;
+        }
+        hdr.nh_len = ntohs(hdr.nh_len);
+        hdr.nh_group = ntohs(hdr.nh_group);
+        if (end - off - sizeof(hdr) < hdr.nh_len) {
+            rc = OS_EINVAL;
+            break;
+        }
+
+        rsp_len = OS_MBUF_PKTLEN(rsp);
+        rsp_hdr = (struct nmgr_hdr *) os_mbuf_extend(rsp,
+                sizeof(struct nmgr_hdr));
+        if (!rsp_hdr) {
+            rc = OS_ENOMEM;
+            break;
+        }
+        rsp_hdr->nh_op = NMGR_OP_READ_RSP;
+        rsp_hdr->nh_flags = hdr.nh_flags & NMGR_F_CBOR;
+        rsp_hdr->nh_len = 0;
+        rsp_hdr->nh_group = hdr.nh_group;
+        rsp_hdr->nh_seq = hdr.nh_seq;
+        rsp_hdr->nh_id = hdr.nh_id;
+
+        nmgr_jbuf_setibuf(njb, req, off + sizeof(hdr), hdr.nh_len);
+        nmgr_jbuf_setobuf(njb, rsp_hdr, rsp);
+        njb->njb_enc.je_cbor = !!(hdr.nh_flags & NMGR_F_CBOR);
+
+        handler = nmgr_find_handler(hdr.nh_group, hdr.nh_id);
+        if (hdr.nh_op != NMGR_OP_READ || !handler || !handler->nh_read ||
+          handler->nh_read == nmgr_def_batch ||
+          (handler->nh_flags & NMGR_HANDLER_F_SLOW)) {
+            cmd_rc = NMGR_ERR_EINVAL;
+        } else {
+            cmd_rc = nmgr_excl_lock(handler);
+            if (cmd_rc == 0) {
+                if (handler->nh_read(njb) != 0) {
+                    cmd_rc = NMGR_ERR_EINVAL;
+                }
+                nmgr_excl_unlock(handler);
+            }
+        }
+        if (cmd_rc != 0) {
+            /* Drop whatever the handler got to write. */
+            os_mbuf_adj(rsp, (int)(rsp_len + sizeof(hdr)) -
+                    (int)OS_MBUF_PKTLEN(rsp));
+            rsp_hdr->nh_len = 0;
+            njb->njb_enc.je_wr_commas = 0;
+            nmgr_jbuf_setoerr(njb, cmd_rc);
+        }
+
+        if (OS_MBUF_PKTLEN(rsp) > njb->njb_mtu) {
+            /* Doesn't fit; leave it and the rest of the batch out. */
+            os_mbuf_adj(rsp, (int)rsp_len - (int)OS_MBUF_PKTLEN(rsp));
+            break;
+        }
+
+        batch_hdr->nh_len += sizeof(hdr) + rsp_hdr->nh_len;
+        rsp_hdr->nh_len = htons(rsp_hdr->nh_len);
+        rsp_hdr->nh_group = htons(rsp_hdr->nh_group);
+
+        off += sizeof(hdr) + OS_ALIGN(hdr.nh_len, 4);
+    }
+
+    nmgr_jbuf_setobuf(njb, batch_hdr, rsp);
+    njb->njb_enc.je_cbor = cbor;
+
+    return (rc);
+}
+
+static uint16_t
+nmgr_transport_mtu(struct nmgr_transport *nt, struct os_mbuf *req)
+{
+    uint16_t mtu;
+
+    mtu = 0;
+    if (nt->nt_mtu) {
+        mtu = nt->nt_mtu(nt, req);
+    }
+    if (mtu == 0 || mtu > NMGR_MAX_MTU) {
+        mtu = NMGR_MAX_MTU;
+    }
+
+    return (mtu);
+}
+
+static int
+nmgr_output(struct nmgr_transport *nt, struct os_mbuf *rsp)
+{
+    int rc;
+
+    if (os_started()) {
+        os_mutex_pend(&g_nmgr_out_lock, OS_WAIT_FOREVER);
+    }
+    rc = nt->nt_output(nt, rsp);
+    if (os_started()) {
+        os_mutex_release(&g_nmgr_out_lock);
+    }
+
+    return (rc);
+}
+
+/*
+ * Hands one command of a request over to the worker task, in a packet of
+ * its own.
+ */
+static int
+nmgr_defer(struct nmgr_transport *nt, struct os_mbuf *req, uint32_t off,
+        uint32_t len)
+{
+    struct os_mbuf *m;
+    int rc;
+
+    m = os_msys_get_pkthdr(len, OS_MBUF_USRHDR_LEN(req));
+    if (!m) {
+        return (OS_ENOMEM);
+    }
+    memcpy(OS_MBUF_USRHDR(m), OS_MBUF_USRHDR(req), OS_MBUF_USRHDR_LEN(req));
+
+    rc = os_mbuf_appendfrom(m, req, off, len);
+    if (rc == 0) {
+        rc = os_mqueue_put(&nt->nt_slowq, &g_nmgr_worker_evq, m);
+    }
+    if (rc != 0) {
+        os_mbuf_free_chain(m);
+    }
+
+    return (rc);
+}
+
+/*
+ * Runs the commands in a request, using 'njb' for their state.  With
+ * 'defer', commands for slow handlers are passed to the worker task.
+ */
+static int
+nmgr_handle_req(struct nmgr_transport *nt, struct os_mbuf *req,
+        struct nmgr_jbuf *njb, int defer)
 {
     struct os_mbuf *rsp;
     struct nmgr_handler *handler;
@@ -420,6 +701,12 @@ nmgr_handle_req(struct nmgr_transport *nt, struct os_mbuf *req)
             goto err;
         }
 
+        if (defer && (handler->nh_flags & NMGR_HANDLER_F_SLOW) &&
+          nmgr_defer(nt, req, off, sizeof(hdr) + hdr.nh_len) == 0) {
+            off += sizeof(hdr) + OS_ALIGN(hdr.nh_len, 4);
+            continue;
+        }
+
         /* Build response header apriori.  Then pass to the handlers
          * to fill out the response data, and adjust length & flags.
          */
@@ -430,7 +717,7 @@ nmgr_handle_req(struct nmgr_transport *nt, struct os_mbuf *req)
             goto err;
         }
         rsp_hdr->nh_len = 0;
-        rsp_hdr->nh_flags = 0;
+        rsp_hdr->nh_flags = hdr.nh_flags & NMGR_F_CBOR;
         rsp_hdr->nh_op = (hdr.nh_op == NMGR_OP_READ) ? NMGR_OP_READ_RSP :
             NMGR_OP_WRITE_RSP;
         rsp_hdr->nh_group = hdr.nh_group;
@@ -440,30 +727,36 @@ nmgr_handle_req(struct nmgr_transport *nt, struct os_mbuf *req)
         /*
          * Setup state for JSON encoding.
          */
-        rc = nmgr_jbuf_setibuf(&nmgr_task_jbuf, req, off + sizeof(hdr),
-          hdr.nh_len);
+        rc = nmgr_jbuf_setibuf(njb, req, off + sizeof(hdr), hdr.nh_len);
         if (rc) {
             goto err;
         }
-        rc = nmgr_jbuf_setobuf(&nmgr_task_jbuf, rsp_hdr, rsp);
+        rc = nmgr_jbuf_setobuf(njb, rsp_hdr, rsp);
         if (rc) {
             goto err;
         }
+        njb->njb_enc.je_cbor = !!(hdr.nh_flags & NMGR_F_CBOR);
+        njb->njb_mtu = nmgr_transport_mtu(nt, req);
 
-        if (hdr.nh_op == NMGR_OP_READ) {
-            if (handler->nh_read) {
-                rc = handler->nh_read(&nmgr_task_jbuf);
-            } else {
-                rc = OS_EINVAL;
-            }
-        } else if (hdr.nh_op == NMGR_OP_WRITE) {
-            if (handler->nh_write) {
-                rc = handler->nh_write(&nmgr_task_jbuf);
+        if (nmgr_excl_lock(handler) != 0) {
+            rc = nmgr_jbuf_setoerr(njb, NMGR_ERR_EBUSY);
+        } else {
+            if (hdr.nh_op == NMGR_OP_READ) {
+                if (handler->nh_read) {
+                    rc = handler->nh_read(njb);
+                } else {
+                    rc = OS_EINVAL;
+                }
+            } else if (hdr.nh_op == NMGR_OP_WRITE) {
+                if (handler->nh_write) {
+                    rc = handler->nh_write(njb);
+                } else {
+                    rc = OS_EINVAL;
+                }
             } else {
                 rc = OS_EINVAL;
             }
-        } else {
-            rc = OS_EINVAL;
+            nmgr_excl_unlock(handler);
         }
 
         if (rc != 0) {
@@ -476,7 +769,12 @@ nmgr_handle_req(struct nmgr_transport *nt, struct os_mbuf *req)
         off += sizeof(hdr) + OS_ALIGN(hdr.nh_len, 4);
     }
 
-    nt->nt_output(nt, rsp);
+    if (OS_MBUF_PKTLEN(rsp) == 0) {
+        /* Everything went to the worker, which sends the only reply. */
+        os_mbuf_free_chain(rsp);
+        return (0);
+    }
+    nmgr_output(nt, rsp);
 
     return (0);
 err:
@@ -496,11 +794,52 @@ nmgr_process(struct nmgr_transport *nt)
             break;
         }
 
-        nmgr_handle_req(nt, m);
+        nmgr_handle_req(nt, m, &nmgr_task_jbuf, nmgr_worker_on);
+        os_mbuf_free_chain(m);
+    }
+}
+
+/**
+ * Runs the commands which were passed to the worker task for a transport.
+ * Called by the worker task; exposed for tests, which have no tasks.
+ *
+ * @param nt                    The transport the commands came in on.
+ */
+void
+nmgr_worker_process(struct nmgr_transport *nt)
+{
+    struct os_mbuf *m;
+
+    while (1) {
+        m = os_mqueue_get(&nt->nt_slowq);
+        if (!m) {
+            break;
+        }
+
+        if (nmgr_worker_on && os_started()) {
+            os_mutex_pend(&g_nmgr_worker_lock, OS_WAIT_FOREVER);
+        }
+        nmgr_handle_req(nt, m, &nmgr_worker_jbuf, 0);
+        if (nmgr_worker_on && os_started()) {
+            os_mutex_release(&g_nmgr_worker_lock);
+        }
         os_mbuf_free_chain(m);
     }
 }
 
+static void
+nmgr_worker_task(void *arg)
+{
+    struct os_event *ev;
+
+    while (1) {
+        ev = os_eventq_get(&g_nmgr_worker_evq);
+        if (ev->ev_type == OS_EVENT_T_MQUEUE_DATA) {
+            nmgr_worker_process((struct nmgr_transport *) ev->ev_arg);
+        }
+    }
+}
+
 void
 nmgr_task(void *arg)
 {
@@ -532,12 +871,18 @@ nmgr_transport_init(struct nmgr_transport *nt,
     int rc;
 
     nt->nt_output = output_func;
+    nt->nt_mtu = NULL;
 
     rc = os_mqueue_init(&nt->nt_imq, nt);
     if (rc != 0) {
         goto err;
     }
 
+    rc = os_mqueue_init(&nt->nt_slowq, nt);
+    if (rc != 0) {
+        goto err;
+    }
+
     return (0);
 err:
     return (rc);
@@ -629,6 +974,11 @@ nmgr_task_init(uint8_t prio, os_stack_t *stack_ptr, uint16_t stack_len)
 
     os_eventq_init(&g_nmgr_evq);
 
+    rc = os_mutex_init(&g_nmgr_out_lock);
+    if (rc != 0) {
+        goto err;
+    }
+
     rc = nmgr_transport_init(&g_nmgr_shell_transport, nmgr_shell_out);
     if (rc != 0) {
         goto err;
@@ -655,3 +1005,40 @@ nmgr_task_init(uint8_t prio, os_stack_t *stack_ptr, uint16_t stack_len)
 err:
     return (rc);
 }
+
+/**
+ * Starts the worker task, which runs commands for handlers marked with
+ * NMGR_HANDLER_F_SLOW.  Optional; without it, all commands run in the
+ * newtmgr task, in order.  Call after nmgr_task_init().
+ *
+ * @param prio                  Priority of the worker task; normally
+ *                                  lower than that of the newtmgr task.
+ * @param stack_ptr             Stack for the worker task.
+ * @param stack_len             Size of the stack, in os_stack_t units.
+ *
+ * @return                      0 on success; nonzero on failure.
+ */
+int
+nmgr_worker_init(uint8_t prio, os_stack_t *stack_ptr, uint16_t stack_len)
+{
+    int rc;
+
+    os_eventq_init(&g_nmgr_worker_evq);
+    nmgr_jbuf_init(&nmgr_worker_jbuf);
+
+    rc = os_mutex_init(&g_nmgr_worker_lock);
+    if (rc != 0) {
+        goto err;
+    }
+
+    rc = os_task_init(&g_nmgr_worker_task, "newtmgr_w", nmgr_worker_task,
+            NULL, prio, OS_WAIT_FOREVER, stack_ptr, stack_len);
+    if (rc != 0) {
+        goto err;
+    }
+    nmgr_worker_on = 1;
+
+    return (0);
+err:
+    return (rc);
+}
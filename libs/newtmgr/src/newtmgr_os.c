@@ -187,7 +187,7 @@ nmgr_datetime_set(struct nmgr_jbuf *njb)
         }
     };
 
-    rc = json_read_object(&njb->njb_buf, datetime_write_attr);
+    rc = nmgr_read_object(njb, datetime_write_attr);
     if (rc) {
         rc = OS_EINVAL;
         goto out;
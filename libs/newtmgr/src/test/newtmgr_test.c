@@ -0,0 +1,587 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include "testutil/testutil.h"
+#include "os/os.h"
+#include "os/endian.h"
+#include "newtmgr/newtmgr.h"
+
+/* Small blocks, so that a request spans many segments. */
+#define NMGR_TEST_BUF_SIZE      (48)
+#define NMGR_TEST_BUF_COUNT     (64)
+#define NMGR_TEST_REQ_LEN       (512)
+#define NMGR_TEST_NAME_LEN      (400)
+
+#define NMGR_TEST_GROUP         (NMGR_GROUP_ID_PERUSER)
+#define NMGR_TEST_ID_FAIL       0
+#define NMGR_TEST_ID_SLOW       1
+
+/* Requests come in on the shell (NLIP) transport. */
+extern struct nmgr_transport g_nmgr_shell_transport;
+
+static os_membuf_t nmgr_test_membuf[OS_MEMPOOL_SIZE(NMGR_TEST_BUF_COUNT,
+        NMGR_TEST_BUF_SIZE)];
+static struct os_mempool nmgr_test_mempool;
+static struct os_mbuf_pool nmgr_test_mbuf_pool;
+
+static char nmgr_test_req[NMGR_TEST_REQ_LEN + 1];
+static char nmgr_test_name[NMGR_TEST_NAME_LEN + 1];
+
+static os_stack_t nmgr_test_stack[OS_STACK_ALIGN(1024)];
+static os_stack_t nmgr_test_worker_stack[OS_STACK_ALIGN(1024)];
+static uint8_t nmgr_test_rsp[NMGR_MAX_MTU];
+static int nmgr_test_rsp_len;
+static int nmgr_test_rsp_cnt;
+static uint16_t nmgr_test_mtu;
+
+static void
+nmgr_test_setup(void)
+{
+    int rc;
+
+    rc = os_mempool_init(&nmgr_test_mempool, NMGR_TEST_BUF_COUNT,
+            NMGR_TEST_BUF_SIZE, nmgr_test_membuf, "nmgr_test");
+    TEST_ASSERT_FATAL(rc == 0);
+
+    rc = os_mbuf_pool_init(&nmgr_test_mbuf_pool, &nmgr_test_mempool,
+            NMGR_TEST_BUF_SIZE, NMGR_TEST_BUF_COUNT);
+    TEST_ASSERT_FATAL(rc == 0);
+}
+
+/*
+ * Builds a 512 byte request, padded with whitespace, in an mbuf chain.
+ */
+static struct os_mbuf *
+nmgr_test_req_build(int *len)
+{
+    struct os_mbuf *m;
+    int rc;
+    int i;
+
+    for (i = 0; i < NMGR_TEST_NAME_LEN; i++) {
+        nmgr_test_name[i] = 'a' + i % 26;
+    }
+    nmgr_test_name[i] = '\0';
+
+    *len = snprintf(nmgr_test_req, sizeof(nmgr_test_req),
+            "{\"off\": 4096, \"name\": \"%s\", \"arr\": [1, 22, 333]",
+            nmgr_test_name);
+    while (*len < NMGR_TEST_REQ_LEN - 1) {
+        nmgr_test_req[(*len)++] = ' ';
+    }
+    nmgr_test_req[(*len)++] = '}';
+
+    m = os_mbuf_get_pkthdr(&nmgr_test_mbuf_pool, 0);
+    TEST_ASSERT_FATAL(m != NULL);
+    rc = os_mbuf_append(m, nmgr_test_req, *len);
+    TEST_ASSERT_FATAL(rc == 0);
+    TEST_ASSERT_FATAL(SLIST_NEXT(m, om_next) != NULL);
+
+    return (m);
+}
+
+TEST_CASE(nmgr_test_jbuf_decode_split)
+{
+    struct nmgr_jbuf njb;
+    struct os_mbuf *m;
+    long long unsigned int off;
+    long long int arr[4];
+    char name[NMGR_TEST_NAME_LEN + 1];
+    int arr_cnt;
+    int len;
+    int rc;
+    const struct json_attr_t attrs[] = {
+        [0] = {
+            .attribute = "off",
+            .type = t_uinteger,
+            .addr.uinteger = &off,
+        },
+        [1] = {
+            .attribute = "name",
+            .type = t_string,
+            .addr.string = name,
+            .len = sizeof(name)
+        },
+        [2] = {
+            .attribute = "arr",
+            .type = t_array,
+            .addr.array = {
+                .element_type = t_integer,
+                .arr.integers.store = arr,
+                .maxlen = sizeof arr / sizeof arr[0],
+                .count = &arr_cnt,
+            },
+        },
+        [3] = {
+            .attribute = NULL
+        }
+    };
+
+    nmgr_test_setup();
+    m = nmgr_test_req_build(&len);
+
+    nmgr_jbuf_init(&njb);
+    rc = nmgr_jbuf_setibuf(&njb, m, 0, len);
+    TEST_ASSERT(rc == 0);
+
+    rc = json_read_object(&njb.njb_buf, attrs);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(off == 4096);
+    TEST_ASSERT(strcmp(name, nmgr_test_name) == 0);
+    TEST_ASSERT(arr_cnt == 3);
+    TEST_ASSERT(arr[0] == 1 && arr[1] == 22 && arr[2] == 333);
+
+    os_mbuf_free_chain(m);
+}
+
+TEST_CASE(nmgr_test_jbuf_read_span)
+{
+    struct nmgr_jbuf njb;
+    struct os_mbuf *m;
+    char buf[NMGR_TEST_REQ_LEN];
+    char c;
+    int len;
+    int rc;
+    int i;
+
+    nmgr_test_setup();
+    m = nmgr_test_req_build(&len);
+
+    /* Bulk read from an offset into the chain, across segments. */
+    nmgr_jbuf_init(&njb);
+    nmgr_jbuf_setibuf(&njb, m, 5, len - 5);
+    rc = njb.njb_buf.jb_readn(&njb.njb_buf, buf, sizeof(buf));
+    TEST_ASSERT(rc == len - 5);
+    TEST_ASSERT(memcmp(buf, nmgr_test_req + 5, len - 5) == 0);
+    TEST_ASSERT(njb.njb_buf.jb_read_next(&njb.njb_buf) == '\0');
+
+    /* Walk back to the start, then forward again. */
+    for (i = len - 1; i >= 5; i--) {
+        c = njb.njb_buf.jb_read_prev(&njb.njb_buf);
+        TEST_ASSERT(c == nmgr_test_req[i]);
+    }
+    for (i = 5; i < len; i++) {
+        c = njb.njb_buf.jb_read_next(&njb.njb_buf);
+        TEST_ASSERT(c == nmgr_test_req[i]);
+    }
+
+    os_mbuf_free_chain(m);
+}
+
+static int
+nmgr_test_ok(struct nmgr_jbuf *njb)
+{
+    nmgr_jbuf_setoerr(njb, 0);
+    return 0;
+}
+
+static int
+nmgr_test_fail(struct nmgr_jbuf *njb)
+{
+    nmgr_jbuf_setoerr(njb, 0);
+    return OS_EINVAL;
+}
+
+static const struct nmgr_handler nmgr_test_handlers[] = {
+    [NMGR_TEST_ID_FAIL] = {
+        .nh_read = nmgr_test_fail
+    },
+    [NMGR_TEST_ID_SLOW] = {
+        .nh_read = nmgr_test_ok,
+        .nh_flags = NMGR_HANDLER_F_SLOW
+    }
+};
+
+static struct nmgr_group nmgr_test_group = {
+    .ng_handlers = (struct nmgr_handler *)nmgr_test_handlers,
+    .ng_handlers_count =
+    sizeof(nmgr_test_handlers) / sizeof(nmgr_test_handlers[0]),
+    .ng_group_id = NMGR_TEST_GROUP,
+};
+
+static int
+nmgr_test_out(struct nmgr_transport *nt, struct os_mbuf *m)
+{
+    nmgr_test_rsp_len = OS_MBUF_PKTLEN(m);
+    TEST_ASSERT_FATAL(nmgr_test_rsp_len <= sizeof(nmgr_test_rsp));
+    os_mbuf_copydata(m, 0, nmgr_test_rsp_len, nmgr_test_rsp);
+    os_mbuf_free_chain(m);
+    nmgr_test_rsp_cnt++;
+
+    return 0;
+}
+
+static uint16_t
+nmgr_test_mtu_get(struct nmgr_transport *nt, struct os_mbuf *req)
+{
+    return nmgr_test_mtu;
+}
+
+static void
+nmgr_test_batch_setup(void)
+{
+    static int initialized;
+    int rc;
+
+    nmgr_test_setup();
+    if (!initialized) {
+        rc = os_msys_register(&nmgr_test_mbuf_pool);
+        TEST_ASSERT_FATAL(rc == 0);
+
+        rc = nmgr_task_init(10, nmgr_test_stack,
+                sizeof(nmgr_test_stack) / sizeof(os_stack_t));
+        TEST_ASSERT_FATAL(rc == 0);
+        nmgr_jbuf_init(&nmgr_task_jbuf);
+
+        rc = nmgr_group_register(&nmgr_test_group);
+        TEST_ASSERT_FATAL(rc == 0);
+        initialized = 1;
+    }
+
+    /* Catch what would be NLIP encoded onto the console. */
+    g_nmgr_shell_transport.nt_output = nmgr_test_out;
+    g_nmgr_shell_transport.nt_mtu = nmgr_test_mtu_get;
+    nmgr_test_mtu = 0;
+}
+
+static void
+nmgr_test_cmd_add(struct os_mbuf *m, uint8_t op, uint16_t group, uint8_t id,
+        uint8_t seq, const char *payload)
+{
+    struct nmgr_hdr hdr;
+    int rc;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.nh_op = op;
+    hdr.nh_len = htons(strlen(payload));
+    hdr.nh_group = htons(group);
+    hdr.nh_id = id;
+    hdr.nh_seq = seq;
+
+    rc = os_mbuf_append(m, &hdr, sizeof(hdr));
+    TEST_ASSERT_FATAL(rc == 0);
+    rc = os_mbuf_append(m, payload, strlen(payload));
+    TEST_ASSERT_FATAL(rc == 0);
+
+    /* Pad to 4 bytes, like the request framing. */
+    rc = os_mbuf_append(m, "\0\0\0", OS_ALIGN(strlen(payload), 4) -
+            strlen(payload));
+    TEST_ASSERT_FATAL(rc == 0);
+}
+
+/*
+ * Sends a batch holding the commands in 'cmds'; returns 1 if a response
+ * came back.
+ */
+static int
+nmgr_test_batch_send(struct os_mbuf *cmds)
+{
+    struct nmgr_hdr hdr;
+    struct os_mbuf *m;
+    int cnt;
+    int rc;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.nh_op = NMGR_OP_READ;
+    hdr.nh_len = htons(OS_MBUF_PKTLEN(cmds));
+    hdr.nh_group = htons(NMGR_GROUP_ID_DEFAULT);
+    hdr.nh_id = NMGR_ID_BATCH;
+
+    m = os_msys_get_pkthdr(0, 0);
+    TEST_ASSERT_FATAL(m != NULL);
+    rc = os_mbuf_append(m, &hdr, sizeof(hdr));
+    TEST_ASSERT_FATAL(rc == 0);
+    os_mbuf_concat(m, cmds);
+
+    cnt = nmgr_test_rsp_cnt;
+    rc = nmgr_rx_req(&g_nmgr_shell_transport, m);
+    TEST_ASSERT_FATAL(rc == 0);
+    nmgr_process(&g_nmgr_shell_transport);
+
+    return nmgr_test_rsp_cnt != cnt;
+}
+
+/*
+ * Checks that response 'idx' in the batch response is for the given
+ * command, and carries 'payload'.
+ */
+static void
+nmgr_test_batch_rsp_check(int idx, uint16_t group, uint8_t id, uint8_t seq,
+        const char *payload)
+{
+    struct nmgr_hdr *hdr;
+    int off;
+    int i;
+
+    hdr = (struct nmgr_hdr *)nmgr_test_rsp;
+    off = sizeof(*hdr);
+    for (i = 0; i <= idx; i++) {
+        TEST_ASSERT_FATAL(off + sizeof(*hdr) <= nmgr_test_rsp_len);
+        hdr = (struct nmgr_hdr *)(nmgr_test_rsp + off);
+        off += sizeof(*hdr) + ntohs(hdr->nh_len);
+        TEST_ASSERT_FATAL(off <= nmgr_test_rsp_len);
+    }
+    TEST_ASSERT(hdr->nh_op == NMGR_OP_READ_RSP);
+    TEST_ASSERT(ntohs(hdr->nh_group) == group);
+    TEST_ASSERT(hdr->nh_id == id);
+    TEST_ASSERT(hdr->nh_seq == seq);
+    TEST_ASSERT(ntohs(hdr->nh_len) == strlen(payload));
+    TEST_ASSERT(!memcmp(hdr + 1, payload, strlen(payload)));
+}
+
+/*
+ * Returns the number of responses in the batch response, after checking
+ * that they add up to its length.
+ */
+static int
+nmgr_test_batch_rsp_cnt(void)
+{
+    struct nmgr_hdr *hdr;
+    int off;
+    int cnt;
+
+    hdr = (struct nmgr_hdr *)nmgr_test_rsp;
+    TEST_ASSERT_FATAL(nmgr_test_rsp_len >= sizeof(*hdr));
+    TEST_ASSERT(hdr->nh_op == NMGR_OP_READ_RSP);
+    TEST_ASSERT(ntohs(hdr->nh_group) == NMGR_GROUP_ID_DEFAULT);
+    TEST_ASSERT(hdr->nh_id == NMGR_ID_BATCH);
+    TEST_ASSERT(sizeof(*hdr) + ntohs(hdr->nh_len) == nmgr_test_rsp_len);
+
+    cnt = 0;
+    for (off = sizeof(*hdr); off < nmgr_test_rsp_len;
+      off += sizeof(*hdr) + ntohs(hdr->nh_len)) {
+        hdr = (struct nmgr_hdr *)(nmgr_test_rsp + off);
+        cnt++;
+    }
+    TEST_ASSERT(off == nmgr_test_rsp_len);
+
+    return cnt;
+}
+
+TEST_CASE(nmgr_test_batch)
+{
+    struct os_mbuf *m;
+
+    nmgr_test_batch_setup();
+
+    m = os_msys_get_pkthdr(0, 0);
+    TEST_ASSERT_FATAL(m != NULL);
+    nmgr_test_cmd_add(m, NMGR_OP_READ, NMGR_GROUP_ID_DEFAULT, NMGR_ID_ECHO,
+            1, "{\"d\":\"one\"}");
+    nmgr_test_cmd_add(m, NMGR_OP_READ, NMGR_GROUP_ID_DEFAULT, NMGR_ID_ECHO,
+            2, "{\"d\":\"two\"}");
+    nmgr_test_cmd_add(m, NMGR_OP_READ, NMGR_GROUP_ID_DEFAULT, NMGR_ID_ECHO,
+            3, "{\"d\":\"three\"}");
+    TEST_ASSERT_FATAL(nmgr_test_batch_send(m));
+
+    TEST_ASSERT(nmgr_test_batch_rsp_cnt() == 3);
+    nmgr_test_batch_rsp_check(0, NMGR_GROUP_ID_DEFAULT, NMGR_ID_ECHO, 1,
+            "{\"r\": \"one\"}");
+    nmgr_test_batch_rsp_check(1, NMGR_GROUP_ID_DEFAULT, NMGR_ID_ECHO, 2,
+            "{\"r\": \"two\"}");
+    nmgr_test_batch_rsp_check(2, NMGR_GROUP_ID_DEFAULT, NMGR_ID_ECHO, 3,
+            "{\"r\": \"three\"}");
+}
+
+TEST_CASE(nmgr_test_batch_refused)
+{
+    struct os_mbuf *m;
+
+    nmgr_test_batch_setup();
+
+    /* Write, failing handler, slow handler, unknown id, nested batch. */
+    m = os_msys_get_pkthdr(0, 0);
+    TEST_ASSERT_FATAL(m != NULL);
+    nmgr_test_cmd_add(m, NMGR_OP_WRITE, NMGR_GROUP_ID_DEFAULT, NMGR_ID_ECHO,
+            1, "{\"d\":\"x\"}");
+    nmgr_test_cmd_add(m, NMGR_OP_READ, NMGR_TEST_GROUP, NMGR_TEST_ID_FAIL,
+            2, "{}");
+    nmgr_test_cmd_add(m, NMGR_OP_READ, NMGR_TEST_GROUP, NMGR_TEST_ID_SLOW,
+            3, "{}");
+    nmgr_test_cmd_add(m, NMGR_OP_READ, NMGR_TEST_GROUP, 9, 4, "{}");
+    nmgr_test_cmd_add(m, NMGR_OP_READ, NMGR_GROUP_ID_DEFAULT, NMGR_ID_BATCH,
+            5, "");
+    nmgr_test_cmd_add(m, NMGR_OP_READ, NMGR_GROUP_ID_DEFAULT, NMGR_ID_ECHO,
+            6, "{\"d\":\"ok\"}");
+    TEST_ASSERT_FATAL(nmgr_test_batch_send(m));
+
+    TEST_ASSERT(nmgr_test_batch_rsp_cnt() == 6);
+    nmgr_test_batch_rsp_check(0, NMGR_GROUP_ID_DEFAULT, NMGR_ID_ECHO, 1,
+            "{\"rc\": 3}");
+    nmgr_test_batch_rsp_check(1, NMGR_TEST_GROUP, NMGR_TEST_ID_FAIL, 2,
+            "{\"rc\": 3}");
+    nmgr_test_batch_rsp_check(2, NMGR_TEST_GROUP, NMGR_TEST_ID_SLOW, 3,
+            "{\"rc\": 3}");
+    nmgr_test_batch_rsp_check(3, NMGR_TEST_GROUP, 9, 4, "{\"rc\": 3}");
+    nmgr_test_batch_rsp_check(4, NMGR_GROUP_ID_DEFAULT, NMGR_ID_BATCH, 5,
+            "{\"rc\": 3}");
+    nmgr_test_batch_rsp_check(5, NMGR_GROUP_ID_DEFAULT, NMGR_ID_ECHO, 6,
+            "{\"r\": \"ok\"}");
+
+    /* A truncated command makes the whole batch invalid. */
+    m = os_msys_get_pkthdr(0, 0);
+    TEST_ASSERT_FATAL(m != NULL);
+    nmgr_test_cmd_add(m, NMGR_OP_READ, NMGR_GROUP_ID_DEFAULT, NMGR_ID_ECHO,
+            1, "{\"d\":\"one\"}");
+    TEST_ASSERT_FATAL(os_mbuf_append(m, "\0\0", 2) == 0);
+    TEST_ASSERT(!nmgr_test_batch_send(m));
+}
+
+TEST_CASE(nmgr_test_batch_mtu)
+{
+    struct os_mbuf *m;
+    int i;
+
+    nmgr_test_batch_setup();
+
+    /* Room for the batch header and three responses, not four. */
+    nmgr_test_mtu = sizeof(struct nmgr_hdr) +
+        3 * (sizeof(struct nmgr_hdr) + strlen("{\"r\": \"abc\"}")) + 10;
+
+    m = os_msys_get_pkthdr(0, 0);
+    TEST_ASSERT_FATAL(m != NULL);
+    for (i = 0; i < 5; i++) {
+        nmgr_test_cmd_add(m, NMGR_OP_READ, NMGR_GROUP_ID_DEFAULT,
+                NMGR_ID_ECHO, i, "{\"d\":\"abc\"}");
+    }
+    TEST_ASSERT_FATAL(nmgr_test_batch_send(m));
+
+    TEST_ASSERT(nmgr_test_rsp_len <= nmgr_test_mtu);
+    TEST_ASSERT(nmgr_test_batch_rsp_cnt() == 3);
+    for (i = 0; i < 3; i++) {
+        nmgr_test_batch_rsp_check(i, NMGR_GROUP_ID_DEFAULT, NMGR_ID_ECHO, i,
+                "{\"r\": \"abc\"}");
+    }
+}
+
+/*
+ * Sends the commands in 'm' as one request; returns 1 if a response came
+ * back from the newtmgr task.
+ */
+static int
+nmgr_test_req_send(struct os_mbuf *m)
+{
+    int cnt;
+    int rc;
+
+    cnt = nmgr_test_rsp_cnt;
+    rc = nmgr_rx_req(&g_nmgr_shell_transport, m);
+    TEST_ASSERT_FATAL(rc == 0);
+    nmgr_process(&g_nmgr_shell_transport);
+
+    return nmgr_test_rsp_cnt != cnt;
+}
+
+/*
+ * Checks that the last response holds exactly one command response.
+ */
+static void
+nmgr_test_rsp_check(uint16_t group, uint8_t id, uint8_t seq,
+        const char *payload)
+{
+    struct nmgr_hdr *hdr;
+
+    hdr = (struct nmgr_hdr *)nmgr_test_rsp;
+    TEST_ASSERT_FATAL(nmgr_test_rsp_len ==
+            sizeof(*hdr) + strlen(payload));
+    TEST_ASSERT(hdr->nh_op == NMGR_OP_READ_RSP);
+    TEST_ASSERT(ntohs(hdr->nh_group) == group);
+    TEST_ASSERT(hdr->nh_id == id);
+    TEST_ASSERT(hdr->nh_seq == seq);
+    TEST_ASSERT(ntohs(hdr->nh_len) == strlen(payload));
+    TEST_ASSERT(!memcmp(hdr + 1, payload, strlen(payload)));
+}
+
+/*
+ * Runs after the other batch tests; once the worker is on, slow commands
+ * are deferred for good.
+ */
+TEST_CASE(nmgr_test_worker)
+{
+    struct os_mbuf *m;
+    int cnt;
+    int rc;
+
+    nmgr_test_batch_setup();
+    rc = nmgr_worker_init(11, nmgr_test_worker_stack,
+            sizeof(nmgr_test_worker_stack) / sizeof(os_stack_t));
+    TEST_ASSERT_FATAL(rc == 0);
+
+    /* All commands deferred: the worker sends the only reply. */
+    m = os_msys_get_pkthdr(0, 0);
+    TEST_ASSERT_FATAL(m != NULL);
+    nmgr_test_cmd_add(m, NMGR_OP_READ, NMGR_TEST_GROUP, NMGR_TEST_ID_SLOW,
+            1, "{}");
+    TEST_ASSERT(!nmgr_test_req_send(m));
+
+    cnt = nmgr_test_rsp_cnt;
+    nmgr_worker_process(&g_nmgr_shell_transport);
+    TEST_ASSERT_FATAL(nmgr_test_rsp_cnt == cnt + 1);
+    nmgr_test_rsp_check(NMGR_TEST_GROUP, NMGR_TEST_ID_SLOW, 1,
+            "{\"rc\": 0}");
+
+    /* Mixed: the rest is answered at once, the slow one after. */
+    m = os_msys_get_pkthdr(0, 0);
+    TEST_ASSERT_FATAL(m != NULL);
+    nmgr_test_cmd_add(m, NMGR_OP_READ, NMGR_TEST_GROUP, NMGR_TEST_ID_SLOW,
+            2, "{}");
+    nmgr_test_cmd_add(m, NMGR_OP_READ, NMGR_GROUP_ID_DEFAULT, NMGR_ID_ECHO,
+            3, "{\"d\":\"x\"}");
+    TEST_ASSERT_FATAL(nmgr_test_req_send(m));
+    nmgr_test_rsp_check(NMGR_GROUP_ID_DEFAULT, NMGR_ID_ECHO, 3,
+            "{\"r\": \"x\"}");
+
+    cnt = nmgr_test_rsp_cnt;
+    nmgr_worker_process(&g_nmgr_shell_transport);
+    TEST_ASSERT_FATAL(nmgr_test_rsp_cnt == cnt + 1);
+    nmgr_test_rsp_check(NMGR_TEST_GROUP, NMGR_TEST_ID_SLOW, 2,
+            "{\"rc\": 0}");
+}
+
+TEST_SUITE(nmgr_batch_test_suite)
+{
+    nmgr_test_batch();
+    nmgr_test_batch_refused();
+    nmgr_test_batch_mtu();
+    nmgr_test_worker();
+}
+
+TEST_SUITE(nmgr_jbuf_test_suite)
+{
+    nmgr_test_jbuf_decode_split();
+    nmgr_test_jbuf_read_span();
+}
+
+#ifdef MYNEWT_SELFTEST
+
+int
+main(int argc, char **argv)
+{
+    tu_config.tc_print_results = 1;
+    tu_init();
+
+    nmgr_jbuf_test_suite();
+    nmgr_batch_test_suite();
+
+    return tu_any_failed;
+}
+
+#endif
@@ -203,6 +203,25 @@ err:
     return (rc);
 }
 
+/*
+ * Responses go out in a single notification, which carries ATT MTU - 3
+ * bytes of value.
+ */
+static uint16_t
+nmgr_ble_mtu(struct nmgr_transport *nt, struct os_mbuf *req)
+{
+    uint16_t conn_handle;
+    uint16_t mtu;
+
+    memcpy(&conn_handle, OS_MBUF_USRHDR(req), sizeof (conn_handle));
+    mtu = ble_att_mtu(conn_handle);
+    if (mtu < 3) {
+        return 0;
+    }
+
+    return mtu - 3;
+}
+
 /**
  * Nmgr ble GATT server initialization
  *
@@ -231,6 +250,7 @@ nmgr_ble_gatt_svr_init(struct os_eventq *evq, struct ble_hs_cfg *cfg)
     os_mqueue_init(&ble_nmgr_mq, &ble_nmgr_mq);
 
     rc = nmgr_transport_init(&ble_nt, &nmgr_ble_out);
+    ble_nt.nt_mtu = nmgr_ble_mtu;
 
 err:
     return rc;
@@ -24,8 +24,18 @@
 struct cbmem_entry_hdr {
     uint16_t ceh_len;
     uint16_t ceh_flags;
+    uint32_t ceh_seq;
 } __attribute__((packed));
 
+/* Entry is reserved but its data has not been committed yet. */
+#define CBMEM_ENTRY_F_BUSY  (0x0001)
+
+/*
+ * Appends are interrupt safe: an entry is reserved inside a short critical
+ * section, its data copied in with interrupts enabled, and then committed.
+ * Each entry carries a sequence number; readers use it to detect entries
+ * that got overwritten while they were looking at them.
+ */
 struct cbmem {
     struct os_mutex c_lock;
 
@@ -34,18 +44,33 @@ struct cbmem {
     uint8_t *c_buf;
     uint8_t *c_buf_end;
     uint8_t *c_buf_cur_end;
+
+    /* Sequence number of c_entry_start, and of the next entry. */
+    uint32_t c_start_seq;
+    uint32_t c_next_seq;
+    /* Number of reserved, uncommitted entries. */
+    uint16_t c_busy;
 };
 
 struct cbmem_iter {
     struct cbmem_entry_hdr *ci_start;
     struct cbmem_entry_hdr *ci_cur;
     struct cbmem_entry_hdr *ci_end;
+    uint32_t ci_seq;
+    uint32_t ci_end_seq;
+
+    /* Entry last returned by cbmem_iter_next(). */
+    struct cbmem_entry_hdr *ci_last;
+    uint32_t ci_last_seq;
+    uint16_t ci_last_len;
 };
 
 #define CBMEM_ENTRY_SIZE(__p) (sizeof(struct cbmem_entry_hdr) \
         + ((struct cbmem_entry_hdr *) (__p))->ceh_len)
 #define CBMEM_ENTRY_NEXT(__p) ((struct cbmem_entry_hdr *) \
         ((uint8_t *) (__p) + CBMEM_ENTRY_SIZE(__p)))
+#define CBMEM_ENTRY_DATA(__p) ((void *) \
+        ((uint8_t *) (__p) + sizeof(struct cbmem_entry_hdr)))
 
 typedef int (*cbmem_walk_func_t)(struct cbmem *, struct cbmem_entry_hdr *, 
         void *arg);
@@ -54,11 +79,15 @@ int cbmem_lock_acquire(struct cbmem *cbmem);
 int cbmem_lock_release(struct cbmem *cbmem);
 int cbmem_init(struct cbmem *cbmem, void *buf, uint32_t buf_len);
 int cbmem_append(struct cbmem *cbmem, void *data, uint16_t len);
+struct cbmem_entry_hdr *cbmem_reserve(struct cbmem *cbmem, uint16_t len);
+void cbmem_commit(struct cbmem *cbmem, struct cbmem_entry_hdr *hdr);
 void cbmem_iter_start(struct cbmem *cbmem, struct cbmem_iter *iter);
 struct cbmem_entry_hdr *cbmem_iter_next(struct cbmem *cbmem, 
         struct cbmem_iter *iter);
 int cbmem_read(struct cbmem *cbmem, struct cbmem_entry_hdr *hdr, void *buf, 
         uint16_t off, uint16_t len);
+int cbmem_iter_read(struct cbmem *cbmem, struct cbmem_iter *iter, void *buf,
+        uint16_t off, uint16_t len);
 int cbmem_walk(struct cbmem *cbmem, cbmem_walk_func_t walk_func, void *arg);
 
 int cbmem_flush(struct cbmem *);
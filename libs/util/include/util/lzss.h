@@ -0,0 +1,93 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#ifndef __UTIL_LZSS_H__
+#define __UTIL_LZSS_H__
+
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Small-footprint LZ77 (LZSS) codec, in the style of heatshrink.
+ *
+ * The output is a bit stream of tokens, most significant bit first:
+ *     literal:    1 <8 bit byte>
+ *     back-ref:   0 <WINDOW_BITS bit distance - 1>
+ *                   <LENGTH_BITS bit length - LZSS_MIN_MATCH>
+ *
+ * The encoder works on a contiguous input buffer and needs no RAM besides
+ * the destination.  The decoder accepts its input in arbitrarily sized
+ * pieces and decodes into a caller supplied buffer which doubles as the
+ * back-reference window, so its RAM cost is the size of the decoded data
+ * plus a few bytes of state.  For output which does not fit in RAM, the
+ * ring decoder (lzss_rdec) keeps only the last LZSS_WINDOW_SIZE bytes and
+ * hands decoded data to a callback.
+ */
+
+#ifndef LZSS_WINDOW_BITS
+#define LZSS_WINDOW_BITS        (8)
+#endif
+
+#ifndef LZSS_LENGTH_BITS
+#define LZSS_LENGTH_BITS        (4)
+#endif
+
+#define LZSS_WINDOW_SIZE        (1 << LZSS_WINDOW_BITS)
+#define LZSS_MIN_MATCH          (2)
+#define LZSS_MAX_MATCH          ((1 << LZSS_LENGTH_BITS) + LZSS_MIN_MATCH - 1)
+
+struct lzss_dec {
+    uint8_t *ld_buf;
+    uint16_t ld_size;
+    uint16_t ld_off;
+    uint32_t ld_bits;
+    uint8_t ld_nbits;
+};
+
+/**
+ * Receives output from the ring decoder.  Returns 0 to continue decoding;
+ * any other value aborts, and is returned by lzss_rdec_feed().
+ */
+typedef int lzss_out_func(void *arg, const uint8_t *data, int len);
+
+struct lzss_rdec {
+    uint8_t lr_win[LZSS_WINDOW_SIZE];
+    uint32_t lr_off;
+    uint32_t lr_flushed;
+    uint32_t lr_bits;
+    uint8_t lr_nbits;
+};
+
+int lzss_encode(const uint8_t *src, int src_len, uint8_t *dst, int dst_len);
+
+void lzss_dec_init(struct lzss_dec *dec, uint8_t *buf, uint16_t size);
+int lzss_dec_feed(struct lzss_dec *dec, const uint8_t *data, int len);
+int lzss_decode(const uint8_t *src, int src_len, uint8_t *dst, int dst_len);
+
+void lzss_rdec_init(struct lzss_rdec *dec);
+int lzss_rdec_feed(struct lzss_rdec *dec, const uint8_t *data, int len,
+                   lzss_out_func *out, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UTIL_LZSS_H__ */
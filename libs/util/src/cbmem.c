@@ -23,14 +23,18 @@
 #include "util/cbmem.h" 
 
 
+/* Wrap-safe sequence number comparison. */
+#define CBMEM_SEQ_LT(__a, __b) ((int32_t) ((__a) - (__b)) < 0)
+
 int 
 cbmem_init(struct cbmem *cbmem, void *buf, uint32_t buf_len)
 {
+    memset(cbmem, 0, sizeof(*cbmem));
     os_mutex_init(&cbmem->c_lock);
 
-    memset(cbmem, 0, sizeof(*cbmem));
     cbmem->c_buf = buf;
     cbmem->c_buf_end = buf + buf_len;
+    cbmem->c_buf_cur_end = cbmem->c_buf_end;
 
     return (0);
 }
@@ -74,19 +78,66 @@ err:
 }
 
 
-int 
-cbmem_append(struct cbmem *cbmem, void *data, uint16_t len)
+/**
+ * Drops the oldest entry.  Called with interrupts disabled.
+ *
+ * @return 0 on success; -1 if the oldest entry is still being written.
+ */
+static int
+cbmem_drop_oldest(struct cbmem *cbmem)
+{
+    struct cbmem_entry_hdr *hdr;
+    uint8_t *next;
+
+    hdr = cbmem->c_entry_start;
+    if (hdr->ceh_flags & CBMEM_ENTRY_F_BUSY) {
+        return (-1);
+    }
+
+    if (hdr == cbmem->c_entry_end) {
+        cbmem->c_entry_start = NULL;
+    } else {
+        next = (uint8_t *) CBMEM_ENTRY_NEXT(hdr);
+        if (next >= cbmem->c_buf_cur_end) {
+            /* Nothing is left past the wrap point. */
+            next = cbmem->c_buf;
+            cbmem->c_buf_cur_end = cbmem->c_buf_end;
+        }
+        cbmem->c_entry_start = (struct cbmem_entry_hdr *) next;
+    }
+    cbmem->c_start_seq++;
+
+    return (0);
+}
+
+/**
+ * Reserves space for an entry.  This only disables interrupts for the
+ * bookkeeping, so it can be called from interrupt context.  The caller
+ * fills in CBMEM_ENTRY_DATA(hdr) and then calls cbmem_commit().  Readers
+ * skip the entry until it is committed.
+ *
+ * Old entries are overwritten to make room, unless an entry that would
+ * have to go is itself still reserved; then the reservation fails.
+ *
+ * @param cbmem The circular buffer.
+ * @param len The length of the entry data.
+ *
+ * @return The reserved entry; NULL if it could not be reserved.
+ */
+struct cbmem_entry_hdr *
+cbmem_reserve(struct cbmem *cbmem, uint16_t len)
 {
     struct cbmem_entry_hdr *dst;
     uint8_t *start;
     uint8_t *end;
-    int rc;
+    os_sr_t sr;
 
-    rc = cbmem_lock_acquire(cbmem);
-    if (rc != 0) {
-        goto err;
+    if (len + sizeof(*dst) > cbmem->c_buf_end - cbmem->c_buf) {
+        return (NULL);
     }
 
+    OS_ENTER_CRITICAL(sr);
+
     if (cbmem->c_entry_end) {
         dst = CBMEM_ENTRY_NEXT(cbmem->c_entry_end);
     } else {
@@ -94,151 +145,277 @@ cbmem_append(struct cbmem *cbmem, void *data, uint16_t len)
     }
     end = (uint8_t *) dst + len + sizeof(*dst);
 
-    /* If this item would take us past the end of this buffer, then adjust 
-     * the item to the beginning of the buffer.
+    /* If this item would take us past the end of this buffer, then drop
+     * whatever is stored after it and wrap to the beginning of the buffer.
      */
     if (end > cbmem->c_buf_end) {
+        while (cbmem->c_entry_start &&
+               (uint8_t *) cbmem->c_entry_start >= (uint8_t *) dst) {
+            if (cbmem_drop_oldest(cbmem) != 0) {
+                goto err;
+            }
+        }
         cbmem->c_buf_cur_end = (uint8_t *) dst;
         dst = (struct cbmem_entry_hdr *) cbmem->c_buf;
         end = (uint8_t *) dst + len + sizeof(*dst);
-        if ((uint8_t *) cbmem->c_entry_start >= cbmem->c_buf_cur_end) {
-            cbmem->c_entry_start = (struct cbmem_entry_hdr *) cbmem->c_buf;
-        }
     }
 
-    /* If the destination is prior to the start, and would overrwrite the 
-     * start of the buffer, move start forward until you don't overwrite it
-     * anymore.
-     */
-    start = (uint8_t *) cbmem->c_entry_start;
-    if (start && (uint8_t *) dst < start + CBMEM_ENTRY_SIZE(start) && 
-            end > start) {
-        while (start < end) {
-            start = (uint8_t *) CBMEM_ENTRY_NEXT(start);
-            if (start == cbmem->c_buf_cur_end) {
-                start = cbmem->c_buf;
-                break;
-            }
+    /* Drop the oldest entries until they no longer overlap the new one. */
+    while (cbmem->c_entry_start) {
+        start = (uint8_t *) cbmem->c_entry_start;
+        if (start < (uint8_t *) dst || start >= end) {
+            break;
+        }
+        if (cbmem_drop_oldest(cbmem) != 0) {
+            goto err;
         }
-        cbmem->c_entry_start = (struct cbmem_entry_hdr *) start;
     }
 
-    /* Copy the entry into the log 
-     */
     dst->ceh_len = len;
-    memcpy((uint8_t *) dst + sizeof(*dst), data, len);
+    dst->ceh_flags = CBMEM_ENTRY_F_BUSY;
+    dst->ceh_seq = cbmem->c_next_seq++;
+    cbmem->c_busy++;
 
     cbmem->c_entry_end = dst;
     if (!cbmem->c_entry_start) {
         cbmem->c_entry_start = dst;
+        cbmem->c_start_seq = dst->ceh_seq;
     }
 
-    rc = cbmem_lock_release(cbmem);
-    if (rc != 0) {
-        goto err;
+    OS_EXIT_CRITICAL(sr);
+
+    return (dst);
+err:
+    OS_EXIT_CRITICAL(sr);
+    return (NULL);
+}
+
+/**
+ * Makes a reserved entry visible to readers.
+ *
+ * @param cbmem The circular buffer.
+ * @param hdr The entry returned by cbmem_reserve().
+ */
+void
+cbmem_commit(struct cbmem *cbmem, struct cbmem_entry_hdr *hdr)
+{
+    os_sr_t sr;
+
+    OS_ENTER_CRITICAL(sr);
+    hdr->ceh_flags &= ~CBMEM_ENTRY_F_BUSY;
+    cbmem->c_busy--;
+    OS_EXIT_CRITICAL(sr);
+}
+
+int 
+cbmem_append(struct cbmem *cbmem, void *data, uint16_t len)
+{
+    struct cbmem_entry_hdr *dst;
+
+    dst = cbmem_reserve(cbmem, len);
+    if (dst == NULL) {
+        return (-1);
     }
 
+    memcpy(CBMEM_ENTRY_DATA(dst), data, len);
+
+    cbmem_commit(cbmem, dst);
+
     return (0);
-err:
-    return (-1);
 }
 
 void 
 cbmem_iter_start(struct cbmem *cbmem, struct cbmem_iter *iter)
 {
+    os_sr_t sr;
+
+    OS_ENTER_CRITICAL(sr);
     iter->ci_start = cbmem->c_entry_start;
     iter->ci_cur = cbmem->c_entry_start;
     iter->ci_end = cbmem->c_entry_end;
+    iter->ci_seq = cbmem->c_start_seq;
+    iter->ci_end_seq = cbmem->c_next_seq - 1;
+    iter->ci_last = NULL;
+    OS_EXIT_CRITICAL(sr);
 }
 
+/**
+ * Returns the next committed entry.  Entries appended after
+ * cbmem_iter_start() are not returned.  If the iterator falls behind and
+ * its position gets overwritten, it continues with the oldest entry still
+ * present.
+ */
 struct cbmem_entry_hdr *
 cbmem_iter_next(struct cbmem *cbmem, struct cbmem_iter *iter)
 {
     struct cbmem_entry_hdr *hdr;
+    uint8_t *next;
+    os_sr_t sr;
 
-    if (iter->ci_start > iter->ci_end) {
-        hdr = iter->ci_cur;
-        iter->ci_cur = CBMEM_ENTRY_NEXT(iter->ci_cur);
+    OS_ENTER_CRITICAL(sr);
 
-        if ((uint8_t *) iter->ci_cur >= cbmem->c_buf_cur_end) {
-            iter->ci_cur = (struct cbmem_entry_hdr *) cbmem->c_buf;
-            iter->ci_start = (struct cbmem_entry_hdr *) cbmem->c_buf;
+    while (1) {
+        if (iter->ci_cur == NULL ||
+            CBMEM_SEQ_LT(iter->ci_end_seq, iter->ci_seq)) {
+            hdr = NULL;
+            break;
         }
-    } else {
-        hdr = iter->ci_cur;
-        if (!iter->ci_cur) {
-            goto err;
+
+        if (CBMEM_SEQ_LT(iter->ci_seq, cbmem->c_start_seq)) {
+            iter->ci_cur = cbmem->c_entry_start;
+            iter->ci_seq = cbmem->c_start_seq;
+            continue;
         }
 
-        if (hdr == CBMEM_ENTRY_NEXT(iter->ci_end)) {
-            hdr = NULL;
+        hdr = iter->ci_cur;
+        if (hdr == cbmem->c_entry_end) {
+            iter->ci_cur = NULL;
         } else {
-            iter->ci_cur = CBMEM_ENTRY_NEXT(iter->ci_cur);
+            next = (uint8_t *) CBMEM_ENTRY_NEXT(hdr);
+            if (next >= cbmem->c_buf_cur_end) {
+                next = cbmem->c_buf;
+            }
+            iter->ci_cur = (struct cbmem_entry_hdr *) next;
+        }
+        iter->ci_seq++;
+
+        if (!(hdr->ceh_flags & CBMEM_ENTRY_F_BUSY)) {
+            iter->ci_last = hdr;
+            iter->ci_last_seq = iter->ci_seq - 1;
+            iter->ci_last_len = hdr->ceh_len;
+            break;
         }
     }
 
-err:
+    OS_EXIT_CRITICAL(sr);
+
     return (hdr);
 }
 
 int
 cbmem_flush(struct cbmem *cbmem)
 {
-    int rc;
+    os_sr_t sr;
 
-    rc = cbmem_lock_acquire(cbmem);
-    if (rc != 0) {
-        goto err;
+    OS_ENTER_CRITICAL(sr);
+
+    /* Pending reservations would be written into reused space. */
+    if (cbmem->c_busy) {
+        OS_EXIT_CRITICAL(sr);
+        return (-1);
     }
 
     cbmem->c_entry_start = NULL;
     cbmem->c_entry_end = NULL;
-    cbmem->c_buf_cur_end = NULL;
+    cbmem->c_buf_cur_end = cbmem->c_buf_end;
+    cbmem->c_start_seq = cbmem->c_next_seq;
 
-    rc = cbmem_lock_release(cbmem);
-    if (rc != 0) {
-        goto err;
-    }
+    OS_EXIT_CRITICAL(sr);
 
     return (0);
-err:
-    return (rc);
 }
 
-int 
-cbmem_read(struct cbmem *cbmem, struct cbmem_entry_hdr *hdr, void *buf, 
-        uint16_t off, uint16_t len)
+/**
+ * Checks that an entry is still present and committed, and returns its
+ * length.  Called with interrupts disabled.
+ */
+static int
+cbmem_entry_valid(struct cbmem *cbmem, struct cbmem_entry_hdr *hdr,
+        uint32_t seq)
 {
-    int rc;
+    if (cbmem->c_entry_start == NULL ||
+            CBMEM_SEQ_LT(seq, cbmem->c_start_seq) ||
+            !CBMEM_SEQ_LT(seq, cbmem->c_next_seq)) {
+        return (-1);
+    }
+    if (hdr->ceh_seq != seq || (hdr->ceh_flags & CBMEM_ENTRY_F_BUSY)) {
+        return (-1);
+    }
+    if ((uint8_t *) CBMEM_ENTRY_NEXT(hdr) > cbmem->c_buf_end) {
+        return (-1);
+    }
+    return (hdr->ceh_len);
+}
 
-    rc = cbmem_lock_acquire(cbmem);
-    if (rc != 0) {
-        goto err;
+static int
+cbmem_read_seq(struct cbmem *cbmem, struct cbmem_entry_hdr *hdr,
+        uint32_t seq, void *buf, uint16_t off, uint16_t len)
+{
+    os_sr_t sr;
+    int elen;
+
+    OS_ENTER_CRITICAL(sr);
+    elen = cbmem_entry_valid(cbmem, hdr, seq);
+    OS_EXIT_CRITICAL(sr);
+
+    if (elen < 0 || off > elen) {
+        return (-1);
     }
 
     /* Only read the maximum number of bytes, if we exceed that, 
      * truncate the read.
      */
-    if (off + len > hdr->ceh_len) {
-        len = hdr->ceh_len - off;
+    if (off + len > elen) {
+        len = elen - off;
     }
 
-    if (off > hdr->ceh_len) {
-        rc = -1;
-        cbmem_lock_release(cbmem);
-        goto err;
-    }
+    memcpy(buf, (uint8_t *) CBMEM_ENTRY_DATA(hdr) + off, len);
 
-    memcpy(buf, (uint8_t *) hdr + sizeof(*hdr) + off, len);
+    /* Make sure no writer got to the entry while we were copying. */
+    OS_ENTER_CRITICAL(sr);
+    elen = cbmem_entry_valid(cbmem, hdr, seq);
+    OS_EXIT_CRITICAL(sr);
 
-    rc = cbmem_lock_release(cbmem);
-    if (rc != 0) {
-        goto err;
+    if (elen < 0) {
+        return (-1);
     }
 
     return (len);
-err:
-    return (-1);
+}
+
+/**
+ * Reads entry data.  The data is copied without blocking appends; if the
+ * entry gets overwritten during the copy the read fails.  An entry that
+ * was already replaced before the call may be read as the entry that
+ * replaced it; use cbmem_iter_read() to rule that out.
+ *
+ * @return The number of bytes read; -1 on error.
+ */
+int 
+cbmem_read(struct cbmem *cbmem, struct cbmem_entry_hdr *hdr, void *buf, 
+        uint16_t off, uint16_t len)
+{
+    uint32_t seq;
+    os_sr_t sr;
+
+    if ((uint8_t *) hdr < cbmem->c_buf ||
+            (uint8_t *) (hdr + 1) > cbmem->c_buf_end) {
+        return (-1);
+    }
+
+    OS_ENTER_CRITICAL(sr);
+    seq = hdr->ceh_seq;
+    OS_EXIT_CRITICAL(sr);
+
+    return (cbmem_read_seq(cbmem, hdr, seq, buf, off, len));
+}
+
+/**
+ * Reads data of the entry last returned by cbmem_iter_next().  Fails if
+ * that entry has been overwritten since.
+ *
+ * @return The number of bytes read; -1 on error.
+ */
+int
+cbmem_iter_read(struct cbmem *cbmem, struct cbmem_iter *iter, void *buf,
+        uint16_t off, uint16_t len)
+{
+    if (iter->ci_last == NULL) {
+        return (-1);
+    }
+
+    return (cbmem_read_seq(cbmem, iter->ci_last, iter->ci_last_seq, buf,
+            off, len));
 }
 
 int 
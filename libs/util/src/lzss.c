@@ -0,0 +1,351 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string.h>
+
+#include "util/lzss.h"
+
+#define LZSS_LITERAL_BITS   (1 + 8)
+#define LZSS_BACKREF_BITS   (1 + LZSS_WINDOW_BITS + LZSS_LENGTH_BITS)
+
+struct lzss_bitw {
+    uint8_t *lb_dst;
+    int lb_dst_len;
+    int lb_off;
+    uint32_t lb_bits;
+    uint8_t lb_nbits;
+};
+
+static int
+lzss_put_bits(struct lzss_bitw *bw, uint32_t val, int nbits)
+{
+    bw->lb_bits = (bw->lb_bits << nbits) | val;
+    bw->lb_nbits += nbits;
+
+    while (bw->lb_nbits >= 8) {
+        if (bw->lb_off >= bw->lb_dst_len) {
+            return -1;
+        }
+        bw->lb_nbits -= 8;
+        bw->lb_dst[bw->lb_off++] = bw->lb_bits >> bw->lb_nbits;
+    }
+
+    return 0;
+}
+
+/**
+ * Compresses a buffer.
+ *
+ * @param src                   The data to compress.
+ * @param src_len               The number of bytes to compress.
+ * @param dst                   Buffer to hold the compressed stream.
+ * @param dst_len               Size of the destination buffer.
+ *
+ * @return                      Number of bytes of compressed output;
+ *                              -1 if the output does not fit in dst.
+ */
+int
+lzss_encode(const uint8_t *src, int src_len, uint8_t *dst, int dst_len)
+{
+    struct lzss_bitw bw;
+    int best_len;
+    int best_dist;
+    int start;
+    int cand;
+    int max;
+    int pos;
+    int len;
+    int rc;
+
+    memset(&bw, 0, sizeof(bw));
+    bw.lb_dst = dst;
+    bw.lb_dst_len = dst_len;
+
+    pos = 0;
+    while (pos < src_len) {
+        best_len = 0;
+        best_dist = 0;
+
+        max = src_len - pos;
+        if (max > LZSS_MAX_MATCH) {
+            max = LZSS_MAX_MATCH;
+        }
+        start = pos - LZSS_WINDOW_SIZE;
+        if (start < 0) {
+            start = 0;
+        }
+
+        /* Search nearest first; the first longest match wins. */
+        for (cand = pos - 1; cand >= start; cand--) {
+            if (src[cand] != src[pos]) {
+                continue;
+            }
+            len = 1;
+            while (len < max && src[cand + len] == src[pos + len]) {
+                len++;
+            }
+            if (len > best_len) {
+                best_len = len;
+                best_dist = pos - cand;
+                if (len == max) {
+                    break;
+                }
+            }
+        }
+
+        if (best_len >= LZSS_MIN_MATCH) {
+            rc = lzss_put_bits(&bw, 0, 1);
+            if (rc == 0) {
+                rc = lzss_put_bits(&bw, best_dist - 1, LZSS_WINDOW_BITS);
+            }
+            if (rc == 0) {
+                rc = lzss_put_bits(&bw, best_len - LZSS_MIN_MATCH,
+                                   LZSS_LENGTH_BITS);
+            }
+            pos += best_len;
+        } else {
+            rc = lzss_put_bits(&bw, 0x100 | src[pos], LZSS_LITERAL_BITS);
+            pos++;
+        }
+        if (rc != 0) {
+            return -1;
+        }
+    }
+
+    /* Pad the final partial byte with zeros. */
+    if (bw.lb_nbits > 0) {
+        rc = lzss_put_bits(&bw, 0, 8 - bw.lb_nbits);
+        if (rc != 0) {
+            return -1;
+        }
+    }
+
+    return bw.lb_off;
+}
+
+/**
+ * Prepares a streaming decoder.
+ *
+ * @param dec                   The decoder to initialize.
+ * @param buf                   Buffer that receives the decoded data.  It
+ *                                  also serves as the back-reference
+ *                                  window, so it must hold the entire
+ *                                  output.
+ * @param size                  The exact size of the decoded data.
+ */
+void
+lzss_dec_init(struct lzss_dec *dec, uint8_t *buf, uint16_t size)
+{
+    memset(dec, 0, sizeof(*dec));
+    dec->ld_buf = buf;
+    dec->ld_size = size;
+}
+
+/**
+ * Feeds a piece of compressed stream to a decoder.  Input past the end of
+ * the expected output (i.e., padding) is ignored.
+ *
+ * @param dec                   The decoder.
+ * @param data                  The compressed bytes.
+ * @param len                   Number of compressed bytes.
+ *
+ * @return                      0 on success; -1 if the stream is corrupt.
+ */
+int
+lzss_dec_feed(struct lzss_dec *dec, const uint8_t *data, int len)
+{
+    uint32_t field;
+    int dist;
+    int cnt;
+    int i;
+
+    for (i = 0; i < len; i++) {
+        dec->ld_bits = (dec->ld_bits << 8) | data[i];
+        dec->ld_nbits += 8;
+
+        while (dec->ld_off < dec->ld_size && dec->ld_nbits > 0) {
+            if ((dec->ld_bits >> (dec->ld_nbits - 1)) & 1) {
+                if (dec->ld_nbits < LZSS_LITERAL_BITS) {
+                    break;
+                }
+                dec->ld_nbits -= LZSS_LITERAL_BITS;
+                dec->ld_buf[dec->ld_off++] = dec->ld_bits >> dec->ld_nbits;
+            } else {
+                if (dec->ld_nbits < LZSS_BACKREF_BITS) {
+                    break;
+                }
+                dec->ld_nbits -= LZSS_BACKREF_BITS;
+                field = dec->ld_bits >> dec->ld_nbits;
+                cnt = (field & ((1 << LZSS_LENGTH_BITS) - 1)) +
+                      LZSS_MIN_MATCH;
+                dist = ((field >> LZSS_LENGTH_BITS) &
+                        (LZSS_WINDOW_SIZE - 1)) + 1;
+                if (dist > dec->ld_off ||
+                    cnt > dec->ld_size - dec->ld_off) {
+                    return -1;
+                }
+
+                /* Byte-wise copy; source and destination may overlap. */
+                while (cnt-- > 0) {
+                    dec->ld_buf[dec->ld_off] = dec->ld_buf[dec->ld_off - dist];
+                    dec->ld_off++;
+                }
+            }
+        }
+        dec->ld_bits &= (1 << dec->ld_nbits) - 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Decompresses a buffer in one call.
+ *
+ * @param src                   The compressed stream.
+ * @param src_len               Length of the compressed stream.
+ * @param dst                   Buffer to hold the decoded data.
+ * @param dst_len               The exact size of the decoded data.
+ *
+ * @return                      0 on success; -1 if the stream is corrupt
+ *                                  or too short.
+ */
+int
+lzss_decode(const uint8_t *src, int src_len, uint8_t *dst, int dst_len)
+{
+    struct lzss_dec dec;
+    int rc;
+
+    lzss_dec_init(&dec, dst, dst_len);
+    rc = lzss_dec_feed(&dec, src, src_len);
+    if (rc != 0 || dec.ld_off != dst_len) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Prepares a ring decoder.  Unlike lzss_dec, it does not need to know the
+ * size of the output; the stream ends when the input does.
+ *
+ * @param dec                   The decoder to initialize.
+ */
+void
+lzss_rdec_init(struct lzss_rdec *dec)
+{
+    memset(dec, 0, sizeof(*dec));
+}
+
+static int
+lzss_rdec_flush(struct lzss_rdec *dec, lzss_out_func *out, void *arg)
+{
+    uint32_t start;
+    uint32_t len;
+
+    start = dec->lr_flushed & (LZSS_WINDOW_SIZE - 1);
+    len = dec->lr_off - dec->lr_flushed;
+    if (len == 0) {
+        return 0;
+    }
+    dec->lr_flushed = dec->lr_off;
+
+    return out(arg, dec->lr_win + start, len);
+}
+
+/*
+ * Appends a byte to the window.  Whenever the window fills up, it is
+ * handed out before being overwritten.
+ */
+static int
+lzss_rdec_put(struct lzss_rdec *dec, uint8_t byte, lzss_out_func *out,
+              void *arg)
+{
+    dec->lr_win[dec->lr_off++ & (LZSS_WINDOW_SIZE - 1)] = byte;
+    if ((dec->lr_off & (LZSS_WINDOW_SIZE - 1)) == 0) {
+        return lzss_rdec_flush(dec, out, arg);
+    }
+    return 0;
+}
+
+/**
+ * Feeds a piece of compressed stream to a ring decoder.  All output
+ * decoded from it is passed to 'out' before this returns, in one or more
+ * calls.
+ *
+ * @param dec                   The decoder.
+ * @param data                  The compressed bytes.
+ * @param len                   Number of compressed bytes.
+ * @param out                   Receives decoded data.
+ * @param arg                   Passed to 'out'.
+ *
+ * @return                      0 on success; -1 if the stream is corrupt;
+ *                                  other values as returned by 'out'.
+ */
+int
+lzss_rdec_feed(struct lzss_rdec *dec, const uint8_t *data, int len,
+               lzss_out_func *out, void *arg)
+{
+    uint32_t field;
+    uint32_t dist;
+    int cnt;
+    int rc;
+    int i;
+
+    for (i = 0; i < len; i++) {
+        dec->lr_bits = (dec->lr_bits << 8) | data[i];
+        dec->lr_nbits += 8;
+
+        while (dec->lr_nbits > 0) {
+            if ((dec->lr_bits >> (dec->lr_nbits - 1)) & 1) {
+                if (dec->lr_nbits < LZSS_LITERAL_BITS) {
+                    break;
+                }
+                dec->lr_nbits -= LZSS_LITERAL_BITS;
+                rc = lzss_rdec_put(dec, dec->lr_bits >> dec->lr_nbits, out,
+                                   arg);
+            } else {
+                if (dec->lr_nbits < LZSS_BACKREF_BITS) {
+                    break;
+                }
+                dec->lr_nbits -= LZSS_BACKREF_BITS;
+                field = dec->lr_bits >> dec->lr_nbits;
+                cnt = (field & ((1 << LZSS_LENGTH_BITS) - 1)) +
+                      LZSS_MIN_MATCH;
+                dist = ((field >> LZSS_LENGTH_BITS) &
+                        (LZSS_WINDOW_SIZE - 1)) + 1;
+                if (dist > dec->lr_off) {
+                    return -1;
+                }
+
+                rc = 0;
+                while (rc == 0 && cnt-- > 0) {
+                    rc = lzss_rdec_put(dec,
+                        dec->lr_win[(dec->lr_off - dist) &
+                                    (LZSS_WINDOW_SIZE - 1)], out, arg);
+                }
+            }
+            if (rc != 0) {
+                return rc;
+            }
+        }
+        dec->lr_bits &= (1 << dec->lr_nbits) - 1;
+    }
+
+    return lzss_rdec_flush(dec, out, arg);
+}
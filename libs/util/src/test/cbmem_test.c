@@ -167,10 +167,295 @@ TEST_CASE(cbmem_test_case_3)
     }
 }
 
+#define CBMEM2_BUF_SIZE (256)
+
+struct cbmem cbmem2;
+uint8_t cbmem2_buf[CBMEM2_BUF_SIZE];
+
+static int
+cbmem_test_count(struct cbmem *cbmem)
+{
+    struct cbmem_iter iter;
+    int cnt;
+
+    cnt = 0;
+    cbmem_iter_start(cbmem, &iter);
+    while (cbmem_iter_next(cbmem, &iter) != NULL) {
+        cnt++;
+    }
+    return (cnt);
+}
+
+TEST_CASE(cbmem_test_case_reserve)
+{
+    struct cbmem_entry_hdr *busy;
+    struct cbmem_entry_hdr *hdr;
+    struct cbmem_iter iter;
+    uint8_t data[28];
+    uint8_t val;
+    int rc;
+    int i;
+
+    rc = cbmem_init(&cbmem2, cbmem2_buf, CBMEM2_BUF_SIZE);
+    TEST_ASSERT_FATAL(rc == 0);
+
+    /* An uncommitted entry is invisible to readers. */
+    busy = cbmem_reserve(&cbmem2, sizeof(data));
+    TEST_ASSERT_FATAL(busy != NULL);
+    TEST_ASSERT(cbmem_test_count(&cbmem2) == 0);
+
+    /* Fill the rest of the buffer; 7 entries of 36 bytes fit. */
+    for (i = 1; i < 7; i++) {
+        data[0] = i;
+        rc = cbmem_append(&cbmem2, data, sizeof(data));
+        TEST_ASSERT_FATAL(rc == 0);
+    }
+    TEST_ASSERT(cbmem_test_count(&cbmem2) == 6);
+
+    /* Wrapping would overwrite the reserved entry, so appends fail. */
+    rc = cbmem_append(&cbmem2, data, sizeof(data));
+    TEST_ASSERT(rc == -1);
+
+    /* The buffer cannot be flushed under a pending writer. */
+    rc = cbmem_flush(&cbmem2);
+    TEST_ASSERT(rc == -1);
+
+    memset(CBMEM_ENTRY_DATA(busy), 0, sizeof(data));
+    cbmem_commit(&cbmem2, busy);
+    TEST_ASSERT(cbmem_test_count(&cbmem2) == 7);
+
+    /* Now the oldest entry can be overwritten. */
+    data[0] = 7;
+    rc = cbmem_append(&cbmem2, data, sizeof(data));
+    TEST_ASSERT_FATAL(rc == 0);
+
+    i = 1;
+    cbmem_iter_start(&cbmem2, &iter);
+    while ((hdr = cbmem_iter_next(&cbmem2, &iter)) != NULL) {
+        rc = cbmem_read(&cbmem2, hdr, &val, 0, sizeof(val));
+        TEST_ASSERT(rc == 1);
+        TEST_ASSERT(val == i);
+        i++;
+    }
+    TEST_ASSERT(i == 8);
+
+    rc = cbmem_flush(&cbmem2);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(cbmem_test_count(&cbmem2) == 0);
+}
+
+TEST_CASE(cbmem_test_case_overrun)
+{
+    struct cbmem_entry_hdr *hdr;
+    struct cbmem_iter iter;
+    uint8_t data[60];
+    uint8_t val;
+    int rc;
+    int i;
+
+    rc = cbmem_init(&cbmem2, cbmem2_buf, CBMEM2_BUF_SIZE);
+    TEST_ASSERT_FATAL(rc == 0);
+
+    for (i = 0; i < 7; i++) {
+        data[0] = i;
+        rc = cbmem_append(&cbmem2, data, 28);
+        TEST_ASSERT_FATAL(rc == 0);
+    }
+
+    /* Take the second entry, then let writers lap the reader.  The new,
+     * larger entries put data where the old header was.
+     */
+    cbmem_iter_start(&cbmem2, &iter);
+    hdr = cbmem_iter_next(&cbmem2, &iter);
+    TEST_ASSERT_FATAL(hdr != NULL);
+    hdr = cbmem_iter_next(&cbmem2, &iter);
+    TEST_ASSERT_FATAL(hdr != NULL);
+
+    memset(data, 0xff, sizeof(data));
+    for (i = 0; i < 8; i++) {
+        rc = cbmem_append(&cbmem2, data, sizeof(data));
+        TEST_ASSERT_FATAL(rc == 0);
+    }
+
+    /* The stale entry is rejected... */
+    rc = cbmem_read(&cbmem2, hdr, &val, 0, sizeof(val));
+    TEST_ASSERT(rc == -1);
+    rc = cbmem_iter_read(&cbmem2, &iter, &val, 0, sizeof(val));
+    TEST_ASSERT(rc == -1);
+
+    /* ...and the iterator does not return entries appended after it was
+     * started, so with all of its entries gone it is done.
+     */
+    hdr = cbmem_iter_next(&cbmem2, &iter);
+    TEST_ASSERT(hdr == NULL);
+
+    /* A fresh iterator sees the surviving entries. */
+    TEST_ASSERT(cbmem_test_count(&cbmem2) == 3);
+}
+
+/*
+ * Multi-producer stress test.  Producers of different priorities append
+ * into a small buffer while a low priority reader keeps walking it and
+ * checks that whatever it manages to read is intact and in order.
+ */
+#ifdef ARCH_sim
+#define CBMEM_STRESS_STACK_SIZE     1024
+#else
+#define CBMEM_STRESS_STACK_SIZE     256
+#endif
+
+#define CBMEM_STRESS_PRODUCERS      3
+#define CBMEM_STRESS_CNT            2000
+#define CBMEM_STRESS_READER_PRIO    (CBMEM_STRESS_PRODUCERS + 1)
+
+struct cbmem_stress_entry {
+    uint8_t cse_id;
+    uint8_t cse_pad;
+    uint16_t cse_cnt;
+    uint8_t cse_data[60];
+};
+
+struct cbmem cbmem3;
+uint8_t cbmem3_buf[1024];
+
+static struct os_task cbmem_stress_tasks[CBMEM_STRESS_PRODUCERS + 1];
+static os_stack_t cbmem_stress_stacks[CBMEM_STRESS_PRODUCERS + 1]
+    [OS_STACK_ALIGN(CBMEM_STRESS_STACK_SIZE)];
+static int cbmem_stress_done;
+static int cbmem_stress_dropped;
+
+static uint8_t
+cbmem_stress_fill(uint8_t id, uint16_t cnt)
+{
+    return (id * 31 + cnt);
+}
+
+static void
+cbmem_stress_producer(void *arg)
+{
+    struct cbmem_stress_entry ent;
+    uint8_t id;
+    int len;
+    int rc;
+    int i;
+
+    id = (uintptr_t) arg;
+
+    for (i = 0; i < CBMEM_STRESS_CNT; i++) {
+        ent.cse_id = id;
+        ent.cse_cnt = i;
+        len = i % sizeof(ent.cse_data);
+        memset(ent.cse_data, cbmem_stress_fill(id, i), len);
+
+        rc = cbmem_append(&cbmem3, &ent, 4 + len);
+        if (rc != 0) {
+            cbmem_stress_dropped++;
+        }
+
+        if (i % (8 + id) == 0) {
+            os_time_delay(1);
+        }
+    }
+
+    cbmem_stress_done++;
+    while (1) {
+        os_time_delay(OS_TICKS_PER_SEC);
+    }
+}
+
+static void
+cbmem_stress_reader(void *arg)
+{
+    struct cbmem_stress_entry ent;
+    struct cbmem_entry_hdr *hdr;
+    struct cbmem_iter iter;
+    int last[CBMEM_STRESS_PRODUCERS];
+    int done;
+    int len;
+    int rc;
+    int i;
+
+    do {
+        done = (cbmem_stress_done == CBMEM_STRESS_PRODUCERS);
+
+        for (i = 0; i < CBMEM_STRESS_PRODUCERS; i++) {
+            last[i] = -1;
+        }
+
+        cbmem_iter_start(&cbmem3, &iter);
+        while ((hdr = cbmem_iter_next(&cbmem3, &iter)) != NULL) {
+            rc = cbmem_iter_read(&cbmem3, &iter, &ent, 0, sizeof(ent));
+            if (rc < 0) {
+                /* Overwritten while we were reading; fine. */
+                TEST_ASSERT_FATAL(!done);
+                continue;
+            }
+            TEST_ASSERT_FATAL(rc >= 4);
+            TEST_ASSERT_FATAL(ent.cse_id < CBMEM_STRESS_PRODUCERS);
+
+            /* Each producer's entries show up in order. */
+            TEST_ASSERT_FATAL(ent.cse_cnt > last[ent.cse_id]);
+            last[ent.cse_id] = ent.cse_cnt;
+
+            len = rc - 4;
+            TEST_ASSERT_FATAL(len == ent.cse_cnt % sizeof(ent.cse_data));
+            for (i = 0; i < len; i++) {
+                TEST_ASSERT_FATAL(ent.cse_data[i] ==
+                                  cbmem_stress_fill(ent.cse_id,
+                                                    ent.cse_cnt));
+            }
+        }
+
+        os_time_delay(1);
+    } while (!done);
+
+    /* The last producer to finish still has its final entry stored. */
+    done = 0;
+    for (i = 0; i < CBMEM_STRESS_PRODUCERS; i++) {
+        if (last[i] == CBMEM_STRESS_CNT - 1) {
+            done = 1;
+        }
+    }
+    TEST_ASSERT(done);
+    TEST_ASSERT(cbmem3.c_busy == 0);
+
+    tu_restart();
+}
+
+TEST_CASE(cbmem_test_case_stress)
+{
+    int rc;
+    int i;
+
+    os_init();
+
+    rc = cbmem_init(&cbmem3, cbmem3_buf, sizeof(cbmem3_buf));
+    TEST_ASSERT_FATAL(rc == 0);
+
+    cbmem_stress_done = 0;
+    cbmem_stress_dropped = 0;
+
+    for (i = 0; i < CBMEM_STRESS_PRODUCERS; i++) {
+        os_task_init(&cbmem_stress_tasks[i], "cbmem_prod",
+                     cbmem_stress_producer, (void *) (uintptr_t) i, i + 1,
+                     OS_WAIT_FOREVER, cbmem_stress_stacks[i],
+                     OS_STACK_ALIGN(CBMEM_STRESS_STACK_SIZE));
+    }
+    os_task_init(&cbmem_stress_tasks[i], "cbmem_read", cbmem_stress_reader,
+                 NULL, CBMEM_STRESS_READER_PRIO, OS_WAIT_FOREVER,
+                 cbmem_stress_stacks[i],
+                 OS_STACK_ALIGN(CBMEM_STRESS_STACK_SIZE));
+
+    os_start();
+}
+
 TEST_SUITE(cbmem_test_suite)
 {
     setup_cbmem1();
     cbmem_test_case_1();
     cbmem_test_case_2();
     cbmem_test_case_3();
+    cbmem_test_case_reserve();
+    cbmem_test_case_overrun();
+    cbmem_test_case_stress();
 }
@@ -0,0 +1,189 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "os/os.h"
+#include "testutil/testutil.h"
+#include "util/lzss.h"
+
+static uint8_t lzss_test_raw[512];
+static uint8_t lzss_test_comp[600];
+static uint8_t lzss_test_out[512];
+
+static int
+lzss_test_fill_text(void)
+{
+    int len;
+    int i;
+
+    len = 0;
+    for (i = 0; len < sizeof(lzss_test_raw) - 64; i++) {
+        len += sprintf((char *)lzss_test_raw + len,
+                       "conn_evt handle=%d rssi=-%d chan=%d\n",
+                       i % 4, 40 + i % 23, i % 37);
+    }
+    return len;
+}
+
+TEST_CASE(lzss_test_case_text)
+{
+    int clen;
+    int len;
+    int rc;
+
+    len = lzss_test_fill_text();
+
+    clen = lzss_encode(lzss_test_raw, len, lzss_test_comp,
+                       sizeof(lzss_test_comp));
+    TEST_ASSERT_FATAL(clen > 0);
+
+    /* Repetitive text should at least halve. */
+    TEST_ASSERT(clen < len / 2, "poor compression %d -> %d", len, clen);
+
+    memset(lzss_test_out, 0, sizeof(lzss_test_out));
+    rc = lzss_decode(lzss_test_comp, clen, lzss_test_out, len);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(memcmp(lzss_test_out, lzss_test_raw, len) == 0);
+}
+
+TEST_CASE(lzss_test_case_stream)
+{
+    struct lzss_dec dec;
+    int clen;
+    int len;
+    int off;
+    int n;
+    int rc;
+
+    len = lzss_test_fill_text();
+    clen = lzss_encode(lzss_test_raw, len, lzss_test_comp,
+                       sizeof(lzss_test_comp));
+    TEST_ASSERT_FATAL(clen > 0);
+
+    /* Feed the decoder in odd sized pieces. */
+    memset(lzss_test_out, 0, sizeof(lzss_test_out));
+    lzss_dec_init(&dec, lzss_test_out, len);
+    for (off = 0; off < clen; off += n) {
+        n = min(clen - off, 7);
+        rc = lzss_dec_feed(&dec, lzss_test_comp + off, n);
+        TEST_ASSERT_FATAL(rc == 0);
+    }
+    TEST_ASSERT(dec.ld_off == len);
+    TEST_ASSERT(memcmp(lzss_test_out, lzss_test_raw, len) == 0);
+}
+
+static int lzss_test_out_len;
+
+static int
+lzss_test_rdec_out(void *arg, const uint8_t *data, int len)
+{
+    TEST_ASSERT_FATAL(len > 0 && len <= LZSS_WINDOW_SIZE);
+    TEST_ASSERT_FATAL(lzss_test_out_len + len <= sizeof(lzss_test_out));
+    memcpy(lzss_test_out + lzss_test_out_len, data, len);
+    lzss_test_out_len += len;
+    return 0;
+}
+
+TEST_CASE(lzss_test_case_ring)
+{
+    struct lzss_rdec dec;
+    int clen;
+    int len;
+    int off;
+    int n;
+    int rc;
+
+    /* Longer than the window, so the ring wraps. */
+    len = lzss_test_fill_text();
+    TEST_ASSERT_FATAL(len > LZSS_WINDOW_SIZE);
+    clen = lzss_encode(lzss_test_raw, len, lzss_test_comp,
+                       sizeof(lzss_test_comp));
+    TEST_ASSERT_FATAL(clen > 0);
+
+    memset(lzss_test_out, 0, sizeof(lzss_test_out));
+    lzss_test_out_len = 0;
+    lzss_rdec_init(&dec);
+    for (off = 0; off < clen; off += n) {
+        n = min(clen - off, 5);
+        rc = lzss_rdec_feed(&dec, lzss_test_comp + off, n,
+                            lzss_test_rdec_out, NULL);
+        TEST_ASSERT_FATAL(rc == 0);
+    }
+    TEST_ASSERT(lzss_test_out_len == len);
+    TEST_ASSERT(memcmp(lzss_test_out, lzss_test_raw, len) == 0);
+
+    /* Back-reference before the start of the stream. */
+    memset(lzss_test_comp, 0, 4);
+    lzss_rdec_init(&dec);
+    rc = lzss_rdec_feed(&dec, lzss_test_comp, 4, lzss_test_rdec_out, NULL);
+    TEST_ASSERT(rc == -1);
+}
+
+TEST_CASE(lzss_test_case_incompressible)
+{
+    uint32_t seed;
+    int clen;
+    int rc;
+    int i;
+
+    seed = 1;
+    for (i = 0; i < sizeof(lzss_test_raw); i++) {
+        seed = seed * 1103515245 + 12345;
+        lzss_test_raw[i] = seed >> 16;
+    }
+
+    /* Output does not fit in a buffer as large as the input. */
+    clen = lzss_encode(lzss_test_raw, sizeof(lzss_test_raw), lzss_test_comp,
+                       sizeof(lzss_test_raw));
+    TEST_ASSERT(clen == -1);
+
+    /* But still round trips given enough room. */
+    clen = lzss_encode(lzss_test_raw, sizeof(lzss_test_raw), lzss_test_comp,
+                       sizeof(lzss_test_comp));
+    TEST_ASSERT_FATAL(clen > 0);
+    rc = lzss_decode(lzss_test_comp, clen, lzss_test_out,
+                     sizeof(lzss_test_raw));
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(memcmp(lzss_test_out, lzss_test_raw,
+                       sizeof(lzss_test_raw)) == 0);
+}
+
+TEST_CASE(lzss_test_case_corrupt)
+{
+    int rc;
+
+    /* Back-reference at the very start of the stream. */
+    memset(lzss_test_comp, 0, 4);
+    rc = lzss_decode(lzss_test_comp, 4, lzss_test_out, 8);
+    TEST_ASSERT(rc == -1);
+
+    /* Truncated stream. */
+    rc = lzss_decode(lzss_test_comp, 0, lzss_test_out, 8);
+    TEST_ASSERT(rc == -1);
+}
+
+TEST_SUITE(lzss_test_suite)
+{
+    lzss_test_case_text();
+    lzss_test_case_stream();
+    lzss_test_case_ring();
+    lzss_test_case_incompressible();
+    lzss_test_case_corrupt();
+}
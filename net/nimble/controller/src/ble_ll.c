@@ -177,6 +177,8 @@ STATS_NAME_START(ble_ll_stats)
     STATS_NAME(ble_ll_stats, scan_req_txf)
     STATS_NAME(ble_ll_stats, scan_req_txg)
     STATS_NAME(ble_ll_stats, scan_rsp_txg)
+    STATS_NAME(ble_ll_stats, scan_dup_filtered)
+    STATS_NAME(ble_ll_stats, scan_dup_evicted)
 STATS_NAME_END(ble_ll_stats)
 
 /* The BLE LL task data structure */
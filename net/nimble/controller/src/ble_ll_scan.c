@@ -37,6 +37,7 @@
 #include "controller/ble_ll_resolv.h"
 #include "hal/hal_cputime.h"
 #include "hal/hal_gpio.h"
+#include "ble_ll_scan_priv.h"
 
 /*
  * XXX:
@@ -50,9 +51,6 @@
  */
 
 /* Dont allow more than 255 of these entries */
-#if NIMBLE_OPT_LL_NUM_SCAN_DUP_ADVS > 255
-    #error "Cannot have more than 255 duplicate entries!"
-#endif
 #if NIMBLE_OPT_LL_NUM_SCAN_RSP_ADVS > 255
     #error "Cannot have more than 255 scan response entries!"
 #endif
@@ -62,8 +60,8 @@ struct ble_ll_scan_sm g_ble_ll_scan_sm;
 
 /*
  * Structure used to store advertisers. This is used to limit sending scan
- * requests to the same advertiser and also to filter duplicate events sent
- * to the host.
+ * requests to the same advertiser. Duplicate events sent to the host are
+ * filtered in ble_ll_scan_dup.c.
  */
 struct ble_ll_scan_advertisers
 {
@@ -71,21 +69,11 @@ struct ble_ll_scan_advertisers
     struct ble_dev_addr adv_addr;
 };
 
-#define BLE_LL_SC_ADV_F_RANDOM_ADDR     (0x01)
-#define BLE_LL_SC_ADV_F_SCAN_RSP_RXD    (0x02)
-#define BLE_LL_SC_ADV_F_DIRECT_RPT_SENT (0x04)
-#define BLE_LL_SC_ADV_F_ADV_RPT_SENT    (0x08)
-
 /* Contains list of advertisers that we have heard scan responses from */
 static uint8_t g_ble_ll_scan_num_rsp_advs;
 struct ble_ll_scan_advertisers
 g_ble_ll_scan_rsp_advs[NIMBLE_OPT_LL_NUM_SCAN_RSP_ADVS];
 
-/* Used to filter duplicate advertising events to host */
-static uint8_t g_ble_ll_scan_num_dup_advs;
-struct ble_ll_scan_advertisers
-g_ble_ll_scan_dup_advs[NIMBLE_OPT_LL_NUM_SCAN_DUP_ADVS];
-
 /* See Vol 6 Part B Section 4.4.3.2. Active scanning backoff */
 static void
 ble_ll_scan_req_backoff(struct ble_ll_scan_sm *scansm, int success)
@@ -189,119 +177,6 @@ ble_ll_scan_req_pdu_make(struct ble_ll_scan_sm *scansm, uint8_t *adv_addr,
     memcpy(dptr + BLE_DEV_ADDR_LEN, adv_addr, BLE_DEV_ADDR_LEN);
 }
 
-/**
- * Checks to see if an advertiser is on the duplicate address list.
- *
- * @param addr Pointer to address
- * @param txadd TxAdd bit. 0: public; random otherwise
- *
- * @return uint8_t 0: not on list; any other value is
- */
-static struct ble_ll_scan_advertisers *
-ble_ll_scan_find_dup_adv(uint8_t *addr, uint8_t txadd)
-{
-    uint8_t num_advs;
-    struct ble_ll_scan_advertisers *adv;
-
-    /* Do we have an address match? Must match address type */
-    adv = &g_ble_ll_scan_dup_advs[0];
-    num_advs = g_ble_ll_scan_num_dup_advs;
-    while (num_advs) {
-        if (!memcmp(&adv->adv_addr, addr, BLE_DEV_ADDR_LEN)) {
-            /* Address type must match */
-            if (txadd) {
-                if ((adv->sc_adv_flags & BLE_LL_SC_ADV_F_RANDOM_ADDR) == 0) {
-                    goto next_dup_adv;
-                }
-            } else {
-                if (adv->sc_adv_flags & BLE_LL_SC_ADV_F_RANDOM_ADDR) {
-                    goto next_dup_adv;
-                }
-            }
-
-            return adv;
-        }
-
-next_dup_adv:
-        ++adv;
-        --num_advs;
-    }
-
-    return NULL;
-}
-
-/**
- * Check if a packet is a duplicate advertising packet.
- *
- * @param pdu_type
- * @param rxbuf
- *
- * @return int 0: not a duplicate. 1:duplicate
- */
-int
-ble_ll_scan_is_dup_adv(uint8_t pdu_type, uint8_t txadd, uint8_t *addr)
-{
-    struct ble_ll_scan_advertisers *adv;
-
-    adv = ble_ll_scan_find_dup_adv(addr, txadd);
-    if (adv) {
-        /* Check appropriate flag (based on type of PDU) */
-        if (pdu_type == BLE_ADV_PDU_TYPE_ADV_DIRECT_IND) {
-            if (adv->sc_adv_flags & BLE_LL_SC_ADV_F_DIRECT_RPT_SENT) {
-                return 1;
-            }
-        } else {
-            if (adv->sc_adv_flags & BLE_LL_SC_ADV_F_ADV_RPT_SENT) {
-                return 1;
-            }
-        }
-    }
-
-    return 0;
-}
-
-/**
- * Add an advertiser the list of duplicate advertisers. An address gets added to
- * the list of duplicate addresses when the controller sends an advertising
- * report to the host.
- *
- * @param addr   Pointer to advertisers address or identity address
- * @param Txadd. TxAdd bit (0 public, random otherwise)
- * @param subev  Type of advertising report sent (direct or normal).
- */
-void
-ble_ll_scan_add_dup_adv(uint8_t *addr, uint8_t txadd, uint8_t subev)
-{
-    uint8_t num_advs;
-    struct ble_ll_scan_advertisers *adv;
-
-    /* Check to see if on list. */
-    adv = ble_ll_scan_find_dup_adv(addr, txadd);
-    if (!adv) {
-        /* XXX: for now, if we dont have room, just leave */
-        num_advs = g_ble_ll_scan_num_dup_advs;
-        if (num_advs == NIMBLE_OPT_LL_NUM_SCAN_DUP_ADVS) {
-            return;
-        }
-
-        /* Add the advertiser to the array */
-        adv = &g_ble_ll_scan_dup_advs[num_advs];
-        memcpy(&adv->adv_addr, addr, BLE_DEV_ADDR_LEN);
-        ++g_ble_ll_scan_num_dup_advs;
-
-        adv->sc_adv_flags = 0;
-        if (txadd) {
-            adv->sc_adv_flags |= BLE_LL_SC_ADV_F_RANDOM_ADDR;
-        }
-    }
-
-    if (subev == BLE_HCI_LE_SUBEV_DIRECT_ADV_RPT) {
-        adv->sc_adv_flags |= BLE_LL_SC_ADV_F_DIRECT_RPT_SENT;
-    } else {
-        adv->sc_adv_flags |= BLE_LL_SC_ADV_F_ADV_RPT_SENT;
-    }
-}
-
 /**
  * Checks to see if we have received a scan response from this advertiser.
  *
@@ -724,7 +599,7 @@ ble_ll_scan_sm_start(struct ble_ll_scan_sm *scansm)
 
     /* Forget filtered advertisers from previous scan. */
     g_ble_ll_scan_num_rsp_advs = 0;
-    g_ble_ll_scan_num_dup_advs = 0;
+    ble_ll_scan_clr_dup_advs();
 
     /* XXX: align to current or next slot???. */
     /* Schedule start time now */
@@ -1449,8 +1324,7 @@ ble_ll_scan_reset(void)
     g_ble_ll_scan_num_rsp_advs = 0;
     memset(&g_ble_ll_scan_rsp_advs[0], 0, sizeof(g_ble_ll_scan_rsp_advs));
 
-    g_ble_ll_scan_num_dup_advs = 0;
-    memset(&g_ble_ll_scan_dup_advs[0], 0, sizeof(g_ble_ll_scan_dup_advs));
+    ble_ll_scan_clr_dup_advs();
 
     /* Call the init function again */
     ble_ll_scan_init();
@@ -1471,6 +1345,8 @@ ble_ll_scan_init(void)
     scansm = &g_ble_ll_scan_sm;
     memset(scansm, 0, sizeof(struct ble_ll_scan_sm));
 
+    ble_ll_scan_clr_dup_advs();
+
     /* Initialize scanning window end event */
     scansm->scan_sched_ev.ev_type = BLE_LL_EVENT_SCAN;
     scansm->scan_sched_ev.ev_arg = scansm;
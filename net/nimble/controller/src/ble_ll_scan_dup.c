@@ -0,0 +1,304 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include "os/os.h"
+#include "nimble/ble.h"
+#include "nimble/nimble_opt.h"
+#include "nimble/hci_common.h"
+#include "controller/ble_ll.h"
+#include "ble_ll_scan_priv.h"
+
+/* Duplicate entries are indexed by uint16_t; 0xffff marks end of list */
+#if NIMBLE_OPT_LL_NUM_SCAN_DUP_ADVS > 65535
+    #error "Cannot have more than 65535 duplicate entries!"
+#endif
+#if (NIMBLE_OPT_LL_SCAN_DUP_ADV_BUCKETS == 0) || \
+    (NIMBLE_OPT_LL_SCAN_DUP_ADV_BUCKETS & \
+     (NIMBLE_OPT_LL_SCAN_DUP_ADV_BUCKETS - 1))
+    #error "Number of duplicate hash buckets must be a power of 2!"
+#endif
+
+/*
+ * Used to filter duplicate advertising events to host. Entries are found by
+ * hashing the advertiser address into a bucket; each bucket is a singly
+ * linked list of entry indices. All entries are also on a doubly linked list
+ * ordered by when the advertiser was last heard from. When the table is full,
+ * the entry at the tail of this list (least recently heard) is evicted to
+ * make room for a new advertiser.
+ */
+struct ble_ll_scan_dup_adv
+{
+    struct ble_dev_addr adv_addr;
+    uint8_t             sc_adv_flags;
+    uint16_t            hash_next;
+    uint16_t            lru_prev;
+    uint16_t            lru_next;
+};
+
+#define BLE_LL_SCAN_DUP_ADV_NONE        (0xffff)
+
+static uint16_t g_ble_ll_scan_num_dup_advs;
+static uint16_t g_ble_ll_scan_dup_lru_head;
+static uint16_t g_ble_ll_scan_dup_lru_tail;
+static uint16_t
+g_ble_ll_scan_dup_buckets[NIMBLE_OPT_LL_SCAN_DUP_ADV_BUCKETS];
+static struct ble_ll_scan_dup_adv
+g_ble_ll_scan_dup_advs[NIMBLE_OPT_LL_NUM_SCAN_DUP_ADVS];
+
+/**
+ * Removes all advertisers from the duplicate address list.
+ */
+void
+ble_ll_scan_clr_dup_advs(void)
+{
+    g_ble_ll_scan_num_dup_advs = 0;
+    g_ble_ll_scan_dup_lru_head = BLE_LL_SCAN_DUP_ADV_NONE;
+    g_ble_ll_scan_dup_lru_tail = BLE_LL_SCAN_DUP_ADV_NONE;
+    memset(&g_ble_ll_scan_dup_buckets[0], 0xff,
+           sizeof(g_ble_ll_scan_dup_buckets));
+}
+
+/**
+ * Returns the hash bucket for an advertiser. Multiplicative hash of the
+ * address; the address type is mixed in so that a public and random address
+ * with the same value do not always collide.
+ *
+ * @param addr Pointer to address
+ * @param txadd TxAdd bit. 0: public; random otherwise
+ *
+ * @return uint16_t Index of bucket
+ */
+uint16_t
+ble_ll_scan_dup_adv_bucket(uint8_t *addr, uint8_t txadd)
+{
+    uint32_t h;
+
+    h = ((uint32_t)addr[0] | ((uint32_t)addr[1] << 8) |
+         ((uint32_t)addr[2] << 16) | ((uint32_t)addr[3] << 24));
+    h ^= ((uint32_t)addr[4] << 5) ^ ((uint32_t)addr[5] << 13) ^ (txadd != 0);
+    h *= 0x9e3779b1;
+
+    return (uint16_t)(h >> 16) & (NIMBLE_OPT_LL_SCAN_DUP_ADV_BUCKETS - 1);
+}
+
+/**
+ * Removes an entry from the recently heard list.
+ *
+ * @param index Index of entry
+ */
+static void
+ble_ll_scan_dup_lru_unlink(uint16_t index)
+{
+    struct ble_ll_scan_dup_adv *adv;
+
+    adv = &g_ble_ll_scan_dup_advs[index];
+    if (adv->lru_prev == BLE_LL_SCAN_DUP_ADV_NONE) {
+        g_ble_ll_scan_dup_lru_head = adv->lru_next;
+    } else {
+        g_ble_ll_scan_dup_advs[adv->lru_prev].lru_next = adv->lru_next;
+    }
+
+    if (adv->lru_next == BLE_LL_SCAN_DUP_ADV_NONE) {
+        g_ble_ll_scan_dup_lru_tail = adv->lru_prev;
+    } else {
+        g_ble_ll_scan_dup_advs[adv->lru_next].lru_prev = adv->lru_prev;
+    }
+}
+
+/**
+ * Puts an entry at the head (most recently heard) of the recently heard list.
+ * The entry must not be on the list.
+ *
+ * @param index Index of entry
+ */
+static void
+ble_ll_scan_dup_lru_push(uint16_t index)
+{
+    struct ble_ll_scan_dup_adv *adv;
+
+    adv = &g_ble_ll_scan_dup_advs[index];
+    adv->lru_prev = BLE_LL_SCAN_DUP_ADV_NONE;
+    adv->lru_next = g_ble_ll_scan_dup_lru_head;
+
+    if (g_ble_ll_scan_dup_lru_head == BLE_LL_SCAN_DUP_ADV_NONE) {
+        g_ble_ll_scan_dup_lru_tail = index;
+    } else {
+        g_ble_ll_scan_dup_advs[g_ble_ll_scan_dup_lru_head].lru_prev = index;
+    }
+    g_ble_ll_scan_dup_lru_head = index;
+}
+
+/**
+ * Evicts the least recently heard advertiser from the duplicate address list.
+ * The list must not be empty.
+ *
+ * @return uint16_t Index of the entry that was freed.
+ */
+static uint16_t
+ble_ll_scan_dup_adv_evict(void)
+{
+    uint16_t index;
+    uint16_t *next;
+    struct ble_ll_scan_dup_adv *adv;
+
+    index = g_ble_ll_scan_dup_lru_tail;
+    assert(index != BLE_LL_SCAN_DUP_ADV_NONE);
+    adv = &g_ble_ll_scan_dup_advs[index];
+
+    /* Unlink from its bucket */
+    next = &g_ble_ll_scan_dup_buckets[
+        ble_ll_scan_dup_adv_bucket(adv->adv_addr.u8,
+                                   adv->sc_adv_flags &
+                                   BLE_LL_SC_ADV_F_RANDOM_ADDR)];
+    while (*next != index) {
+        assert(*next != BLE_LL_SCAN_DUP_ADV_NONE);
+        next = &g_ble_ll_scan_dup_advs[*next].hash_next;
+    }
+    *next = adv->hash_next;
+
+    ble_ll_scan_dup_lru_unlink(index);
+    STATS_INC(ble_ll_stats, scan_dup_evicted);
+
+    return index;
+}
+
+/**
+ * Checks to see if an advertiser is on the duplicate address list.
+ *
+ * @param addr Pointer to address
+ * @param txadd TxAdd bit. 0: public; random otherwise
+ *
+ * @return uint16_t Index of entry; BLE_LL_SCAN_DUP_ADV_NONE if not on list.
+ */
+static uint16_t
+ble_ll_scan_find_dup_adv(uint8_t *addr, uint8_t txadd)
+{
+    uint8_t random;
+    uint16_t index;
+    struct ble_ll_scan_dup_adv *adv;
+
+    /* Do we have an address match? Must match address type */
+    random = txadd ? BLE_LL_SC_ADV_F_RANDOM_ADDR : 0;
+    index = g_ble_ll_scan_dup_buckets[ble_ll_scan_dup_adv_bucket(addr, txadd)];
+    while (index != BLE_LL_SCAN_DUP_ADV_NONE) {
+        adv = &g_ble_ll_scan_dup_advs[index];
+        if (((adv->sc_adv_flags & BLE_LL_SC_ADV_F_RANDOM_ADDR) == random) &&
+            !memcmp(&adv->adv_addr, addr, BLE_DEV_ADDR_LEN)) {
+            break;
+        }
+        index = adv->hash_next;
+    }
+
+    return index;
+}
+
+/**
+ * Check if a packet is a duplicate advertising packet. An advertiser that is
+ * heard from becomes the most recently heard entry so that it is the last to
+ * be evicted.
+ *
+ * @param pdu_type
+ * @param rxbuf
+ *
+ * @return int 0: not a duplicate. 1:duplicate
+ */
+int
+ble_ll_scan_is_dup_adv(uint8_t pdu_type, uint8_t txadd, uint8_t *addr)
+{
+    uint8_t flag;
+    uint16_t index;
+
+    index = ble_ll_scan_find_dup_adv(addr, txadd);
+    if (index == BLE_LL_SCAN_DUP_ADV_NONE) {
+        return 0;
+    }
+
+    if (index != g_ble_ll_scan_dup_lru_head) {
+        ble_ll_scan_dup_lru_unlink(index);
+        ble_ll_scan_dup_lru_push(index);
+    }
+
+    /* Check appropriate flag (based on type of PDU) */
+    if (pdu_type == BLE_ADV_PDU_TYPE_ADV_DIRECT_IND) {
+        flag = BLE_LL_SC_ADV_F_DIRECT_RPT_SENT;
+    } else {
+        flag = BLE_LL_SC_ADV_F_ADV_RPT_SENT;
+    }
+
+    if (g_ble_ll_scan_dup_advs[index].sc_adv_flags & flag) {
+        STATS_INC(ble_ll_stats, scan_dup_filtered);
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Add an advertiser the list of duplicate advertisers. An address gets added
+ * to the list of duplicate addresses when the controller sends an
+ * advertising report to the host. If the list is full, the advertiser heard
+ * from least recently is removed from the list.
+ *
+ * @param addr   Pointer to advertisers address or identity address
+ * @param Txadd. TxAdd bit (0 public, random otherwise)
+ * @param subev  Type of advertising report sent (direct or normal).
+ */
+void
+ble_ll_scan_add_dup_adv(uint8_t *addr, uint8_t txadd, uint8_t subev)
+{
+    uint16_t index;
+    uint16_t bucket;
+    struct ble_ll_scan_dup_adv *adv;
+
+    /* Check to see if on list. */
+    index = ble_ll_scan_find_dup_adv(addr, txadd);
+    if (index == BLE_LL_SCAN_DUP_ADV_NONE) {
+        if (g_ble_ll_scan_num_dup_advs < NIMBLE_OPT_LL_NUM_SCAN_DUP_ADVS) {
+            index = g_ble_ll_scan_num_dup_advs;
+            ++g_ble_ll_scan_num_dup_advs;
+        } else {
+            index = ble_ll_scan_dup_adv_evict();
+        }
+
+        /* Add the advertiser to the table */
+        adv = &g_ble_ll_scan_dup_advs[index];
+        memcpy(&adv->adv_addr, addr, BLE_DEV_ADDR_LEN);
+        adv->sc_adv_flags = 0;
+        if (txadd) {
+            adv->sc_adv_flags |= BLE_LL_SC_ADV_F_RANDOM_ADDR;
+        }
+
+        bucket = ble_ll_scan_dup_adv_bucket(addr, txadd);
+        adv->hash_next = g_ble_ll_scan_dup_buckets[bucket];
+        g_ble_ll_scan_dup_buckets[bucket] = index;
+    } else {
+        adv = &g_ble_ll_scan_dup_advs[index];
+        ble_ll_scan_dup_lru_unlink(index);
+    }
+    ble_ll_scan_dup_lru_push(index);
+
+    if (subev == BLE_HCI_LE_SUBEV_DIRECT_ADV_RPT) {
+        adv->sc_adv_flags |= BLE_LL_SC_ADV_F_DIRECT_RPT_SENT;
+    } else {
+        adv->sc_adv_flags |= BLE_LL_SC_ADV_F_ADV_RPT_SENT;
+    }
+}
@@ -0,0 +1,38 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_BLE_LL_SCAN_PRIV_
+#define H_BLE_LL_SCAN_PRIV_
+
+#include <inttypes.h>
+#include "controller/ble_ll.h"
+
+/* Flags kept for each advertiser the scanner has heard from */
+#define BLE_LL_SC_ADV_F_RANDOM_ADDR     (0x01)
+#define BLE_LL_SC_ADV_F_SCAN_RSP_RXD    (0x02)
+#define BLE_LL_SC_ADV_F_DIRECT_RPT_SENT (0x04)
+#define BLE_LL_SC_ADV_F_ADV_RPT_SENT    (0x08)
+
+/* Duplicate advertiser filter */
+void ble_ll_scan_clr_dup_advs(void);
+uint16_t ble_ll_scan_dup_adv_bucket(uint8_t *addr, uint8_t txadd);
+int ble_ll_scan_is_dup_adv(uint8_t pdu_type, uint8_t txadd, uint8_t *addr);
+void ble_ll_scan_add_dup_adv(uint8_t *addr, uint8_t txadd, uint8_t subev);
+
+#endif
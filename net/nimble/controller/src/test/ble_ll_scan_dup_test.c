@@ -0,0 +1,227 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "testutil/testutil.h"
+#include "nimble/ble.h"
+#include "nimble/nimble_opt.h"
+#include "nimble/hci_common.h"
+#include "controller/ble_ll.h"
+#include "../ble_ll_scan_priv.h"
+
+#define BLE_LL_SCAN_DUP_TEST_NUM    NIMBLE_OPT_LL_NUM_SCAN_DUP_ADVS
+
+static void
+ble_ll_scan_dup_test_addr(uint8_t *addr, int i)
+{
+    addr[0] = i;
+    addr[1] = i >> 8;
+    addr[2] = 0x33;
+    addr[3] = 0x44;
+    addr[4] = 0x55;
+    addr[5] = 0xc0;
+}
+
+static int
+ble_ll_scan_dup_test_is_dup(int i, uint8_t txadd)
+{
+    uint8_t addr[BLE_DEV_ADDR_LEN];
+
+    ble_ll_scan_dup_test_addr(addr, i);
+    return ble_ll_scan_is_dup_adv(BLE_ADV_PDU_TYPE_ADV_IND, txadd, addr);
+}
+
+static void
+ble_ll_scan_dup_test_add(int i, uint8_t txadd)
+{
+    uint8_t addr[BLE_DEV_ADDR_LEN];
+
+    ble_ll_scan_dup_test_addr(addr, i);
+    ble_ll_scan_add_dup_adv(addr, txadd, BLE_HCI_LE_SUBEV_ADV_RPT);
+}
+
+TEST_CASE(ble_ll_scan_dup_test_case_bucket)
+{
+    uint8_t addr[BLE_DEV_ADDR_LEN];
+    int hits[NIMBLE_OPT_LL_SCAN_DUP_ADV_BUCKETS];
+    int type_differs;
+    uint16_t bucket;
+    int i;
+
+    memset(hits, 0, sizeof hits);
+    type_differs = 0;
+    for (i = 0; i < 8 * NIMBLE_OPT_LL_SCAN_DUP_ADV_BUCKETS; i++) {
+        ble_ll_scan_dup_test_addr(addr, i);
+        bucket = ble_ll_scan_dup_adv_bucket(addr, 0);
+        TEST_ASSERT_FATAL(bucket < NIMBLE_OPT_LL_SCAN_DUP_ADV_BUCKETS);
+        TEST_ASSERT(bucket == ble_ll_scan_dup_adv_bucket(addr, 0));
+        hits[bucket]++;
+
+        if (bucket != ble_ll_scan_dup_adv_bucket(addr, 1)) {
+            type_differs = 1;
+        }
+    }
+
+    /* Addresses that differ only in their low bytes use every bucket. */
+    for (i = 0; i < NIMBLE_OPT_LL_SCAN_DUP_ADV_BUCKETS; i++) {
+        TEST_ASSERT(hits[i] > 0);
+    }
+
+    /* The address type is part of the hash. */
+    if (NIMBLE_OPT_LL_SCAN_DUP_ADV_BUCKETS > 1) {
+        TEST_ASSERT(type_differs);
+    }
+}
+
+TEST_CASE(ble_ll_scan_dup_test_case_flags)
+{
+    uint8_t addr[BLE_DEV_ADDR_LEN];
+
+    ble_ll_scan_clr_dup_advs();
+    ble_ll_scan_dup_test_addr(addr, 1);
+
+    /*** Unknown advertiser. */
+    TEST_ASSERT(!ble_ll_scan_is_dup_adv(BLE_ADV_PDU_TYPE_ADV_IND, 0, addr));
+
+    /*** Advertising report sent; direct report not. */
+    ble_ll_scan_add_dup_adv(addr, 0, BLE_HCI_LE_SUBEV_ADV_RPT);
+    TEST_ASSERT(ble_ll_scan_is_dup_adv(BLE_ADV_PDU_TYPE_ADV_IND, 0, addr));
+    TEST_ASSERT(!ble_ll_scan_is_dup_adv(BLE_ADV_PDU_TYPE_ADV_DIRECT_IND, 0,
+                                        addr));
+
+    /*** Same address, other type, is a different advertiser. */
+    TEST_ASSERT(!ble_ll_scan_is_dup_adv(BLE_ADV_PDU_TYPE_ADV_IND, 1, addr));
+
+    /*** Direct report sent. */
+    ble_ll_scan_add_dup_adv(addr, 0, BLE_HCI_LE_SUBEV_DIRECT_ADV_RPT);
+    TEST_ASSERT(ble_ll_scan_is_dup_adv(BLE_ADV_PDU_TYPE_ADV_DIRECT_IND, 0,
+                                       addr));
+    TEST_ASSERT(ble_ll_scan_is_dup_adv(BLE_ADV_PDU_TYPE_ADV_IND, 0, addr));
+
+    /*** Clearing forgets every advertiser. */
+    ble_ll_scan_clr_dup_advs();
+    TEST_ASSERT(!ble_ll_scan_is_dup_adv(BLE_ADV_PDU_TYPE_ADV_IND, 0, addr));
+}
+
+TEST_CASE(ble_ll_scan_dup_test_case_collide)
+{
+    uint8_t addr[BLE_DEV_ADDR_LEN];
+    uint16_t bucket;
+    int same[3];
+    int num_same;
+    int i;
+
+    ble_ll_scan_clr_dup_advs();
+
+    /* Find advertisers which share a bucket. */
+    ble_ll_scan_dup_test_addr(addr, 0);
+    bucket = ble_ll_scan_dup_adv_bucket(addr, 0);
+    num_same = 0;
+    for (i = 0; num_same < 3; i++) {
+        TEST_ASSERT_FATAL(i < 0x10000);
+        ble_ll_scan_dup_test_addr(addr, i);
+        if (ble_ll_scan_dup_adv_bucket(addr, 0) == bucket) {
+            same[num_same++] = i;
+        }
+    }
+
+    for (i = 0; i < 3; i++) {
+        ble_ll_scan_dup_test_add(same[i], 0);
+    }
+    for (i = 0; i < 3; i++) {
+        TEST_ASSERT(ble_ll_scan_dup_test_is_dup(same[i], 0));
+    }
+
+    /*** Evict the middle one of the chain; the others stay reachable. */
+    if (BLE_LL_SCAN_DUP_TEST_NUM >= 3) {
+        TEST_ASSERT(ble_ll_scan_dup_test_is_dup(same[0], 0));
+        TEST_ASSERT(ble_ll_scan_dup_test_is_dup(same[2], 0));
+        for (i = 3; i < BLE_LL_SCAN_DUP_TEST_NUM; i++) {
+            ble_ll_scan_dup_test_add(0x8000 + i, 1);
+        }
+        ble_ll_scan_dup_test_add(0x7fff, 1);
+
+        TEST_ASSERT(!ble_ll_scan_dup_test_is_dup(same[1], 0));
+        TEST_ASSERT(ble_ll_scan_dup_test_is_dup(same[0], 0));
+        TEST_ASSERT(ble_ll_scan_dup_test_is_dup(same[2], 0));
+        TEST_ASSERT(ble_ll_scan_dup_test_is_dup(0x7fff, 1));
+    }
+}
+
+TEST_CASE(ble_ll_scan_dup_test_case_lru)
+{
+    int i;
+
+    ble_ll_scan_clr_dup_advs();
+
+    /*** Fill the table. */
+    for (i = 0; i < BLE_LL_SCAN_DUP_TEST_NUM; i++) {
+        ble_ll_scan_dup_test_add(i, 0);
+    }
+    for (i = 0; i < BLE_LL_SCAN_DUP_TEST_NUM; i++) {
+        TEST_ASSERT(ble_ll_scan_dup_test_is_dup(i, 0));
+    }
+
+    /*** Hearing from 0 makes 1 the least recently heard; it is evicted. */
+    TEST_ASSERT(ble_ll_scan_dup_test_is_dup(0, 0));
+    ble_ll_scan_dup_test_add(BLE_LL_SCAN_DUP_TEST_NUM, 0);
+    TEST_ASSERT(ble_ll_scan_dup_test_is_dup(BLE_LL_SCAN_DUP_TEST_NUM, 0));
+    TEST_ASSERT(ble_ll_scan_dup_test_is_dup(0, 0));
+    TEST_ASSERT(!ble_ll_scan_dup_test_is_dup(1, 0));
+
+    /*** Adding again refreshes too; 2 is evicted next, not 0 or 3. */
+    ble_ll_scan_dup_test_add(3, 0);
+    ble_ll_scan_dup_test_add(BLE_LL_SCAN_DUP_TEST_NUM + 1, 0);
+    TEST_ASSERT(!ble_ll_scan_dup_test_is_dup(2, 0));
+    TEST_ASSERT(ble_ll_scan_dup_test_is_dup(3, 0));
+    TEST_ASSERT(ble_ll_scan_dup_test_is_dup(0, 0));
+
+    /*** Many more advertisers than entries; only the newest are kept. */
+    for (i = 0; i < 4 * BLE_LL_SCAN_DUP_TEST_NUM; i++) {
+        ble_ll_scan_dup_test_add(0x1000 + i, 1);
+    }
+    for (i = 0; i < 4 * BLE_LL_SCAN_DUP_TEST_NUM; i++) {
+        TEST_ASSERT(ble_ll_scan_dup_test_is_dup(0x1000 + i, 1) ==
+                    (i >= 3 * BLE_LL_SCAN_DUP_TEST_NUM));
+    }
+}
+
+TEST_SUITE(ble_ll_scan_dup_test_suite)
+{
+    ble_ll_scan_dup_test_case_bucket();
+    ble_ll_scan_dup_test_case_flags();
+    ble_ll_scan_dup_test_case_collide();
+    ble_ll_scan_dup_test_case_lru();
+}
+
+#ifdef MYNEWT_SELFTEST
+
+int
+main(int argc, char **argv)
+{
+    tu_config.tc_print_results = 1;
+    tu_init();
+
+    ble_ll_scan_dup_test_suite();
+
+    return tu_any_failed;
+}
+
+#endif
@@ -158,6 +158,24 @@ struct ble_gap_adv_params {
     uint8_t high_duty_cycle:1;
 };
 
+/** Host-side ACL transmit statistics for a single connection. */
+struct ble_gap_conn_tx_stats {
+    /** Number of ACL fragments currently queued in the host. */
+    uint16_t queue_depth;
+
+    /** Highest queue depth seen on this connection. */
+    uint16_t queue_depth_max;
+
+    /** Number of ACL fragments handed to the controller. */
+    uint32_t tx_frags;
+
+    /** Total time fragments spent queued in the host, in OS ticks. */
+    uint32_t latency_total;
+
+    /** Longest time any fragment spent queued in the host, in OS ticks. */
+    uint32_t latency_max;
+};
+
 struct ble_gap_conn_desc {
     struct ble_gap_sec_state sec_state;
     uint8_t peer_ota_addr[6];
@@ -561,5 +579,7 @@ int ble_gap_pair_initiate(uint16_t conn_handle);
 int ble_gap_encryption_initiate(uint16_t conn_handle, const uint8_t *ltk,
                                 uint16_t ediv, uint64_t rand_val, int auth);
 int ble_gap_conn_rssi(uint16_t conn_handle, int8_t *out_rssi);
+int ble_gap_conn_tx_stats(uint16_t conn_handle,
+                          struct ble_gap_conn_tx_stats *out_stats);
 
 #endif
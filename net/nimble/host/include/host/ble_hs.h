@@ -208,6 +208,16 @@ struct ble_hs_cfg {
     uint8_t sm_our_key_dist;
     uint8_t sm_their_key_dist;
 
+    /**
+     * Event queue of a low-priority task which performs the P-256 operations
+     * of LE secure connections pairing (key pair generation and DHKey).  The
+     * task must handle OS_EVENT_T_TIMER events by calling the callout
+     * function (os_callout_func.cf_func) with the event argument.  If NULL,
+     * these operations execute in the host task, blocking it for their
+     * duration.
+     */
+    struct os_eventq *sm_crypto_evq;
+
     /*** HCI settings */
     /**
      * This callback is executed when the host resets itself and the controller
@@ -498,7 +498,6 @@ ble_att_set_preferred_mtu(uint16_t mtu)
 {
     struct ble_l2cap_chan *chan;
     struct ble_hs_conn *conn;
-    int i;
 
     if (mtu < BLE_ATT_MTU_DFLT) {
         return BLE_HS_EINVAL;
@@ -512,16 +511,16 @@ ble_att_set_preferred_mtu(uint16_t mtu)
     /* Set my_mtu for established connections that haven't exchanged. */
     ble_hs_lock();
 
-    i = 0;
-    while ((conn = ble_hs_conn_find_by_idx(i)) != NULL) {
+    for (conn = ble_hs_conn_first();
+         conn != NULL;
+         conn = ble_hs_conn_next(conn)) {
+
         chan = ble_hs_conn_chan_find(conn, BLE_L2CAP_CID_ATT);
         BLE_HS_DBG_ASSERT(chan != NULL);
 
         if (!(chan->blc_flags & BLE_L2CAP_CHAN_F_TXED_MTU)) {
             chan->blc_my_mtu = mtu;
         }
-
-        i++;
     }
 
     ble_hs_unlock();
@@ -145,6 +145,9 @@ int ble_att_svr_register_uuid16(uint16_t uuid16, uint8_t flags,
 struct ble_att_svr_entry {
     STAILQ_ENTRY(ble_att_svr_entry) ha_next;
 
+    /* Next attribute with the same UUID, in handle order. */
+    struct ble_att_svr_entry *ha_uuid_next;
+
     uint8_t ha_uuid[16];
     uint8_t ha_flags;
     uint8_t ha_pad1;
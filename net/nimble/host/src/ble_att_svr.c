@@ -30,6 +30,19 @@ static struct ble_att_svr_entry_list ble_att_svr_list;
 
 static uint16_t ble_att_svr_id;
 
+/* Registered entries, indexed by handle - 1.  Handles are assigned densely
+ * and attributes are never removed, so the first ble_att_svr_id slots are
+ * always filled.
+ */
+static struct ble_att_svr_entry **ble_att_svr_handle_idx;
+
+/* Registered entries, sorted by UUID and then by handle.  All attributes
+ * sharing a UUID are adjacent, so the first attribute of a given type at or
+ * after a handle is found with a binary search; the ha_uuid_next links lead
+ * from there to the following ones.
+ */
+static struct ble_att_svr_entry **ble_att_svr_uuid_idx;
+
 static void *ble_att_svr_entry_mem;
 static struct os_mempool ble_att_svr_entry_pool;
 
@@ -49,6 +62,50 @@ ble_att_svr_entry_alloc(void)
     return entry;
 }
 
+/**
+ * Compares an attribute against a UUID / handle pair using the sort order of
+ * the UUID index.
+ */
+static int
+ble_att_svr_uuid_idx_cmp(const struct ble_att_svr_entry *entry,
+                         const uint8_t *uuid, uint16_t handle_id)
+{
+    int rc;
+
+    rc = memcmp(entry->ha_uuid, uuid, sizeof entry->ha_uuid);
+    if (rc != 0) {
+        return rc;
+    }
+
+    return (int)entry->ha_handle_id - (int)handle_id;
+}
+
+/**
+ * Returns the position in the UUID index of the first attribute that sorts
+ * at or after the specified UUID / handle pair.
+ */
+static int
+ble_att_svr_uuid_idx_find(const uint8_t *uuid, uint16_t handle_id)
+{
+    int mid;
+    int lo;
+    int hi;
+
+    lo = 0;
+    hi = ble_att_svr_id;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (ble_att_svr_uuid_idx_cmp(ble_att_svr_uuid_idx[mid], uuid,
+                                     handle_id) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
 /**
  * Allocate the next handle id and return it.
  *
@@ -78,12 +135,18 @@ ble_att_svr_register(const uint8_t *uuid, uint8_t flags, uint16_t *handle_id,
                      ble_att_svr_access_fn *cb, void *cb_arg)
 {
     struct ble_att_svr_entry *entry;
+    int idx;
 
     entry = ble_att_svr_entry_alloc();
     if (entry == NULL) {
         return BLE_HS_ENOMEM;
     }
 
+    /* The new attribute gets the highest handle, so it sorts after every
+     * existing attribute with the same UUID.
+     */
+    idx = ble_att_svr_uuid_idx_find(uuid, UINT16_MAX);
+
     memcpy(&entry->ha_uuid, uuid, sizeof entry->ha_uuid);
     entry->ha_flags = flags;
     entry->ha_handle_id = ble_att_svr_next_id();
@@ -91,6 +154,18 @@ ble_att_svr_register(const uint8_t *uuid, uint8_t flags, uint16_t *handle_id,
     entry->ha_cb_arg = cb_arg;
 
     STAILQ_INSERT_TAIL(&ble_att_svr_list, entry, ha_next);
+    ble_att_svr_handle_idx[entry->ha_handle_id - 1] = entry;
+
+    memmove(ble_att_svr_uuid_idx + idx + 1, ble_att_svr_uuid_idx + idx,
+            (entry->ha_handle_id - 1 - idx) * sizeof *ble_att_svr_uuid_idx);
+    ble_att_svr_uuid_idx[idx] = entry;
+
+    if (idx > 0 &&
+        memcmp(ble_att_svr_uuid_idx[idx - 1]->ha_uuid, uuid,
+               sizeof entry->ha_uuid) == 0) {
+
+        ble_att_svr_uuid_idx[idx - 1]->ha_uuid_next = entry;
+    }
 
     if (handle_id != NULL) {
         *handle_id = entry->ha_handle_id;
@@ -130,31 +205,65 @@ ble_att_svr_prev_handle(void)
  * Find a host attribute by handle id.
  *
  * @param handle_id             The handle_id to search for
- * @param ha_ptr                On input: Indicates the starting point of the
- *                                  walk; null means start at the beginning of
- *                                  the list, non-null means start at the
- *                                  following entry.
- *                              On output: Indicates the last ble_att element
- *                                  processed, or NULL if the entire list has
- *                                  been processed.
  *
- * @return                      0 on success; BLE_HS_ENOENT on not found.
+ * @return                      The attribute entry on success; NULL if no
+ *                                  attribute has the specified handle.
  */
 struct ble_att_svr_entry *
 ble_att_svr_find_by_handle(uint16_t handle_id)
+{
+    if (handle_id == 0 || handle_id > ble_att_svr_id) {
+        return NULL;
+    }
+
+    return ble_att_svr_handle_idx[handle_id - 1];
+}
+
+/**
+ * Finds the first attribute whose handle is greater than or equal to the
+ * specified handle; the starting point for walks over a handle range.
+ */
+static struct ble_att_svr_entry *
+ble_att_svr_find_first(uint16_t handle_id)
+{
+    if (handle_id == 0) {
+        handle_id = 1;
+    }
+
+    return ble_att_svr_find_by_handle(handle_id);
+}
+
+/**
+ * Finds the first attribute with the specified UUID whose handle lies in the
+ * range [start_handle, end_handle].
+ *
+ * @return                      The attribute entry on success; NULL if no
+ *                                  attribute matches.
+ */
+static struct ble_att_svr_entry *
+ble_att_svr_find_by_uuid_range(const uint8_t *uuid, uint16_t start_handle,
+                               uint16_t end_handle)
 {
     struct ble_att_svr_entry *entry;
+    int idx;
 
-    for (entry = STAILQ_FIRST(&ble_att_svr_list);
-         entry != NULL;
-         entry = STAILQ_NEXT(entry, ha_next)) {
+    if (start_handle > end_handle) {
+        return NULL;
+    }
 
-        if (entry->ha_handle_id == handle_id) {
-            return entry;
-        }
+    idx = ble_att_svr_uuid_idx_find(uuid, start_handle);
+    if (idx >= ble_att_svr_id) {
+        return NULL;
+    }
+
+    entry = ble_att_svr_uuid_idx[idx];
+    if (entry->ha_handle_id > end_handle ||
+        memcmp(entry->ha_uuid, uuid, sizeof entry->ha_uuid) != 0) {
+
+        return NULL;
     }
 
-    return NULL;
+    return entry;
 }
 
 /**
@@ -178,21 +287,23 @@ ble_att_svr_find_by_uuid(struct ble_att_svr_entry *prev, const uint8_t *uuid,
     struct ble_att_svr_entry *entry;
 
     if (prev == NULL) {
-        entry = STAILQ_FIRST(&ble_att_svr_list);
-    } else {
-        entry = STAILQ_NEXT(prev, ha_next);
+        return ble_att_svr_find_by_uuid_range(uuid, 0, end_handle);
     }
 
-    for (;
-         entry != NULL && entry->ha_handle_id <= end_handle;
-         entry = STAILQ_NEXT(entry, ha_next)) {
-
-        if (memcmp(entry->ha_uuid, uuid, sizeof entry->ha_uuid) == 0) {
-            return entry;
+    if (memcmp(prev->ha_uuid, uuid, sizeof prev->ha_uuid) != 0) {
+        if (prev->ha_handle_id == UINT16_MAX) {
+            return NULL;
         }
+        return ble_att_svr_find_by_uuid_range(uuid, prev->ha_handle_id + 1,
+                                              end_handle);
+    }
+
+    entry = prev->ha_uuid_next;
+    if (entry == NULL || entry->ha_handle_id > end_handle) {
+        return NULL;
     }
 
-    return NULL;
+    return entry;
 }
 
 static int
@@ -730,7 +841,10 @@ ble_att_svr_fill_info(struct ble_att_find_info_req *req, struct os_mbuf *om,
     num_entries = 0;
     rc = 0;
 
-    STAILQ_FOREACH(ha, &ble_att_svr_list, ha_next) {
+    for (ha = ble_att_svr_find_first(req->bafq_start_handle);
+         ha != NULL;
+         ha = STAILQ_NEXT(ha, ha_next)) {
+
         if (ha->ha_handle_id > req->bafq_end_handle) {
             rc = 0;
             goto done;
@@ -1041,50 +1155,45 @@ ble_att_svr_fill_type_value(uint16_t conn_handle,
                             uint16_t mtu, uint8_t *out_att_err)
 {
     struct ble_att_svr_entry *ha;
+    uint8_t uuid128[16];
     uint8_t buf[16];
     uint16_t attr_len;
-    uint16_t uuid16;
     uint16_t first;
     uint16_t prev;
     int any_entries;
-    int match;
     int rc;
 
     first = 0;
     prev = 0;
-    rc = 0;
 
-    /* Iterate through the attribute list, keeping track of the current
-     * matching group.  For each attribute entry, determine if data needs to be
-     * written to the response.
+    /* Iterate through the attributes of the requested type, keeping track of
+     * the current matching group.  Attributes of other types never match;
+     * they only separate groups, which shows up as a gap in the handles.
      */
-    STAILQ_FOREACH(ha, &ble_att_svr_list, ha_next) {
-        match = 0;
+    rc = ble_uuid_16_to_128(req->bavq_attr_type, uuid128);
+    if (rc != 0) {
+        ha = NULL;
+    } else {
+        ha = ble_att_svr_find_by_uuid_range(uuid128, req->bavq_start_handle,
+                                            req->bavq_end_handle);
+    }
 
-        if (ha->ha_handle_id > req->bavq_end_handle) {
-            break;
-        }
+    for (;
+         ha != NULL;
+         ha = ble_att_svr_find_by_uuid(ha, uuid128, req->bavq_end_handle)) {
 
-        if (ha->ha_handle_id >= req->bavq_start_handle) {
-            /* Compare the attribute type and value to the request fields to
-             * determine if this attribute matches.
-             */
-            uuid16 = ble_uuid_128_to_16(ha->ha_uuid);
-            if (uuid16 == req->bavq_attr_type) {
-                rc = ble_att_svr_read_flat(conn_handle, ha, 0, sizeof buf, buf,
-                                           &attr_len, out_att_err);
-                if (rc != 0) {
-                    goto done;
-                }
-                rc = os_mbuf_cmpf(rxom, BLE_ATT_FIND_TYPE_VALUE_REQ_BASE_SZ,
-                                  buf, attr_len);
-                if (rc == 0) {
-                    match = 1;
-                }
-            }
+        /* Compare the attribute value to the request field to determine if
+         * this attribute matches.
+         */
+        rc = ble_att_svr_read_flat(conn_handle, ha, 0, sizeof buf, buf,
+                                   &attr_len, out_att_err);
+        if (rc != 0) {
+            goto done;
         }
+        rc = os_mbuf_cmpf(rxom, BLE_ATT_FIND_TYPE_VALUE_REQ_BASE_SZ,
+                          buf, attr_len);
 
-        if (match) {
+        if (rc == 0) {
             rc = ble_att_svr_fill_type_value_match(txom, &first, &prev,
                                                    ha->ha_handle_id, mtu,
                                                    out_att_err);
@@ -1271,47 +1380,52 @@ ble_att_svr_build_read_type_rsp(uint16_t conn_handle,
     /* Find all matching attributes, writing a record for each. */
     entry = NULL;
     while (1) {
-        entry = ble_att_svr_find_by_uuid(entry, uuid128, req->batq_end_handle);
+        if (entry == NULL) {
+            entry = ble_att_svr_find_by_uuid_range(uuid128,
+                                                   req->batq_start_handle,
+                                                   req->batq_end_handle);
+        } else {
+            entry = ble_att_svr_find_by_uuid(entry, uuid128,
+                                             req->batq_end_handle);
+        }
         if (entry == NULL) {
             rc = BLE_HS_ENOENT;
             break;
         }
 
-        if (entry->ha_handle_id >= req->batq_start_handle) {
-            rc = ble_att_svr_read_flat(conn_handle, entry, 0, sizeof buf, buf,
-                                       &attr_len, att_err);
-            if (rc != 0) {
-                *err_handle = entry->ha_handle_id;
-                goto done;
-            }
-
-            if (attr_len > mtu - 4) {
-                attr_len = mtu - 4;
-            }
+        rc = ble_att_svr_read_flat(conn_handle, entry, 0, sizeof buf, buf,
+                                   &attr_len, att_err);
+        if (rc != 0) {
+            *err_handle = entry->ha_handle_id;
+            goto done;
+        }
 
-            if (prev_attr_len == 0) {
-                prev_attr_len = attr_len;
-            } else if (prev_attr_len != attr_len) {
-                break;
-            }
+        if (attr_len > mtu - 4) {
+            attr_len = mtu - 4;
+        }
 
-            txomlen = OS_MBUF_PKTHDR(txom)->omp_len + 2 + attr_len;
-            if (txomlen > mtu) {
-                break;
-            }
+        if (prev_attr_len == 0) {
+            prev_attr_len = attr_len;
+        } else if (prev_attr_len != attr_len) {
+            break;
+        }
 
-            dptr = os_mbuf_extend(txom, 2 + attr_len);
-            if (dptr == NULL) {
-                *att_err = BLE_ATT_ERR_INSUFFICIENT_RES;
-                *err_handle = entry->ha_handle_id;
-                rc = BLE_HS_ENOMEM;
-                goto done;
-            }
+        txomlen = OS_MBUF_PKTHDR(txom)->omp_len + 2 + attr_len;
+        if (txomlen > mtu) {
+            break;
+        }
 
-            htole16(dptr + 0, entry->ha_handle_id);
-            memcpy(dptr + 2, buf, attr_len);
-            entry_written = 1;
+        dptr = os_mbuf_extend(txom, 2 + attr_len);
+        if (dptr == NULL) {
+            *att_err = BLE_ATT_ERR_INSUFFICIENT_RES;
+            *err_handle = entry->ha_handle_id;
+            rc = BLE_HS_ENOMEM;
+            goto done;
         }
+
+        htole16(dptr + 0, entry->ha_handle_id);
+        memcpy(dptr + 2, buf, attr_len);
+        entry_written = 1;
     }
 
 done:
@@ -1729,6 +1843,51 @@ ble_att_svr_read_group_type_entry_write(struct os_mbuf *om, uint16_t mtu,
     return 0;
 }
 
+/**
+ * Determines the last handle of the group that starts at the specified
+ * handle.  A group ends just before the next primary or secondary service
+ * declaration.  If that declaration lies beyond the requested range, the
+ * group is reported as ending at the end of the range; if no attributes
+ * follow the group at all, 0xffff is reported so that the client knows not
+ * to send a follow-up request.
+ */
+static uint16_t
+ble_att_svr_group_end(uint16_t start_handle, uint16_t end_handle)
+{
+    struct ble_att_svr_entry *entry;
+    uint8_t uuid128[16];
+    uint16_t next;
+    int rc;
+
+    next = 0;
+
+    rc = ble_uuid_16_to_128(BLE_ATT_UUID_PRIMARY_SERVICE, uuid128);
+    BLE_HS_DBG_ASSERT_EVAL(rc == 0);
+    entry = ble_att_svr_find_by_uuid_range(uuid128, start_handle + 1,
+                                           end_handle);
+    if (entry != NULL) {
+        next = entry->ha_handle_id;
+    }
+
+    rc = ble_uuid_16_to_128(BLE_ATT_UUID_SECONDARY_SERVICE, uuid128);
+    BLE_HS_DBG_ASSERT_EVAL(rc == 0);
+    entry = ble_att_svr_find_by_uuid_range(uuid128, start_handle + 1,
+                                           end_handle);
+    if (entry != NULL && (next == 0 || entry->ha_handle_id < next)) {
+        next = entry->ha_handle_id;
+    }
+
+    if (next != 0) {
+        return next - 1;
+    }
+
+    if (ble_att_svr_id > end_handle) {
+        return end_handle;
+    }
+
+    return 0xffff;
+}
+
 /**
  * @return                      0 on success; BLE_HS error code on failure.
  */
@@ -1776,120 +1935,82 @@ ble_att_svr_build_read_group_type_rsp(uint16_t conn_handle,
         goto done;
     }
 
-    start_group_handle = 0;
     rsp.bagp_length = 0;
-    STAILQ_FOREACH(entry, &ble_att_svr_list, ha_next) {
-        if (entry->ha_handle_id < req->bagq_start_handle) {
-            continue;
-        }
-        if (entry->ha_handle_id > req->bagq_end_handle) {
-            /* The full input range has been searched. */
-            rc = 0;
+    for (entry = ble_att_svr_find_by_uuid_range(group_uuid128,
+                                                req->bagq_start_handle,
+                                                req->bagq_end_handle);
+         entry != NULL;
+         entry = ble_att_svr_find_by_uuid_range(group_uuid128,
+                                                end_group_handle + 1,
+                                                req->bagq_end_handle)) {
+
+        /* Found a group start.  Read the group UUID. */
+        rc = ble_att_svr_service_uuid(entry, &service_uuid16, service_uuid128);
+        if (rc != 0) {
+            *err_handle = entry->ha_handle_id;
+            *att_err = BLE_ATT_ERR_UNLIKELY;
+            rc = BLE_HS_ENOTSUP;
             goto done;
         }
 
-        if (start_group_handle != 0) {
-            /* We have already found the start of a group. */
-            if (!ble_att_svr_is_valid_group_type(entry->ha_uuid)) {
-                /* This attribute is part of the current group. */
-                end_group_handle = entry->ha_handle_id;
+        /* Make sure the group UUID lengths are consistent.  If this group has
+         * a different length UUID, then cut the response short.
+         */
+        switch (rsp.bagp_length) {
+        case 0:
+            if (service_uuid16 != 0) {
+                rsp.bagp_length = BLE_ATT_READ_GROUP_TYPE_ADATA_SZ_16;
             } else {
-                /* This attribute marks the end of the group.  Write an entry
-                 * representing the group to the response.
-                 */
-                rc = ble_att_svr_read_group_type_entry_write(
-                    txom, mtu, start_group_handle, end_group_handle,
-                    service_uuid16, service_uuid128);
-                start_group_handle = 0;
-                end_group_handle = 0;
-                if (rc != 0) {
-                    *err_handle = entry->ha_handle_id;
-                    if (rc == BLE_HS_ENOMEM) {
-                        *att_err = BLE_ATT_ERR_INSUFFICIENT_RES;
-                    } else {
-                        BLE_HS_DBG_ASSERT(rc == BLE_HS_EMSGSIZE);
-                    }
-                    goto done;
-                }
+                rsp.bagp_length = BLE_ATT_READ_GROUP_TYPE_ADATA_SZ_128;
             }
-        }
-
-        if (start_group_handle == 0) {
-            /* We are looking for the start of a group. */
-            if (memcmp(entry->ha_uuid, group_uuid128, 16) == 0) {
-                /* Found a group start.  Read the group UUID. */
-                rc = ble_att_svr_service_uuid(entry, &service_uuid16,
-                                              service_uuid128);
-                if (rc != 0) {
-                    *err_handle = entry->ha_handle_id;
-                    *att_err = BLE_ATT_ERR_UNLIKELY;
-                    rc = BLE_HS_ENOTSUP;
-                    goto done;
-                }
+            break;
 
-                /* Make sure the group UUID lengths are consistent.  If this
-                 * group has a different length UUID, then cut the response
-                 * short.
-                 */
-                switch (rsp.bagp_length) {
-                case 0:
-                    if (service_uuid16 != 0) {
-                        rsp.bagp_length = BLE_ATT_READ_GROUP_TYPE_ADATA_SZ_16;
-                    } else {
-                        rsp.bagp_length = BLE_ATT_READ_GROUP_TYPE_ADATA_SZ_128;
-                    }
-                    break;
-
-                case BLE_ATT_READ_GROUP_TYPE_ADATA_SZ_16:
-                    if (service_uuid16 == 0) {
-                        rc = 0;
-                        goto done;
-                    }
-                    break;
-
-                case BLE_ATT_READ_GROUP_TYPE_ADATA_SZ_128:
-                    if (service_uuid16 != 0) {
-                        rc = 0;
-                        goto done;
-                    }
-                    break;
-
-                default:
-                    BLE_HS_DBG_ASSERT(0);
-                    goto done;
-                }
+        case BLE_ATT_READ_GROUP_TYPE_ADATA_SZ_16:
+            if (service_uuid16 == 0) {
+                rc = 0;
+                goto done;
+            }
+            break;
 
-                start_group_handle = entry->ha_handle_id;
-                end_group_handle = entry->ha_handle_id;
+        case BLE_ATT_READ_GROUP_TYPE_ADATA_SZ_128:
+            if (service_uuid16 != 0) {
+                rc = 0;
+                goto done;
             }
+            break;
+
+        default:
+            BLE_HS_DBG_ASSERT(0);
+            goto done;
         }
-    }
 
-    rc = 0;
+        start_group_handle = entry->ha_handle_id;
+        end_group_handle = ble_att_svr_group_end(start_group_handle,
+                                                 req->bagq_end_handle);
 
-done:
-    if (rc == 0) {
-        if (start_group_handle != 0) {
-            /* A group was being processed.  Add its corresponding entry to the
-             * response.
-             */
-
-            if (entry == NULL) {
-                /* We have reached the end of the attribute list.  Indicate an
-                 * end handle of 0xffff so that the client knows there are no
-                 * more attributes without needing to send a follow-up request.
-                 */
-                end_group_handle = 0xffff;
-            }
-
-            rc = ble_att_svr_read_group_type_entry_write(
-                txom, mtu, start_group_handle, end_group_handle,
-                service_uuid16, service_uuid128);
+        rc = ble_att_svr_read_group_type_entry_write(
+            txom, mtu, start_group_handle, end_group_handle,
+            service_uuid16, service_uuid128);
+        if (rc != 0) {
+            *err_handle = entry->ha_handle_id;
             if (rc == BLE_HS_ENOMEM) {
                 *att_err = BLE_ATT_ERR_INSUFFICIENT_RES;
+            } else {
+                BLE_HS_DBG_ASSERT(rc == BLE_HS_EMSGSIZE);
             }
+            goto done;
+        }
+
+        if (end_group_handle == 0xffff) {
+            /* No more attributes. */
+            break;
         }
+    }
 
+    rc = 0;
+
+done:
+    if (rc == 0) {
         if (OS_MBUF_PKTLEN(txom) <= BLE_ATT_READ_GROUP_TYPE_RSP_BASE_SZ) {
             *att_err = BLE_ATT_ERR_ATTR_NOT_FOUND;
             rc = BLE_HS_ENOENT;
@@ -2668,6 +2789,12 @@ ble_att_svr_free_mem(void)
 {
     free(ble_att_svr_entry_mem);
     ble_att_svr_entry_mem = NULL;
+
+    free(ble_att_svr_handle_idx);
+    ble_att_svr_handle_idx = NULL;
+
+    free(ble_att_svr_uuid_idx);
+    ble_att_svr_uuid_idx = NULL;
 }
 
 int
@@ -2693,6 +2820,20 @@ ble_att_svr_init(void)
             rc = BLE_HS_EOS;
             goto err;
         }
+
+        ble_att_svr_handle_idx = malloc(ble_hs_cfg.max_attrs *
+                                        sizeof *ble_att_svr_handle_idx);
+        if (ble_att_svr_handle_idx == NULL) {
+            rc = BLE_HS_ENOMEM;
+            goto err;
+        }
+
+        ble_att_svr_uuid_idx = malloc(ble_hs_cfg.max_attrs *
+                                      sizeof *ble_att_svr_uuid_idx);
+        if (ble_att_svr_uuid_idx == NULL) {
+            rc = BLE_HS_ENOMEM;
+            goto err;
+        }
     }
 
     if (ble_hs_cfg.max_prep_entries > 0) {
@@ -1392,8 +1392,12 @@ ble_gap_wl_busy(void)
            ble_gap_master.conn.using_wl;
 }
 
+/**
+ * Queues an add-to-white-list command.  The command's result is recorded in
+ * *status once it completes; see ble_hs_hci_cmd_status_cb().
+ */
 static int
-ble_gap_wl_tx_add(const struct ble_gap_white_entry *entry)
+ble_gap_wl_tx_add(const struct ble_gap_white_entry *entry, int *status)
 {
     uint8_t buf[BLE_HCI_CMD_HDR_LEN + BLE_HCI_CHG_WHITE_LIST_LEN];
     int rc;
@@ -1404,7 +1408,7 @@ ble_gap_wl_tx_add(const struct ble_gap_white_entry *entry)
         return rc;
     }
 
-    rc = ble_hs_hci_cmd_tx_empty_ack(buf);
+    rc = ble_hs_hci_cmd_tx_async(buf, ble_hs_hci_cmd_status_cb, status);
     if (rc != 0) {
         return rc;
     }
@@ -1443,6 +1447,7 @@ ble_gap_wl_set(const struct ble_gap_white_entry *white_list,
     return BLE_HS_ENOTSUP;
 #endif
 
+    int status;
     int rc;
     int i;
 
@@ -1478,14 +1483,19 @@ ble_gap_wl_set(const struct ble_gap_white_entry *white_list,
         goto done;
     }
 
+    /* Pipeline the additions rather than waiting for each ack in turn. */
+    status = 0;
     for (i = 0; i < white_list_count; i++) {
-        rc = ble_gap_wl_tx_add(white_list + i);
+        rc = ble_gap_wl_tx_add(white_list + i, &status);
         if (rc != 0) {
-            goto done;
+            break;
         }
     }
+    ble_hs_hci_cmd_wait_all();
 
-    rc = 0;
+    if (rc == 0) {
+        rc = status;
+    }
 
 done:
     ble_hs_unlock();
@@ -3143,6 +3153,43 @@ ble_gap_conn_rssi(uint16_t conn_handle, int8_t *out_rssi)
     return rc;
 }
 
+/*****************************************************************************
+ * $tx stats                                                                 *
+ *****************************************************************************/
+
+/**
+ * Retrieves the host-side ACL transmit statistics for the specified
+ * connection.
+ *
+ * @param conn_handle           The connection to query.
+ * @param out_stats             On success, the statistics get written here.
+ *
+ * @return                      0 on success;
+ *                              BLE_HS_ENOTCONN if there is no connection with
+ *                                  the specified handle.
+ */
+int
+ble_gap_conn_tx_stats(uint16_t conn_handle,
+                      struct ble_gap_conn_tx_stats *out_stats)
+{
+    struct ble_hs_conn *conn;
+
+    ble_hs_lock();
+
+    conn = ble_hs_conn_find(conn_handle);
+    if (conn != NULL) {
+        *out_stats = conn->bhc_tx_stats;
+    }
+
+    ble_hs_unlock();
+
+    if (conn == NULL) {
+        return BLE_HS_ENOTCONN;
+    }
+
+    return 0;
+}
+
 /*****************************************************************************
  * $notify                                                                   *
  *****************************************************************************/
@@ -36,9 +36,10 @@
  * Notes on thread-safety:
  * 1. The ble_hs mutex must never be locked when an application callback is
  *    executed.  A callback is free to initiate additional host procedures.
- * 2. The only resource protected by the mutex is the list of active procedures
- *    (ble_gattc_procs).  Thread-safety is achieved by locking the mutex during
- *    removal and insertion operations.  Procedure objects are only modified
+ * 2. The only resources protected by the mutex are the lists of active
+ *    procedures (ble_gattc_proc_buckets and ble_gattc_proc_exp_list).
+ *    Thread-safety is achieved by locking the mutex during removal and
+ *    insertion operations.  Procedure objects are only modified
  *    while they are not in the list.  This is sufficient, as the host parent
  *    task is the only task which inspects or modifies individual procedure
  *    entries.  Tasks have the following permissions regarding procedure
@@ -86,8 +87,12 @@
 
 /** Represents an in-progress GATT procedure. */
 struct ble_gattc_proc {
+    /* Links the proc into its connection's bucket (or a temporary list). */
     STAILQ_ENTRY(ble_gattc_proc) next;
 
+    /* Links the proc into the deadline-ordered expiry list. */
+    TAILQ_ENTRY(ble_gattc_proc) exp_next;
+
     uint32_t exp_os_ticks;
     uint16_t conn_handle;
     uint8_t op;
@@ -197,6 +202,7 @@ struct ble_gattc_proc {
 };
 
 STAILQ_HEAD(ble_gattc_proc_list, ble_gattc_proc);
+TAILQ_HEAD(ble_gattc_proc_exp_list, ble_gattc_proc);
 
 /**
  * Error functions - these handle an incoming ATT error response and apply it
@@ -319,7 +325,19 @@ static const struct ble_gattc_rx_exec_entry {
 /* Maintains the list of active GATT client procedures. */
 static void *ble_gattc_proc_mem;
 static struct os_mempool ble_gattc_proc_pool;
-static struct ble_gattc_proc_list ble_gattc_procs;
+
+/**
+ * Active procedures are kept in two places:
+ *     o Per-connection buckets, indexed by the low bits of the connection
+ *       handle.  Within a bucket, procs are kept in insertion order, so a
+ *       response is matched against the procs of its own connection only.
+ *     o A single list ordered by expiry time.  Every proc gets the same
+ *       timeout when it is (re)inserted, so new procs almost always go at the
+ *       tail and the heartbeat only needs to look at the head.
+ */
+static struct ble_gattc_proc_list *ble_gattc_proc_buckets;
+static struct ble_gattc_proc_exp_list ble_gattc_proc_exp_list;
+static uint16_t ble_gattc_proc_bucket_mask;
 
 /* Statistics. */
 STATS_SECT_DECL(ble_gattc_stats) ble_gattc_stats;
@@ -373,7 +391,7 @@ ble_gattc_dbg_assert_proc_not_inserted(struct ble_gattc_proc *proc)
 
     ble_hs_lock();
 
-    STAILQ_FOREACH(cur, &ble_gattc_procs, next) {
+    TAILQ_FOREACH(cur, &ble_gattc_proc_exp_list, exp_next) {
         BLE_HS_DBG_ASSERT(cur != proc);
     }
 
@@ -628,16 +646,62 @@ ble_gattc_proc_free(struct ble_gattc_proc *proc)
     }
 }
 
+static struct ble_gattc_proc_list *
+ble_gattc_proc_bucket(uint16_t conn_handle)
+{
+    return ble_gattc_proc_buckets + (conn_handle & ble_gattc_proc_bucket_mask);
+}
+
 static void
 ble_gattc_proc_insert(struct ble_gattc_proc *proc)
 {
+    struct ble_gattc_proc *prev;
+
     ble_gattc_dbg_assert_proc_not_inserted(proc);
 
     ble_hs_lock();
-    STAILQ_INSERT_TAIL(&ble_gattc_procs, proc, next);
+
+    STAILQ_INSERT_TAIL(ble_gattc_proc_bucket(proc->conn_handle), proc, next);
+
+    /* Keep the expiry list sorted.  Timers are set just before insertion, so
+     * the new proc only lands ahead of the tail if another task raced us.
+     */
+    TAILQ_FOREACH_REVERSE(prev, &ble_gattc_proc_exp_list,
+                          ble_gattc_proc_exp_list, exp_next) {
+        if ((int32_t)(proc->exp_os_ticks - prev->exp_os_ticks) >= 0) {
+            break;
+        }
+    }
+    if (prev == NULL) {
+        TAILQ_INSERT_HEAD(&ble_gattc_proc_exp_list, proc, exp_next);
+    } else {
+        TAILQ_INSERT_AFTER(&ble_gattc_proc_exp_list, prev, proc, exp_next);
+    }
+
     ble_hs_unlock();
 }
 
+/**
+ * Unlinks a proc from its connection bucket and from the expiry list.  The
+ * caller must hold the host lock and supply the proc's predecessor within
+ * the bucket (null if the proc is at the head).
+ */
+static void
+ble_gattc_proc_remove(struct ble_gattc_proc *proc, struct ble_gattc_proc *prev)
+{
+    struct ble_gattc_proc_list *bucket;
+
+    BLE_HS_DBG_ASSERT(ble_hs_locked_by_cur_task());
+
+    bucket = ble_gattc_proc_bucket(proc->conn_handle);
+    if (prev == NULL) {
+        STAILQ_REMOVE_HEAD(bucket, next);
+    } else {
+        STAILQ_REMOVE_AFTER(bucket, prev, next);
+    }
+    TAILQ_REMOVE(&ble_gattc_proc_exp_list, proc, exp_next);
+}
+
 static void
 ble_gattc_proc_set_timer(struct ble_gattc_proc *proc)
 {
@@ -706,13 +770,9 @@ ble_gattc_extract(uint16_t conn_handle, uint8_t op)
     ble_hs_lock();
 
     prev = NULL;
-    STAILQ_FOREACH(proc, &ble_gattc_procs, next) {
+    STAILQ_FOREACH(proc, ble_gattc_proc_bucket(conn_handle), next) {
         if (ble_gattc_proc_matches(proc, conn_handle, op)) {
-            if (prev == NULL) {
-                STAILQ_REMOVE_HEAD(&ble_gattc_procs, next);
-            } else {
-                STAILQ_REMOVE_AFTER(&ble_gattc_procs, prev, next);
-            }
+            ble_gattc_proc_remove(proc, prev);
             break;
         }
         prev = proc;
@@ -741,31 +801,21 @@ ble_gattc_conn_op_matches(struct ble_gattc_proc *proc, uint16_t conn_handle,
 }
 
 static void
-ble_gattc_extract_by_conn_op(uint16_t conn_handle, uint8_t op,
-                             struct ble_gattc_proc_list *dst_list)
+ble_gattc_extract_from_bucket(struct ble_gattc_proc_list *bucket,
+                              uint16_t conn_handle, uint8_t op,
+                              struct ble_gattc_proc_list *dst_list)
 {
     struct ble_gattc_proc *proc;
     struct ble_gattc_proc *prev;
     struct ble_gattc_proc *next;
 
-    /* Only the parent task is allowed to remove entries from the list. */
-    BLE_HS_DBG_ASSERT(ble_hs_is_parent_task());
-
-    STAILQ_INIT(dst_list);
-
-    ble_hs_lock();
-
     prev = NULL;
-    proc = STAILQ_FIRST(&ble_gattc_procs);
+    proc = STAILQ_FIRST(bucket);
     while (proc != NULL) {
         next = STAILQ_NEXT(proc, next);
 
         if (ble_gattc_conn_op_matches(proc, conn_handle, op)) {
-            if (prev == NULL) {
-                STAILQ_REMOVE_HEAD(&ble_gattc_procs, next);
-            } else {
-                STAILQ_REMOVE_AFTER(&ble_gattc_procs, prev, next);
-            }
+            ble_gattc_proc_remove(proc, prev);
             STAILQ_INSERT_TAIL(dst_list, proc, next);
         } else {
             prev = proc;
@@ -773,6 +823,30 @@ ble_gattc_extract_by_conn_op(uint16_t conn_handle, uint8_t op,
 
         proc = next;
     }
+}
+
+static void
+ble_gattc_extract_by_conn_op(uint16_t conn_handle, uint8_t op,
+                             struct ble_gattc_proc_list *dst_list)
+{
+    int i;
+
+    /* Only the parent task is allowed to remove entries from the list. */
+    BLE_HS_DBG_ASSERT(ble_hs_is_parent_task());
+
+    STAILQ_INIT(dst_list);
+
+    ble_hs_lock();
+
+    if (conn_handle != BLE_HS_CONN_HANDLE_NONE) {
+        ble_gattc_extract_from_bucket(ble_gattc_proc_bucket(conn_handle),
+                                      conn_handle, op, dst_list);
+    } else {
+        for (i = 0; i <= ble_gattc_proc_bucket_mask; i++) {
+            ble_gattc_extract_from_bucket(ble_gattc_proc_buckets + i,
+                                          conn_handle, op, dst_list);
+        }
+    }
 
     ble_hs_unlock();
 }
@@ -782,7 +856,7 @@ ble_gattc_extract_expired(struct ble_gattc_proc_list *dst_list)
 {
     struct ble_gattc_proc *proc;
     struct ble_gattc_proc *prev;
-    struct ble_gattc_proc *next;
+    struct ble_gattc_proc *cur;
     uint32_t now;
     int32_t time_diff;
 
@@ -794,23 +868,24 @@ ble_gattc_extract_expired(struct ble_gattc_proc_list *dst_list)
 
     ble_hs_lock();
 
-    prev = NULL;
-    proc = STAILQ_FIRST(&ble_gattc_procs);
-    while (proc != NULL) {
-        next = STAILQ_NEXT(proc, next);
-
+    /* The expiry list is sorted; stop at the first proc still in time. */
+    while ((proc = TAILQ_FIRST(&ble_gattc_proc_exp_list)) != NULL) {
         time_diff = now - proc->exp_os_ticks;
-        if (time_diff >= 0) {
-            if (prev == NULL) {
-                STAILQ_REMOVE_HEAD(&ble_gattc_procs, next);
-            } else {
-                STAILQ_REMOVE_AFTER(&ble_gattc_procs, prev, next);
+        if (time_diff < 0) {
+            break;
+        }
+
+        prev = NULL;
+        STAILQ_FOREACH(cur, ble_gattc_proc_bucket(proc->conn_handle), next) {
+            if (cur == proc) {
+                break;
             }
-            STAILQ_INSERT_TAIL(dst_list, proc, next);
+            prev = cur;
         }
+        BLE_HS_DBG_ASSERT(cur == proc);
 
-        prev = proc;
-        proc = next;
+        ble_gattc_proc_remove(proc, prev);
+        STAILQ_INSERT_TAIL(dst_list, proc, next);
     }
 
     ble_hs_unlock();
@@ -831,16 +906,12 @@ ble_gattc_extract_with_rx_entry(uint16_t conn_handle,
     ble_hs_lock();
 
     prev = NULL;
-    STAILQ_FOREACH(proc, &ble_gattc_procs, next) {
+    STAILQ_FOREACH(proc, ble_gattc_proc_bucket(conn_handle), next) {
         if (proc->conn_handle == conn_handle) {
             rx_entry = ble_gattc_rx_entry_find(proc->op, rx_entries,
                                                num_entries);
             if (rx_entry != NULL) {
-                if (prev == NULL) {
-                    STAILQ_REMOVE_HEAD(&ble_gattc_procs, next);
-                } else {
-                    STAILQ_REMOVE_AFTER(&ble_gattc_procs, prev, next);
-                }
+                ble_gattc_proc_remove(proc, prev);
 
                 *out_rx_entry = rx_entry;
                 break;
@@ -856,9 +927,9 @@ ble_gattc_extract_with_rx_entry(uint16_t conn_handle,
 }
 
 /**
- * Searches the main proc list for an entry whose connection handle and op code
- * match those specified.  If a matching entry is found, it is removed from the
- * list and returned.
+ * Searches the connection's proc bucket for an entry whose connection handle
+ * and op code match those specified.  If a matching entry is found, it is
+ * removed from the list and returned.
  *
  * @param conn_handle           The connection handle to match against.
  * @param rx_entries            The array of rx entries corresponding to the
@@ -4556,17 +4627,38 @@ ble_gattc_connection_broken(uint16_t conn_handle)
 int
 ble_gattc_any_jobs(void)
 {
-    return !STAILQ_EMPTY(&ble_gattc_procs);
+    return !TAILQ_EMPTY(&ble_gattc_proc_exp_list);
 }
 
 int
 ble_gattc_init(void)
 {
+    int num_buckets;
     int rc;
+    int i;
 
     free(ble_gattc_proc_mem);
+    ble_gattc_proc_mem = NULL;
+    free(ble_gattc_proc_buckets);
+
+    TAILQ_INIT(&ble_gattc_proc_exp_list);
+
+    /* Use a power of two number of buckets, no fewer than connections. */
+    num_buckets = 1;
+    while (num_buckets < ble_hs_cfg.max_connections) {
+        num_buckets *= 2;
+    }
+    ble_gattc_proc_bucket_mask = num_buckets - 1;
 
-    STAILQ_INIT(&ble_gattc_procs);
+    ble_gattc_proc_buckets =
+        malloc(num_buckets * sizeof *ble_gattc_proc_buckets);
+    if (ble_gattc_proc_buckets == NULL) {
+        rc = BLE_HS_ENOMEM;
+        goto err;
+    }
+    for (i = 0; i < num_buckets; i++) {
+        STAILQ_INIT(ble_gattc_proc_buckets + i);
+    }
 
     if (ble_hs_cfg.max_gattc_procs > 0) {
         ble_gattc_proc_mem = malloc(
@@ -4600,6 +4692,8 @@ ble_gattc_init(void)
 err:
     free(ble_gattc_proc_mem);
     ble_gattc_proc_mem = NULL;
+    free(ble_gattc_proc_buckets);
+    ble_gattc_proc_buckets = NULL;
 
     return rc;
 }
@@ -53,6 +53,18 @@ struct ble_gatts_clt_cfg {
 static struct ble_gatts_clt_cfg *ble_gatts_clt_cfgs;
 static int ble_gatts_num_cfgable_chrs;
 
+/** A peer that is due an update of the characteristic being fanned out. */
+struct ble_gatts_tx_target {
+    uint16_t conn_handle;
+    uint8_t att_op;
+};
+
+/**
+ * Scratch space for the peers collected during a fan-out; one slot per
+ * connection.  Only used from the host task.
+ */
+static struct ble_gatts_tx_target *ble_gatts_tx_targets;
+
 STATS_SECT_DECL(ble_gatts_stats) ble_gatts_stats;
 STATS_NAME_START(ble_gatts_stats)
     STATS_NAME(ble_gatts_stats, svcs)
@@ -1378,7 +1390,6 @@ ble_gatts_chr_updated(uint16_t chr_val_handle)
     int clt_cfg_idx;
     int persist;
     int rc;
-    int i;
 
     /* Determine if notifications or indications are allowed for this
      * characteristic.  If not, return immediately.
@@ -1391,15 +1402,12 @@ ble_gatts_chr_updated(uint16_t chr_val_handle)
 
     /*** Send notifications and indications to connected devices. */
 
+    new_notifications = 0;
+
     ble_hs_lock();
-    for (i = 0; ; i++) {
-        /* XXX: This is inefficient when there are a lot of connections.
-         * Consider using a "foreach" function to walk the connection list.
-         */
-        conn = ble_hs_conn_find_by_idx(i);
-        if (conn == NULL) {
-            break;
-        }
+    for (conn = ble_hs_conn_first();
+         conn != NULL;
+         conn = ble_hs_conn_next(conn)) {
 
         BLE_HS_DBG_ASSERT_EVAL(conn->bhc_gatt_svr.num_clt_cfgs >
                                clt_cfg_idx);
@@ -1467,19 +1475,97 @@ ble_gatts_chr_updated(uint16_t chr_val_handle)
     }
 }
 
+/**
+ * Reads the current value of a characteristic into a fresh ATT packet, so
+ * that it can be shared by every notification of a fan-out.
+ *
+ * @return                      The value on success; NULL if the value could
+ *                                  not be read.  In that case, each
+ *                                  notification reads the value itself and
+ *                                  reports the failure to the application.
+ */
+static struct os_mbuf *
+ble_gatts_tx_notifications_read_val(uint16_t chr_val_handle)
+{
+    struct os_mbuf *om;
+    int rc;
+
+    om = ble_hs_mbuf_att_pkt();
+    if (om == NULL) {
+        return NULL;
+    }
+
+    rc = ble_att_svr_read_handle(BLE_HS_CONN_HANDLE_NONE, chr_val_handle, 0,
+                                 om, NULL);
+    if (rc != 0) {
+        os_mbuf_free_chain(om);
+        return NULL;
+    }
+
+    return om;
+}
+
+/**
+ * Sends a notification carrying a copy of a value that was read once for
+ * the whole fan-out.  The last peer takes the value itself.
+ */
+static void
+ble_gatts_tx_notify_shared(uint16_t conn_handle, uint16_t chr_val_handle,
+                           struct os_mbuf **val, int last)
+{
+    struct os_mbuf *om;
+    int rc;
+
+    if (*val == NULL) {
+        ble_gattc_notify(conn_handle, chr_val_handle);
+        return;
+    }
+
+    if (last) {
+        om = *val;
+        *val = NULL;
+    } else {
+        om = ble_hs_mbuf_att_pkt();
+        if (om != NULL) {
+            rc = os_mbuf_appendfrom(om, *val, 0, OS_MBUF_PKTLEN(*val));
+            if (rc != 0) {
+                os_mbuf_free_chain(om);
+                om = NULL;
+            }
+        }
+        if (om == NULL) {
+            /* Out of buffers; let the notification procedure report it. */
+            ble_gattc_notify(conn_handle, chr_val_handle);
+            return;
+        }
+    }
+
+    rc = ble_gattc_notify_custom(conn_handle, chr_val_handle, om);
+
+    /* Tell the application that a notification transmission was attempted. */
+    ble_gap_notify_tx_event(rc, conn_handle, chr_val_handle, 0);
+}
+
 /**
  * Sends notifications or indications for the specified characteristic to all
  * connected devices.  The bluetooth spec does not allow more than one
  * concurrent indication for a single peer, so this function will hold off on
  * sending such indications.
+ *
+ * The connection list is walked once, under a single lock, to collect the
+ * peers that are due an update.  The characteristic value is then read once
+ * and shared by all notifications.
  */
 static void
 ble_gatts_tx_notifications_one_chr(uint16_t chr_val_handle)
 {
+    struct ble_gatts_tx_target *target;
     struct ble_gatts_clt_cfg *clt_cfg;
     struct ble_hs_conn *conn;
-    uint16_t conn_handle;
+    struct os_mbuf *val;
     uint8_t att_op;
+    int num_targets;
+    int num_notify;
     int clt_cfg_idx;
     int i;
 
@@ -1492,41 +1578,54 @@ ble_gatts_tx_notifications_one_chr(uint16_t chr_val_handle)
         return;
     }
 
-    for (i = 0; ; i++) {
-        ble_hs_lock();
+    num_targets = 0;
+    num_notify = 0;
 
-        conn = ble_hs_conn_find_by_idx(i);
-        if (conn != NULL) {
-            BLE_HS_DBG_ASSERT_EVAL(conn->bhc_gatt_svr.num_clt_cfgs >
-                                   clt_cfg_idx);
-            clt_cfg = conn->bhc_gatt_svr.clt_cfgs + clt_cfg_idx;
-            BLE_HS_DBG_ASSERT_EVAL(clt_cfg->chr_val_handle == chr_val_handle);
+    ble_hs_lock();
+    for (conn = ble_hs_conn_first();
+         conn != NULL;
+         conn = ble_hs_conn_next(conn)) {
 
-            /* Determine what type of command should get sent, if any. */
-            att_op = ble_gatts_schedule_update(conn, clt_cfg);
-            conn_handle = conn->bhc_handle;
-        } else {
-            /* Silence some spurious gcc warnings. */
-            att_op = 0;
-            conn_handle = BLE_HS_CONN_HANDLE_NONE;
-        }
-        ble_hs_unlock();
+        BLE_HS_DBG_ASSERT_EVAL(conn->bhc_gatt_svr.num_clt_cfgs >
+                               clt_cfg_idx);
+        clt_cfg = conn->bhc_gatt_svr.clt_cfgs + clt_cfg_idx;
+        BLE_HS_DBG_ASSERT_EVAL(clt_cfg->chr_val_handle == chr_val_handle);
 
-        if (conn == NULL) {
-            /* No more connected devices. */
-            break;
+        /* Determine what type of command should get sent, if any. */
+        att_op = ble_gatts_schedule_update(conn, clt_cfg);
+        if (att_op != 0) {
+            BLE_HS_DBG_ASSERT(num_targets < ble_hs_cfg.max_connections);
+
+            target = ble_gatts_tx_targets + num_targets;
+            target->conn_handle = conn->bhc_handle;
+            target->att_op = att_op;
+            num_targets++;
+
+            if (att_op == BLE_ATT_OP_NOTIFY_REQ) {
+                num_notify++;
+            }
         }
+    }
+    ble_hs_unlock();
 
-        switch (att_op) {
-        case 0:
-            break;
+    if (num_notify > 0) {
+        val = ble_gatts_tx_notifications_read_val(chr_val_handle);
+    } else {
+        val = NULL;
+    }
+
+    for (i = 0; i < num_targets; i++) {
+        target = ble_gatts_tx_targets + i;
 
+        switch (target->att_op) {
         case BLE_ATT_OP_NOTIFY_REQ:
-            ble_gattc_notify(conn_handle, chr_val_handle);
+            num_notify--;
+            ble_gatts_tx_notify_shared(target->conn_handle, chr_val_handle,
+                                       &val, num_notify == 0);
             break;
 
         case BLE_ATT_OP_INDICATE_REQ:
-            ble_gattc_indicate(conn_handle, chr_val_handle);
+            ble_gattc_indicate(target->conn_handle, chr_val_handle);
             break;
 
         default:
@@ -1534,6 +1633,8 @@ ble_gatts_tx_notifications_one_chr(uint16_t chr_val_handle)
             break;
         }
     }
+
+    BLE_HS_DBG_ASSERT(val == NULL);
 }
 
 /**
@@ -2033,6 +2134,9 @@ ble_gatts_free_mem(void)
 
     free(ble_gatts_svc_entries);
     ble_gatts_svc_entries = NULL;
+
+    free(ble_gatts_tx_targets);
+    ble_gatts_tx_targets = NULL;
 }
 
 int
@@ -2064,6 +2168,15 @@ ble_gatts_init(void)
         }
     }
 
+    if (ble_hs_cfg.max_connections > 0) {
+        ble_gatts_tx_targets =
+            malloc(ble_hs_cfg.max_connections * sizeof *ble_gatts_tx_targets);
+        if (ble_gatts_tx_targets == NULL) {
+            rc = BLE_HS_ENOMEM;
+            goto err;
+        }
+    }
+
     ble_gatts_num_svc_entries = 0;
     for (i = 0; i < ble_gatts_num_svc_defs; i++) {
         rc = ble_gatts_register_svcs(ble_gatts_svc_defs[i],
@@ -43,6 +43,12 @@ static struct os_event ble_hs_event_tx_notifications = {
     .ev_arg = NULL,
 };
 
+/** OS event - triggers tx of queued ACL data. */
+static struct os_event ble_hs_event_tx_data = {
+    .ev_type = BLE_HS_EVENT_TX_DATA,
+    .ev_arg = NULL,
+};
+
 /** OS event - triggers a full reset. */
 static struct os_event ble_hs_event_reset = {
     .ev_type = BLE_HS_EVENT_RESET,
@@ -76,7 +82,6 @@ static struct os_eventq *ble_hs_parent_evq;
 static struct os_task *ble_hs_parent_task;
 
 static struct os_mqueue ble_hs_rx_q;
-static struct os_mqueue ble_hs_tx_q;
 
 static struct os_mutex ble_hs_mutex;
 
@@ -159,11 +164,7 @@ ble_hs_unlock(void)
 void
 ble_hs_process_tx_data_queue(void)
 {
-    struct os_mbuf *om;
-
-    while ((om = os_mqueue_get(&ble_hs_tx_q)) != NULL) {
-        ble_hci_trans_hs_acl_tx(om);
-    }
+    ble_hs_hci_acl_sched();
 }
 
 void
@@ -271,7 +272,6 @@ ble_hs_reset(void)
         return rc;
     }
 
-    ble_hs_clear_data_queue(&ble_hs_tx_q);
     ble_hs_clear_data_queue(&ble_hs_rx_q);
 
     while (1) {
@@ -375,8 +375,12 @@ ble_hs_event_handle(void *unused)
             ble_gatts_tx_notifications();
             break;
 
-        case OS_EVENT_T_MQUEUE_DATA:
+        case BLE_HS_EVENT_TX_DATA:
+            BLE_HS_DBG_ASSERT(ev == &ble_hs_event_tx_data);
             ble_hs_process_tx_data_queue();
+            break;
+
+        case OS_EVENT_T_MQUEUE_DATA:
             ble_hs_process_rx_data_queue();
             break;
 
@@ -498,27 +502,13 @@ ble_hs_rx_data(struct os_mbuf *om, void *arg)
 }
 
 /**
- * Enqueues an ACL data packet for transmission.  This function consumes the
- * supplied mbuf, regardless of the outcome.
- *
- * @param om                    The outgoing data packet, beginning with the
- *                                  HCI ACL data header.
- *
- * @return                      0 on success; nonzero on failure.
+ * Schedules queued ACL data to be sent to the controller in the host parent
+ * task.
  */
-int
-ble_hs_tx_data(struct os_mbuf *om)
+void
+ble_hs_tx_data_sched(void)
 {
-    int rc;
-
-    rc = os_mqueue_put(&ble_hs_tx_q, &ble_hs_evq, om);
-    if (rc != 0) {
-        os_mbuf_free_chain(om);
-        return BLE_HS_EOS;
-    }
-    os_eventq_put(ble_hs_parent_evq, &ble_hs_event_co.cf_c.c_ev);
-
-    return 0;
+    ble_hs_event_enqueue(&ble_hs_event_tx_data);
 }
 
 static void
@@ -577,8 +567,9 @@ ble_hs_init(struct os_eventq *app_evq, struct ble_hs_cfg *cfg)
                          "ble_hs_hci_ev_pool");
     assert(rc == 0);
 
-    /* Initialize eventq */
+    /* Initialize eventq; a reset that was scheduled is dropped with it. */
     os_eventq_init(&ble_hs_evq);
+    ble_hs_reset_reason = 0;
 
     /* Initialize stats. */
     rc = stats_module_init();
@@ -625,7 +616,6 @@ ble_hs_init(struct os_eventq *app_evq, struct ble_hs_cfg *cfg)
     }
 
     os_mqueue_init(&ble_hs_rx_q, NULL);
-    os_mqueue_init(&ble_hs_tx_q, NULL);
 
     rc = stats_init_and_reg(
         STATS_HDR(ble_hs_stats), STATS_SIZE_INIT_PARMS(ble_hs_stats,
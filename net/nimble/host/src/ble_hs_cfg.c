@@ -62,6 +62,7 @@ const struct ble_hs_cfg ble_hs_cfg_dflt = {
     .sm_keypress = 0,
     .sm_our_key_dist = 0,
     .sm_their_key_dist = 0,
+    .sm_crypto_evq = NULL,
 
     /** Privacy settings. */
     .rpa_timeout = 300,
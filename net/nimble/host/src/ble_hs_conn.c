@@ -26,13 +26,44 @@
 /** At least three channels required per connection (sig, att, sm). */
 #define BLE_HS_CONN_MIN_CHANS       3
 
-static SLIST_HEAD(, ble_hs_conn) ble_hs_conns;
+SLIST_HEAD(ble_hs_conn_list, ble_hs_conn);
+
+static struct ble_hs_conn_list ble_hs_conns;
+
+/* Connections hashed by handle and by peer address.  There are at least as
+ * many buckets as connections; since the controller hands out small, dense
+ * handles, each handle usually gets a bucket to itself.
+ */
+static struct ble_hs_conn_list *ble_hs_conn_handle_buckets;
+static struct ble_hs_conn_list *ble_hs_conn_addr_buckets;
+static uint16_t ble_hs_conn_bucket_mask;
 static struct os_mempool ble_hs_conn_pool;
 
 static os_membuf_t *ble_hs_conn_elem_mem;
 
 static const uint8_t ble_hs_conn_null_addr[6];
 
+static struct ble_hs_conn_list *
+ble_hs_conn_handle_bucket(uint16_t conn_handle)
+{
+    return ble_hs_conn_handle_buckets +
+           (conn_handle & ble_hs_conn_bucket_mask);
+}
+
+static struct ble_hs_conn_list *
+ble_hs_conn_addr_bucket(uint8_t addr_type, const uint8_t *addr)
+{
+    uint32_t hash;
+    int i;
+
+    hash = addr_type;
+    for (i = 0; i < 6; i++) {
+        hash = hash * 31 + addr[i];
+    }
+
+    return ble_hs_conn_addr_buckets + (hash & ble_hs_conn_bucket_mask);
+}
+
 int
 ble_hs_conn_can_alloc(void)
 {
@@ -115,6 +146,7 @@ ble_hs_conn_alloc(void)
     memset(conn, 0, sizeof *conn);
 
     SLIST_INIT(&conn->bhc_channels);
+    STAILQ_INIT(&conn->bhc_tx_q);
 
     chan = ble_att_create_chan();
     if (chan == NULL) {
@@ -210,6 +242,11 @@ ble_hs_conn_insert(struct ble_hs_conn *conn)
 
     BLE_HS_DBG_ASSERT_EVAL(ble_hs_conn_find(conn->bhc_handle) == NULL);
     SLIST_INSERT_HEAD(&ble_hs_conns, conn, bhc_next);
+    SLIST_INSERT_HEAD(ble_hs_conn_handle_bucket(conn->bhc_handle), conn,
+                      bhc_handle_next);
+    SLIST_INSERT_HEAD(ble_hs_conn_addr_bucket(conn->bhc_peer_addr_type,
+                                              conn->bhc_peer_addr),
+                      conn, bhc_addr_next);
 }
 
 void
@@ -222,6 +259,13 @@ ble_hs_conn_remove(struct ble_hs_conn *conn)
     BLE_HS_DBG_ASSERT(ble_hs_locked_by_cur_task());
 
     SLIST_REMOVE(&ble_hs_conns, conn, ble_hs_conn, bhc_next);
+    SLIST_REMOVE(ble_hs_conn_handle_bucket(conn->bhc_handle), conn,
+                 ble_hs_conn, bhc_handle_next);
+    SLIST_REMOVE(ble_hs_conn_addr_bucket(conn->bhc_peer_addr_type,
+                                         conn->bhc_peer_addr),
+                 conn, ble_hs_conn, bhc_addr_next);
+
+    ble_hs_hci_acl_conn_flush(conn);
 }
 
 struct ble_hs_conn *
@@ -235,7 +279,8 @@ ble_hs_conn_find(uint16_t conn_handle)
 
     BLE_HS_DBG_ASSERT(ble_hs_locked_by_cur_task());
 
-    SLIST_FOREACH(conn, &ble_hs_conns, bhc_next) {
+    SLIST_FOREACH(conn, ble_hs_conn_handle_bucket(conn_handle),
+                  bhc_handle_next) {
         if (conn->bhc_handle == conn_handle) {
             return conn;
         }
@@ -266,7 +311,8 @@ ble_hs_conn_find_by_addr(uint8_t addr_type, uint8_t *addr)
 
     BLE_HS_DBG_ASSERT(ble_hs_locked_by_cur_task());
 
-    SLIST_FOREACH(conn, &ble_hs_conns, bhc_next) {
+    SLIST_FOREACH(conn, ble_hs_conn_addr_bucket(addr_type, addr),
+                  bhc_addr_next) {
         if (conn->bhc_peer_addr_type == addr_type &&
             memcmp(conn->bhc_peer_addr, addr, 6) == 0) {
 
@@ -324,6 +370,23 @@ ble_hs_conn_first(void)
     return SLIST_FIRST(&ble_hs_conns);
 }
 
+/**
+ * Returns the connection that follows the specified one in the connection
+ * list.  Together with ble_hs_conn_first(), this walks every connection.
+ * The walk survives removal of the current connection as long as its
+ * successor is retrieved before it is removed.
+ */
+struct ble_hs_conn *
+ble_hs_conn_next(struct ble_hs_conn *conn)
+{
+#if !NIMBLE_OPT(CONNECT)
+    return NULL;
+#endif
+
+    BLE_HS_DBG_ASSERT(ble_hs_locked_by_cur_task());
+    return SLIST_NEXT(conn, bhc_next);
+}
+
 void
 ble_hs_conn_addrs(const struct ble_hs_conn *conn,
                   struct ble_hs_conn_addrs *addrs)
@@ -379,12 +442,20 @@ ble_hs_conn_free_mem(void)
 {
     free(ble_hs_conn_elem_mem);
     ble_hs_conn_elem_mem = NULL;
+
+    free(ble_hs_conn_handle_buckets);
+    ble_hs_conn_handle_buckets = NULL;
+
+    free(ble_hs_conn_addr_buckets);
+    ble_hs_conn_addr_buckets = NULL;
 }
 
 int 
 ble_hs_conn_init(void)
 {
+    int num_buckets;
     int rc;
+    int i;
 
     ble_hs_conn_free_mem();
 
@@ -403,6 +474,29 @@ ble_hs_conn_init(void)
         goto err;
     }
 
+    /* Use a power of two number of buckets, no fewer than connections. */
+    num_buckets = 1;
+    while (num_buckets < ble_hs_cfg.max_connections) {
+        num_buckets *= 2;
+    }
+    ble_hs_conn_bucket_mask = num_buckets - 1;
+
+    ble_hs_conn_handle_buckets =
+        malloc(num_buckets * sizeof *ble_hs_conn_handle_buckets);
+    ble_hs_conn_addr_buckets =
+        malloc(num_buckets * sizeof *ble_hs_conn_addr_buckets);
+    if (ble_hs_conn_handle_buckets == NULL ||
+        ble_hs_conn_addr_buckets == NULL) {
+
+        rc = BLE_HS_ENOMEM;
+        goto err;
+    }
+
+    for (i = 0; i < num_buckets; i++) {
+        SLIST_INIT(ble_hs_conn_handle_buckets + i);
+        SLIST_INIT(ble_hs_conn_addr_buckets + i);
+    }
+
     SLIST_INIT(&ble_hs_conns);
 
     return 0;
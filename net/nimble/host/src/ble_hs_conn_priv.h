@@ -34,6 +34,8 @@ typedef uint8_t ble_hs_conn_flags_t;
 
 struct ble_hs_conn {
     SLIST_ENTRY(ble_hs_conn) bhc_next;
+    SLIST_ENTRY(ble_hs_conn) bhc_handle_next;   /* Handle hash chain. */
+    SLIST_ENTRY(ble_hs_conn) bhc_addr_next;     /* Address hash chain. */
     uint16_t bhc_handle;
     uint8_t bhc_peer_addr_type;
     uint8_t bhc_our_addr_type;
@@ -50,7 +52,15 @@ struct ble_hs_conn {
 
     struct ble_l2cap_chan_list bhc_channels;
     struct ble_l2cap_chan *bhc_rx_chan; /* Channel rxing current packet. */
-    uint16_t bhc_outstanding_pkts;
+    uint16_t bhc_outstanding_pkts;     /* Fragments held by controller. */
+
+    /* ACL fragments waiting for a controller buffer.  A connection is on
+     * the scheduler's active list whenever this queue is nonempty.
+     */
+    STAILQ_HEAD(, os_mbuf_pkthdr) bhc_tx_q;
+    STAILQ_ENTRY(ble_hs_conn) bhc_tx_next;
+    uint32_t bhc_tx_deficit;
+    struct ble_gap_conn_tx_stats bhc_tx_stats;
 
     struct ble_att_svr_conn bhc_att_svr;
     struct ble_gatts_conn bhc_gatt_svr;
@@ -83,6 +93,7 @@ struct ble_hs_conn *ble_hs_conn_find_by_addr(uint8_t addr_type, uint8_t *addr);
 struct ble_hs_conn *ble_hs_conn_find_by_idx(int idx);
 int ble_hs_conn_exists(uint16_t conn_handle);
 struct ble_hs_conn *ble_hs_conn_first(void);
+struct ble_hs_conn *ble_hs_conn_next(struct ble_hs_conn *conn);
 struct ble_l2cap_chan *ble_hs_conn_chan_find(struct ble_hs_conn *conn,
                                              uint16_t cid);
 int ble_hs_conn_chan_insert(struct ble_hs_conn *conn,
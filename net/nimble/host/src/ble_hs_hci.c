@@ -27,13 +27,88 @@
 
 #define BLE_HCI_CMD_TIMEOUT     (OS_TICKS_PER_SEC)
 
+/** Maximum number of commands that can be queued or awaiting an ack. */
+#define BLE_HS_HCI_CMD_Q_LEN    8
+
+/**
+ * Largest parameter length of a command the host sends.  Longer commands are
+ * rejected with BLE_HS_EINVAL rather than queued.
+ */
+#define BLE_HS_HCI_CMD_MAX_PARAMS   64
+
+#define BLE_HS_HCI_CMD_BUF_SZ       \
+    (BLE_HCI_CMD_HDR_LEN + BLE_HS_HCI_CMD_MAX_PARAMS)
+
+/**
+ * Acks are queued by the transport and processed by whichever task is
+ * waiting on the HCI.  There can never be more of them than outstanding
+ * commands; the extra slot absorbs one unsolicited ack.
+ */
+#define BLE_HS_HCI_ACK_Q_LEN    (BLE_HS_HCI_CMD_Q_LEN + 1)
+
+/** An HCI command that is queued or awaiting its ack. */
+struct ble_hs_hci_cmd_entry {
+    STAILQ_ENTRY(ble_hs_hci_cmd_entry) next;
+
+    ble_hs_hci_cmd_cb *cb;
+    void *cb_arg;
+    uint16_t opcode;
+    uint8_t buf[BLE_HS_HCI_CMD_BUF_SZ];
+};
+
+STAILQ_HEAD(ble_hs_hci_cmd_list, ble_hs_hci_cmd_entry);
+
+/** Arguments for the callback backing the blocking ble_hs_hci_cmd_tx(). */
+struct ble_hs_hci_tx_arg {
+    uint8_t *evt_buf;
+    uint8_t evt_buf_len;
+    uint8_t evt_len;
+    int status;
+    int done;
+};
+
 static struct os_mutex ble_hs_hci_mutex;
 static struct os_sem ble_hs_hci_sem;
 
-static uint8_t *ble_hs_hci_ack;
+/**
+ * Command queues; protected by the HCI mutex.  Commands sit in the pending
+ * list until the controller has room for them (Num_HCI_Command_Packets), and
+ * in the in-flight list until they are acknowledged.
+ */
+static struct ble_hs_hci_cmd_entry
+    ble_hs_hci_cmd_entries[BLE_HS_HCI_CMD_Q_LEN];
+static struct ble_hs_hci_cmd_list ble_hs_hci_cmd_free_list;
+static struct ble_hs_hci_cmd_list ble_hs_hci_cmd_pending;
+static struct ble_hs_hci_cmd_list ble_hs_hci_cmd_inflight;
+static uint8_t ble_hs_hci_cmd_credits;
+
+/**
+ * Number of in-flight commands, checked by the transport before it queues an
+ * ack.  Only changed with the HCI mutex held.
+ */
+static volatile uint8_t ble_hs_hci_cmd_inflight_cnt;
+
+/** Received acks; protected by a critical section. */
+static uint8_t *ble_hs_hci_ack_q[BLE_HS_HCI_ACK_Q_LEN];
+static uint8_t ble_hs_hci_ack_q_head;
+static uint8_t ble_hs_hci_ack_q_count;
+
 static uint16_t ble_hs_hci_buf_sz;
 static uint8_t ble_hs_hci_max_pkts;
 
+/**
+ * ACL flow control; protected by the host mutex.  Fragments are handed to
+ * the controller only while it has a free buffer, and buffers come back in
+ * Number-Of-Completed-Packets events.  Connections with queued fragments sit
+ * in the active list and take turns in deficit round-robin order, so a
+ * connection with a deep queue cannot starve the others.
+ */
+static uint8_t ble_hs_hci_avail_pkts;
+static STAILQ_HEAD(, ble_hs_conn) ble_hs_hci_acl_active;
+
+/** Whether the head of the active list has already been granted its turn. */
+static uint8_t ble_hs_hci_acl_turn_open;
+
 #if PHONY_HCI_ACKS
 static ble_hs_hci_phony_ack_fn *ble_hs_hci_phony_ack_cb;
 #endif
@@ -73,10 +148,62 @@ ble_hs_hci_set_buf_sz(uint16_t pktlen, uint8_t max_pkts)
 
     ble_hs_hci_buf_sz = pktlen;
     ble_hs_hci_max_pkts = max_pkts;
+    ble_hs_hci_avail_pkts = max_pkts;
 
     return 0;
 }
 
+static int
+ble_hs_hci_ack_q_put(uint8_t *ack_ev)
+{
+    os_sr_t sr;
+    int idx;
+    int rc;
+
+    OS_ENTER_CRITICAL(sr);
+
+    if (ble_hs_hci_cmd_inflight_cnt == 0) {
+        /* Nothing is waiting for an ack, e.g., a late ack for a command
+         * that already timed out.
+         */
+        rc = BLE_HS_ENOENT;
+    } else if (ble_hs_hci_ack_q_count >= BLE_HS_HCI_ACK_Q_LEN) {
+        rc = BLE_HS_ENOMEM;
+    } else {
+        idx = (ble_hs_hci_ack_q_head + ble_hs_hci_ack_q_count) %
+              BLE_HS_HCI_ACK_Q_LEN;
+        ble_hs_hci_ack_q[idx] = ack_ev;
+        ble_hs_hci_ack_q_count++;
+        rc = 0;
+    }
+
+    OS_EXIT_CRITICAL(sr);
+
+    return rc;
+}
+
+static uint8_t *
+ble_hs_hci_ack_q_get(void)
+{
+    uint8_t *ack_ev;
+    os_sr_t sr;
+
+    OS_ENTER_CRITICAL(sr);
+
+    if (ble_hs_hci_ack_q_count == 0) {
+        ack_ev = NULL;
+    } else {
+        ack_ev = ble_hs_hci_ack_q[ble_hs_hci_ack_q_head];
+        ble_hs_hci_ack_q_head = (ble_hs_hci_ack_q_head + 1) %
+                                BLE_HS_HCI_ACK_Q_LEN;
+        ble_hs_hci_ack_q_count--;
+    }
+
+    OS_EXIT_CRITICAL(sr);
+
+    return ack_ev;
+}
+
 static int
 ble_hs_hci_rx_cmd_complete(uint8_t event_code, uint8_t *data, int len,
                            struct ble_hs_hci_ack *out_ack)
@@ -94,10 +221,8 @@ ble_hs_hci_rx_cmd_complete(uint8_t event_code, uint8_t *data, int len,
     opcode = le16toh(data + 3);
     params = data + 5;
 
-    /* XXX: Process num_pkts field. */
-    (void)num_pkts;
-
     out_ack->bha_opcode = opcode;
+    out_ack->bha_num_pkts = num_pkts;
 
     params_len = len - BLE_HCI_EVENT_CMD_COMPLETE_HDR_LEN;
     if (params_len > 0) {
@@ -136,10 +261,8 @@ ble_hs_hci_rx_cmd_status(uint8_t event_code, uint8_t *data, int len,
     num_pkts = data[3];
     opcode = le16toh(data + 4);
 
-    /* XXX: Process num_pkts field. */
-    (void)num_pkts;
-
     out_ack->bha_opcode = opcode;
+    out_ack->bha_num_pkts = num_pkts;
     out_ack->bha_params = NULL;
     out_ack->bha_params_len = 0;
     out_ack->bha_status = BLE_HS_HCI_ERR(status);
@@ -148,25 +271,21 @@ ble_hs_hci_rx_cmd_status(uint8_t event_code, uint8_t *data, int len,
 }
 
 static int
-ble_hs_hci_process_ack(uint16_t expected_opcode,
-                       uint8_t *params_buf, uint8_t params_buf_len,
-                       struct ble_hs_hci_ack *out_ack)
+ble_hs_hci_parse_ack(uint8_t *ack_ev, struct ble_hs_hci_ack *out_ack)
 {
     uint8_t event_code;
     uint8_t param_len;
     uint8_t event_len;
     int rc;
 
-    BLE_HS_DBG_ASSERT(ble_hs_hci_ack != NULL);
-
     /* Count events received */
     STATS_INC(ble_hs_stats, hci_event);
 
     /* Display to console */
-    ble_hs_dbg_event_disp(ble_hs_hci_ack);
+    ble_hs_dbg_event_disp(ack_ev);
 
-    event_code = ble_hs_hci_ack[0];
-    param_len = ble_hs_hci_ack[1];
+    event_code = ack_ev[0];
+    param_len = ack_ev[1];
     event_len = param_len + 2;
 
     /* Clear ack fields up front to silence spurious gcc warnings. */
@@ -174,13 +293,13 @@ ble_hs_hci_process_ack(uint16_t expected_opcode,
 
     switch (event_code) {
     case BLE_HCI_EVCODE_COMMAND_COMPLETE:
-        rc = ble_hs_hci_rx_cmd_complete(event_code, ble_hs_hci_ack,
-                                         event_len, out_ack);
+        rc = ble_hs_hci_rx_cmd_complete(event_code, ack_ev, event_len,
+                                        out_ack);
         break;
 
     case BLE_HCI_EVCODE_COMMAND_STATUS:
-        rc = ble_hs_hci_rx_cmd_status(event_code, ble_hs_hci_ack,
-                                       event_len, out_ack);
+        rc = ble_hs_hci_rx_cmd_status(event_code, ack_ev, event_len,
+                                      out_ack);
         break;
 
     default:
@@ -189,49 +308,155 @@ ble_hs_hci_process_ack(uint16_t expected_opcode,
         break;
     }
 
-    if (rc == 0) {
-        if (params_buf == NULL) {
-            out_ack->bha_params_len = 0;
-        } else {
-            if (out_ack->bha_params_len > params_buf_len) {
-                out_ack->bha_params_len = params_buf_len;
-                rc = BLE_HS_ECONTROLLER;
-            }
-            memcpy(params_buf, out_ack->bha_params, out_ack->bha_params_len);
-        }
-        out_ack->bha_params = params_buf;
+    return rc;
+}
 
-        if (out_ack->bha_opcode != expected_opcode) {
-            rc = BLE_HS_ECONTROLLER;
-        }
+static void
+ble_hs_hci_cmd_complete(struct ble_hs_hci_cmd_entry *entry,
+                        const struct ble_hs_hci_ack *ack)
+{
+    if (entry->cb != NULL) {
+        entry->cb(ack, entry->cb_arg);
+    }
+
+    STAILQ_INSERT_HEAD(&ble_hs_hci_cmd_free_list, entry, next);
+}
+
+static void
+ble_hs_hci_cmd_fail(struct ble_hs_hci_cmd_entry *entry, int status)
+{
+    struct ble_hs_hci_ack ack;
+
+    memset(&ack, 0, sizeof ack);
+    ack.bha_status = status;
+    ack.bha_opcode = entry->opcode;
+
+    ble_hs_hci_cmd_complete(entry, &ack);
+}
+
+/**
+ * Fails every queued and in-flight command with the specified status.  Used
+ * when the controller stops responding or misbehaves.
+ */
+static void
+ble_hs_hci_cmd_fail_all(int status)
+{
+    struct ble_hs_hci_cmd_entry *entry;
+
+    while ((entry = STAILQ_FIRST(&ble_hs_hci_cmd_inflight)) != NULL) {
+        STAILQ_REMOVE_HEAD(&ble_hs_hci_cmd_inflight, next);
+        ble_hs_hci_cmd_fail(entry, status);
     }
+    while ((entry = STAILQ_FIRST(&ble_hs_hci_cmd_pending)) != NULL) {
+        STAILQ_REMOVE_HEAD(&ble_hs_hci_cmd_pending, next);
+        ble_hs_hci_cmd_fail(entry, status);
+    }
+
+    ble_hs_hci_cmd_inflight_cnt = 0;
+    ble_hs_hci_cmd_credits = 1;
+}
 
+#if PHONY_HCI_ACKS
+static void
+ble_hs_hci_phony_ack(void)
+{
+    uint8_t *ack_ev;
+    int rc;
+
+    if (ble_hs_hci_phony_ack_cb == NULL) {
+        return;
+    }
+
+    ack_ev = ble_hci_trans_buf_alloc(BLE_HCI_TRANS_BUF_CMD);
+    BLE_HS_DBG_ASSERT(ack_ev != NULL);
+
+    rc = ble_hs_hci_phony_ack_cb(ack_ev, 260);
     if (rc != 0) {
-        STATS_INC(ble_hs_stats, hci_invalid_ack);
+        /* No ack; the command will time out. */
+        ble_hci_trans_buf_free(ack_ev);
+        return;
     }
 
-    return rc;
+    rc = ble_hs_hci_ack_q_put(ack_ev);
+    BLE_HS_DBG_ASSERT_EVAL(rc == 0);
+}
+#endif
+
+/**
+ * Sends queued commands for as long as the controller has room for them.
+ * Must be called with the HCI mutex held.
+ */
+static void
+ble_hs_hci_cmd_send_pending(void)
+{
+    struct ble_hs_hci_cmd_entry *entry;
+    int rc;
+
+    /* A controller that reports no free command slots announces new ones
+     * with a no-op ack, which only reaches the event path.  Never let the
+     * queue stall with nothing outstanding.
+     */
+    if (ble_hs_hci_cmd_credits == 0 &&
+        STAILQ_EMPTY(&ble_hs_hci_cmd_inflight)) {
+
+        ble_hs_hci_cmd_credits = 1;
+    }
+
+    while (ble_hs_hci_cmd_credits > 0) {
+        entry = STAILQ_FIRST(&ble_hs_hci_cmd_pending);
+        if (entry == NULL) {
+            break;
+        }
+
+        /* Count the command first; its ack can arrive before the send
+         * returns.
+         */
+        ble_hs_hci_cmd_inflight_cnt++;
+        rc = ble_hs_hci_cmd_send_buf(entry->buf);
+        if (rc != 0) {
+            ble_hs_hci_cmd_inflight_cnt--;
+        }
+        if (rc == BLE_HS_ENOMEM && !STAILQ_EMPTY(&ble_hs_hci_cmd_inflight)) {
+            /* The transport is out of command buffers; retry when the next
+             * ack arrives.
+             */
+            break;
+        }
+
+        STAILQ_REMOVE_HEAD(&ble_hs_hci_cmd_pending, next);
+        if (rc != 0) {
+            ble_hs_hci_cmd_fail(entry, rc);
+            continue;
+        }
+
+        ble_hs_hci_cmd_credits--;
+        STAILQ_INSERT_TAIL(&ble_hs_hci_cmd_inflight, entry, next);
+
+#if PHONY_HCI_ACKS
+        ble_hs_hci_phony_ack();
+#endif
+    }
 }
 
 static int
-ble_hs_hci_wait_for_ack(void)
+ble_hs_hci_wait_for_ack(uint8_t **out_ack_ev)
 {
     int rc;
 
 #if PHONY_HCI_ACKS
-    if (ble_hs_hci_phony_ack_cb == NULL) {
+    /* Phony acks are queued as soon as their command is sent. */
+    *out_ack_ev = ble_hs_hci_ack_q_get();
+    if (*out_ack_ev == NULL) {
         rc = BLE_HS_ETIMEOUT_HCI;
     } else {
-        ble_hs_hci_ack =
-            ble_hci_trans_buf_alloc(BLE_HCI_TRANS_BUF_CMD);
-        BLE_HS_DBG_ASSERT(ble_hs_hci_ack != NULL);
-        rc = ble_hs_hci_phony_ack_cb(ble_hs_hci_ack, 260);
+        rc = 0;
     }
 #else
     rc = os_sem_pend(&ble_hs_hci_sem, BLE_HCI_CMD_TIMEOUT);
     switch (rc) {
     case 0:
-        BLE_HS_DBG_ASSERT(ble_hs_hci_ack != NULL);
+        *out_ack_ev = ble_hs_hci_ack_q_get();
+        BLE_HS_DBG_ASSERT(*out_ack_ev != NULL);
         break;
     case OS_TIMEOUT:
         rc = BLE_HS_ETIMEOUT_HCI;
@@ -246,48 +471,189 @@ ble_hs_hci_wait_for_ack(void)
     return rc;
 }
 
-int
-ble_hs_hci_cmd_tx(void *cmd, void *evt_buf, uint8_t evt_buf_len,
-                  uint8_t *out_evt_buf_len)
+/**
+ * Matches an ack against the oldest in-flight command with the same opcode
+ * and completes that command.  The ack buffer is freed before returning, so
+ * the transport can reuse it for the next command.
+ *
+ * @return                      0 on success;
+ *                              BLE_HS_ENOENT if no in-flight command has the
+ *                                  ack's opcode; the ack is discarded;
+ *                              BLE_HS_ECONTROLLER if the ack is malformed.
+ */
+static int
+ble_hs_hci_process_ack(uint8_t *ack_ev)
 {
+    struct ble_hs_hci_cmd_entry *entry;
+    struct ble_hs_hci_cmd_entry *prev;
     struct ble_hs_hci_ack ack;
-    uint16_t opcode;
     int rc;
 
-    opcode = le16toh(cmd);
+    rc = ble_hs_hci_parse_ack(ack_ev, &ack);
+    if (rc == 0) {
+        ble_hs_hci_cmd_credits = ack.bha_num_pkts;
 
-    BLE_HS_DBG_ASSERT(ble_hs_hci_ack == NULL);
-    ble_hs_hci_lock();
+        prev = NULL;
+        STAILQ_FOREACH(entry, &ble_hs_hci_cmd_inflight, next) {
+            if (entry->opcode == ack.bha_opcode) {
+                break;
+            }
+            prev = entry;
+        }
 
-    rc = ble_hs_hci_cmd_send_buf(cmd);
-    if (rc != 0) {
-        goto done;
+        if (entry == NULL) {
+            /* A stale ack, for a command which is no longer in flight. */
+            rc = BLE_HS_ENOENT;
+        } else {
+            if (prev == NULL) {
+                STAILQ_REMOVE_HEAD(&ble_hs_hci_cmd_inflight, next);
+            } else {
+                STAILQ_REMOVE_AFTER(&ble_hs_hci_cmd_inflight, prev, next);
+            }
+            ble_hs_hci_cmd_inflight_cnt--;
+        }
     }
 
-    rc = ble_hs_hci_wait_for_ack();
-    if (rc != 0) {
+    if (rc == 0) {
+        ble_hs_hci_cmd_complete(entry, &ack);
+    } else {
+        STATS_INC(ble_hs_stats, hci_invalid_ack);
+    }
+
+    ble_hci_trans_buf_free(ack_ev);
+
+    return rc;
+}
+
+/**
+ * Waits for the next ack, completes the corresponding command, and sends
+ * whatever the freed controller slot allows.  Acks which match no in-flight
+ * command are dropped.  If no valid ack arrives, all outstanding commands
+ * fail and a host reset is scheduled.  Must be called with the HCI mutex
+ * held.
+ */
+static void
+ble_hs_hci_cmd_drain_one(void)
+{
+    uint8_t *ack_ev;
+    int rc;
+
+    rc = ble_hs_hci_wait_for_ack(&ack_ev);
+    if (rc == 0) {
+        rc = ble_hs_hci_process_ack(ack_ev);
+    }
+
+    if (rc != 0 && rc != BLE_HS_ENOENT) {
+        ble_hs_hci_cmd_fail_all(rc);
         ble_hs_sched_reset(rc);
-        goto done;
     }
 
-    rc = ble_hs_hci_process_ack(opcode, evt_buf, evt_buf_len, &ack);
+    ble_hs_hci_cmd_send_pending();
+}
+
+static int
+ble_hs_hci_cmd_enqueue(const void *cmd, ble_hs_hci_cmd_cb *cb, void *cb_arg)
+{
+    struct ble_hs_hci_cmd_entry *entry;
+    const uint8_t *u8ptr;
+    int len;
+
+    /* Don't truncate a command that doesn't fit in a queue entry. */
+    u8ptr = cmd;
+    if (u8ptr[2] > BLE_HS_HCI_CMD_MAX_PARAMS) {
+        return BLE_HS_EINVAL;
+    }
+    len = BLE_HCI_CMD_HDR_LEN + u8ptr[2];
+
+    /* Every entry is either pending or in flight; wait for one to finish. */
+    while (STAILQ_EMPTY(&ble_hs_hci_cmd_free_list)) {
+        ble_hs_hci_cmd_drain_one();
+    }
+
+    entry = STAILQ_FIRST(&ble_hs_hci_cmd_free_list);
+    STAILQ_REMOVE_HEAD(&ble_hs_hci_cmd_free_list, next);
+
+    memcpy(entry->buf, cmd, len);
+    entry->opcode = le16toh(entry->buf);
+    entry->cb = cb;
+    entry->cb_arg = cb_arg;
+
+    STAILQ_INSERT_TAIL(&ble_hs_hci_cmd_pending, entry, next);
+    ble_hs_hci_cmd_send_pending();
+
+    return 0;
+}
+
+static void
+ble_hs_hci_cmd_tx_cb(const struct ble_hs_hci_ack *ack, void *arg)
+{
+    struct ble_hs_hci_tx_arg *tx_arg;
+    int len;
+
+    tx_arg = arg;
+    tx_arg->status = ack->bha_status;
+
+    if (tx_arg->evt_buf == NULL) {
+        len = 0;
+    } else {
+        len = ack->bha_params_len;
+        if (len > tx_arg->evt_buf_len) {
+            len = tx_arg->evt_buf_len;
+            tx_arg->status = BLE_HS_ECONTROLLER;
+            STATS_INC(ble_hs_stats, hci_invalid_ack);
+            ble_hs_sched_reset(BLE_HS_ECONTROLLER);
+        }
+        memcpy(tx_arg->evt_buf, ack->bha_params, len);
+    }
+
+    tx_arg->evt_len = len;
+    tx_arg->done = 1;
+}
+
+/**
+ * Sends an HCI command and blocks until the controller acknowledges it.  Any
+ * asynchronous commands queued ahead of this one are completed first.
+ *
+ * @param cmd                   A flat buffer containing the HCI command.
+ * @param evt_buf               Receives the ack's return parameters, minus
+ *                                  the status byte.  May be null.
+ * @param evt_buf_len           The size of evt_buf.
+ * @param out_evt_buf_len       On success, the number of parameter bytes
+ *                                  written to evt_buf.  May be null.
+ *
+ * @return                      0 on success;
+ *                              BLE_HS_EINVAL if the command is too long;
+ *                              other BLE host core return code on failure.
+ */
+int
+ble_hs_hci_cmd_tx(void *cmd, void *evt_buf, uint8_t evt_buf_len,
+                  uint8_t *out_evt_buf_len)
+{
+    struct ble_hs_hci_tx_arg tx_arg;
+    int rc;
+
+    memset(&tx_arg, 0, sizeof tx_arg);
+    tx_arg.evt_buf = evt_buf;
+    tx_arg.evt_buf_len = evt_buf_len;
+
+    ble_hs_hci_lock();
+
+    rc = ble_hs_hci_cmd_enqueue(cmd, ble_hs_hci_cmd_tx_cb, &tx_arg);
     if (rc != 0) {
-        ble_hs_sched_reset(rc);
         goto done;
     }
 
+    while (!tx_arg.done) {
+        ble_hs_hci_cmd_drain_one();
+    }
+
     if (out_evt_buf_len != NULL) {
-        *out_evt_buf_len = ack.bha_params_len;
+        *out_evt_buf_len = tx_arg.evt_len;
     }
 
-    rc = ack.bha_status;
+    rc = tx_arg.status;
 
 done:
-    if (ble_hs_hci_ack != NULL) {
-        ble_hci_trans_buf_free(ble_hs_hci_ack);
-        ble_hs_hci_ack = NULL;
-    }
-
     ble_hs_hci_unlock();
     return rc;
 }
@@ -305,20 +671,80 @@ ble_hs_hci_cmd_tx_empty_ack(void *cmd)
     return 0;
 }
 
+/**
+ * Queues an HCI command without waiting for its ack.  As many commands are
+ * kept in flight as the controller allows (Num_HCI_Command_Packets).  The
+ * callback is executed by whichever task next waits on the HCI, i.e., from
+ * within ble_hs_hci_cmd_tx(), ble_hs_hci_cmd_tx_async(), or
+ * ble_hs_hci_cmd_wait_all(), with the HCI mutex held.  It must not block.
+ *
+ * @param cmd                   A flat buffer containing the HCI command.  It
+ *                                  is copied; the caller may reuse it as soon
+ *                                  as this function returns.
+ * @param cb                    Called when the command completes.  May be
+ *                                  null.
+ * @param cb_arg                The argument to pass to the callback.
+ *
+ * @return                      0 if the command was queued;
+ *                              BLE_HS_EINVAL if the command is too long.
+ */
+int
+ble_hs_hci_cmd_tx_async(const void *cmd, ble_hs_hci_cmd_cb *cb, void *cb_arg)
+{
+    int rc;
+
+    ble_hs_hci_lock();
+    rc = ble_hs_hci_cmd_enqueue(cmd, cb, cb_arg);
+    ble_hs_hci_unlock();
+
+    return rc;
+}
+
+/**
+ * Blocks until every queued and in-flight HCI command has completed.
+ */
+void
+ble_hs_hci_cmd_wait_all(void)
+{
+    ble_hs_hci_lock();
+
+    while (!STAILQ_EMPTY(&ble_hs_hci_cmd_inflight) ||
+           !STAILQ_EMPTY(&ble_hs_hci_cmd_pending)) {
+
+        ble_hs_hci_cmd_drain_one();
+    }
+
+    ble_hs_hci_unlock();
+}
+
+/**
+ * A command callback that records the first failure in a batch.  The
+ * argument points to an int which the caller initializes to 0.
+ */
+void
+ble_hs_hci_cmd_status_cb(const struct ble_hs_hci_ack *ack, void *arg)
+{
+    int *status;
+
+    status = arg;
+    if (*status == 0) {
+        *status = ack->bha_status;
+    }
+}
+
 void
 ble_hs_hci_rx_ack(uint8_t *ack_ev)
 {
-    if (ble_hs_hci_sem.sem_tokens != 0) {
-        /* This ack is unexpected; ignore it. */
+    int rc;
+
+    rc = ble_hs_hci_ack_q_put(ack_ev);
+    if (rc != 0) {
+        /* Late, or more acks than outstanding commands; ignore it. */
         ble_hci_trans_buf_free(ack_ev);
         return;
     }
-    BLE_HS_DBG_ASSERT(ble_hs_hci_ack == NULL);
 
-    /* Unblock the application now that the HCI command buffer is populated
-     * with the acknowledgement.
-     */
-    ble_hs_hci_ack = ack_ev;
+    /* Wake up the task waiting on the HCI. */
     os_sem_release(&ble_hs_hci_sem);
 }
 
@@ -356,12 +782,16 @@ ble_hs_hci_rx_evt(uint8_t *hci_ev, void *arg)
 /**
  * Splits an appropriately-sized fragment from the front of an outgoing ACL
  * data packet, if necessary.  If the packet size is within the controller's
- * buffer size requirements, no splitting is performed.  The fragment data is
- * removed from the data packet mbuf.
+ * buffer size requirements, no splitting is performed.
  *
- * @param om                    The ACL data packet.  If this constitutes a
- *                                  single fragment, it gets set to NULL on
- *                                  success.
+ * The fragment keeps the packet's mbufs by reference; only the mbuf that
+ * straddles the fragment boundary is split, by copying whichever side of the
+ * boundary is smaller.  The remainder of the packet gets a fresh packet
+ * header mbuf with leading space reserved for its ACL header.
+ *
+ * @param om                    The ACL data packet.  On success, this points
+ *                                  to the remainder of the packet, or NULL if
+ *                                  the entire packet fits in one fragment.
  * @param out_frag              On success, this points to the fragment to
  *                                  send.  If the entire packet can fit within
  *                                  a single fragment, this will point to the
@@ -373,39 +803,115 @@ ble_hs_hci_rx_evt(uint8_t *hci_ev, void *arg)
 static int
 ble_hs_hci_split_frag(struct os_mbuf **om, struct os_mbuf **out_frag)
 {
-    struct os_mbuf *frag;
+    struct os_mbuf *rest;
+    struct os_mbuf *prev;
+    struct os_mbuf *cur;
+    struct os_mbuf *dst;
+    uint16_t pktlen;
+    uint16_t tail;
+    uint16_t cut;
+    uint16_t off;
     int rc;
 
     /* Assume failure. */
     *out_frag = NULL;
 
-    if (OS_MBUF_PKTLEN(*om) <= ble_hs_hci_buf_sz) {
+    pktlen = OS_MBUF_PKTLEN(*om);
+    if (pktlen <= ble_hs_hci_buf_sz) {
         /* Final fragment. */
         *out_frag = *om;
         *om = NULL;
         return 0;
     }
 
-    frag = ble_hs_mbuf_acm_pkt();
-    if (frag == NULL) {
-        rc = BLE_HS_ENOMEM;
-        goto err;
+    /* Find the mbuf containing the first byte past the fragment. */
+    prev = NULL;
+    cur = *om;
+    off = 0;
+    while (off + cur->om_len <= ble_hs_hci_buf_sz) {
+        off += cur->om_len;
+        prev = cur;
+        cur = SLIST_NEXT(cur, om_next);
     }
+    cut = ble_hs_hci_buf_sz - off;
+    tail = cur->om_len - cut;
 
-    /* Move data from the front of the packet into the fragment mbuf. */
-    rc = os_mbuf_appendfrom(frag, *om, 0, ble_hs_hci_buf_sz);
-    if (rc != 0) {
+    rest = ble_hs_mbuf_acm_pkt();
+    if (rest == NULL) {
         rc = BLE_HS_ENOMEM;
         goto err;
     }
-    os_mbuf_adj(*om, ble_hs_hci_buf_sz);
+
+    if (prev == NULL && cut <= tail) {
+        /* The fragment is the smaller part of the first mbuf.  Copy it into
+         * its own packet and leave the rest in place.
+         */
+        rc = os_mbuf_appendfrom(rest, *om, 0, cut);
+        if (rc != 0) {
+            rc = BLE_HS_ENOMEM;
+            goto err;
+        }
+        os_mbuf_adj(*om, cut);
+
+        *out_frag = rest;
+        return 0;
+    }
+
+    if (cut == 0) {
+        /* The boundary falls between mbufs; nothing to copy. */
+        SLIST_NEXT(prev, om_next) = NULL;
+        SLIST_NEXT(rest, om_next) = cur;
+    } else if (prev != NULL && cut <= tail) {
+        /* Move the head of the straddling mbuf to the end of the fragment. */
+        dst = prev;
+        if (OS_MBUF_TRAILINGSPACE(dst) < cut) {
+            dst = os_mbuf_get(cur->om_omp, 0);
+            if (dst == NULL) {
+                rc = BLE_HS_ENOMEM;
+                goto err;
+            }
+            SLIST_NEXT(prev, om_next) = dst;
+        }
+
+        memcpy(dst->om_data + dst->om_len, cur->om_data, cut);
+        dst->om_len += cut;
+        cur->om_data += cut;
+        cur->om_len -= cut;
+
+        SLIST_NEXT(dst, om_next) = NULL;
+        SLIST_NEXT(rest, om_next) = cur;
+    } else {
+        /* Move the tail of the straddling mbuf to the front of the
+         * remainder.
+         */
+        dst = rest;
+        if (OS_MBUF_TRAILINGSPACE(dst) < tail) {
+            dst = os_mbuf_get(cur->om_omp, 0);
+            if (dst == NULL) {
+                rc = BLE_HS_ENOMEM;
+                goto err;
+            }
+            SLIST_NEXT(rest, om_next) = dst;
+        }
+
+        memcpy(dst->om_data + dst->om_len, cur->om_data + cut, tail);
+        dst->om_len += tail;
+        cur->om_len = cut;
+
+        SLIST_NEXT(dst, om_next) = SLIST_NEXT(cur, om_next);
+        SLIST_NEXT(cur, om_next) = NULL;
+    }
+
+    OS_MBUF_PKTHDR(*om)->omp_len = ble_hs_hci_buf_sz;
+    OS_MBUF_PKTHDR(rest)->omp_len = pktlen - ble_hs_hci_buf_sz;
 
     /* More fragments to follow. */
-    *out_frag = frag;
+    *out_frag = *om;
+    *om = rest;
     return 0;
 
 err:
-    os_mbuf_free_chain(frag);
+    os_mbuf_free_chain(rest);
     return rc;
 }
 
@@ -440,11 +946,221 @@ ble_hs_hci_acl_hdr_prepend(struct os_mbuf *om, uint16_t handle,
 }
 
 /**
- * Transmits an HCI ACL data packet.  This function consumes the supplied mbuf,
- * regardless of the outcome.
+ * Queues an ACL fragment on its connection.  The packet header flags are not
+ * used by the host or the transports, so they hold the tick at which the
+ * fragment was queued until it is handed to the controller.
+ */
+static void
+ble_hs_hci_acl_enqueue(struct ble_hs_conn *conn, struct os_mbuf *frag)
+{
+    struct ble_gap_conn_tx_stats *stats;
+    struct os_mbuf_pkthdr *omp;
+
+    BLE_HS_DBG_ASSERT(ble_hs_locked_by_cur_task());
+
+    omp = OS_MBUF_PKTHDR(frag);
+    omp->omp_flags = os_time_get();
+
+    if (STAILQ_EMPTY(&conn->bhc_tx_q)) {
+        STAILQ_INSERT_TAIL(&ble_hs_hci_acl_active, conn, bhc_tx_next);
+    }
+    STAILQ_INSERT_TAIL(&conn->bhc_tx_q, omp, omp_next);
+
+    stats = &conn->bhc_tx_stats;
+    stats->queue_depth++;
+    if (stats->queue_depth > stats->queue_depth_max) {
+        stats->queue_depth_max = stats->queue_depth;
+    }
+}
+
+/**
+ * Returns controller buffers to the pool available for ACL data.
+ */
+static void
+ble_hs_hci_acl_credit(uint16_t num_pkts)
+{
+    if (num_pkts > ble_hs_hci_max_pkts - ble_hs_hci_avail_pkts) {
+        ble_hs_hci_avail_pkts = ble_hs_hci_max_pkts;
+    } else {
+        ble_hs_hci_avail_pkts += num_pkts;
+    }
+}
+
+/**
+ * Removes the next fragment from a connection's queue and charges it to the
+ * connection and to the controller's buffer pool.
+ */
+static struct os_mbuf_pkthdr *
+ble_hs_hci_acl_dequeue(struct ble_hs_conn *conn, uint16_t len)
+{
+    struct ble_gap_conn_tx_stats *stats;
+    struct os_mbuf_pkthdr *omp;
+    uint16_t latency;
+
+    omp = STAILQ_FIRST(&conn->bhc_tx_q);
+    STAILQ_REMOVE_HEAD(&conn->bhc_tx_q, omp_next);
+
+    conn->bhc_tx_deficit -= len;
+    conn->bhc_outstanding_pkts++;
+    ble_hs_hci_avail_pkts--;
+
+    latency = (uint16_t)os_time_get() - omp->omp_flags;
+    omp->omp_flags = 0;
+
+    stats = &conn->bhc_tx_stats;
+    stats->queue_depth--;
+    stats->tx_frags++;
+    stats->latency_total += latency;
+    if (latency > stats->latency_max) {
+        stats->latency_max = latency;
+    }
+
+    if (STAILQ_EMPTY(&conn->bhc_tx_q)) {
+        /* An idle connection does not bank unused credit. */
+        conn->bhc_tx_deficit = 0;
+        STAILQ_REMOVE_HEAD(&ble_hs_hci_acl_active, bhc_tx_next);
+        ble_hs_hci_acl_turn_open = 0;
+    }
+
+    return omp;
+}
+
+/**
+ * Performs one scheduling pass: moves fragments from the connection queues
+ * to the controller until it runs out of buffers or nothing is left.  Each
+ * turn tops up the connection's deficit by one controller buffer, and the
+ * connection sends fragments for as long as its deficit covers them.
  *
- * XXX: Ensure the controller has sufficient buffer capacity for the outgoing
- * fragments.
+ * @return                      The number of fragments sent.
+ */
+static int
+ble_hs_hci_acl_sched_once(void)
+{
+    STAILQ_HEAD(, os_mbuf_pkthdr) txq;
+    struct os_mbuf_pkthdr *omp;
+    struct ble_hs_conn *conn;
+    uint16_t len;
+    int num_sent;
+
+    STAILQ_INIT(&txq);
+    num_sent = 0;
+
+    ble_hs_lock();
+
+    while (ble_hs_hci_avail_pkts > 0) {
+        conn = STAILQ_FIRST(&ble_hs_hci_acl_active);
+        if (conn == NULL) {
+            break;
+        }
+
+        if (!ble_hs_hci_acl_turn_open) {
+            conn->bhc_tx_deficit += ble_hs_hci_buf_sz;
+            ble_hs_hci_acl_turn_open = 1;
+        }
+
+        omp = STAILQ_FIRST(&conn->bhc_tx_q);
+        len = omp->omp_len - BLE_HCI_DATA_HDR_SZ;
+        if (len > conn->bhc_tx_deficit) {
+            /* Turn is over; move to the back of the line. */
+            STAILQ_REMOVE_HEAD(&ble_hs_hci_acl_active, bhc_tx_next);
+            STAILQ_INSERT_TAIL(&ble_hs_hci_acl_active, conn, bhc_tx_next);
+            ble_hs_hci_acl_turn_open = 0;
+            continue;
+        }
+
+        omp = ble_hs_hci_acl_dequeue(conn, len);
+        STAILQ_INSERT_TAIL(&txq, omp, omp_next);
+        num_sent++;
+    }
+
+    ble_hs_unlock();
+
+    /* Hand the fragments to the transport without holding the host mutex. */
+    while ((omp = STAILQ_FIRST(&txq)) != NULL) {
+        STAILQ_REMOVE_HEAD(&txq, omp_next);
+        ble_hci_trans_hs_acl_tx(OS_MBUF_PKTHDR_TO_MBUF(omp));
+    }
+
+    return num_sent;
+}
+
+/**
+ * Sends queued ACL fragments to the controller while it has room for them.
+ * Called by the host parent task.
+ */
+void
+ble_hs_hci_acl_sched(void)
+{
+    while (ble_hs_hci_acl_sched_once() > 0) {
+        /* Buffers may have been freed while the last batch was sent. */
+    }
+}
+
+/**
+ * Processes one entry of a Number-Of-Completed-Packets event.
+ */
+void
+ble_hs_hci_acl_completed(uint16_t conn_handle, uint16_t num_pkts)
+{
+    struct ble_hs_conn *conn;
+
+    ble_hs_lock();
+
+    /* Packets belonging to a terminated connection were already returned to
+     * the pool when the connection was removed.
+     */
+    conn = ble_hs_conn_find(conn_handle);
+    if (conn != NULL) {
+        if (num_pkts > conn->bhc_outstanding_pkts) {
+            num_pkts = conn->bhc_outstanding_pkts;
+        }
+        conn->bhc_outstanding_pkts -= num_pkts;
+        ble_hs_hci_acl_credit(num_pkts);
+    }
+
+    ble_hs_unlock();
+
+    if (conn != NULL && num_pkts > 0) {
+        ble_hs_tx_data_sched();
+    }
+}
+
+/**
+ * Discards a connection's queued fragments and reclaims the controller
+ * buffers it still holds; the controller frees those buffers when the
+ * connection terminates without reporting them as completed.  Must be called
+ * with the host mutex locked when the connection is removed.
+ */
+void
+ble_hs_hci_acl_conn_flush(struct ble_hs_conn *conn)
+{
+    struct os_mbuf_pkthdr *omp;
+
+    BLE_HS_DBG_ASSERT(ble_hs_locked_by_cur_task());
+
+    if (!STAILQ_EMPTY(&conn->bhc_tx_q)) {
+        if (conn == STAILQ_FIRST(&ble_hs_hci_acl_active)) {
+            ble_hs_hci_acl_turn_open = 0;
+        }
+        STAILQ_REMOVE(&ble_hs_hci_acl_active, conn, ble_hs_conn, bhc_tx_next);
+
+        while ((omp = STAILQ_FIRST(&conn->bhc_tx_q)) != NULL) {
+            STAILQ_REMOVE_HEAD(&conn->bhc_tx_q, omp_next);
+            os_mbuf_free_chain(OS_MBUF_PKTHDR_TO_MBUF(omp));
+        }
+    }
+    conn->bhc_tx_deficit = 0;
+    conn->bhc_tx_stats.queue_depth = 0;
+
+    ble_hs_hci_acl_credit(conn->bhc_outstanding_pkts);
+    conn->bhc_outstanding_pkts = 0;
+}
+
+/**
+ * Transmits an HCI ACL data packet.  The packet is split into fragments which
+ * are queued on the connection until the controller has room for them.  This
+ * function consumes the supplied mbuf, regardless of the outcome.  Must be
+ * called with the host mutex locked.
  */
 int
 ble_hs_hci_acl_tx(struct ble_hs_conn *connection, struct os_mbuf *txom)
@@ -459,7 +1175,7 @@ ble_hs_hci_acl_tx(struct ble_hs_conn *connection, struct os_mbuf *txom)
      */
     pb = BLE_HCI_PB_FIRST_NON_FLUSH;
 
-    /* Send fragments until the entire packet has been sent. */
+    /* Queue fragments until the entire packet has been consumed. */
     while (txom != NULL) {
         rc = ble_hs_hci_split_frag(&txom, &frag);
         if (rc != 0) {
@@ -477,30 +1193,20 @@ ble_hs_hci_acl_tx(struct ble_hs_conn *connection, struct os_mbuf *txom)
         ble_hs_log_mbuf(frag);
         BLE_HS_LOG(DEBUG, "\n");
 
-        /* XXX: Try to pullup the entire fragment.  The controller currently
-         * requires the entire fragment to fit in a single buffer.  When this
-         * restriction is removed from the controller, this operation can be
-         * removed.
-         */
-        frag = os_mbuf_pullup(frag, OS_MBUF_PKTLEN(frag));
-        if (frag == NULL) {
-            rc = BLE_HS_ENOMEM;
-            goto err;
-        }
-
-        rc = ble_hs_tx_data(frag);
-        if (rc != 0) {
-            goto err;
-        }
-
-        connection->bhc_outstanding_pkts++;
+        ble_hs_hci_acl_enqueue(connection, frag);
     }
 
+    ble_hs_tx_data_sched();
     return 0;
 
 err:
     BLE_HS_DBG_ASSERT(rc != 0);
 
+    /* Fragments that were already queued still go out. */
+    if (!STAILQ_EMPTY(&connection->bhc_tx_q)) {
+        ble_hs_tx_data_sched();
+    }
+
     os_mbuf_free_chain(txom);
     return rc;
 }
@@ -509,6 +1215,26 @@ void
 ble_hs_hci_init(void)
 {
     int rc;
+    int i;
+
+    STAILQ_INIT(&ble_hs_hci_cmd_free_list);
+    STAILQ_INIT(&ble_hs_hci_cmd_pending);
+    STAILQ_INIT(&ble_hs_hci_cmd_inflight);
+    for (i = 0; i < BLE_HS_HCI_CMD_Q_LEN; i++) {
+        STAILQ_INSERT_TAIL(&ble_hs_hci_cmd_free_list,
+                           ble_hs_hci_cmd_entries + i, next);
+    }
+
+    /* The controller accepts one command until it says otherwise. */
+    ble_hs_hci_cmd_credits = 1;
+    ble_hs_hci_cmd_inflight_cnt = 0;
+
+    ble_hs_hci_ack_q_head = 0;
+    ble_hs_hci_ack_q_count = 0;
+
+    STAILQ_INIT(&ble_hs_hci_acl_active);
+    ble_hs_hci_acl_turn_open = 0;
+    ble_hs_hci_avail_pkts = 0;
 
     rc = os_sem_init(&ble_hs_hci_sem, 0);
     BLE_HS_DBG_ASSERT_EVAL(rc == 0);
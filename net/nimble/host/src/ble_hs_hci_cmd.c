@@ -66,7 +66,9 @@ ble_hs_hci_cmd_send(uint8_t ogf, uint8_t ocf, uint8_t len, const void *cmddata)
     int rc;
 
     buf = ble_hci_trans_buf_alloc(BLE_HCI_TRANS_BUF_CMD);
-    BLE_HS_DBG_ASSERT(buf != NULL);
+    if (buf == NULL) {
+        return BLE_HS_ENOMEM;
+    }
 
     htole16(buf, ogf << 10 | ocf);
     buf[2] = len;
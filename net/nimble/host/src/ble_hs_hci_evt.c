@@ -222,9 +222,7 @@ ble_hs_hci_evt_num_completed_pkts(uint8_t event_code, uint8_t *data, int len)
         handle = le16toh(data + off + 2 * i);
         num_pkts = le16toh(data + off + 2 * num_handles + 2 * i);
 
-        /* XXX: Do something with these values. */
-        (void)handle;
-        (void)num_pkts;
+        ble_hs_hci_acl_completed(handle, num_pkts);
     }
 
     return 0;
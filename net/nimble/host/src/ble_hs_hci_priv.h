@@ -30,11 +30,24 @@ struct ble_hs_hci_ack {
     int bha_params_len;
     uint16_t bha_opcode;
     uint8_t bha_hci_handle;
+    uint8_t bha_num_pkts;   /* Commands the controller will now accept. */
 };
 
+/**
+ * Called when an asynchronous HCI command completes.  The ack's parameters
+ * are only valid for the duration of the call.  If the command could not be
+ * sent or was never acknowledged, bha_status indicates why and bha_params is
+ * null.
+ */
+typedef void ble_hs_hci_cmd_cb(const struct ble_hs_hci_ack *ack, void *arg);
+
 int ble_hs_hci_cmd_tx(void *cmd, void *evt_buf, uint8_t evt_buf_len,
                       uint8_t *out_evt_buf_len);
 int ble_hs_hci_cmd_tx_empty_ack(void *cmd);
+int ble_hs_hci_cmd_tx_async(const void *cmd, ble_hs_hci_cmd_cb *cb,
+                            void *cb_arg);
+void ble_hs_hci_cmd_wait_all(void);
+void ble_hs_hci_cmd_status_cb(const struct ble_hs_hci_ack *ack, void *arg);
 void ble_hs_hci_rx_ack(uint8_t *ack_ev);
 void ble_hs_hci_init(void);
 
@@ -130,6 +143,9 @@ uint16_t ble_hs_hci_util_handle_pb_bc_join(uint16_t handle, uint8_t pb,
                                            uint8_t bc);
 
 int ble_hs_hci_acl_tx(struct ble_hs_conn *connection, struct os_mbuf *txom);
+void ble_hs_hci_acl_sched(void);
+void ble_hs_hci_acl_completed(uint16_t conn_handle, uint16_t num_pkts);
+void ble_hs_hci_acl_conn_flush(struct ble_hs_conn *conn);
 
 int ble_hs_hci_cmd_build_set_data_len(uint16_t connection_handle,
                                       uint16_t tx_octets, uint16_t tx_time,
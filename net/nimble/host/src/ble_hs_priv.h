@@ -53,6 +53,7 @@ struct os_event;
 #define BLE_HOST_HCI_EVENT_CTLR_EVENT   (OS_EVENT_T_PERUSER + 0)
 #define BLE_HS_EVENT_TX_NOTIFICATIONS   (OS_EVENT_T_PERUSER + 1)
 #define BLE_HS_EVENT_RESET              (OS_EVENT_T_PERUSER + 2)
+#define BLE_HS_EVENT_TX_DATA            (OS_EVENT_T_PERUSER + 3)
 
 #define BLE_HS_SYNC_STATE_BAD           0
 #define BLE_HS_SYNC_STATE_BRINGUP       1
@@ -79,7 +80,7 @@ extern const uint8_t ble_hs_misc_null_addr[6];
 
 void ble_hs_process_tx_data_queue(void);
 void ble_hs_process_rx_data_queue(void);
-int ble_hs_tx_data(struct os_mbuf *om);
+void ble_hs_tx_data_sched(void);
 void ble_hs_enqueue_hci_event(uint8_t *hci_evt);
 void ble_hs_event_enqueue(struct os_event *ev);
 
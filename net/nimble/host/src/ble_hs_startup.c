@@ -22,55 +22,97 @@
 #include "host/ble_hs.h"
 #include "ble_hs_priv.h"
 
+/**
+ * Results of the pipelined part of the startup sequence.  Ack callbacks run
+ * with the HCI mutex held, so they only record results here; anything that
+ * needs the host lock is applied once all commands have completed.
+ */
+struct ble_hs_startup_ctx {
+    int status;
+    uint8_t pub_addr[6];
+};
+
+static void
+ble_hs_startup_fail(struct ble_hs_startup_ctx *ctx, int rc)
+{
+    if (ctx->status == 0) {
+        ctx->status = rc;
+    }
+}
+
+static void
+ble_hs_startup_le_read_sup_f_cb(const struct ble_hs_hci_ack *ack, void *arg)
+{
+    struct ble_hs_startup_ctx *ctx;
+
+    ctx = arg;
+
+    if (ack->bha_status != 0) {
+        ble_hs_startup_fail(ctx, ack->bha_status);
+        return;
+    }
+
+    if (ack->bha_params_len != BLE_HCI_RD_LOC_SUPP_FEAT_RSPLEN) {
+        ble_hs_startup_fail(ctx, BLE_HS_ECONTROLLER);
+        return;
+    }
+
+    /* XXX: Do something with the supported features bit map. */
+}
+
 static int
-ble_hs_startup_le_read_sup_f_tx(void)
+ble_hs_startup_le_read_sup_f_tx(struct ble_hs_startup_ctx *ctx)
 {
-    uint8_t ack_params[BLE_HCI_RD_LOC_SUPP_FEAT_RSPLEN];
     uint8_t buf[BLE_HCI_CMD_HDR_LEN];
-    uint8_t ack_params_len;
     int rc;
 
     ble_hs_hci_cmd_build_le_read_loc_supp_feat(buf, sizeof buf);
-    rc = ble_hs_hci_cmd_tx(buf, ack_params, sizeof ack_params,
-                           &ack_params_len);
+    rc = ble_hs_hci_cmd_tx_async(buf, ble_hs_startup_le_read_sup_f_cb, ctx);
     if (rc != 0) {
         return rc;
     }
 
-    if (ack_params_len != BLE_HCI_RD_LOC_SUPP_FEAT_RSPLEN) {
-        return BLE_HS_ECONTROLLER;
-    }
-
-    /* XXX: Do something with the supported features bit map. */
-
     return 0;
 }
 
-static int
-ble_hs_startup_le_read_buf_sz_tx(void)
+static void
+ble_hs_startup_le_read_buf_sz_cb(const struct ble_hs_hci_ack *ack, void *arg)
 {
+    struct ble_hs_startup_ctx *ctx;
     uint16_t pktlen;
-    uint8_t ack_params[BLE_HCI_RD_BUF_SIZE_RSPLEN];
-    uint8_t buf[BLE_HCI_CMD_HDR_LEN];
-    uint8_t ack_params_len;
     uint8_t max_pkts;
     int rc;
 
-    ble_hs_hci_cmd_build_le_read_buffer_size(buf, sizeof buf);
-    rc = ble_hs_hci_cmd_tx(buf, ack_params, sizeof ack_params,
-                           &ack_params_len);
-    if (rc != 0) {
-        return rc;
+    ctx = arg;
+
+    if (ack->bha_status != 0) {
+        ble_hs_startup_fail(ctx, ack->bha_status);
+        return;
     }
 
-    if (ack_params_len != BLE_HCI_RD_BUF_SIZE_RSPLEN) {
-        return BLE_HS_ECONTROLLER;
+    if (ack->bha_params_len != BLE_HCI_RD_BUF_SIZE_RSPLEN) {
+        ble_hs_startup_fail(ctx, BLE_HS_ECONTROLLER);
+        return;
     }
 
-    pktlen = le16toh(ack_params + 0);
-    max_pkts = ack_params[2];
+    pktlen = le16toh(ack->bha_params + 0);
+    max_pkts = ack->bha_params[2];
 
     rc = ble_hs_hci_set_buf_sz(pktlen, max_pkts);
+    if (rc != 0) {
+        ble_hs_startup_fail(ctx, rc);
+        return;
+    }
+}
+
+static int
+ble_hs_startup_le_read_buf_sz_tx(struct ble_hs_startup_ctx *ctx)
+{
+    uint8_t buf[BLE_HCI_CMD_HDR_LEN];
+    int rc;
+
+    ble_hs_hci_cmd_build_le_read_buffer_size(buf, sizeof buf);
+    rc = ble_hs_hci_cmd_tx_async(buf, ble_hs_startup_le_read_buf_sz_cb, ctx);
     if (rc != 0) {
         return rc;
     }
@@ -78,31 +120,43 @@ ble_hs_startup_le_read_buf_sz_tx(void)
     return 0;
 }
 
+static void
+ble_hs_startup_read_bd_addr_cb(const struct ble_hs_hci_ack *ack, void *arg)
+{
+    struct ble_hs_startup_ctx *ctx;
+
+    ctx = arg;
+
+    if (ack->bha_status != 0) {
+        ble_hs_startup_fail(ctx, ack->bha_status);
+        return;
+    }
+
+    if (ack->bha_params_len != BLE_HCI_IP_RD_BD_ADDR_ACK_PARAM_LEN) {
+        ble_hs_startup_fail(ctx, BLE_HS_ECONTROLLER);
+        return;
+    }
+
+    memcpy(ctx->pub_addr, ack->bha_params, sizeof ctx->pub_addr);
+}
+
 static int
-ble_hs_startup_read_bd_addr(void)
+ble_hs_startup_read_bd_addr(struct ble_hs_startup_ctx *ctx)
 {
-    uint8_t ack_params[BLE_HCI_IP_RD_BD_ADDR_ACK_PARAM_LEN];
     uint8_t buf[BLE_HCI_CMD_HDR_LEN];
-    uint8_t ack_params_len;
     int rc;
 
     ble_hs_hci_cmd_build_read_bd_addr(buf, sizeof buf);
-    rc = ble_hs_hci_cmd_tx(buf, ack_params, sizeof ack_params,
-                           &ack_params_len);
+    rc = ble_hs_hci_cmd_tx_async(buf, ble_hs_startup_read_bd_addr_cb, ctx);
     if (rc != 0) {
         return rc;
     }
 
-    if (ack_params_len != sizeof ack_params) {
-        return BLE_HS_ECONTROLLER;
-    }
-
-    ble_hs_id_set_pub(ack_params);
     return 0;
 }
 
 static int
-ble_hs_startup_le_set_evmask_tx(void)
+ble_hs_startup_le_set_evmask_tx(struct ble_hs_startup_ctx *ctx)
 {
     uint8_t buf[BLE_HCI_CMD_HDR_LEN + BLE_HCI_SET_LE_EVENT_MASK_LEN];
     int rc;
@@ -120,7 +174,8 @@ ble_hs_startup_le_set_evmask_tx(void)
      */
     ble_hs_hci_cmd_build_le_set_event_mask(0x000000000000027f,
                                            buf, sizeof buf);
-    rc = ble_hs_hci_cmd_tx_empty_ack(buf);
+    rc = ble_hs_hci_cmd_tx_async(buf, ble_hs_hci_cmd_status_cb,
+                                 &ctx->status);
     if (rc != 0) {
         return rc;
     }
@@ -129,7 +184,7 @@ ble_hs_startup_le_set_evmask_tx(void)
 }
 
 static int
-ble_hs_startup_set_evmask_tx(void)
+ble_hs_startup_set_evmask_tx(struct ble_hs_startup_ctx *ctx)
 {
     uint8_t buf[BLE_HCI_CMD_HDR_LEN + BLE_HCI_SET_EVENT_MASK_LEN];
     int rc;
@@ -177,7 +232,8 @@ ble_hs_startup_set_evmask_tx(void)
      *     0x2000000000000000 LE Meta-Event
      */
     ble_hs_hci_cmd_build_set_event_mask(0x20009fffffffffff, buf, sizeof buf);
-    rc = ble_hs_hci_cmd_tx_empty_ack(buf);
+    rc = ble_hs_hci_cmd_tx_async(buf, ble_hs_hci_cmd_status_cb,
+                                 &ctx->status);
     if (rc != 0) {
         return rc;
     }
@@ -187,7 +243,8 @@ ble_hs_startup_set_evmask_tx(void)
      *     0x0000000000800000 Authenticated Payload Timeout Event
      */
     ble_hs_hci_cmd_build_set_event_mask2(0x0000000000800000, buf, sizeof buf);
-    rc = ble_hs_hci_cmd_tx_empty_ack(buf);
+    rc = ble_hs_hci_cmd_tx_async(buf, ble_hs_hci_cmd_status_cb,
+                                 &ctx->status);
     if (rc != 0) {
         return rc;
     }
@@ -213,6 +270,7 @@ ble_hs_startup_reset_tx(void)
 int
 ble_hs_startup_go(void)
 {
+    struct ble_hs_startup_ctx ctx;
     int rc;
 
     rc = ble_hs_startup_reset_tx();
@@ -220,36 +278,51 @@ ble_hs_startup_go(void)
         return rc;
     }
 
+    /* The rest of the sequence consists of independent commands.  Queue them
+     * all and let the HCI keep as many in flight as the controller allows.
+     */
+    memset(&ctx, 0, sizeof ctx);
+
     /* XXX: Read local supported commands. */
     /* XXX: Read local supported features. */
 
-    rc = ble_hs_startup_set_evmask_tx();
+    rc = ble_hs_startup_set_evmask_tx(&ctx);
     if (rc != 0) {
-        return rc;
+        goto done;
     }
 
-    rc = ble_hs_startup_le_set_evmask_tx();
+    rc = ble_hs_startup_le_set_evmask_tx(&ctx);
     if (rc != 0) {
-        return rc;
+        goto done;
     }
 
-    rc = ble_hs_startup_le_read_buf_sz_tx();
+    rc = ble_hs_startup_le_read_buf_sz_tx(&ctx);
     if (rc != 0) {
-        return rc;
+        goto done;
     }
 
     /* XXX: Read buffer size. */
 
-    rc = ble_hs_startup_le_read_sup_f_tx();
+    rc = ble_hs_startup_le_read_sup_f_tx(&ctx);
     if (rc != 0) {
-        return rc;
+        goto done;
     }
 
-    rc = ble_hs_startup_read_bd_addr();
+    rc = ble_hs_startup_read_bd_addr(&ctx);
+    if (rc != 0) {
+        goto done;
+    }
+
+done:
+    ble_hs_hci_cmd_wait_all();
     if (rc != 0) {
         return rc;
     }
+    if (ctx.status != 0) {
+        return ctx.status;
+    }
 
+    ble_hs_id_set_pub(ctx.pub_addr);
     ble_hs_pvcy_set_our_irk(NULL);
 
     return 0;
@@ -204,6 +204,12 @@ ble_sm_dbg_set_sc_keys(uint8_t *pubkey, uint8_t *privkey)
     ble_sm_dbg_sc_keys_set = 1;
 }
 
+int
+ble_sm_dbg_sc_keys_pending(void)
+{
+    return ble_sm_dbg_sc_keys_set;
+}
+
 int
 ble_sm_dbg_num_procs(void)
 {
@@ -619,6 +625,18 @@ ble_sm_proc_find(uint16_t conn_handle, uint8_t state, int is_initiator,
     return proc;
 }
 
+/**
+ * Returns the first entry in the main proc list.  The remaining entries can
+ * be walked with STAILQ_NEXT().
+ */
+struct ble_sm_proc *
+ble_sm_proc_first(void)
+{
+    BLE_HS_DBG_ASSERT(ble_hs_locked_by_cur_task());
+
+    return STAILQ_FIRST(&ble_sm_procs);
+}
+
 static void
 ble_sm_insert(struct ble_sm_proc *proc)
 {
@@ -765,6 +783,13 @@ ble_sm_process_result(uint16_t conn_handle, struct ble_sm_result *res)
     rm = 0;
 
     while (1) {
+        if (res->execute) {
+            /* The next step may need our key pair; get it outside the
+             * lock.
+             */
+            ble_sm_sc_keys_prepare(conn_handle);
+        }
+
         ble_hs_lock();
         proc = ble_sm_proc_find(conn_handle, BLE_SM_PROC_STATE_NONE, -1,
                                 &prev);
@@ -2046,6 +2071,8 @@ ble_sm_heartbeat(void)
         ble_sm_proc_free(proc);
     }
 
+    ble_sm_sc_heartbeat();
+
     return BLE_HS_FOREVER;
 }
 
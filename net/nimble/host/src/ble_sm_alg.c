@@ -437,6 +437,40 @@ ble_sm_alg_gen_dhkey(uint8_t *peer_pub_key_x, uint8_t *peer_pub_key_y,
     return 0;
 }
 
+/**
+ * Derives a key pair from 64 bytes of random data.  No HCI commands are sent,
+ * so this can execute outside the host task.
+ *
+ * pub: 64 bytes
+ * priv: 32 bytes
+ *
+ * @return                      0 on success;
+ *                              BLE_HS_EAGAIN if the random data produced the
+ *                                  debug key; retry with new data;
+ *                              BLE_HS_EUNKNOWN on failure.
+ */
+int
+ble_sm_alg_make_key_pair(uint32_t *random, void *pub, uint32_t *priv)
+{
+    EccPoint pkey;
+    int rc;
+
+    rc = ecc_make_key(&pkey, priv, random);
+    if (rc != TC_CRYPTO_SUCCESS) {
+        return BLE_HS_EUNKNOWN;
+    }
+
+    /* Make sure generated key isn't debug key. */
+    if (memcmp(priv, ble_sm_alg_dbg_priv_key, 32) == 0) {
+        return BLE_HS_EAGAIN;
+    }
+
+    memcpy(pub + 0, pkey.x, 32);
+    memcpy(pub + 32, pkey.y, 32);
+
+    return 0;
+}
+
 /**
  * pub: 64 bytes
  * priv: 32 bytes
@@ -445,7 +479,6 @@ int
 ble_sm_alg_gen_key_pair(void *pub, uint32_t *priv)
 {
     uint32_t random[16];
-    EccPoint pkey;
     int rc;
 
     do {
@@ -454,18 +487,10 @@ ble_sm_alg_gen_key_pair(void *pub, uint32_t *priv)
             return rc;
         }
 
-        rc = ecc_make_key(&pkey, priv, random);
-        if (rc != TC_CRYPTO_SUCCESS) {
-            return BLE_HS_EUNKNOWN;
-        }
-
-        /* Make sure generated key isn't debug key. */
-    } while (memcmp(priv, ble_sm_alg_dbg_priv_key, 32) == 0);
+        rc = ble_sm_alg_make_key_pair(random, pub, priv);
+    } while (rc == BLE_HS_EAGAIN);
 
-    memcpy(pub + 0, pkey.x, 32);
-    memcpy(pub + 32, pkey.y, 32);
-
-    return 0;
+    return rc;
 }
 
 #endif
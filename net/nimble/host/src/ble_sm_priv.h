@@ -219,6 +219,10 @@ struct ble_sm_dhkey_check {
 #define BLE_SM_PROC_F_AUTHENTICATED         0x08
 #define BLE_SM_PROC_F_SC                    0x10
 #define BLE_SM_PROC_F_BONDING               0x20
+#define BLE_SM_PROC_F_SC_KEYS               0x40
+#define BLE_SM_PROC_F_SC_KEYS_WAIT          0x80
+#define BLE_SM_PROC_F_SC_DHKEY_WAIT         0x100
+#define BLE_SM_PROC_F_SC_DHKEY_BUSY         0x200
 
 #define BLE_SM_KE_F_ENC_INFO                0x01
 #define BLE_SM_KE_F_MASTER_ID               0x02
@@ -226,7 +230,7 @@ struct ble_sm_dhkey_check {
 #define BLE_SM_KE_F_ADDR_INFO               0x08
 #define BLE_SM_KE_F_SIGN_INFO               0x10
 
-typedef uint8_t ble_sm_proc_flags;
+typedef uint16_t ble_sm_proc_flags;
 
 struct ble_sm_keys {
     unsigned ltk_valid:1;
@@ -270,6 +274,10 @@ struct ble_sm_proc {
     struct ble_sm_public_key pub_key_peer;
     uint8_t mackey[16];
     uint8_t dhkey[32];
+
+    /* Our key pair for this pairing; valid if BLE_SM_PROC_F_SC_KEYS set. */
+    struct ble_sm_public_key pub_key_our;
+    uint32_t priv_key_our[8];
 #endif
 };
 
@@ -291,6 +299,7 @@ void ble_sm_dbg_set_next_master_id_rand(uint64_t next_master_id_rand);
 void ble_sm_dbg_set_next_ltk(uint8_t *next_ltk);
 void ble_sm_dbg_set_next_csrk(uint8_t *next_csrk);
 void ble_sm_dbg_set_sc_keys(uint8_t *pubkey, uint8_t *privkey);
+int ble_sm_dbg_sc_keys_pending(void);
 int ble_sm_dbg_num_procs(void);
 #endif
 
@@ -392,6 +401,7 @@ int ble_sm_alg_f6(const uint8_t *w, const uint8_t *n1, const uint8_t *n2,
                   uint8_t *check);
 int ble_sm_alg_gen_dhkey(uint8_t *peer_pub_key_x, uint8_t *peer_pub_key_y,
                          uint32_t *our_priv_key, void *out_dhkey);
+int ble_sm_alg_make_key_pair(uint32_t *random, void *pub, uint32_t *priv);
 int ble_sm_alg_gen_key_pair(void *pub, uint32_t *priv);
 
 void ble_sm_enc_change_rx(struct hci_encrypt_change *evt);
@@ -423,6 +433,8 @@ void ble_sm_sc_dhkey_check_exec(struct ble_sm_proc *proc,
 void ble_sm_sc_dhkey_check_rx(uint16_t conn_handle, uint8_t op,
                               struct os_mbuf **rxom,
                               struct ble_sm_result *res);
+void ble_sm_sc_keys_prepare(uint16_t conn_handle);
+void ble_sm_sc_heartbeat(void);
 void ble_sm_sc_init(void);
 #else
 #define ble_sm_sc_io_action(proc) (BLE_SM_IOACT_NONE)
@@ -433,6 +445,8 @@ void ble_sm_sc_init(void);
 #define ble_sm_sc_public_key_rx(conn_handle, op, om, res)
 #define ble_sm_sc_dhkey_check_exec(proc, res, arg)
 #define ble_sm_sc_dhkey_check_rx(conn_handle, op, om, res)
+#define ble_sm_sc_keys_prepare(conn_handle)
+#define ble_sm_sc_heartbeat()
 #define ble_sm_sc_init()
 
 #endif
@@ -440,6 +454,7 @@ void ble_sm_sc_init(void);
 struct ble_sm_proc *ble_sm_proc_find(uint16_t conn_handle, uint8_t state,
                                      int is_initiator,
                                      struct ble_sm_proc **out_prev);
+struct ble_sm_proc *ble_sm_proc_first(void);
 int ble_sm_gen_pair_rand(uint8_t *pair_rand);
 int ble_sm_gen_pub_priv(void *pub, uint32_t *priv);
 uint8_t *ble_sm_our_pair_rand(struct ble_sm_proc *proc);
@@ -44,10 +44,46 @@ static union {
 } ble_sm_sc_priv_key;
 
 /**
- * Whether our public-private key pair has been generated.  We generate it on
- * startup for now until we have a non-volatile storage mechanism.
+ * State of the key pair above.  Without a crypto task, a single key pair is
+ * generated on first use and shared by every pairing.  With a crypto task
+ * (ble_hs_cfg.sm_crypto_evq), each pairing takes the pair for itself and the
+ * next one is generated in the background.
  */
-static uint8_t ble_sm_sc_keys_generated;
+#define BLE_SM_SC_KEYS_NONE         0
+#define BLE_SM_SC_KEYS_PENDING      1
+#define BLE_SM_SC_KEYS_READY        2
+
+static uint8_t ble_sm_sc_keys_state;
+
+/** Result of the last attempt to start generating a key pair. */
+static int ble_sm_sc_keygen_rc;
+
+/**
+ * A P-256 operation which executes on the application's crypto task.  While
+ * a job is busy, its inputs and outputs belong to the crypto task; the host
+ * only touches them again from the job's completion callback, which executes
+ * in the host task.
+ */
+struct ble_sm_sc_job {
+    struct os_callout_func work;
+    struct os_callout_func done;
+    int status;
+    uint8_t busy;
+};
+
+static struct {
+    struct ble_sm_sc_job job;
+    uint32_t random[16];
+    uint32_t pub[16];
+    uint32_t priv[8];
+} ble_sm_sc_keygen_job;
+
+static struct {
+    struct ble_sm_sc_job job;
+    struct ble_sm_public_key peer_pub_key;
+    uint32_t priv[8];
+    uint8_t dhkey[32];
+} ble_sm_sc_dhkey_job;
 
 /**
  * Create some shortened names for the passkey actions so that the table is
@@ -138,30 +174,197 @@ ble_sm_sc_io_action(struct ble_sm_proc *proc)
 }
 
 static int
-ble_sm_sc_ensure_keys_generated(void)
+ble_sm_sc_async(void)
+{
+    return ble_hs_cfg.sm_crypto_evq != NULL;
+}
+
+static void
+ble_sm_sc_job_submit(struct ble_sm_sc_job *job)
+{
+    job->busy = 1;
+    os_eventq_put(ble_hs_cfg.sm_crypto_evq, &job->work.cf_c.c_ev);
+}
+
+/**
+ * Starts generating a new key pair.  Only the curve arithmetic is offloaded
+ * to the crypto task; the random seed is read from the controller here.
+ * Both block, so the host lock must not be held.
+ */
+static int
+ble_sm_sc_keygen_start(void)
 {
     int rc;
 
-    if (!ble_sm_sc_keys_generated) {
-        rc = ble_sm_gen_pub_priv(ble_sm_sc_pub_key.u32,
-                                 ble_sm_sc_priv_key.u32);
+    BLE_HS_DBG_ASSERT(ble_sm_sc_keys_state == BLE_SM_SC_KEYS_NONE);
+    BLE_HS_DBG_ASSERT(!ble_hs_locked_by_cur_task());
+
+#ifdef BLE_HS_DEBUG
+    if (ble_sm_dbg_sc_keys_pending()) {
+        goto sync;
+    }
+#endif
+
+    if (ble_sm_sc_async()) {
+        rc = ble_hs_hci_util_rand(ble_sm_sc_keygen_job.random,
+                                  sizeof ble_sm_sc_keygen_job.random);
         if (rc != 0) {
             return rc;
         }
 
-        ble_sm_sc_keys_generated = 1;
+        ble_sm_sc_keys_state = BLE_SM_SC_KEYS_PENDING;
+        ble_sm_sc_job_submit(&ble_sm_sc_keygen_job.job);
+        return 0;
+    }
+
+#ifdef BLE_HS_DEBUG
+sync:
+#endif
+    rc = ble_sm_gen_pub_priv(ble_sm_sc_pub_key.u32, ble_sm_sc_priv_key.u32);
+    if (rc != 0) {
+        return rc;
+    }
+
+    ble_sm_sc_keys_state = BLE_SM_SC_KEYS_READY;
+    return 0;
+}
+
+/**
+ * Indicates whether the proc is about to take our key pair.
+ */
+static int
+ble_sm_sc_proc_needs_keys(struct ble_sm_proc *proc)
+{
+    return proc->flags & BLE_SM_PROC_F_SC &&
+           !(proc->flags & BLE_SM_PROC_F_SC_KEYS) &&
+           proc->state == BLE_SM_PROC_STATE_PUBLIC_KEY;
+}
+
+/**
+ * Starts generating a key pair if a proc on the specified connection (any
+ * connection, for BLE_HS_CONN_HANDLE_NONE) is about to need one and none is
+ * ready or pending.  Called before the host lock is taken for the step that
+ * takes the key pair, so that ble_sm_sc_keys_take() only copies it.
+ */
+void
+ble_sm_sc_keys_prepare(uint16_t conn_handle)
+{
+    struct ble_sm_proc *proc;
+
+    if (ble_sm_sc_keys_state != BLE_SM_SC_KEYS_NONE) {
+        return;
+    }
+
+    ble_hs_lock();
+    for (proc = ble_sm_proc_first();
+         proc != NULL;
+         proc = STAILQ_NEXT(proc, next)) {
+
+        if ((conn_handle == BLE_HS_CONN_HANDLE_NONE ||
+             proc->conn_handle == conn_handle) &&
+            ble_sm_sc_proc_needs_keys(proc)) {
+
+            break;
+        }
+    }
+    ble_hs_unlock();
+
+    if (proc != NULL) {
+        ble_sm_sc_keygen_rc = ble_sm_sc_keygen_start();
     }
+}
+
+/**
+ * Gives the specified proc its own copy of our key pair.  The pair must
+ * have been started by ble_sm_sc_keys_prepare().
+ *
+ * @return                      0 on success;
+ *                              BLE_HS_EAGAIN if the proc has to wait for a
+ *                                  key pair to be generated;
+ *                              Other nonzero on error.
+ */
+static int
+ble_sm_sc_keys_take(struct ble_sm_proc *proc)
+{
+    int rc;
+
+    if (proc->flags & BLE_SM_PROC_F_SC_KEYS) {
+        return 0;
+    }
+
+    if (ble_sm_sc_keys_state == BLE_SM_SC_KEYS_NONE) {
+        /* ble_sm_sc_keys_prepare() could not start one. */
+        rc = ble_sm_sc_keygen_rc;
+        if (rc == 0) {
+            rc = BLE_HS_EUNKNOWN;
+        }
+        return rc;
+    }
+
+    if (ble_sm_sc_keys_state != BLE_SM_SC_KEYS_READY) {
+        proc->flags |= BLE_SM_PROC_F_SC_KEYS_WAIT;
+        return BLE_HS_EAGAIN;
+    }
+
+    memcpy(&proc->pub_key_our, ble_sm_sc_pub_key.u8,
+           sizeof proc->pub_key_our);
+    memcpy(proc->priv_key_our, ble_sm_sc_priv_key.u32,
+           sizeof proc->priv_key_our);
+    proc->flags &= ~BLE_SM_PROC_F_SC_KEYS_WAIT;
+    proc->flags |= BLE_SM_PROC_F_SC_KEYS;
 
     BLE_HS_LOG(DEBUG, "our pubkey=");
-    ble_hs_log_flat_buf(&ble_sm_sc_pub_key, 64);
+    ble_hs_log_flat_buf(&proc->pub_key_our, 64);
     BLE_HS_LOG(DEBUG, "\n");
     BLE_HS_LOG(DEBUG, "our privkey=");
-    ble_hs_log_flat_buf(&ble_sm_sc_priv_key, 32);
+    ble_hs_log_flat_buf(proc->priv_key_our, 32);
     BLE_HS_LOG(DEBUG, "\n");
 
+    if (ble_sm_sc_async()) {
+        /* This pair is now used up; ble_sm_sc_heartbeat() starts on the next
+         * one.
+         */
+        ble_sm_sc_keys_state = BLE_SM_SC_KEYS_NONE;
+    }
+
     return 0;
 }
 
+/**
+ * Computes the DHKey for the specified proc.  With a crypto task, the
+ * computation is queued and the proc resumes when it completes.
+ *
+ * @return                      0 if proc->dhkey has been computed;
+ *                              BLE_HS_EAGAIN if the proc has to wait for the
+ *                                  crypto task;
+ *                              Other nonzero on error.
+ */
+static int
+ble_sm_sc_dhkey_start(struct ble_sm_proc *proc)
+{
+    if (!ble_sm_sc_async()) {
+        return ble_sm_alg_gen_dhkey(proc->pub_key_peer.x,
+                                    proc->pub_key_peer.y,
+                                    proc->priv_key_our,
+                                    proc->dhkey);
+    }
+
+    proc->flags |= BLE_SM_PROC_F_SC_DHKEY_WAIT;
+
+    if (ble_sm_sc_dhkey_job.job.busy) {
+        /* The job is in use by another pairing; retried on completion. */
+        return BLE_HS_EAGAIN;
+    }
+
+    ble_sm_sc_dhkey_job.peer_pub_key = proc->pub_key_peer;
+    memcpy(ble_sm_sc_dhkey_job.priv, proc->priv_key_our,
+           sizeof ble_sm_sc_dhkey_job.priv);
+    proc->flags |= BLE_SM_PROC_F_SC_DHKEY_BUSY;
+
+    ble_sm_sc_job_submit(&ble_sm_sc_dhkey_job.job);
+    return BLE_HS_EAGAIN;
+}
+
 /* Initiator does not send a confirm when pairing algorithm is any of:
  *     o just works
  *     o numeric comparison
@@ -244,7 +447,7 @@ ble_sm_sc_confirm_exec(struct ble_sm_proc *proc, struct ble_sm_result *res)
         return;
     }
 
-    rc = ble_sm_alg_f4(ble_sm_sc_pub_key.u8, proc->pub_key_peer.x,
+    rc = ble_sm_alg_f4(proc->pub_key_our.x, proc->pub_key_peer.x,
                        ble_sm_our_pair_rand(proc), proc->ri, cmd.value);
     if (rc != 0) {
         res->app_status = rc;
@@ -273,11 +476,11 @@ ble_sm_sc_gen_numcmp(struct ble_sm_proc *proc, struct ble_sm_result *res)
     uint8_t *pkb;
 
     if (proc->flags & BLE_SM_PROC_F_INITIATOR) {
-        pka = ble_sm_sc_pub_key.u8;
+        pka = proc->pub_key_our.x;
         pkb = proc->pub_key_peer.x;
     } else {
         pka = proc->pub_key_peer.x;
-        pkb = ble_sm_sc_pub_key.u8;
+        pkb = proc->pub_key_our.x;
     }
     res->app_status = ble_sm_alg_g2(pka, pkb, proc->randm, proc->rands,
                                     &res->passkey_params.numcmp);
@@ -366,7 +569,7 @@ ble_sm_sc_random_rx(struct ble_sm_proc *proc, struct ble_sm_result *res)
         ble_hs_log_flat_buf(proc->tk, 32);
         BLE_HS_LOG(DEBUG, "\n");
 
-        rc = ble_sm_alg_f4(proc->pub_key_peer.x, ble_sm_sc_pub_key.u8,
+        rc = ble_sm_alg_f4(proc->pub_key_peer.x, proc->pub_key_our.x,
                            ble_sm_peer_pair_rand(proc), proc->ri,
                            confirm_val);
         if (rc != 0) {
@@ -431,19 +634,23 @@ void
 ble_sm_sc_public_key_exec(struct ble_sm_proc *proc, struct ble_sm_result *res,
                           void *arg)
 {
-    struct ble_sm_public_key cmd;
     uint8_t ioact;
+    int rc;
 
-    res->app_status = ble_sm_sc_ensure_keys_generated();
-    if (res->app_status != 0) {
+    rc = ble_sm_sc_keys_take(proc);
+    if (rc == BLE_HS_EAGAIN) {
+        /* Resumed by ble_sm_sc_resume() once a key pair is ready. */
+        return;
+    }
+    if (rc != 0) {
+        res->app_status = rc;
         res->enc_cb = 1;
         res->sm_err = BLE_SM_ERR_UNSPECIFIED;
         return;
     }
 
-    memcpy(cmd.x, ble_sm_sc_pub_key.u8 + 0, 32);
-    memcpy(cmd.y, ble_sm_sc_pub_key.u8 + 32, 32);
-    res->app_status = ble_sm_public_key_tx(proc->conn_handle, &cmd);
+    res->app_status = ble_sm_public_key_tx(proc->conn_handle,
+                                           &proc->pub_key_our);
     if (res->app_status != 0) {
         res->enc_cb = 1;
         res->sm_err = BLE_SM_ERR_UNSPECIFIED;
@@ -466,6 +673,68 @@ ble_sm_sc_public_key_exec(struct ble_sm_proc *proc, struct ble_sm_result *res,
     }
 }
 
+/**
+ * Advances a proc whose DHKey has just been computed.
+ */
+static void
+ble_sm_sc_dhkey_ready(struct ble_sm_proc *proc, struct ble_sm_result *res)
+{
+    uint8_t ioact;
+
+    if (proc->flags & BLE_SM_PROC_F_INITIATOR) {
+        proc->state = BLE_SM_PROC_STATE_CONFIRM;
+
+        ioact = ble_sm_sc_io_action(proc);
+        if (ble_sm_ioact_state(ioact) == proc->state) {
+            res->passkey_params.action = ioact;
+        }
+
+        if (ble_sm_proc_can_advance(proc) &&
+            ble_sm_sc_initiator_txes_confirm(proc)) {
+
+            res->execute = 1;
+        }
+    } else {
+        res->execute = 1;
+    }
+}
+
+/**
+ * Processes the peer's public key: acquires our key pair if we don't have one
+ * yet, then computes the DHKey.  Either step may leave the proc waiting on
+ * the crypto task, in which case ble_sm_sc_resume() calls this again.
+ */
+static void
+ble_sm_sc_public_key_process(struct ble_sm_proc *proc,
+                             struct ble_sm_result *res)
+{
+    int rc;
+
+    rc = ble_sm_sc_keys_take(proc);
+    if (rc == BLE_HS_EAGAIN) {
+        return;
+    }
+    if (rc != 0) {
+        res->app_status = rc;
+        res->sm_err = BLE_SM_ERR_UNSPECIFIED;
+        res->enc_cb = 1;
+        return;
+    }
+
+    rc = ble_sm_sc_dhkey_start(proc);
+    if (rc == BLE_HS_EAGAIN) {
+        return;
+    }
+    if (rc != 0) {
+        res->app_status = BLE_HS_SM_US_ERR(BLE_SM_ERR_DHKEY);
+        res->sm_err = BLE_SM_ERR_DHKEY;
+        res->enc_cb = 1;
+        return;
+    }
+
+    ble_sm_sc_dhkey_ready(proc, res);
+}
+
 void
 ble_sm_sc_public_key_rx(uint16_t conn_handle, uint8_t op, struct os_mbuf **om,
                         struct ble_sm_result *res)
@@ -473,8 +742,6 @@ ble_sm_sc_public_key_rx(uint16_t conn_handle, uint8_t op, struct os_mbuf **om,
     struct ble_sm_public_key cmd;
     struct ble_sm_proc *proc;
     struct ble_sm_proc *prev;
-    uint8_t ioact;
-    int rc;
 
     res->app_status = ble_hs_mbuf_pullup_base(om, BLE_SM_PUBLIC_KEY_SZ);
     if (res->app_status != 0) {
@@ -482,52 +749,220 @@ ble_sm_sc_public_key_rx(uint16_t conn_handle, uint8_t op, struct os_mbuf **om,
         return;
     }
 
-    res->app_status = ble_sm_sc_ensure_keys_generated();
-    if (res->app_status != 0) {
-        res->enc_cb = 1;
-        res->sm_err = BLE_SM_ERR_UNSPECIFIED;
-        return;
-    }
-
     ble_sm_public_key_parse((*om)->om_data, (*om)->om_len, &cmd);
     BLE_SM_LOG_CMD(0, "public key", conn_handle, ble_sm_public_key_log, &cmd);
 
+    ble_sm_sc_keys_prepare(conn_handle);
+
     ble_hs_lock();
     proc = ble_sm_proc_find(conn_handle, BLE_SM_PROC_STATE_PUBLIC_KEY, -1,
                             &prev);
     if (proc == NULL) {
         res->app_status = BLE_HS_ENOENT;
         res->sm_err = BLE_SM_ERR_UNSPECIFIED;
+    } else if (proc->flags & (BLE_SM_PROC_F_SC_KEYS_WAIT |
+                              BLE_SM_PROC_F_SC_DHKEY_WAIT)) {
+        /* Either we haven't sent our own key yet, or we are still processing
+         * a previous key from this peer.
+         */
+        res->app_status = BLE_HS_EBADDATA;
+        res->sm_err = BLE_SM_ERR_UNSPECIFIED;
+        res->enc_cb = 1;
     } else {
         proc->pub_key_peer = cmd;
-        rc = ble_sm_alg_gen_dhkey(proc->pub_key_peer.x,
-                                  proc->pub_key_peer.y,
-                                  ble_sm_sc_priv_key.u32,
-                                  proc->dhkey);
-        if (rc != 0) {
-            res->app_status = BLE_HS_SM_US_ERR(BLE_SM_ERR_DHKEY);
-            res->sm_err = BLE_SM_ERR_DHKEY;
-            res->enc_cb = 1;
-        } else {
-            if (proc->flags & BLE_SM_PROC_F_INITIATOR) {
-                proc->state = BLE_SM_PROC_STATE_CONFIRM;
+        ble_sm_sc_public_key_process(proc, res);
+    }
+    ble_hs_unlock();
+}
+
+/*****************************************************************************
+ * $crypto task                                                              *
+ *****************************************************************************/
+
+/**
+ * Indicates whether a waiting proc can make progress now.
+ */
+static int
+ble_sm_sc_proc_runnable(struct ble_sm_proc *proc)
+{
+    if (proc->flags & BLE_SM_PROC_F_SC_KEYS_WAIT) {
+        return ble_sm_sc_keys_state != BLE_SM_SC_KEYS_PENDING;
+    }
+
+    if (proc->flags & BLE_SM_PROC_F_SC_DHKEY_WAIT &&
+        !(proc->flags & BLE_SM_PROC_F_SC_DHKEY_BUSY)) {
+
+        return !ble_sm_sc_dhkey_job.job.busy;
+    }
+
+    return 0;
+}
+
+/**
+ * Restarts procs that were waiting for a key pair or for the DHKey job.  Each
+ * step either consumes the resource the proc was waiting for or fails the
+ * proc, so this loop terminates.
+ */
+static void
+ble_sm_sc_resume(void)
+{
+    struct ble_sm_result res;
+    struct ble_sm_proc *proc;
+    uint16_t conn_handle;
+
+    while (1) {
+        memset(&res, 0, sizeof res);
 
-                ioact = ble_sm_sc_io_action(proc);
-                if (ble_sm_ioact_state(ioact) == proc->state) {
-                    res->passkey_params.action = ioact;
-                }
+        ble_sm_sc_keys_prepare(BLE_HS_CONN_HANDLE_NONE);
 
-                if (ble_sm_proc_can_advance(proc) &&
-                    ble_sm_sc_initiator_txes_confirm(proc)) {
+        ble_hs_lock();
 
-                    res->execute = 1;
-                }
+        for (proc = ble_sm_proc_first();
+             proc != NULL;
+             proc = STAILQ_NEXT(proc, next)) {
+
+            if (ble_sm_sc_proc_runnable(proc)) {
+                break;
+            }
+        }
+
+        if (proc != NULL) {
+            conn_handle = proc->conn_handle;
+
+            if (proc->flags & BLE_SM_PROC_F_SC_KEYS_WAIT &&
+                proc->flags & BLE_SM_PROC_F_INITIATOR) {
+
+                /* Haven't sent our public key yet; re-execute that step. */
+                res.execute = 1;
             } else {
-                res->execute = 1;
+                ble_sm_sc_public_key_process(proc, &res);
             }
         }
+
+        ble_hs_unlock();
+
+        if (proc == NULL) {
+            break;
+        }
+
+        ble_sm_process_result(conn_handle, &res);
+    }
+}
+
+/** Executes in the crypto task. */
+static void
+ble_sm_sc_keygen_work(void *arg)
+{
+    ble_sm_sc_keygen_job.job.status =
+        ble_sm_alg_make_key_pair(ble_sm_sc_keygen_job.random,
+                                 ble_sm_sc_keygen_job.pub,
+                                 ble_sm_sc_keygen_job.priv);
+    ble_hs_event_enqueue(&ble_sm_sc_keygen_job.job.done.cf_c.c_ev);
+}
+
+static void
+ble_sm_sc_keygen_done(void *arg)
+{
+    ble_sm_sc_keygen_job.job.busy = 0;
+
+    if (ble_sm_sc_keygen_job.job.status == 0) {
+        memcpy(ble_sm_sc_pub_key.u32, ble_sm_sc_keygen_job.pub,
+               sizeof ble_sm_sc_pub_key);
+        memcpy(ble_sm_sc_priv_key.u32, ble_sm_sc_keygen_job.priv,
+               sizeof ble_sm_sc_priv_key);
+        ble_sm_sc_keys_state = BLE_SM_SC_KEYS_READY;
+    } else {
+        BLE_HS_LOG(DEBUG, "sc key generation failed; status=%d\n",
+                   ble_sm_sc_keygen_job.job.status);
+        ble_sm_sc_keys_state = BLE_SM_SC_KEYS_NONE;
     }
+    memset(ble_sm_sc_keygen_job.priv, 0, sizeof ble_sm_sc_keygen_job.priv);
+
+    ble_sm_sc_resume();
+}
+
+/** Executes in the crypto task. */
+static void
+ble_sm_sc_dhkey_work(void *arg)
+{
+    ble_sm_sc_dhkey_job.job.status =
+        ble_sm_alg_gen_dhkey(ble_sm_sc_dhkey_job.peer_pub_key.x,
+                             ble_sm_sc_dhkey_job.peer_pub_key.y,
+                             ble_sm_sc_dhkey_job.priv,
+                             ble_sm_sc_dhkey_job.dhkey);
+    ble_hs_event_enqueue(&ble_sm_sc_dhkey_job.job.done.cf_c.c_ev);
+}
+
+static void
+ble_sm_sc_dhkey_done(void *arg)
+{
+    struct ble_sm_result res;
+    struct ble_sm_proc *proc;
+    uint16_t conn_handle;
+
+    memset(&res, 0, sizeof res);
+
+    ble_hs_lock();
+
+    ble_sm_sc_dhkey_job.job.busy = 0;
+    memset(ble_sm_sc_dhkey_job.priv, 0, sizeof ble_sm_sc_dhkey_job.priv);
+
+    /* The proc may have been freed (e.g., disconnect or timeout) while the
+     * job was executing; if so, the result is discarded.
+     */
+    for (proc = ble_sm_proc_first();
+         proc != NULL;
+         proc = STAILQ_NEXT(proc, next)) {
+
+        if (proc->flags & BLE_SM_PROC_F_SC_DHKEY_BUSY) {
+            break;
+        }
+    }
+
+    if (proc != NULL) {
+        conn_handle = proc->conn_handle;
+        proc->flags &= ~(BLE_SM_PROC_F_SC_DHKEY_WAIT |
+                         BLE_SM_PROC_F_SC_DHKEY_BUSY);
+
+        if (ble_sm_sc_dhkey_job.job.status != 0) {
+            res.app_status = BLE_HS_SM_US_ERR(BLE_SM_ERR_DHKEY);
+            res.sm_err = BLE_SM_ERR_DHKEY;
+            res.enc_cb = 1;
+        } else {
+            memcpy(proc->dhkey, ble_sm_sc_dhkey_job.dhkey,
+                   sizeof proc->dhkey);
+            ble_sm_sc_dhkey_ready(proc, &res);
+        }
+    }
+
     ble_hs_unlock();
+
+    if (proc != NULL) {
+        ble_sm_process_result(conn_handle, &res);
+    }
+
+    ble_sm_sc_resume();
+}
+
+/**
+ * Called by the heartbeat timer.  With a crypto task, this precomputes the
+ * next key pair so that it is ready before the next pairing starts.
+ */
+void
+ble_sm_sc_heartbeat(void)
+{
+    int rc;
+
+    if (ble_sm_sc_async() &&
+        ble_hs_cfg.sm_sc &&
+        ble_sm_sc_keys_state == BLE_SM_SC_KEYS_NONE &&
+        ble_hs_synced()) {
+
+        rc = ble_sm_sc_keygen_start();
+        if (rc != 0) {
+            BLE_HS_LOG(DEBUG, "sc key generation failed; rc=%d\n", rc);
+        }
+    }
 }
 
 static void
@@ -703,7 +1138,19 @@ ble_sm_sc_dhkey_check_rx(uint16_t conn_handle, uint8_t op, struct os_mbuf **om,
 void
 ble_sm_sc_init(void)
 {
-    ble_sm_sc_keys_generated = 0;
+    ble_sm_sc_keys_state = BLE_SM_SC_KEYS_NONE;
+
+    memset(&ble_sm_sc_keygen_job, 0, sizeof ble_sm_sc_keygen_job);
+    os_callout_func_init(&ble_sm_sc_keygen_job.job.work, NULL,
+                         ble_sm_sc_keygen_work, NULL);
+    os_callout_func_init(&ble_sm_sc_keygen_job.job.done, NULL,
+                         ble_sm_sc_keygen_done, NULL);
+
+    memset(&ble_sm_sc_dhkey_job, 0, sizeof ble_sm_sc_dhkey_job);
+    os_callout_func_init(&ble_sm_sc_dhkey_job.job.work, NULL,
+                         ble_sm_sc_dhkey_work, NULL);
+    os_callout_func_init(&ble_sm_sc_dhkey_job.job.done, NULL,
+                         ble_sm_sc_dhkey_done, NULL);
 }
 
 #endif  /* NIMBLE_OPT_SM_SC */
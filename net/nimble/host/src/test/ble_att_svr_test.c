@@ -1056,6 +1056,83 @@ TEST_CASE(ble_att_svr_test_read)
 
 }
 
+static int
+ble_att_svr_test_misc_attr_fn_handle(uint16_t conn_handle,
+                                     uint16_t attr_handle,
+                                     uint8_t op, uint16_t offset,
+                                     struct os_mbuf **om, void *arg)
+{
+    uint8_t buf[2];
+
+    switch (op) {
+    case BLE_ATT_ACCESS_OP_READ:
+        htole16(buf, attr_handle);
+        os_mbuf_append(*om, buf, sizeof buf);
+        return 0;
+
+    default:
+        return -1;
+    }
+}
+
+TEST_CASE(ble_att_svr_test_read_many)
+{
+    struct ble_att_read_req req;
+    uint16_t conn_handle;
+    uint16_t handle;
+    uint16_t last;
+    uint8_t buf[BLE_ATT_READ_REQ_SZ];
+    uint8_t uuid[16] = {0};
+    uint8_t data[2];
+    int rc;
+    int i;
+
+    conn_handle = ble_att_svr_test_misc_init(0);
+
+    /*** Fill the attribute table. */
+    last = 0;
+    for (i = 0; ; i++) {
+        uuid[0] = i;
+        rc = ble_att_svr_register(uuid, HA_FLAG_PERM_RW, &handle,
+                                  ble_att_svr_test_misc_attr_fn_handle, NULL);
+        if (rc != 0) {
+            TEST_ASSERT(rc == BLE_HS_ENOMEM);
+            break;
+        }
+        TEST_ASSERT_FATAL(handle == last + 1);
+        last = handle;
+    }
+    TEST_ASSERT_FATAL(last > 1);
+
+    /*** Each handle reaches its own attribute. */
+    for (handle = 1; handle <= last; handle++) {
+        req.barq_handle = handle;
+        ble_att_read_req_write(buf, sizeof buf, &req);
+
+        rc = ble_hs_test_util_l2cap_rx_payload_flat(conn_handle,
+                                                    BLE_L2CAP_CID_ATT,
+                                                    buf, sizeof buf);
+        TEST_ASSERT(rc == 0);
+        htole16(data, handle);
+        ble_hs_test_util_verify_tx_read_rsp(data, sizeof data);
+
+        TEST_ASSERT(ble_att_svr_find_by_handle(handle)->ha_uuid[0] ==
+                    (uint8_t)(handle - 1));
+    }
+
+    /*** Handles outside the table. */
+    TEST_ASSERT(ble_att_svr_find_by_handle(0) == NULL);
+    TEST_ASSERT(ble_att_svr_find_by_handle(last + 1) == NULL);
+
+    req.barq_handle = last + 1;
+    ble_att_read_req_write(buf, sizeof buf, &req);
+    rc = ble_hs_test_util_l2cap_rx_payload_flat(conn_handle, BLE_L2CAP_CID_ATT,
+                                                buf, sizeof buf);
+    TEST_ASSERT(rc != 0);
+    ble_hs_test_util_verify_tx_err_rsp(BLE_ATT_OP_READ_REQ, last + 1,
+                                       BLE_ATT_ERR_INVALID_HANDLE);
+}
+
 TEST_CASE(ble_att_svr_test_read_blob)
 {
     struct ble_att_read_blob_req req;
@@ -2038,6 +2115,144 @@ TEST_CASE(ble_att_svr_test_read_group_type)
 
 }
 
+TEST_CASE(ble_att_svr_test_find_by_uuid)
+{
+    static const uint16_t uuids[] = {
+        0x2800, 0x2803, 0x1111, 0x2803, 0x2222, 0x2800, 0x2803, 0x1111,
+        0x2801, 0x2803, 0x1111,
+    };
+    struct ble_att_svr_entry *entry;
+    uint8_t uuid128[16];
+    uint16_t prev;
+    int num_found;
+    int num_uuids;
+    int i;
+    int j;
+
+    ble_att_svr_test_misc_init(0);
+
+    num_uuids = sizeof uuids / sizeof uuids[0];
+    for (i = 0; i < num_uuids; i++) {
+        ble_att_svr_test_misc_register_uuid16(
+            uuids[i], HA_FLAG_PERM_RW, i + 1,
+            ble_att_svr_test_misc_attr_fn_handle);
+    }
+
+    /*** Each walk visits exactly the attributes of one type, in order. */
+    for (i = 0; i < num_uuids; i++) {
+        TEST_ASSERT_FATAL(ble_uuid_16_to_128(uuids[i], uuid128) == 0);
+
+        num_found = 0;
+        prev = 0;
+        entry = NULL;
+        while ((entry = ble_att_svr_find_by_uuid(entry, uuid128,
+                                                 0xffff)) != NULL) {
+            TEST_ASSERT(entry->ha_handle_id > prev);
+            TEST_ASSERT(uuids[entry->ha_handle_id - 1] == uuids[i]);
+            prev = entry->ha_handle_id;
+            num_found++;
+        }
+
+        for (j = 0; j < num_uuids; j++) {
+            if (uuids[j] == uuids[i]) {
+                num_found--;
+            }
+        }
+        TEST_ASSERT(num_found == 0);
+    }
+
+    /*** End handle bounds the walk. */
+    TEST_ASSERT_FATAL(ble_uuid_16_to_128(0x1111, uuid128) == 0);
+    entry = ble_att_svr_find_by_uuid(NULL, uuid128, 8);
+    TEST_ASSERT_FATAL(entry != NULL && entry->ha_handle_id == 3);
+    entry = ble_att_svr_find_by_uuid(entry, uuid128, 8);
+    TEST_ASSERT_FATAL(entry != NULL && entry->ha_handle_id == 8);
+    TEST_ASSERT(ble_att_svr_find_by_uuid(entry, uuid128, 10) == NULL);
+
+    /*** A previous entry of a different type is a starting handle. */
+    entry = ble_att_svr_find_by_handle(4);
+    entry = ble_att_svr_find_by_uuid(entry, uuid128, 0xffff);
+    TEST_ASSERT_FATAL(entry != NULL && entry->ha_handle_id == 8);
+
+    /*** Unregistered type. */
+    TEST_ASSERT_FATAL(ble_uuid_16_to_128(0x3333, uuid128) == 0);
+    TEST_ASSERT(ble_att_svr_find_by_uuid(NULL, uuid128, 0xffff) == NULL);
+}
+
+TEST_CASE(ble_att_svr_test_read_group_type_secondary)
+{
+    struct ble_att_read_group_type_req req;
+    uint16_t conn_handle;
+    uint8_t buf[BLE_ATT_READ_GROUP_TYPE_REQ_SZ_16];
+    int rc;
+
+    conn_handle = ble_att_svr_test_misc_init(0);
+
+    /* Primary 1-2, secondary 3-4, primary 5-6. */
+    ble_att_svr_test_misc_register_uuid16(
+        BLE_ATT_UUID_PRIMARY_SERVICE, HA_FLAG_PERM_RW, 1,
+        ble_att_svr_test_misc_attr_fn_r_group);
+    ble_att_svr_test_misc_register_uuid16(
+        BLE_ATT_UUID_CHARACTERISTIC, HA_FLAG_PERM_RW, 2,
+        ble_att_svr_test_misc_attr_fn_r_group);
+    ble_att_svr_test_misc_register_uuid16(
+        BLE_ATT_UUID_SECONDARY_SERVICE, HA_FLAG_PERM_RW, 3,
+        ble_att_svr_test_misc_attr_fn_r_group);
+    ble_att_svr_test_misc_register_uuid16(
+        BLE_ATT_UUID_CHARACTERISTIC, HA_FLAG_PERM_RW, 4,
+        ble_att_svr_test_misc_attr_fn_r_group);
+    ble_att_svr_test_misc_register_uuid16(
+        BLE_ATT_UUID_PRIMARY_SERVICE, HA_FLAG_PERM_RW, 5,
+        ble_att_svr_test_misc_attr_fn_r_group);
+    ble_att_svr_test_misc_register_uuid16(
+        BLE_ATT_UUID_CHARACTERISTIC, HA_FLAG_PERM_RW, 6,
+        ble_att_svr_test_misc_attr_fn_r_group);
+
+    /*** The secondary service ends the first group. */
+    req.bagq_start_handle = 1;
+    req.bagq_end_handle = 0xffff;
+
+    ble_att_read_group_type_req_write(buf, sizeof buf, &req);
+    htole16(buf + BLE_ATT_READ_GROUP_TYPE_REQ_BASE_SZ,
+            BLE_ATT_UUID_PRIMARY_SERVICE);
+
+    rc = ble_hs_test_util_l2cap_rx_payload_flat(conn_handle, BLE_L2CAP_CID_ATT,
+                                                buf, sizeof buf);
+    TEST_ASSERT(rc == 0);
+    ble_att_svr_test_misc_verify_tx_read_group_type_rsp(
+        ((struct ble_att_svr_test_group_type_entry[]) { {
+            .start_handle = 1,
+            .end_handle = 2,
+            .uuid16 = 0x1122,
+        }, {
+            .start_handle = 5,
+            .end_handle = 0xffff,
+            .uuid16 = 0x1104,
+        }, {
+            .start_handle = 0,
+        } }));
+
+    /*** Secondary services only. */
+    req.bagq_start_handle = 1;
+    req.bagq_end_handle = 5;
+
+    ble_att_read_group_type_req_write(buf, sizeof buf, &req);
+    htole16(buf + BLE_ATT_READ_GROUP_TYPE_REQ_BASE_SZ,
+            BLE_ATT_UUID_SECONDARY_SERVICE);
+
+    rc = ble_hs_test_util_l2cap_rx_payload_flat(conn_handle, BLE_L2CAP_CID_ATT,
+                                                buf, sizeof buf);
+    TEST_ASSERT(rc == 0);
+    ble_att_svr_test_misc_verify_tx_read_group_type_rsp(
+        ((struct ble_att_svr_test_group_type_entry[]) { {
+            .start_handle = 3,
+            .end_handle = 4,
+            .uuid16 = 0x1102,
+        }, {
+            .start_handle = 0,
+        } }));
+}
+
 TEST_CASE(ble_att_svr_test_prep_write)
 {
     struct ble_hs_conn *conn;
@@ -2253,6 +2468,7 @@ TEST_SUITE(ble_att_svr_suite)
 
     ble_att_svr_test_mtu();
     ble_att_svr_test_read();
+    ble_att_svr_test_read_many();
     ble_att_svr_test_read_blob();
     ble_att_svr_test_read_mult();
     ble_att_svr_test_write();
@@ -2260,6 +2476,8 @@ TEST_SUITE(ble_att_svr_suite)
     ble_att_svr_test_find_type_value();
     ble_att_svr_test_read_type();
     ble_att_svr_test_read_group_type();
+    ble_att_svr_test_read_group_type_secondary();
+    ble_att_svr_test_find_by_uuid();
     ble_att_svr_test_prep_write();
     ble_att_svr_test_notify();
     ble_att_svr_test_indicate();
@@ -517,11 +517,65 @@ TEST_CASE(ble_gatt_conn_test_disconnect)
     TEST_ASSERT(write_rel_arg.called == 1);
 }
 
+TEST_CASE(ble_gatt_conn_test_timeout)
+{
+    struct ble_gatt_conn_test_cb_arg read_arg1 = { 0 };
+    struct ble_gatt_conn_test_cb_arg read_arg2 = { 0 };
+    int rc;
+
+    ble_hs_test_util_init();
+
+    ble_hs_test_util_create_conn(1, ((uint8_t[]){1,2,3,4,5,6,7,8}),
+                                 NULL, NULL);
+    ble_hs_test_util_create_conn(2, ((uint8_t[]){2,3,4,5,6,7,8,9}),
+                                 NULL, NULL);
+
+    /*** Start a read on each connection, ten seconds apart. */
+    read_arg1.exp_conn_handle = 1;
+    rc = ble_gattc_read(1, BLE_GATT_BREAK_TEST_READ_ATTR_HANDLE,
+                        ble_gatt_conn_test_read_cb, &read_arg1);
+    TEST_ASSERT_FATAL(rc == 0);
+
+    os_time_advance(10 * OS_TICKS_PER_SEC);
+
+    read_arg2.exp_conn_handle = 2;
+    rc = ble_gattc_read(2, BLE_GATT_BREAK_TEST_READ_ATTR_HANDLE,
+                        ble_gatt_conn_test_read_cb, &read_arg2);
+    TEST_ASSERT_FATAL(rc == 0);
+
+    ble_hs_test_util_tx_all();
+
+    /*** Neither procedure has expired yet. */
+    os_time_advance(19 * OS_TICKS_PER_SEC);
+    ble_gattc_heartbeat();
+    TEST_ASSERT(ble_gattc_any_jobs());
+
+    /*** Only the first connection's procedure expires. */
+    os_time_advance(1 * OS_TICKS_PER_SEC);
+    ble_hs_test_util_set_ack_disconnect(0);
+    ble_gattc_heartbeat();
+    TEST_ASSERT(ble_gattc_any_jobs());
+
+    /* The expired procedure is gone; the other one is still pending. */
+    ble_gattc_connection_broken(1);
+    TEST_ASSERT(read_arg1.called == 0);
+
+    /*** The second connection's procedure expires ten seconds later. */
+    os_time_advance(10 * OS_TICKS_PER_SEC);
+    ble_hs_test_util_set_ack_disconnect(0);
+    ble_gattc_heartbeat();
+    TEST_ASSERT(!ble_gattc_any_jobs());
+
+    ble_gattc_connection_broken(2);
+    TEST_ASSERT(read_arg2.called == 0);
+}
+
 TEST_SUITE(ble_gatt_break_suite)
 {
     tu_suite_set_post_test_cb(ble_hs_test_util_post_test, NULL);
 
     ble_gatt_conn_test_disconnect();
+    ble_gatt_conn_test_timeout();
 }
 
 int
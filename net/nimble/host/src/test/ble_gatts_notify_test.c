@@ -75,6 +75,8 @@ ble_gatts_notify_test_events[BLE_GATTS_NOTIFY_TEST_MAX_EVENTS];
 
 static int ble_gatts_notify_test_num_events;
 
+static int ble_gatts_notify_test_num_reads;
+
 typedef int ble_store_write_fn(int obj_type, union ble_store_value *val);
 
 typedef int ble_store_delete_fn(int obj_type, union ble_store_key *key);
@@ -401,6 +403,8 @@ ble_gatts_notify_test_misc_access(uint16_t conn_handle,
     TEST_ASSERT_FATAL(ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR);
     TEST_ASSERT(conn_handle == 0xffff);
 
+    ble_gatts_notify_test_num_reads++;
+
     if (attr_handle == ble_gatts_notify_test_chr_1_def_handle + 1) {
         TEST_ASSERT(ctxt->chr ==
                     &ble_gatts_notify_test_svcs[0].characteristics[0]);
@@ -657,6 +661,58 @@ TEST_CASE(ble_gatts_notify_test_n)
     TEST_ASSERT(flags == 0);
 }
 
+TEST_CASE(ble_gatts_notify_test_fan_out)
+{
+    uint16_t conn_handle;
+
+    ble_gatts_notify_test_misc_init(&conn_handle, 0,
+                                    BLE_GATTS_CLT_CFG_F_NOTIFY, 0);
+
+    /* Two more peers: one subscribed to notifications, one to indications. */
+    ble_hs_test_util_create_conn(3, ((uint8_t[]){3,4,5,6,7,8}),
+                                 ble_gatts_notify_test_util_gap_event, NULL);
+    ble_gatts_notify_test_misc_enable_notify(
+        3, ble_gatts_notify_test_chr_1_def_handle, BLE_GATTS_CLT_CFG_F_NOTIFY);
+    ble_gatts_notify_test_util_verify_sub_event(
+        3, ble_gatts_notify_test_chr_1_def_handle + 1,
+        BLE_GAP_SUBSCRIBE_REASON_WRITE, 0, 1, 0, 0);
+
+    ble_hs_test_util_create_conn(4, ((uint8_t[]){4,5,6,7,8,9}),
+                                 ble_gatts_notify_test_util_gap_event, NULL);
+    ble_gatts_notify_test_misc_enable_notify(
+        4, ble_gatts_notify_test_chr_1_def_handle,
+        BLE_GATTS_CLT_CFG_F_INDICATE);
+    ble_gatts_notify_test_util_verify_sub_event(
+        4, ble_gatts_notify_test_chr_1_def_handle + 1,
+        BLE_GAP_SUBSCRIBE_REASON_WRITE, 0, 0, 0, 1);
+
+    ble_hs_test_util_prev_tx_queue_clear();
+
+    /* Update characteristic 1's value. */
+    ble_gatts_notify_test_num_reads = 0;
+    ble_gatts_notify_test_chr_1_len = 4;
+    memcpy(ble_gatts_notify_test_chr_1_val, ((uint8_t[]){1,2,3,4}), 4);
+    ble_gatts_chr_updated(ble_gatts_notify_test_chr_1_def_handle + 1);
+
+    /* Each peer gets an update, in connection list order (newest first). */
+    ble_gatts_notify_test_misc_verify_tx_i(
+        4, ble_gatts_notify_test_chr_1_def_handle + 1,
+        ble_gatts_notify_test_chr_1_val, ble_gatts_notify_test_chr_1_len);
+    ble_gatts_notify_test_misc_verify_tx_n(
+        3, ble_gatts_notify_test_chr_1_def_handle + 1,
+        ble_gatts_notify_test_chr_1_val, ble_gatts_notify_test_chr_1_len);
+    ble_gatts_notify_test_misc_verify_tx_n(
+        conn_handle, ble_gatts_notify_test_chr_1_def_handle + 1,
+        ble_gatts_notify_test_chr_1_val, ble_gatts_notify_test_chr_1_len);
+    TEST_ASSERT(ble_hs_test_util_prev_tx_dequeue() == NULL);
+    TEST_ASSERT(ble_gatts_notify_test_num_events == 0);
+
+    /* The value was read once for both notifications, and once for the
+     * indication.
+     */
+    TEST_ASSERT(ble_gatts_notify_test_num_reads == 2);
+}
+
 TEST_CASE(ble_gatts_notify_test_i)
 {
     uint16_t conn_handle;
@@ -1050,6 +1106,7 @@ TEST_SUITE(ble_gatts_notify_suite)
     tu_suite_set_post_test_cb(ble_hs_test_util_post_test, NULL);
 
     ble_gatts_notify_test_n();
+    ble_gatts_notify_test_fan_out();
     ble_gatts_notify_test_i();
 
     ble_gatts_notify_test_bonded_n();
@@ -201,6 +201,190 @@ TEST_CASE(ble_hs_conn_test_undirect_connectable_success)
     ble_hs_unlock();
 }
 
+TEST_CASE(ble_hs_conn_test_lookup)
+{
+    static const uint16_t handles[] = { 1, 9, 17, 0x0eff };
+    struct ble_hs_conn *conn;
+    struct ble_hs_conn *next;
+    uint8_t addr[6] = { 1, 2, 3, 4, 5, 6 };
+    int num_conns;
+    int i;
+
+    ble_hs_test_util_init();
+
+    /* The first three handles share a hash bucket. */
+    for (i = 0; i < sizeof handles / sizeof handles[0]; i++) {
+        addr[5] = i;
+        ble_hs_test_util_create_conn(handles[i], addr, NULL, NULL);
+    }
+
+    ble_hs_lock();
+
+    /*** Each connection is found by handle and by address. */
+    for (i = 0; i < sizeof handles / sizeof handles[0]; i++) {
+        conn = ble_hs_conn_find(handles[i]);
+        TEST_ASSERT_FATAL(conn != NULL);
+        TEST_ASSERT(conn->bhc_handle == handles[i]);
+
+        addr[5] = i;
+        TEST_ASSERT(ble_hs_conn_find_by_addr(BLE_ADDR_TYPE_PUBLIC, addr) ==
+                    conn);
+    }
+    TEST_ASSERT(ble_hs_conn_find(25) == NULL);
+    TEST_ASSERT(ble_hs_conn_find(BLE_HS_CONN_HANDLE_NONE) == NULL);
+    addr[5] = 0;
+    TEST_ASSERT(ble_hs_conn_find_by_addr(BLE_ADDR_TYPE_RANDOM, addr) == NULL);
+
+    /*** Removing a connection leaves the rest of its bucket intact. */
+    conn = ble_hs_conn_find(9);
+    ble_hs_conn_remove(conn);
+    ble_hs_conn_free(conn);
+
+    TEST_ASSERT(ble_hs_conn_find(9) == NULL);
+    TEST_ASSERT(ble_hs_conn_find(1) != NULL);
+    TEST_ASSERT(ble_hs_conn_find(17) != NULL);
+    addr[5] = 1;
+    TEST_ASSERT(ble_hs_conn_find_by_addr(BLE_ADDR_TYPE_PUBLIC, addr) == NULL);
+
+    /*** Iteration survives removal of the current connection. */
+    num_conns = 0;
+    for (conn = ble_hs_conn_first(); conn != NULL; conn = next) {
+        next = ble_hs_conn_next(conn);
+        num_conns++;
+
+        if (conn->bhc_handle == 17) {
+            ble_hs_conn_remove(conn);
+            ble_hs_conn_free(conn);
+        }
+    }
+    TEST_ASSERT(num_conns == 3);
+    TEST_ASSERT(ble_hs_conn_find(17) == NULL);
+
+    num_conns = 0;
+    for (conn = ble_hs_conn_first();
+         conn != NULL;
+         conn = ble_hs_conn_next(conn)) {
+
+        num_conns++;
+    }
+    TEST_ASSERT(num_conns == 2);
+
+    ble_hs_unlock();
+}
+
+static void
+ble_hs_conn_test_tx_acl(uint16_t conn_handle, int len)
+{
+    struct ble_hs_conn *conn;
+    struct os_mbuf *om;
+    int rc;
+
+    om = ble_hs_mbuf_l2cap_pkt();
+    TEST_ASSERT_FATAL(om != NULL);
+    while (len-- > 0) {
+        rc = os_mbuf_append(om, (uint8_t[]){ len }, 1);
+        TEST_ASSERT_FATAL(rc == 0);
+    }
+
+    ble_hs_lock();
+    conn = ble_hs_conn_find(conn_handle);
+    TEST_ASSERT_FATAL(conn != NULL);
+    rc = ble_hs_hci_acl_tx(conn, om);
+    ble_hs_unlock();
+
+    TEST_ASSERT_FATAL(rc == 0);
+}
+
+static void
+ble_hs_conn_test_verify_tx_handles(const uint16_t *handles, int num_handles)
+{
+    struct hci_data_hdr hdr;
+    struct os_mbuf *om;
+    int i;
+
+    for (i = 0; i < num_handles; i++) {
+        om = ble_hs_test_util_prev_tx_dequeue_frag(&hdr);
+        TEST_ASSERT_FATAL(om != NULL);
+        TEST_ASSERT(BLE_HCI_DATA_HANDLE(hdr.hdh_handle_pb_bc) == handles[i]);
+        os_mbuf_free_chain(om);
+    }
+
+    TEST_ASSERT(ble_hs_test_util_prev_tx_queue_sz() == 0);
+}
+
+TEST_CASE(ble_hs_conn_test_tx_fair)
+{
+    struct ble_hs_test_util_num_completed_pkts_entry ncpe[3];
+    struct ble_gap_conn_tx_stats stats;
+    struct hci_disconn_complete evt;
+    int rc;
+
+    ble_hs_test_util_init();
+    ble_hs_test_util_set_auto_complete(0);
+
+    ble_hs_test_util_create_conn(1, ((uint8_t[]){ 1, 2, 3, 4, 5, 6 }),
+                                 NULL, NULL);
+    ble_hs_test_util_create_conn(2, ((uint8_t[]){ 2, 3, 4, 5, 6, 7 }),
+                                 NULL, NULL);
+
+    /* 16-byte controller buffers, two of them. */
+    rc = ble_hs_hci_set_buf_sz(16, 2);
+    TEST_ASSERT_FATAL(rc == 0);
+
+    /*** Connection 1 queues five fragments, then connection 2 queues two. */
+    ble_hs_conn_test_tx_acl(1, 80);
+    ble_hs_conn_test_tx_acl(2, 32);
+    os_time_advance(5);
+
+    /*** Only two buffers; each connection gets one. */
+    ble_hs_test_util_tx_all();
+    ble_hs_conn_test_verify_tx_handles((uint16_t[]){ 1, 2 }, 2);
+
+    rc = ble_gap_conn_tx_stats(1, &stats);
+    TEST_ASSERT_FATAL(rc == 0);
+    TEST_ASSERT(stats.queue_depth == 4);
+    TEST_ASSERT(stats.queue_depth_max == 5);
+    TEST_ASSERT(stats.tx_frags == 1);
+    TEST_ASSERT(stats.latency_max == 5);
+
+    /*** Nothing more is sent until the controller frees a buffer. */
+    ble_hs_test_util_tx_all();
+    TEST_ASSERT(ble_hs_test_util_prev_tx_queue_sz() == 0);
+
+    /*** Completions let the connections keep taking turns. */
+    memset(ncpe, 0, sizeof ncpe);
+    ncpe[0].handle_id = 1;
+    ncpe[0].num_pkts = 1;
+    ncpe[1].handle_id = 2;
+    ncpe[1].num_pkts = 1;
+    ble_hs_test_util_rx_num_completed_pkts_event(ncpe);
+    ble_hs_test_util_tx_all();
+    ble_hs_conn_test_verify_tx_handles((uint16_t[]){ 1, 2 }, 2);
+
+    rc = ble_gap_conn_tx_stats(2, &stats);
+    TEST_ASSERT_FATAL(rc == 0);
+    TEST_ASSERT(stats.queue_depth == 0);
+    TEST_ASSERT(stats.tx_frags == 2);
+
+    /*** Connection 2 is idle; connection 1 gets every buffer. */
+    ble_hs_test_util_rx_num_completed_pkts_event(ncpe);
+    ble_hs_test_util_tx_all();
+    ble_hs_conn_test_verify_tx_handles((uint16_t[]){ 1, 1 }, 2);
+
+    /*** Terminating connection 1 drops its last fragment and reclaims its
+     * buffers.
+     */
+    memset(&evt, 0, sizeof evt);
+    evt.connection_handle = 1;
+    evt.reason = BLE_ERR_REM_USER_CONN_TERM;
+    ble_hs_test_util_rx_disconn_complete_event(&evt);
+    TEST_ASSERT(ble_gap_conn_tx_stats(1, &stats) == BLE_HS_ENOTCONN);
+
+    ble_hs_conn_test_tx_acl(2, 32);
+    ble_hs_test_util_tx_all();
+    ble_hs_conn_test_verify_tx_handles((uint16_t[]){ 2, 2 }, 2);
+}
+
 TEST_SUITE(conn_suite)
 {
     tu_suite_set_post_test_cb(ble_hs_test_util_post_test, NULL);
@@ -208,6 +392,8 @@ TEST_SUITE(conn_suite)
     ble_hs_conn_test_direct_connect_success();
     ble_hs_conn_test_direct_connectable_success();
     ble_hs_conn_test_undirect_connectable_success();
+    ble_hs_conn_test_lookup();
+    ble_hs_conn_test_tx_fair();
 }
 
 int
@@ -83,12 +83,180 @@ TEST_CASE(ble_hs_hci_test_rssi)
     TEST_ASSERT(rc == BLE_HS_ECONTROLLER);
 }
 
+static uint16_t ble_hs_hci_test_pipeline_opcode;
+
+static int
+ble_hs_hci_test_pipeline_ack_cb(uint8_t *ack, int ack_buf_len)
+{
+    /* Advertise room for three outstanding commands. */
+    ble_hs_test_util_build_cmd_complete(ack, ack_buf_len, 1, 3,
+                                        ble_hs_hci_test_pipeline_opcode);
+    ack[BLE_HCI_EVENT_CMD_COMPLETE_HDR_LEN] = 0;
+
+    return 0;
+}
+
+static void
+ble_hs_hci_test_rx_ack(uint16_t opcode, uint8_t status)
+{
+    uint8_t *ack;
+
+    ack = ble_hci_trans_buf_alloc(BLE_HCI_TRANS_BUF_EVT_LO);
+    TEST_ASSERT_FATAL(ack != NULL);
+
+    ble_hs_test_util_build_cmd_complete(ack, 70, 1, 3, opcode);
+    ack[BLE_HCI_EVENT_CMD_COMPLETE_HDR_LEN] = status;
+
+    ble_hs_hci_rx_ack(ack);
+}
+
+static void
+ble_hs_hci_test_pipeline_rx_ack(uint8_t status)
+{
+    ble_hs_hci_test_rx_ack(ble_hs_hci_test_pipeline_opcode, status);
+}
+
+static int
+ble_hs_hci_test_num_txed(void)
+{
+    int num_txed;
+
+    num_txed = 0;
+    while (ble_hs_test_util_get_first_hci_tx() != NULL) {
+        num_txed++;
+    }
+
+    return num_txed;
+}
+
+TEST_CASE(ble_hs_hci_test_pipeline)
+{
+    uint8_t buf[BLE_HCI_CMD_HDR_LEN];
+    int status[4];
+    int rc;
+    int i;
+
+    ble_hs_test_util_init();
+
+    ble_hs_hci_cmd_build_le_clear_whitelist(buf, sizeof buf);
+    ble_hs_hci_test_pipeline_opcode = le16toh(buf);
+
+    /*** The controller reports room for three commands. */
+    ble_hs_hci_set_phony_ack_cb(ble_hs_hci_test_pipeline_ack_cb);
+    rc = ble_hs_hci_cmd_tx_empty_ack(buf);
+    TEST_ASSERT_FATAL(rc == 0);
+    ble_hs_test_util_prev_hci_tx_clear();
+
+    /*** Queue four commands; only three get sent before an ack arrives. */
+    ble_hs_hci_set_phony_ack_cb(NULL);
+    for (i = 0; i < 4; i++) {
+        status[i] = 0;
+        rc = ble_hs_hci_cmd_tx_async(buf, ble_hs_hci_cmd_status_cb,
+                                     status + i);
+        TEST_ASSERT_FATAL(rc == 0);
+    }
+    TEST_ASSERT(ble_hs_hci_test_num_txed() == 3);
+
+    /*** Acks complete the commands in order; the fourth is sent once the
+     * first completes.
+     */
+    ble_hs_hci_test_pipeline_rx_ack(0);
+    ble_hs_hci_test_pipeline_rx_ack(BLE_ERR_UNSPECIFIED);
+    ble_hs_hci_test_pipeline_rx_ack(0);
+    ble_hs_hci_test_pipeline_rx_ack(0);
+    ble_hs_hci_cmd_wait_all();
+
+    TEST_ASSERT(ble_hs_hci_test_num_txed() == 1);
+    TEST_ASSERT(status[0] == 0);
+    TEST_ASSERT(status[1] == BLE_HS_HCI_ERR(BLE_ERR_UNSPECIFIED));
+    TEST_ASSERT(status[2] == 0);
+    TEST_ASSERT(status[3] == 0);
+}
+
+TEST_CASE(ble_hs_hci_test_late_ack)
+{
+    uint8_t buf[BLE_HCI_CMD_HDR_LEN];
+    uint16_t opcode;
+    int status;
+    int rc;
+
+    ble_hs_test_util_init();
+
+    ble_hs_hci_cmd_build_le_clear_whitelist(buf, sizeof buf);
+    opcode = le16toh(buf);
+    ble_hs_hci_set_phony_ack_cb(NULL);
+
+    /*** No ack; the command times out. */
+    status = 0;
+    rc = ble_hs_hci_cmd_tx_async(buf, ble_hs_hci_cmd_status_cb, &status);
+    TEST_ASSERT_FATAL(rc == 0);
+    ble_hs_hci_cmd_wait_all();
+    TEST_ASSERT(status == BLE_HS_ETIMEOUT_HCI);
+
+    /*** Its ack turns up late, with nothing in flight; it is dropped. */
+    ble_hs_hci_test_rx_ack(opcode, 0);
+
+    /*** The next command gets its own ack, not the late one. */
+    status = 0;
+    rc = ble_hs_hci_cmd_tx_async(buf, ble_hs_hci_cmd_status_cb, &status);
+    TEST_ASSERT_FATAL(rc == 0);
+    ble_hs_hci_test_rx_ack(opcode, BLE_ERR_UNSPECIFIED);
+    ble_hs_hci_cmd_wait_all();
+    TEST_ASSERT(status == BLE_HS_HCI_ERR(BLE_ERR_UNSPECIFIED));
+
+    /*** An ack for another opcode is skipped over. */
+    status = 0;
+    rc = ble_hs_hci_cmd_tx_async(buf, ble_hs_hci_cmd_status_cb, &status);
+    TEST_ASSERT_FATAL(rc == 0);
+    ble_hs_hci_test_rx_ack(opcode + 1, BLE_ERR_UNSPECIFIED);
+    ble_hs_hci_test_rx_ack(opcode, 0);
+    ble_hs_hci_cmd_wait_all();
+    TEST_ASSERT(status == 0);
+
+    TEST_ASSERT(ble_hs_hci_test_num_txed() == 3);
+}
+
+TEST_CASE(ble_hs_hci_test_cmd_too_long)
+{
+    uint8_t buf[BLE_HCI_CMD_HDR_LEN + 255];
+    int rc;
+
+    ble_hs_test_util_init();
+
+    memset(buf, 0, sizeof buf);
+    ble_hs_hci_cmd_build_le_clear_whitelist(buf, sizeof buf);
+
+    /*** Longest parameters that fit in a queue entry; command is sent. */
+    ble_hs_test_util_set_ack(le16toh(buf), 0);
+    buf[2] = 64;
+    rc = ble_hs_hci_cmd_tx_empty_ack(buf);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(ble_hs_hci_test_num_txed() == 1);
+
+    /*** One byte longer; rejected rather than truncated. */
+    buf[2] = 65;
+    rc = ble_hs_hci_cmd_tx_empty_ack(buf);
+    TEST_ASSERT(rc == BLE_HS_EINVAL);
+    rc = ble_hs_hci_cmd_tx_async(buf, NULL, NULL);
+    TEST_ASSERT(rc == BLE_HS_EINVAL);
+
+    buf[2] = 255;
+    rc = ble_hs_hci_cmd_tx_async(buf, NULL, NULL);
+    TEST_ASSERT(rc == BLE_HS_EINVAL);
+
+    ble_hs_hci_cmd_wait_all();
+    TEST_ASSERT(ble_hs_hci_test_num_txed() == 0);
+}
+
 TEST_SUITE(ble_hs_hci_suite)
 {
     tu_suite_set_post_test_cb(ble_hs_test_util_post_test, NULL);
 
     ble_hs_hci_test_event_bad();
     ble_hs_hci_test_rssi();
+    ble_hs_hci_test_pipeline();
+    ble_hs_hci_test_late_ack();
+    ble_hs_hci_test_cmd_too_long();
 }
 
 int
@@ -54,6 +54,11 @@ struct os_mempool ble_hs_test_util_mbuf_mpool;
 static STAILQ_HEAD(, os_mbuf_pkthdr) ble_hs_test_util_prev_tx_queue;
 struct os_mbuf *ble_hs_test_util_prev_tx_cur;
 
+/* Whether the fake controller completes each ACL packet as soon as it is
+ * transmitted.
+ */
+static int ble_hs_test_util_auto_complete;
+
 #define BLE_HS_TEST_UTIL_PREV_HCI_TX_CNT      64
 static uint8_t
 ble_hs_test_util_prev_hci_tx[BLE_HS_TEST_UTIL_PREV_HCI_TX_CNT][260];
@@ -109,6 +114,17 @@ ble_hs_test_util_prev_tx_dequeue_once(struct hci_data_hdr *out_hci_hdr)
     return om;
 }
 
+/**
+ * Removes a single transmitted ACL fragment from the queue without
+ * reassembling its L2CAP packet.  The HCI data header is stripped and
+ * written to out_hci_hdr.  The caller frees the returned mbuf.
+ */
+struct os_mbuf *
+ble_hs_test_util_prev_tx_dequeue_frag(struct hci_data_hdr *out_hci_hdr)
+{
+    return ble_hs_test_util_prev_tx_dequeue_once(out_hci_hdr);
+}
+
 struct os_mbuf *
 ble_hs_test_util_prev_tx_dequeue(void)
 {
@@ -250,15 +266,15 @@ ble_hs_test_util_rx_hci_evt(uint8_t *evt)
     totlen = BLE_HCI_EVENT_HDR_LEN + evt[1];
     TEST_ASSERT_FATAL(totlen <= UINT8_MAX + BLE_HCI_EVENT_HDR_LEN);
 
-    if (os_started()) {
-        evbuf = ble_hci_trans_buf_alloc(
-            BLE_HCI_TRANS_BUF_EVT_LO);
-        TEST_ASSERT_FATAL(evbuf != NULL);
+    /* The host frees the event buffer, so it must come from the transport. */
+    evbuf = ble_hci_trans_buf_alloc(BLE_HCI_TRANS_BUF_EVT_LO);
+    TEST_ASSERT_FATAL(evbuf != NULL);
+    memcpy(evbuf, evt, totlen);
 
-        memcpy(evbuf, evt, totlen);
+    if (os_started()) {
         rc = ble_hci_trans_ll_evt_tx(evbuf);
     } else {
-        rc = ble_hs_hci_evt_process(evt);
+        rc = ble_hs_hci_evt_process(evbuf);
     }
 
     TEST_ASSERT_FATAL(rc == 0);
@@ -1542,10 +1558,28 @@ ble_hs_test_util_post_test(void *arg)
     ble_hs_test_util_assert_mbufs_freed(arg);
 }
 
+void
+ble_hs_test_util_set_auto_complete(int auto_complete)
+{
+    ble_hs_test_util_auto_complete = auto_complete;
+}
+
 static int
 ble_hs_test_util_pkt_txed(struct os_mbuf *om, void *arg)
 {
+    struct ble_hs_test_util_num_completed_pkts_entry entries[2];
+    uint16_t handle;
+
+    handle = BLE_HCI_DATA_HANDLE(le16toh(om->om_data));
     ble_hs_test_util_prev_tx_enqueue(om);
+
+    if (ble_hs_test_util_auto_complete) {
+        memset(entries, 0, sizeof entries);
+        entries[0].handle_id = handle;
+        entries[0].num_pkts = 1;
+        ble_hs_test_util_rx_num_completed_pkts_event(entries);
+    }
+
     return 0;
 }
 
@@ -1569,6 +1603,7 @@ ble_hs_test_util_init(void)
     os_eventq_init(&ble_hs_test_util_evq);
     STAILQ_INIT(&ble_hs_test_util_prev_tx_queue);
     ble_hs_test_util_prev_tx_cur = NULL;
+    ble_hs_test_util_auto_complete = 1;
 
     os_msys_reset();
     stats_module_reset();
@@ -28,6 +28,7 @@ struct ble_hs_conn;
 struct ble_l2cap_chan;
 struct hci_disconn_complete;
 struct hci_create_conn;
+struct hci_data_hdr;
 
 extern struct os_eventq ble_hs_test_util_evq;
 extern const struct ble_gap_adv_params ble_hs_test_util_adv_params;
@@ -59,6 +60,8 @@ struct ble_hs_test_util_mbuf_params {
 
 void ble_hs_test_util_prev_tx_enqueue(struct os_mbuf *om);
 struct os_mbuf *ble_hs_test_util_prev_tx_dequeue(void);
+struct os_mbuf *ble_hs_test_util_prev_tx_dequeue_frag(
+    struct hci_data_hdr *out_hci_hdr);
 struct os_mbuf *ble_hs_test_util_prev_tx_dequeue_pullup(void);
 int ble_hs_test_util_prev_tx_queue_sz(void);
 void ble_hs_test_util_prev_tx_queue_clear(void);
@@ -140,6 +143,7 @@ void ble_hs_test_util_rx_att_err_rsp(uint16_t conn_handle, uint8_t req_op,
 void ble_hs_test_util_set_startup_acks(void);
 void ble_hs_test_util_rx_num_completed_pkts_event(
     struct ble_hs_test_util_num_completed_pkts_entry *entries);
+void ble_hs_test_util_set_auto_complete(int auto_complete);
 void ble_hs_test_util_rx_disconn_complete_event(
     struct hci_disconn_complete *evt);
 uint8_t *ble_hs_test_util_verify_tx_hci(uint8_t ogf, uint16_t ocf,
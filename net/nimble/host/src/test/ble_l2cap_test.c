@@ -317,6 +317,79 @@ TEST_CASE(ble_l2cap_test_case_frag_multiple)
     ble_l2cap_test_util_verify_last_frag(2, 1);
 }
 
+TEST_CASE(ble_l2cap_test_case_frag_tx)
+{
+    static const uint8_t seg_lens[] = { 5, 30, 16, 3, 40 };
+    struct ble_l2cap_chan *chan;
+    struct ble_hs_conn *conn;
+    struct hci_data_hdr hci_hdr;
+    struct os_mbuf *om;
+    struct os_mbuf *m;
+    uint8_t buf[128];
+    int num_frags;
+    int len;
+    int off;
+    int rc;
+    int i;
+    int j;
+
+    ble_l2cap_test_util_init();
+
+    ble_l2cap_test_util_create_conn(2, ((uint8_t[]){1,2,3,4,5,6}),
+                                    NULL, NULL);
+
+    /* Build a payload spread across several mbufs whose boundaries do not
+     * line up with the 16-byte controller buffers.
+     */
+    om = ble_hs_mbuf_l2cap_pkt();
+    TEST_ASSERT_FATAL(om != NULL);
+
+    off = 0;
+    for (i = 0; i < sizeof seg_lens / sizeof seg_lens[0]; i++) {
+        m = os_msys_get(0, 0);
+        TEST_ASSERT_FATAL(m != NULL);
+        for (j = 0; j < seg_lens[i]; j++) {
+            m->om_data[j] = off++;
+        }
+        m->om_len = seg_lens[i];
+        os_mbuf_concat(om, m);
+    }
+
+    ble_hs_lock();
+    ble_hs_misc_conn_chan_find_reqd(2, BLE_L2CAP_CID_ATT, &conn, &chan);
+    rc = ble_l2cap_tx(conn, chan, om);
+    ble_hs_unlock();
+    TEST_ASSERT_FATAL(rc == 0);
+
+    ble_hs_test_util_tx_all();
+
+    /*** Reassemble the fragments and verify the packet. */
+    len = 0;
+    num_frags = 0;
+    while ((om = ble_hs_test_util_prev_tx_dequeue_frag(&hci_hdr)) != NULL) {
+        TEST_ASSERT(BLE_HCI_DATA_PB(hci_hdr.hdh_handle_pb_bc) ==
+                    (num_frags == 0 ? BLE_HCI_PB_FIRST_NON_FLUSH :
+                                      BLE_HCI_PB_MIDDLE));
+        TEST_ASSERT(hci_hdr.hdh_len <= 16);
+        TEST_ASSERT_FATAL(len + hci_hdr.hdh_len <= sizeof buf);
+
+        rc = os_mbuf_copydata(om, 0, hci_hdr.hdh_len, buf + len);
+        TEST_ASSERT_FATAL(rc == 0);
+        len += hci_hdr.hdh_len;
+        num_frags++;
+
+        os_mbuf_free_chain(om);
+    }
+
+    TEST_ASSERT(num_frags == 7);
+    TEST_ASSERT_FATAL(len == BLE_L2CAP_HDR_SZ + off);
+    TEST_ASSERT(le16toh(buf) == off);
+    TEST_ASSERT(le16toh(buf + 2) == BLE_L2CAP_CID_ATT);
+    for (i = 0; i < off; i++) {
+        TEST_ASSERT(buf[BLE_L2CAP_HDR_SZ + i] == i);
+    }
+}
+
 TEST_CASE(ble_l2cap_test_case_frag_channels)
 {
     struct ble_hs_conn *conn;
@@ -569,6 +642,7 @@ TEST_SUITE(ble_l2cap_test_suite)
     ble_l2cap_test_case_frag_single();
     ble_l2cap_test_case_frag_multiple();
     ble_l2cap_test_case_frag_channels();
+    ble_l2cap_test_case_frag_tx();
     ble_l2cap_test_case_sig_unsol_rsp();
     ble_l2cap_test_case_sig_update_accept();
     ble_l2cap_test_case_sig_update_reject();
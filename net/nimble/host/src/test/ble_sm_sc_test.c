@@ -4905,6 +4905,21 @@ TEST_SUITE(ble_sm_sc_test_suite)
     ble_sm_sc_us_jw_iio3_rio3_b1_iat2_rat2_ik3_rk3();
     ble_sm_sc_us_nc_iio1_rio1_b1_iat2_rat2_ik3_rk3();
     ble_sm_sc_us_pk_iio2_rio0_b1_iat2_rat2_ik7_rk3();
+
+    /*** Asynchronous crypto. */
+    ble_sm_test_util_set_async_crypto(1);
+
+    /* Peer as initiator. */
+    ble_sm_sc_peer_jw_iio3_rio3_b1_iat0_rat0_ik5_rk7();
+    ble_sm_sc_peer_pk_iio0_rio2_b1_iat0_rat0_ik5_rk7();
+    ble_sm_sc_peer_nc_iio1_rio1_b1_iat0_rat0_ik5_rk7();
+
+    /* Us as initiator. */
+    ble_sm_sc_us_jw_iio3_rio4_b1_iat0_rat0_ik7_rk5();
+    ble_sm_sc_us_pk_iio2_rio4_b1_iat0_rat0_ik7_rk5();
+    ble_sm_sc_us_nc_iio1_rio4_b1_iat0_rat0_ik7_rk5();
+
+    ble_sm_test_util_set_async_crypto(0);
 }
 
 #endif /* NIMBLE_OPT_SM */
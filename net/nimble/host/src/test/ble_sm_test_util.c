@@ -38,6 +38,10 @@ int ble_sm_test_store_obj_type;
 union ble_store_key ble_sm_test_store_key;
 union ble_store_value ble_sm_test_store_value;
 
+/** Stands in for the application's crypto task when async crypto is on. */
+static struct os_eventq ble_sm_test_util_crypto_evq;
+static int ble_sm_test_util_async_crypto;
+
 static ble_store_read_fn ble_sm_test_util_store_read;
 static ble_store_write_fn ble_sm_test_util_store_write;
 
@@ -108,6 +112,50 @@ ble_sm_test_util_init(void)
 
     memset(&ble_sm_test_ioact, 0, sizeof ble_sm_test_ioact);
     memset(&ble_sm_test_sec_state, 0xff, sizeof ble_sm_test_sec_state);
+
+    os_eventq_init(&ble_sm_test_util_crypto_evq);
+    if (ble_sm_test_util_async_crypto) {
+        ble_hs_cfg.sm_crypto_evq = &ble_sm_test_util_crypto_evq;
+    }
+}
+
+void
+ble_sm_test_util_set_async_crypto(int async)
+{
+    ble_sm_test_util_async_crypto = async;
+}
+
+static void
+ble_sm_test_util_evq_run(struct os_eventq *evq)
+{
+    struct os_callout_func *cf;
+    struct os_event *ev;
+
+    while ((ev = os_eventq_poll(&evq, 1, 0)) != NULL) {
+        TEST_ASSERT_FATAL(ev->ev_type == OS_EVENT_T_TIMER);
+        cf = (struct os_callout_func *)ev;
+        cf->cf_func(ev->ev_arg);
+    }
+}
+
+/**
+ * If async crypto is enabled, verifies that the host is waiting on the crypto
+ * task, then runs the crypto task followed by the host's completion events.
+ */
+static void
+ble_sm_test_util_crypto_run(void)
+{
+    if (!ble_sm_test_util_async_crypto) {
+        return;
+    }
+
+    /* Nothing gets sent until the crypto task has done its job. */
+    ble_hs_test_util_tx_all();
+    TEST_ASSERT(ble_hs_test_util_prev_tx_dequeue() == NULL);
+    TEST_ASSERT(!STAILQ_EMPTY(&ble_sm_test_util_crypto_evq.evq_list));
+
+    ble_sm_test_util_evq_run(&ble_sm_test_util_crypto_evq);
+    ble_sm_test_util_evq_run(&ble_hs_test_util_evq);
 }
 
 static void
@@ -2022,6 +2070,7 @@ ble_sm_test_util_us_sc_good_once(struct ble_sm_test_params *params)
 
     /* Receive a public key from the peer. */
     ble_sm_test_util_rx_public_key(2, peer_entity.public_key);
+    ble_sm_test_util_crypto_run();
     TEST_ASSERT(!conn->bhc_sec_state.encrypted);
     TEST_ASSERT(ble_sm_dbg_num_procs() == 1);
     ble_sm_test_util_io_inject_bad(2, params->passkey_info.passkey.action);
@@ -2188,6 +2237,7 @@ ble_sm_test_util_peer_sc_good_once(struct ble_sm_test_params *params)
 
     /* Receive a public key from the peer. */
     ble_sm_test_util_rx_public_key(2, peer_entity.public_key);
+    ble_sm_test_util_crypto_run();
     TEST_ASSERT(!conn->bhc_sec_state.encrypted);
     TEST_ASSERT(ble_sm_dbg_num_procs() == 1);
     ble_sm_test_util_io_inject_bad(2, params->passkey_info.passkey.action);
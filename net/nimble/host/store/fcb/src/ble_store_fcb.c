@@ -0,0 +1,929 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/**
+ * This file implements a flash-backed key database for BLE host security
+ * material and CCCDs.  The whole database is mirrored in RAM, where it is
+ * indexed by (peer address, characteristic value handle), so lookups never
+ * touch flash.  Each change is appended as a record to a flash circular
+ * buffer (FCB); the RAM copy is rebuilt by replaying these records at init.
+ *
+ * Changes which only toggle a CCCD's value_changed flag are not written
+ * immediately.  They are held in RAM and appended together, several records
+ * per FCB element, when BLE_STORE_FCB_MAX_DIRTY of them accumulate, when
+ * another object gets written, or when ble_store_fcb_flush() is called.
+ * Flags which have not been flushed are lost on reset; at worst, a bonded
+ * peer misses one update notification when it reconnects.
+ */
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "os/os.h"
+#include "fcb/fcb.h"
+#include "host/ble_hs.h"
+#include "store/fcb/ble_store_fcb.h"
+
+#ifndef BLE_STORE_FCB_MAX_OUR_SECS
+#define BLE_STORE_FCB_MAX_OUR_SECS      4
+#endif
+
+#ifndef BLE_STORE_FCB_MAX_PEER_SECS
+#define BLE_STORE_FCB_MAX_PEER_SECS     4
+#endif
+
+#ifndef BLE_STORE_FCB_MAX_CCCDS
+#define BLE_STORE_FCB_MAX_CCCDS         16
+#endif
+
+/**
+ * Number of deferred records which triggers a flush.  This is also the
+ * maximum number of records packed into a single FCB element.
+ */
+#ifndef BLE_STORE_FCB_MAX_DIRTY
+#define BLE_STORE_FCB_MAX_DIRTY         8
+#endif
+
+#define BLE_STORE_FCB_HASH_SIZE         16
+
+#define BLE_STORE_FCB_MAGIC             0xb1e5f0cb
+#define BLE_STORE_FCB_VERS              1
+
+#define BLE_STORE_FCB_OP_WRITE          1
+#define BLE_STORE_FCB_OP_DELETE         2
+
+/** The RAM copy of the entry has not been written to flash yet. */
+#define BLE_STORE_FCB_F_DIRTY           0x01
+
+/** On-flash record; each FCB element contains one or more of these. */
+struct ble_store_fcb_rec {
+    uint8_t bsfr_obj_type;
+    uint8_t bsfr_op;
+    union ble_store_value bsfr_value;
+};
+
+struct ble_store_fcb_entry {
+    /** Per-type list in insertion order; used for wildcard lookups. */
+    STAILQ_ENTRY(ble_store_fcb_entry) bsfe_next;
+
+    /** (peer address, handle) hash chain; also links the free list. */
+    SLIST_ENTRY(ble_store_fcb_entry) bsfe_peer_next;
+
+    /** Handle hash chain; CCCDs only. */
+    SLIST_ENTRY(ble_store_fcb_entry) bsfe_handle_next;
+
+    /** Sector containing the latest copy of this entry; NULL if none. */
+    struct flash_area *bsfe_area;
+
+    uint8_t bsfe_obj_type;
+    uint8_t bsfe_flags;
+    union ble_store_value bsfe_value;
+};
+
+STAILQ_HEAD(ble_store_fcb_entry_list, ble_store_fcb_entry);
+SLIST_HEAD(ble_store_fcb_entry_slist, ble_store_fcb_entry);
+
+struct ble_store_fcb_table {
+    struct ble_store_fcb_entry_list bsft_entries;
+    struct ble_store_fcb_entry_slist bsft_free;
+};
+
+static struct ble_store_fcb_entry
+    ble_store_fcb_our_secs[BLE_STORE_FCB_MAX_OUR_SECS];
+static struct ble_store_fcb_entry
+    ble_store_fcb_peer_secs[BLE_STORE_FCB_MAX_PEER_SECS];
+static struct ble_store_fcb_entry ble_store_fcb_cccds[BLE_STORE_FCB_MAX_CCCDS];
+
+/** Indexed by BLE_STORE_OBJ_TYPE_[...]; slot 0 is unused. */
+static struct ble_store_fcb_table
+    ble_store_fcb_tables[BLE_STORE_OBJ_TYPE_CCCD + 1];
+
+static struct ble_store_fcb_entry_slist
+    ble_store_fcb_peer_hash[BLE_STORE_FCB_HASH_SIZE];
+static struct ble_store_fcb_entry_slist
+    ble_store_fcb_handle_hash[BLE_STORE_FCB_HASH_SIZE];
+
+static int ble_store_fcb_num_dirty;
+
+/** Staging area for records being written to or read from flash. */
+static struct ble_store_fcb_rec ble_store_fcb_buf[BLE_STORE_FCB_MAX_DIRTY];
+
+static struct fcb *ble_store_fcb;
+
+/*****************************************************************************
+ * $index                                                                    *
+ *****************************************************************************/
+
+static struct ble_store_fcb_table *
+ble_store_fcb_table(int obj_type)
+{
+    switch (obj_type) {
+    case BLE_STORE_OBJ_TYPE_OUR_SEC:
+    case BLE_STORE_OBJ_TYPE_PEER_SEC:
+    case BLE_STORE_OBJ_TYPE_CCCD:
+        return ble_store_fcb_tables + obj_type;
+
+    default:
+        return NULL;
+    }
+}
+
+static struct ble_store_fcb_entry_slist *
+ble_store_fcb_peer_bucket(uint8_t peer_addr_type, uint8_t *peer_addr,
+                          uint16_t chr_val_handle)
+{
+    unsigned int hash;
+    int i;
+
+    hash = peer_addr_type ^ chr_val_handle;
+    for (i = 0; i < 6; i++) {
+        hash = hash * 31 + peer_addr[i];
+    }
+
+    return ble_store_fcb_peer_hash + hash % BLE_STORE_FCB_HASH_SIZE;
+}
+
+static struct ble_store_fcb_entry_slist *
+ble_store_fcb_handle_bucket(uint16_t chr_val_handle)
+{
+    return ble_store_fcb_handle_hash +
+           chr_val_handle % BLE_STORE_FCB_HASH_SIZE;
+}
+
+static struct ble_store_fcb_entry_slist *
+ble_store_fcb_entry_bucket(struct ble_store_fcb_entry *entry)
+{
+    union ble_store_value *val;
+
+    val = &entry->bsfe_value;
+    if (entry->bsfe_obj_type == BLE_STORE_OBJ_TYPE_CCCD) {
+        return ble_store_fcb_peer_bucket(val->cccd.peer_addr_type,
+                                         val->cccd.peer_addr,
+                                         val->cccd.chr_val_handle);
+    } else {
+        return ble_store_fcb_peer_bucket(val->sec.peer_addr_type,
+                                         val->sec.peer_addr, 0);
+    }
+}
+
+static int
+ble_store_fcb_sec_matches(struct ble_store_key_sec *key,
+                          struct ble_store_value_sec *sec)
+{
+    if (key->peer_addr_type != BLE_STORE_ADDR_TYPE_NONE) {
+        if (sec->peer_addr_type != key->peer_addr_type) {
+            return 0;
+        }
+
+        if (memcmp(sec->peer_addr, key->peer_addr,
+                   sizeof sec->peer_addr) != 0) {
+            return 0;
+        }
+    }
+
+    if (key->ediv_rand_present) {
+        if (sec->ediv != key->ediv) {
+            return 0;
+        }
+
+        if (sec->rand_num != key->rand_num) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int
+ble_store_fcb_cccd_matches(struct ble_store_key_cccd *key,
+                           struct ble_store_value_cccd *cccd)
+{
+    if (key->peer_addr_type != BLE_STORE_ADDR_TYPE_NONE) {
+        if (cccd->peer_addr_type != key->peer_addr_type) {
+            return 0;
+        }
+
+        if (memcmp(cccd->peer_addr, key->peer_addr, 6) != 0) {
+            return 0;
+        }
+    }
+
+    if (key->chr_val_handle != 0) {
+        if (cccd->chr_val_handle != key->chr_val_handle) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Indicates whether the specified entry is the one a lookup is looking for.
+ * Matching entries are counted in *skipped until the key's idx is reached.
+ */
+static int
+ble_store_fcb_entry_matches(int obj_type, union ble_store_key *key,
+                            struct ble_store_fcb_entry *entry, int *skipped)
+{
+    uint8_t idx;
+    int match;
+
+    if (entry->bsfe_obj_type != obj_type) {
+        return 0;
+    }
+
+    if (obj_type == BLE_STORE_OBJ_TYPE_CCCD) {
+        match = ble_store_fcb_cccd_matches(&key->cccd,
+                                           &entry->bsfe_value.cccd);
+        idx = key->cccd.idx;
+    } else {
+        match = ble_store_fcb_sec_matches(&key->sec, &entry->bsfe_value.sec);
+        idx = key->sec.idx;
+    }
+
+    if (!match) {
+        return 0;
+    }
+
+    if (idx > *skipped) {
+        (*skipped)++;
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Finds the entry matching the specified key.  Lookups which specify a peer
+ * (and, for CCCDs, a handle) walk a single (peer address, handle) hash
+ * chain.  CCCD lookups by handle alone, as performed whenever a
+ * characteristic is updated, walk a handle hash chain.  Anything else scans
+ * every entry of the requested type.
+ */
+static struct ble_store_fcb_entry *
+ble_store_fcb_find(int obj_type, union ble_store_key *key)
+{
+    struct ble_store_fcb_entry_slist *bucket;
+    struct ble_store_fcb_entry *entry;
+    struct ble_store_fcb_table *table;
+    int skipped;
+
+    table = ble_store_fcb_table(obj_type);
+    if (table == NULL) {
+        return NULL;
+    }
+
+    skipped = 0;
+
+    if (obj_type == BLE_STORE_OBJ_TYPE_CCCD) {
+        if (key->cccd.chr_val_handle != 0) {
+            if (key->cccd.peer_addr_type != BLE_STORE_ADDR_TYPE_NONE) {
+                bucket = ble_store_fcb_peer_bucket(key->cccd.peer_addr_type,
+                                                   key->cccd.peer_addr,
+                                                   key->cccd.chr_val_handle);
+                SLIST_FOREACH(entry, bucket, bsfe_peer_next) {
+                    if (ble_store_fcb_entry_matches(obj_type, key, entry,
+                                                    &skipped)) {
+                        return entry;
+                    }
+                }
+            } else {
+                bucket = ble_store_fcb_handle_bucket(key->cccd.chr_val_handle);
+                SLIST_FOREACH(entry, bucket, bsfe_handle_next) {
+                    if (ble_store_fcb_entry_matches(obj_type, key, entry,
+                                                    &skipped)) {
+                        return entry;
+                    }
+                }
+            }
+
+            return NULL;
+        }
+    } else if (key->sec.peer_addr_type != BLE_STORE_ADDR_TYPE_NONE) {
+        bucket = ble_store_fcb_peer_bucket(key->sec.peer_addr_type,
+                                           key->sec.peer_addr, 0);
+        SLIST_FOREACH(entry, bucket, bsfe_peer_next) {
+            if (ble_store_fcb_entry_matches(obj_type, key, entry,
+                                            &skipped)) {
+                return entry;
+            }
+        }
+
+        return NULL;
+    }
+
+    STAILQ_FOREACH(entry, &table->bsft_entries, bsfe_next) {
+        if (ble_store_fcb_entry_matches(obj_type, key, entry, &skipped)) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Copies an object of the specified type.  Callers often pass a pointer to
+ * the type-specific struct rather than to a full union, so only the
+ * relevant member may be accessed.
+ */
+static void
+ble_store_fcb_value_copy(int obj_type, union ble_store_value *dst,
+                         union ble_store_value *src)
+{
+    if (obj_type == BLE_STORE_OBJ_TYPE_CCCD) {
+        dst->cccd = src->cccd;
+    } else {
+        dst->sec = src->sec;
+    }
+}
+
+static struct ble_store_fcb_entry *
+ble_store_fcb_insert(int obj_type, union ble_store_value *val)
+{
+    struct ble_store_fcb_entry_slist *bucket;
+    struct ble_store_fcb_entry *entry;
+    struct ble_store_fcb_table *table;
+
+    table = ble_store_fcb_table(obj_type);
+    entry = SLIST_FIRST(&table->bsft_free);
+    if (entry == NULL) {
+        return NULL;
+    }
+    SLIST_REMOVE_HEAD(&table->bsft_free, bsfe_peer_next);
+
+    entry->bsfe_area = NULL;
+    entry->bsfe_obj_type = obj_type;
+    entry->bsfe_flags = 0;
+    ble_store_fcb_value_copy(obj_type, &entry->bsfe_value, val);
+
+    STAILQ_INSERT_TAIL(&table->bsft_entries, entry, bsfe_next);
+    SLIST_INSERT_HEAD(ble_store_fcb_entry_bucket(entry), entry,
+                      bsfe_peer_next);
+    if (obj_type == BLE_STORE_OBJ_TYPE_CCCD) {
+        bucket = ble_store_fcb_handle_bucket(val->cccd.chr_val_handle);
+        SLIST_INSERT_HEAD(bucket, entry, bsfe_handle_next);
+    }
+
+    return entry;
+}
+
+static void
+ble_store_fcb_remove(struct ble_store_fcb_entry *entry)
+{
+    struct ble_store_fcb_table *table;
+    uint16_t chr_val_handle;
+
+    table = ble_store_fcb_table(entry->bsfe_obj_type);
+
+    STAILQ_REMOVE(&table->bsft_entries, entry, ble_store_fcb_entry,
+                  bsfe_next);
+    SLIST_REMOVE(ble_store_fcb_entry_bucket(entry), entry,
+                 ble_store_fcb_entry, bsfe_peer_next);
+    if (entry->bsfe_obj_type == BLE_STORE_OBJ_TYPE_CCCD) {
+        chr_val_handle = entry->bsfe_value.cccd.chr_val_handle;
+        SLIST_REMOVE(ble_store_fcb_handle_bucket(chr_val_handle), entry,
+                     ble_store_fcb_entry, bsfe_handle_next);
+    }
+
+    if (entry->bsfe_flags & BLE_STORE_FCB_F_DIRTY) {
+        ble_store_fcb_num_dirty--;
+    }
+
+    SLIST_INSERT_HEAD(&table->bsft_free, entry, bsfe_peer_next);
+}
+
+static void
+ble_store_fcb_reset(void)
+{
+    struct ble_store_fcb_table *table;
+    int i;
+
+    memset(ble_store_fcb_tables, 0, sizeof ble_store_fcb_tables);
+    for (i = 0; i < BLE_STORE_FCB_HASH_SIZE; i++) {
+        SLIST_INIT(ble_store_fcb_peer_hash + i);
+        SLIST_INIT(ble_store_fcb_handle_hash + i);
+    }
+
+    table = ble_store_fcb_table(BLE_STORE_OBJ_TYPE_OUR_SEC);
+    STAILQ_INIT(&table->bsft_entries);
+    for (i = 0; i < BLE_STORE_FCB_MAX_OUR_SECS; i++) {
+        SLIST_INSERT_HEAD(&table->bsft_free, ble_store_fcb_our_secs + i,
+                          bsfe_peer_next);
+    }
+
+    table = ble_store_fcb_table(BLE_STORE_OBJ_TYPE_PEER_SEC);
+    STAILQ_INIT(&table->bsft_entries);
+    for (i = 0; i < BLE_STORE_FCB_MAX_PEER_SECS; i++) {
+        SLIST_INSERT_HEAD(&table->bsft_free, ble_store_fcb_peer_secs + i,
+                          bsfe_peer_next);
+    }
+
+    table = ble_store_fcb_table(BLE_STORE_OBJ_TYPE_CCCD);
+    STAILQ_INIT(&table->bsft_entries);
+    for (i = 0; i < BLE_STORE_FCB_MAX_CCCDS; i++) {
+        SLIST_INSERT_HEAD(&table->bsft_free, ble_store_fcb_cccds + i,
+                          bsfe_peer_next);
+    }
+
+    ble_store_fcb_num_dirty = 0;
+}
+
+static int
+ble_store_fcb_key_from_value(int obj_type, union ble_store_key *key,
+                             union ble_store_value *val)
+{
+    switch (obj_type) {
+    case BLE_STORE_OBJ_TYPE_OUR_SEC:
+    case BLE_STORE_OBJ_TYPE_PEER_SEC:
+        ble_store_key_from_value_sec(&key->sec, &val->sec);
+        return 0;
+
+    case BLE_STORE_OBJ_TYPE_CCCD:
+        ble_store_key_from_value_cccd(&key->cccd, &val->cccd);
+        return 0;
+
+    default:
+        return BLE_HS_ENOTSUP;
+    }
+}
+
+static void
+ble_store_fcb_mark_dirty(struct ble_store_fcb_entry *entry)
+{
+    if (!(entry->bsfe_flags & BLE_STORE_FCB_F_DIRTY)) {
+        entry->bsfe_flags |= BLE_STORE_FCB_F_DIRTY;
+        ble_store_fcb_num_dirty++;
+    }
+}
+
+/*****************************************************************************
+ * $flash                                                                    *
+ *****************************************************************************/
+
+static void
+ble_store_fcb_rec_fill(struct ble_store_fcb_rec *rec, int obj_type, int op,
+                       union ble_store_value *val)
+{
+    memset(rec, 0, sizeof *rec);
+    rec->bsfr_obj_type = obj_type;
+    rec->bsfr_op = op;
+    ble_store_fcb_value_copy(obj_type, &rec->bsfr_value, val);
+}
+
+static int
+ble_store_fcb_append_once(struct ble_store_fcb_rec *recs, int num_recs,
+                          struct fcb_entry *loc)
+{
+    int len;
+    int rc;
+
+    len = num_recs * sizeof *recs;
+
+    rc = fcb_append(ble_store_fcb, len, loc);
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = flash_area_write(loc->fe_area, loc->fe_data_off, recs, len);
+    if (rc != 0) {
+        return FCB_ERR_FLASH;
+    }
+
+    rc = fcb_append_finish(ble_store_fcb, loc);
+    return rc;
+}
+
+/**
+ * Frees the oldest sector.  Entries whose latest copy lives in that sector
+ * are rewritten to the scratch sector from their RAM copy; everything else
+ * in it, including deletion records, is obsolete and simply dropped.  The
+ * sector is left alone if any entry could not be copied.
+ */
+static void
+ble_store_fcb_compress(void)
+{
+    struct ble_store_fcb_entry *entry;
+    struct ble_store_fcb_table *table;
+    struct ble_store_fcb_rec rec;
+    struct flash_area *oldest;
+    struct fcb_entry loc;
+    int obj_type;
+    int rc;
+
+    rc = fcb_append_to_scratch(ble_store_fcb);
+    if (rc != 0) {
+        return;
+    }
+
+    oldest = ble_store_fcb->f_oldest;
+    for (obj_type = BLE_STORE_OBJ_TYPE_OUR_SEC;
+         obj_type <= BLE_STORE_OBJ_TYPE_CCCD;
+         obj_type++) {
+
+        table = ble_store_fcb_table(obj_type);
+        STAILQ_FOREACH(entry, &table->bsft_entries, bsfe_next) {
+            if (entry->bsfe_area != oldest) {
+                continue;
+            }
+
+            ble_store_fcb_rec_fill(&rec, obj_type, BLE_STORE_FCB_OP_WRITE,
+                                   &entry->bsfe_value);
+            rc = ble_store_fcb_append_once(&rec, 1, &loc);
+            if (rc != 0) {
+                BLE_HS_LOG(ERROR, "ble_store_fcb: compress failed; rc=%d\n",
+                           rc);
+                return;
+            }
+            entry->bsfe_area = loc.fe_area;
+        }
+    }
+
+    fcb_rotate(ble_store_fcb);
+}
+
+static int
+ble_store_fcb_append(struct ble_store_fcb_rec *recs, int num_recs,
+                     struct flash_area **out_area)
+{
+    struct fcb_entry loc;
+    int rc;
+    int i;
+
+    rc = FCB_ERR_NOSPACE;
+    for (i = 0; i < ble_store_fcb->f_sector_cnt; i++) {
+        rc = ble_store_fcb_append_once(recs, num_recs, &loc);
+        if (rc != FCB_ERR_NOSPACE) {
+            break;
+        }
+        ble_store_fcb_compress();
+    }
+
+    if (rc != 0) {
+        BLE_HS_LOG(ERROR, "ble_store_fcb: append failed; rc=%d\n", rc);
+        return BLE_HS_EOS;
+    }
+
+    *out_area = loc.fe_area;
+    return 0;
+}
+
+static int
+ble_store_fcb_write_batch(struct ble_store_fcb_entry **entries, int num_recs)
+{
+    struct flash_area *area;
+    int rc;
+    int i;
+
+    rc = ble_store_fcb_append(ble_store_fcb_buf, num_recs, &area);
+    if (rc != 0) {
+        return rc;
+    }
+
+    for (i = 0; i < num_recs; i++) {
+        if (entries[i] != NULL) {
+            entries[i]->bsfe_flags &= ~BLE_STORE_FCB_F_DIRTY;
+            entries[i]->bsfe_area = area;
+            ble_store_fcb_num_dirty--;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Writes every dirty entry to flash, packing up to BLE_STORE_FCB_MAX_DIRTY
+ * records into each FCB element.  If a deletion record is specified, it is
+ * written first, in the same element as the first batch.
+ */
+static int
+ble_store_fcb_write_dirty(struct ble_store_fcb_rec *del_rec)
+{
+    struct ble_store_fcb_entry *entries[BLE_STORE_FCB_MAX_DIRTY];
+    struct ble_store_fcb_entry *entry;
+    struct ble_store_fcb_table *table;
+    int num_recs;
+    int obj_type;
+    int rc;
+
+    num_recs = 0;
+    if (del_rec != NULL) {
+        ble_store_fcb_buf[0] = *del_rec;
+        entries[0] = NULL;
+        num_recs++;
+    }
+
+    for (obj_type = BLE_STORE_OBJ_TYPE_OUR_SEC;
+         obj_type <= BLE_STORE_OBJ_TYPE_CCCD;
+         obj_type++) {
+
+        table = ble_store_fcb_table(obj_type);
+        STAILQ_FOREACH(entry, &table->bsft_entries, bsfe_next) {
+            if (!(entry->bsfe_flags & BLE_STORE_FCB_F_DIRTY)) {
+                continue;
+            }
+
+            ble_store_fcb_rec_fill(ble_store_fcb_buf + num_recs, obj_type,
+                                   BLE_STORE_FCB_OP_WRITE,
+                                   &entry->bsfe_value);
+            entries[num_recs] = entry;
+            num_recs++;
+
+            if (num_recs == BLE_STORE_FCB_MAX_DIRTY) {
+                rc = ble_store_fcb_write_batch(entries, num_recs);
+                if (rc != 0) {
+                    return rc;
+                }
+                num_recs = 0;
+            }
+        }
+    }
+
+    if (num_recs > 0) {
+        rc = ble_store_fcb_write_batch(entries, num_recs);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    return 0;
+}
+
+static void
+ble_store_fcb_replay(struct ble_store_fcb_rec *rec, struct flash_area *area)
+{
+    struct ble_store_fcb_entry *entry;
+    union ble_store_key key;
+    int rc;
+
+    rc = ble_store_fcb_key_from_value(rec->bsfr_obj_type, &key,
+                                      &rec->bsfr_value);
+    if (rc != 0) {
+        return;
+    }
+
+    entry = ble_store_fcb_find(rec->bsfr_obj_type, &key);
+
+    switch (rec->bsfr_op) {
+    case BLE_STORE_FCB_OP_WRITE:
+        if (entry == NULL) {
+            entry = ble_store_fcb_insert(rec->bsfr_obj_type,
+                                         &rec->bsfr_value);
+            if (entry == NULL) {
+                BLE_HS_LOG(ERROR, "ble_store_fcb: too many entries; "
+                                  "obj_type=%d\n", rec->bsfr_obj_type);
+                return;
+            }
+        } else {
+            ble_store_fcb_value_copy(rec->bsfr_obj_type, &entry->bsfe_value,
+                                     &rec->bsfr_value);
+        }
+        entry->bsfe_area = area;
+        break;
+
+    case BLE_STORE_FCB_OP_DELETE:
+        if (entry != NULL) {
+            ble_store_fcb_remove(entry);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+static int
+ble_store_fcb_load_cb(struct fcb_entry *loc, void *arg)
+{
+    int num_recs;
+    int rc;
+    int i;
+
+    if (loc->fe_data_len > sizeof ble_store_fcb_buf ||
+        loc->fe_data_len % sizeof ble_store_fcb_buf[0] != 0) {
+
+        /* Not a valid element; skip it. */
+        return 0;
+    }
+
+    rc = flash_area_read(loc->fe_area, loc->fe_data_off, ble_store_fcb_buf,
+                         loc->fe_data_len);
+    if (rc != 0) {
+        return 0;
+    }
+
+    num_recs = loc->fe_data_len / sizeof ble_store_fcb_buf[0];
+    for (i = 0; i < num_recs; i++) {
+        ble_store_fcb_replay(ble_store_fcb_buf + i, loc->fe_area);
+    }
+
+    return 0;
+}
+
+/*****************************************************************************
+ * $api                                                                      *
+ *****************************************************************************/
+
+/**
+ * Searches the database for an object matching the specified criteria.
+ *
+ * @return                      0 if a key was found; else BLE_HS_ENOENT.
+ */
+int
+ble_store_fcb_read(int obj_type, union ble_store_key *key,
+                   union ble_store_value *value)
+{
+    struct ble_store_fcb_entry *entry;
+
+    if (ble_store_fcb_table(obj_type) == NULL) {
+        return BLE_HS_ENOTSUP;
+    }
+
+    entry = ble_store_fcb_find(obj_type, key);
+    if (entry == NULL) {
+        return BLE_HS_ENOENT;
+    }
+
+    ble_store_fcb_value_copy(obj_type, value, &entry->bsfe_value);
+    return 0;
+}
+
+/**
+ * Adds the specified object to the database, replacing any object with the
+ * same identity.  A CCCD write which only changes the value_changed flag is
+ * deferred until a batch of such writes has accumulated; all other writes
+ * are committed to flash before this function returns.
+ *
+ * @return                      0 on success; BLE_HS_ENOMEM if the database is
+ *                                  full; BLE_HS_EOS on flash error.
+ */
+int
+ble_store_fcb_write(int obj_type, union ble_store_value *val)
+{
+    struct ble_store_fcb_entry *entry;
+    struct ble_store_value_cccd *cccd;
+    union ble_store_key key;
+    int defer;
+    int rc;
+
+    rc = ble_store_fcb_key_from_value(obj_type, &key, val);
+    if (rc != 0) {
+        return rc;
+    }
+
+    defer = 0;
+
+    entry = ble_store_fcb_find(obj_type, &key);
+    if (entry == NULL) {
+        entry = ble_store_fcb_insert(obj_type, val);
+        if (entry == NULL) {
+            BLE_HS_LOG(DEBUG, "error persisting to fcb; too many entries; "
+                              "obj_type=%d\n", obj_type);
+            return BLE_HS_ENOMEM;
+        }
+    } else {
+        if (obj_type == BLE_STORE_OBJ_TYPE_CCCD) {
+            cccd = &entry->bsfe_value.cccd;
+            if (cccd->flags == val->cccd.flags) {
+                if (cccd->value_changed == val->cccd.value_changed) {
+                    /* Identical to the stored object; nothing to do. */
+                    return 0;
+                }
+                defer = 1;
+            }
+        }
+        ble_store_fcb_value_copy(obj_type, &entry->bsfe_value, val);
+    }
+
+    ble_store_fcb_mark_dirty(entry);
+
+    if (defer && ble_store_fcb_num_dirty < BLE_STORE_FCB_MAX_DIRTY) {
+        return 0;
+    }
+
+    rc = ble_store_fcb_write_dirty(NULL);
+    return rc;
+}
+
+/**
+ * Deletes the first object matching the specified criteria.  The deletion
+ * is committed to flash before this function returns.
+ *
+ * @return                      0 on success; BLE_HS_ENOENT if no matching
+ *                                  object was found; BLE_HS_EOS on flash
+ *                                  error.
+ */
+int
+ble_store_fcb_delete(int obj_type, union ble_store_key *key)
+{
+    struct ble_store_fcb_entry *entry;
+    struct ble_store_fcb_rec rec;
+    int on_flash;
+    int rc;
+
+    if (ble_store_fcb_table(obj_type) == NULL) {
+        return BLE_HS_ENOTSUP;
+    }
+
+    entry = ble_store_fcb_find(obj_type, key);
+    if (entry == NULL) {
+        return BLE_HS_ENOENT;
+    }
+
+    ble_store_fcb_rec_fill(&rec, obj_type, BLE_STORE_FCB_OP_DELETE,
+                           &entry->bsfe_value);
+    on_flash = entry->bsfe_area != NULL;
+    ble_store_fcb_remove(entry);
+
+    if (!on_flash) {
+        /* Never made it to flash; there is nothing to cancel. */
+        return 0;
+    }
+
+    rc = ble_store_fcb_write_dirty(&rec);
+    return rc;
+}
+
+/**
+ * Writes all deferred changes to flash.  The application should call this
+ * before an orderly shutdown, and may call it periodically to limit what a
+ * sudden reset can lose.
+ *
+ * @return                      0 on success; BLE_HS_EOS on flash error.
+ */
+int
+ble_store_fcb_flush(void)
+{
+    int rc;
+
+    if (ble_store_fcb_num_dirty == 0) {
+        return 0;
+    }
+
+    rc = ble_store_fcb_write_dirty(NULL);
+    return rc;
+}
+
+/**
+ * Attaches the store to the specified flash circular buffer and loads its
+ * contents into RAM.  The caller fills in fcb->f_sectors and
+ * fcb->f_sector_cnt; at least two sectors are required, as one is always
+ * kept empty for compaction.
+ *
+ * @return                      0 on success; BLE_HS_EINVAL if the FCB could
+ *                                  not be initialized; BLE_HS_EOS on flash
+ *                                  error.
+ */
+int
+ble_store_fcb_init(struct fcb *fcb)
+{
+    int rc;
+
+    ble_store_fcb_reset();
+
+    fcb->f_magic = BLE_STORE_FCB_MAGIC;
+    fcb->f_version = BLE_STORE_FCB_VERS;
+    fcb->f_scratch_cnt = 1;
+
+    while (1) {
+        rc = fcb_init(fcb);
+        if (rc != 0) {
+            return BLE_HS_EINVAL;
+        }
+
+        /* Check if system was reset in middle of emptying a sector.  This
+         * situation is recognized by checking if the scratch block is
+         * missing.
+         */
+        if (fcb_free_sector_cnt(fcb) < 1) {
+            flash_area_erase(fcb->f_active.fe_area, 0,
+                             fcb->f_active.fe_area->fa_size);
+        } else {
+            break;
+        }
+    }
+
+    ble_store_fcb = fcb;
+
+    rc = fcb_walk(fcb, NULL, ble_store_fcb_load_cb, NULL);
+    if (rc != 0) {
+        return BLE_HS_EOS;
+    }
+
+    return 0;
+}
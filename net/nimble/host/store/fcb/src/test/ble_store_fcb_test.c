@@ -0,0 +1,397 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "testutil/testutil.h"
+#include "fcb/fcb.h"
+#include "host/ble_hs.h"
+#include "store/fcb/ble_store_fcb.h"
+
+static struct fcb ble_store_fcb_test_fcb;
+
+static struct flash_area ble_store_fcb_test_areas[] = {
+    [0] = {
+        .fa_flash_id = 0,
+        .fa_off = 0x00000000,
+        .fa_size = 16 * 1024
+    },
+    [1] = {
+        .fa_flash_id = 0,
+        .fa_off = 0x00004000,
+        .fa_size = 16 * 1024
+    },
+    [2] = {
+        .fa_flash_id = 0,
+        .fa_off = 0x00008000,
+        .fa_size = 16 * 1024
+    },
+};
+
+#define BLE_STORE_FCB_TEST_NUM_AREAS                        \
+    (sizeof ble_store_fcb_test_areas / sizeof ble_store_fcb_test_areas[0])
+
+static void
+ble_store_fcb_test_wipe(void)
+{
+    struct flash_area *fa;
+    int rc;
+    int i;
+
+    for (i = 0; i < BLE_STORE_FCB_TEST_NUM_AREAS; i++) {
+        fa = ble_store_fcb_test_areas + i;
+        rc = flash_area_erase(fa, 0, fa->fa_size);
+        TEST_ASSERT_FATAL(rc == 0);
+    }
+}
+
+/**
+ * (Re)initializes the store from flash, as happens after a reset.
+ */
+static void
+ble_store_fcb_test_load(void)
+{
+    int rc;
+
+    memset(&ble_store_fcb_test_fcb, 0, sizeof ble_store_fcb_test_fcb);
+    ble_store_fcb_test_fcb.f_sectors = ble_store_fcb_test_areas;
+    ble_store_fcb_test_fcb.f_sector_cnt = BLE_STORE_FCB_TEST_NUM_AREAS;
+
+    rc = ble_store_fcb_init(&ble_store_fcb_test_fcb);
+    TEST_ASSERT_FATAL(rc == 0);
+}
+
+static void
+ble_store_fcb_test_init(void)
+{
+    ble_store_fcb_test_wipe();
+    ble_store_fcb_test_load();
+}
+
+static int
+ble_store_fcb_test_count_cb(struct fcb_entry *loc, void *arg)
+{
+    (*(int *)arg)++;
+    return 0;
+}
+
+/** Returns the number of elements in the FCB. */
+static int
+ble_store_fcb_test_num_elems(void)
+{
+    int count;
+    int rc;
+
+    count = 0;
+    rc = fcb_walk(&ble_store_fcb_test_fcb, NULL, ble_store_fcb_test_count_cb,
+                  &count);
+    TEST_ASSERT_FATAL(rc == 0);
+
+    return count;
+}
+
+/** Returns the offset of the next FCB element to be written. */
+static uint32_t
+ble_store_fcb_test_flash_pos(void)
+{
+    return ble_store_fcb_test_fcb.f_active.fe_area->fa_off +
+           ble_store_fcb_test_fcb.f_active.fe_elem_off;
+}
+
+static void
+ble_store_fcb_test_cccd(struct ble_store_value_cccd *cccd, uint8_t peer_id,
+                        uint16_t chr_val_handle, int value_changed)
+{
+    uint8_t peer_addr[6] = { 1, 2, 3, 4, 5, 0 };
+
+    memset(cccd, 0, sizeof *cccd);
+    peer_addr[5] = peer_id;
+    memcpy(cccd->peer_addr, peer_addr, 6);
+    cccd->peer_addr_type = BLE_ADDR_TYPE_PUBLIC;
+    cccd->chr_val_handle = chr_val_handle;
+    cccd->flags = 0x0001;
+    cccd->value_changed = value_changed;
+}
+
+static void
+ble_store_fcb_test_sec(struct ble_store_value_sec *sec, uint8_t peer_id,
+                       uint8_t ltk_byte)
+{
+    uint8_t peer_addr[6] = { 6, 7, 8, 9, 10, 0 };
+
+    memset(sec, 0, sizeof *sec);
+    peer_addr[5] = peer_id;
+    memcpy(sec->peer_addr, peer_addr, 6);
+    sec->peer_addr_type = BLE_ADDR_TYPE_RANDOM;
+    sec->ediv = 0x1234;
+    sec->rand_num = 0x1122334455667788;
+    memset(sec->ltk, ltk_byte, sizeof sec->ltk);
+    sec->ltk_present = 1;
+}
+
+static int
+ble_store_fcb_test_write_cccd(struct ble_store_value_cccd *cccd)
+{
+    return ble_store_fcb_write(BLE_STORE_OBJ_TYPE_CCCD,
+                               (union ble_store_value *)cccd);
+}
+
+static int
+ble_store_fcb_test_read_cccd(uint8_t peer_id, uint16_t chr_val_handle,
+                             struct ble_store_value_cccd *out_cccd)
+{
+    struct ble_store_value_cccd cccd;
+    union ble_store_key key;
+
+    ble_store_fcb_test_cccd(&cccd, peer_id, chr_val_handle, 0);
+    ble_store_key_from_value_cccd(&key.cccd, &cccd);
+    return ble_store_fcb_read(BLE_STORE_OBJ_TYPE_CCCD, &key,
+                              (union ble_store_value *)out_cccd);
+}
+
+/**
+ * Counts the CCCDs for the specified handle, the way
+ * ble_gatts_chr_updated() enumerates them.
+ */
+static int
+ble_store_fcb_test_count_handle(uint16_t chr_val_handle)
+{
+    struct ble_store_value_cccd cccd;
+    union ble_store_key key;
+    int rc;
+
+    memset(&key, 0, sizeof key);
+    key.cccd.peer_addr_type = BLE_STORE_ADDR_TYPE_NONE;
+    key.cccd.chr_val_handle = chr_val_handle;
+
+    while (1) {
+        rc = ble_store_fcb_read(BLE_STORE_OBJ_TYPE_CCCD, &key,
+                                (union ble_store_value *)&cccd);
+        if (rc != 0) {
+            TEST_ASSERT(rc == BLE_HS_ENOENT);
+            return key.cccd.idx;
+        }
+        TEST_ASSERT(cccd.chr_val_handle == chr_val_handle);
+        key.cccd.idx++;
+    }
+}
+
+TEST_CASE(ble_store_fcb_test_case_persist)
+{
+    struct ble_store_value_cccd cccd;
+    struct ble_store_value_sec sec;
+    union ble_store_key key;
+    int rc;
+    int i;
+
+    ble_store_fcb_test_init();
+
+    ble_store_fcb_test_sec(&sec, 1, 0xaa);
+    rc = ble_store_fcb_write(BLE_STORE_OBJ_TYPE_PEER_SEC,
+                             (union ble_store_value *)&sec);
+    TEST_ASSERT_FATAL(rc == 0);
+
+    for (i = 0; i < 3; i++) {
+        ble_store_fcb_test_cccd(&cccd, i, 10, 0);
+        rc = ble_store_fcb_test_write_cccd(&cccd);
+        TEST_ASSERT_FATAL(rc == 0);
+    }
+    ble_store_fcb_test_cccd(&cccd, 0, 20, 0);
+    rc = ble_store_fcb_test_write_cccd(&cccd);
+    TEST_ASSERT_FATAL(rc == 0);
+
+    /* Everything survives a reset. */
+    ble_store_fcb_test_load();
+
+    memset(&key, 0, sizeof key);
+    ble_store_key_from_value_sec(&key.sec, &sec);
+    memset(&sec, 0, sizeof sec);
+    rc = ble_store_fcb_read(BLE_STORE_OBJ_TYPE_PEER_SEC, &key,
+                            (union ble_store_value *)&sec);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(sec.ltk_present);
+    TEST_ASSERT(sec.ltk[0] == 0xaa);
+
+    /* Only peer security material was written. */
+    rc = ble_store_fcb_read(BLE_STORE_OBJ_TYPE_OUR_SEC, &key,
+                            (union ble_store_value *)&sec);
+    TEST_ASSERT(rc == BLE_HS_ENOENT);
+
+    for (i = 0; i < 3; i++) {
+        rc = ble_store_fcb_test_read_cccd(i, 10, &cccd);
+        TEST_ASSERT(rc == 0);
+        TEST_ASSERT(cccd.flags == 0x0001);
+    }
+    TEST_ASSERT(ble_store_fcb_test_count_handle(10) == 3);
+    TEST_ASSERT(ble_store_fcb_test_count_handle(20) == 1);
+    TEST_ASSERT(ble_store_fcb_test_count_handle(30) == 0);
+}
+
+TEST_CASE(ble_store_fcb_test_case_defer)
+{
+    struct ble_store_value_cccd cccd;
+    uint32_t pos;
+    int num_elems;
+    int rc;
+    int i;
+
+    ble_store_fcb_test_init();
+
+    for (i = 0; i < 8; i++) {
+        ble_store_fcb_test_cccd(&cccd, i, 10, 0);
+        rc = ble_store_fcb_test_write_cccd(&cccd);
+        TEST_ASSERT_FATAL(rc == 0);
+    }
+
+    /* Rewriting an identical object does not touch flash. */
+    pos = ble_store_fcb_test_flash_pos();
+    rc = ble_store_fcb_test_write_cccd(&cccd);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(ble_store_fcb_test_flash_pos() == pos);
+
+    /* Setting the value-changed flag is deferred. */
+    ble_store_fcb_test_cccd(&cccd, 0, 10, 1);
+    rc = ble_store_fcb_test_write_cccd(&cccd);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(ble_store_fcb_test_flash_pos() == pos);
+
+    rc = ble_store_fcb_test_read_cccd(0, 10, &cccd);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(cccd.value_changed);
+
+    /* Unflushed flags are lost on reset. */
+    ble_store_fcb_test_load();
+    rc = ble_store_fcb_test_read_cccd(0, 10, &cccd);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(!cccd.value_changed);
+
+    /* A full batch of flag updates gets written as a single element. */
+    num_elems = ble_store_fcb_test_num_elems();
+    pos = ble_store_fcb_test_flash_pos();
+    for (i = 0; i < 8; i++) {
+        ble_store_fcb_test_cccd(&cccd, i, 10, 1);
+        rc = ble_store_fcb_test_write_cccd(&cccd);
+        TEST_ASSERT(rc == 0);
+        if (i < 7) {
+            TEST_ASSERT(ble_store_fcb_test_flash_pos() == pos);
+        }
+    }
+    TEST_ASSERT(ble_store_fcb_test_num_elems() == num_elems + 1);
+
+    /* An explicit flush writes a partial batch. */
+    ble_store_fcb_test_cccd(&cccd, 3, 10, 0);
+    rc = ble_store_fcb_test_write_cccd(&cccd);
+    TEST_ASSERT(rc == 0);
+    rc = ble_store_fcb_flush();
+    TEST_ASSERT(rc == 0);
+
+    ble_store_fcb_test_load();
+    for (i = 0; i < 8; i++) {
+        rc = ble_store_fcb_test_read_cccd(i, 10, &cccd);
+        TEST_ASSERT(rc == 0);
+        TEST_ASSERT(cccd.value_changed == (i != 3));
+    }
+}
+
+TEST_CASE(ble_store_fcb_test_case_delete)
+{
+    struct ble_store_value_cccd cccd;
+    union ble_store_key key;
+    int rc;
+
+    ble_store_fcb_test_init();
+
+    ble_store_fcb_test_cccd(&cccd, 1, 10, 0);
+    rc = ble_store_fcb_test_write_cccd(&cccd);
+    TEST_ASSERT_FATAL(rc == 0);
+    ble_store_fcb_test_cccd(&cccd, 2, 10, 0);
+    rc = ble_store_fcb_test_write_cccd(&cccd);
+    TEST_ASSERT_FATAL(rc == 0);
+
+    ble_store_key_from_value_cccd(&key.cccd, &cccd);
+    rc = ble_store_fcb_delete(BLE_STORE_OBJ_TYPE_CCCD, &key);
+    TEST_ASSERT(rc == 0);
+    rc = ble_store_fcb_delete(BLE_STORE_OBJ_TYPE_CCCD, &key);
+    TEST_ASSERT(rc == BLE_HS_ENOENT);
+
+    ble_store_fcb_test_load();
+    rc = ble_store_fcb_test_read_cccd(1, 10, &cccd);
+    TEST_ASSERT(rc == 0);
+    rc = ble_store_fcb_test_read_cccd(2, 10, &cccd);
+    TEST_ASSERT(rc == BLE_HS_ENOENT);
+    TEST_ASSERT(ble_store_fcb_test_count_handle(10) == 1);
+}
+
+TEST_CASE(ble_store_fcb_test_case_compress)
+{
+    struct ble_store_value_cccd cccd;
+    struct ble_store_value_sec sec;
+    union ble_store_key key;
+    int rc;
+    int i;
+
+    ble_store_fcb_test_init();
+
+    ble_store_fcb_test_cccd(&cccd, 1, 10, 0);
+    rc = ble_store_fcb_test_write_cccd(&cccd);
+    TEST_ASSERT_FATAL(rc == 0);
+
+    /* Rewrite one bond until the buffer has wrapped several times. */
+    for (i = 0; i < 2000; i++) {
+        ble_store_fcb_test_sec(&sec, 1, i);
+        rc = ble_store_fcb_write(BLE_STORE_OBJ_TYPE_OUR_SEC,
+                                 (union ble_store_value *)&sec);
+        TEST_ASSERT_FATAL(rc == 0);
+    }
+
+    ble_store_fcb_test_load();
+
+    rc = ble_store_fcb_test_read_cccd(1, 10, &cccd);
+    TEST_ASSERT(rc == 0);
+
+    memset(&key, 0, sizeof key);
+    ble_store_key_from_value_sec(&key.sec, &sec);
+    rc = ble_store_fcb_read(BLE_STORE_OBJ_TYPE_OUR_SEC, &key,
+                            (union ble_store_value *)&sec);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(sec.ltk[0] == (uint8_t)(i - 1));
+}
+
+TEST_SUITE(ble_store_fcb_test_suite)
+{
+    ble_store_fcb_test_case_persist();
+    ble_store_fcb_test_case_defer();
+    ble_store_fcb_test_case_delete();
+    ble_store_fcb_test_case_compress();
+}
+
+#ifdef MYNEWT_SELFTEST
+
+int
+main(int argc, char **argv)
+{
+    tu_config.tc_print_results = 1;
+    tu_init();
+
+    ble_store_fcb_test_suite();
+
+    return tu_any_failed;
+}
+
+#endif
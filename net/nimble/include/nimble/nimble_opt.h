@@ -285,6 +285,15 @@
 #define NIMBLE_OPT_LL_NUM_SCAN_DUP_ADVS         (8)
 #endif
 
+/*
+ * Number of hash buckets used to look up duplicate advertisers. Must be a
+ * power of 2. For fast lookups, use roughly one bucket per duplicate
+ * advertiser; each bucket costs two bytes.
+ */
+#ifndef NIMBLE_OPT_LL_SCAN_DUP_ADV_BUCKETS
+#define NIMBLE_OPT_LL_SCAN_DUP_ADV_BUCKETS      (8)
+#endif
+
 #ifndef NIMBLE_OPT_LL_NUM_SCAN_RSP_ADVS
 #define NIMBLE_OPT_LL_NUM_SCAN_RSP_ADVS         (8)
 #endif
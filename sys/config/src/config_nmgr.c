@@ -61,7 +61,7 @@ conf_nmgr_read(struct nmgr_jbuf *njb)
     };
     struct json_value jv;
 
-    rc = json_read_object(&njb->njb_buf, attr);
+    rc = nmgr_read_object(njb, attr);
     if (rc) {
         return OS_EINVAL;
     }
@@ -23,6 +23,9 @@
 #include "util/cbmem.h"
 
 #include <os/queue.h>
+#ifdef LOG_FCB_COMPRESS
+#include <os/os_mutex.h>
+#endif
 
 /* Global log info */
 struct log_info {
@@ -191,6 +194,60 @@ struct fcb;
 int log_fcb_handler_init(struct log_handler *, struct fcb *,
                          uint8_t entries);
 
+#ifdef LOG_FCB_COMPRESS
+/*
+ * Compressed FCB logs.  Entries are collected in RAM and written to the FCB
+ * as one LZSS-compressed batch once the batch buffer fills up (or when
+ * log_fcb_batch_commit() is called).  Reads and walks still present the
+ * log one entry at a time.  Use a different FCB magic than for plain FCB
+ * logs; the two on-flash formats cannot be mixed.
+ */
+#ifndef LOG_FCB_BATCH_SIZE
+#define LOG_FCB_BATCH_SIZE          (512)
+#endif
+
+/* Batch is LZSS compressed; otherwise it is stored as is. */
+#define LOG_FCB_BATCH_F_LZSS        (0x01)
+
+/* Header of each FCB element holding a batch of log entries. */
+struct log_fcb_batch_hdr {
+    uint16_t lbh_raw_len;
+    uint8_t lbh_flags;
+    uint8_t _pad;
+} __attribute__((__packed__));
+#define LOG_FCB_BATCH_HDR_SIZE      (sizeof(struct log_fcb_batch_hdr))
+
+struct log_fcb_batch {
+    struct os_mutex lfb_mtx;
+
+    /* Pending entries, each one prefixed by a 16-bit little endian length.
+     * Space for the batch header is reserved at the front.
+     */
+    uint8_t lfb_buf[LOG_FCB_BATCH_HDR_SIZE + LOG_FCB_BATCH_SIZE];
+    uint16_t lfb_len;
+
+    /* Compression output when writing, decompressed batch when reading. */
+    uint8_t lfb_work[LOG_FCB_BATCH_HDR_SIZE + LOG_FCB_BATCH_SIZE];
+
+    /* Set while the log is being walked; the walk callback cannot append
+     * to, commit, flush or walk the same log.
+     */
+    uint8_t lfb_walking;
+
+    /* Totals since init: entries and bytes before and after compression
+     * (including batch headers), and the cputime ticks spent compressing.
+     */
+    uint32_t lfb_entries;
+    uint32_t lfb_raw_bytes;
+    uint32_t lfb_comp_bytes;
+    uint32_t lfb_comp_ticks;
+};
+
+int log_fcb_compress_handler_init(struct log_handler *, struct fcb *,
+                                  uint8_t entries, struct log_fcb_batch *);
+int log_fcb_batch_commit(struct log *log);
+#endif
+
 /* Private */
 #ifdef NEWTMGR_PRESENT
 int log_nmgr_register_group(void);
@@ -47,13 +47,16 @@ log_cbmem_read(struct log *log, void *dptr, void *buf, uint16_t offset,
         uint16_t len)
 {
     struct cbmem *cbmem;
-    struct cbmem_entry_hdr *hdr;
+    struct cbmem_iter *iter;
     int rc;
 
+    /* Entries are handed to walkers by iterator, so that entries which get
+     * overwritten while being read are detected.
+     */
     cbmem = (struct cbmem *) log->l_log->log_arg;
-    hdr = (struct cbmem_entry_hdr *) dptr;
+    iter = (struct cbmem_iter *) dptr;
 
-    rc = cbmem_read(cbmem, hdr, buf, offset, len);
+    rc = cbmem_iter_read(cbmem, iter, buf, offset, len);
 
     return (rc);
 }
@@ -80,7 +83,7 @@ log_cbmem_walk(struct log *log, log_walk_func_t walk_func, void *arg)
             break;
         }
 
-        rc = walk_func(log, arg, (void *)hdr, hdr->ceh_len);
+        rc = walk_func(log, arg, (void *)&iter, iter.ci_last_len);
         if (rc == 1) {
             break;
         }
@@ -24,19 +24,30 @@
 #include <hal/flash_map.h>
 #include <fcb/fcb.h>
 
+#ifdef LOG_FCB_COMPRESS
+#include <hal/hal_cputime.h>
+#include <util/lzss.h>
+#endif
+
 #include "log/log.h"
 
 static struct flash_area sector;
 struct fcb_log {
     uint8_t fl_entries;
     struct fcb *fl_fcb;
+#ifdef LOG_FCB_COMPRESS
+    struct log_fcb_batch *fl_batch;
+#endif
 } fcb_log;
 
+/**
+ * Reserves space for a new FCB element, making room by erasing old
+ * entries if the FCB is full.
+ */
 static int
-log_fcb_append(struct log *log, void *buf, int len)
+log_fcb_start_append(struct log *log, int len, struct fcb_entry *loc)
 {
     struct fcb *fcb;
-    struct fcb_entry loc;
     struct fcb_log *fcb_log;
     int rc;
 
@@ -44,7 +55,7 @@ log_fcb_append(struct log *log, void *buf, int len)
     fcb = fcb_log->fl_fcb;
 
     while (1) {
-        rc = fcb_append(fcb, len, &loc);
+        rc = fcb_append(fcb, len, loc);
         if (rc == 0) {
             break;
         }
@@ -67,12 +78,333 @@ log_fcb_append(struct log *log, void *buf, int len)
         }
     }
 
+err:
+    return (rc);
+}
+
+#ifdef LOG_FCB_COMPRESS
+
+static void
+log_fcb_put_le16(uint8_t *dst, uint16_t val)
+{
+    dst[0] = val;
+    dst[1] = val >> 8;
+}
+
+static uint16_t
+log_fcb_get_le16(const uint8_t *src)
+{
+    return src[0] | (src[1] << 8);
+}
+
+/**
+ * Locks the batch.  Fails with OS_EINVAL when called from within a walk of
+ * the same log (the mutex nests), as the walk is reading out of the batch
+ * buffers which appends, commits and walks would overwrite.
+ */
+static int
+log_fcb_batch_lock(struct log_fcb_batch *batch)
+{
+    int rc;
+
+    rc = os_mutex_pend(&batch->lfb_mtx, OS_WAIT_FOREVER);
+    if (rc && rc != OS_NOT_STARTED) {
+        return rc;
+    }
+    if (batch->lfb_walking) {
+        os_mutex_release(&batch->lfb_mtx);
+        return OS_EINVAL;
+    }
+    return 0;
+}
+
+static void
+log_fcb_batch_unlock(struct log_fcb_batch *batch)
+{
+    os_mutex_release(&batch->lfb_mtx);
+}
+
+/**
+ * Compresses the pending entries and writes them to the FCB as a single
+ * element.  Must be called with the batch locked.
+ */
+static int
+log_fcb_batch_write(struct log *log, struct log_fcb_batch *batch)
+{
+    struct log_fcb_batch_hdr *hdr;
+    struct fcb_entry loc;
+    uint32_t start;
+    uint8_t *data;
+    int dlen;
+    int rc;
+
+    if (batch->lfb_len == 0) {
+        return 0;
+    }
+
+    /* Only keep the compressed form if it actually saves space. */
+    start = cputime_get32();
+    dlen = lzss_encode(batch->lfb_buf + LOG_FCB_BATCH_HDR_SIZE,
+                       batch->lfb_len,
+                       batch->lfb_work + LOG_FCB_BATCH_HDR_SIZE,
+                       batch->lfb_len - 1);
+    batch->lfb_comp_ticks += cputime_get32() - start;
+
+    if (dlen > 0) {
+        data = batch->lfb_work;
+    } else {
+        data = batch->lfb_buf;
+        dlen = batch->lfb_len;
+    }
+    hdr = (struct log_fcb_batch_hdr *)data;
+    hdr->lbh_raw_len = batch->lfb_len;
+    hdr->lbh_flags = (data == batch->lfb_work) ? LOG_FCB_BATCH_F_LZSS : 0;
+    hdr->_pad = 0;
+    dlen += LOG_FCB_BATCH_HDR_SIZE;
+
+    rc = log_fcb_start_append(log, dlen, &loc);
+    if (rc) {
+        goto err;
+    }
+
+    rc = flash_area_write(loc.fe_area, loc.fe_data_off, data, dlen);
+    if (rc) {
+        goto err;
+    }
+
+    rc = fcb_append_finish(((struct fcb_log *)log->l_log->log_arg)->fl_fcb,
+                           &loc);
+    if (rc) {
+        goto err;
+    }
+
+    batch->lfb_raw_bytes += batch->lfb_len;
+    batch->lfb_comp_bytes += dlen;
+
+err:
+    /* The entries are dropped on failure; retrying would wedge the log. */
+    batch->lfb_len = 0;
+    return (rc);
+}
+
+static int
+log_fcb_batch_append(struct log *log, struct log_fcb_batch *batch,
+                     void *buf, int len)
+{
+    uint8_t *dst;
+    int rc;
+
+    if (len + 2 > LOG_FCB_BATCH_SIZE) {
+        return OS_EINVAL;
+    }
+
+    rc = log_fcb_batch_lock(batch);
+    if (rc) {
+        return rc;
+    }
+
+    if (batch->lfb_len + 2 + len > LOG_FCB_BATCH_SIZE) {
+        rc = log_fcb_batch_write(log, batch);
+        if (rc) {
+            /* Don't start a new batch behind the one that was lost. */
+            goto done;
+        }
+    }
+
+    dst = batch->lfb_buf + LOG_FCB_BATCH_HDR_SIZE + batch->lfb_len;
+    log_fcb_put_le16(dst, len);
+    memcpy(dst + 2, buf, len);
+    batch->lfb_len += 2 + len;
+    batch->lfb_entries++;
+
+done:
+    log_fcb_batch_unlock(batch);
+
+    return (rc);
+}
+
+/**
+ * Reads one batch from flash and decompresses it into the work buffer.
+ * Must be called with the batch locked.
+ *
+ * @return                      Length of the decompressed batch; negative
+ *                                  on error.
+ */
+static int
+log_fcb_batch_load(struct log_fcb_batch *batch, struct fcb_entry *loc)
+{
+    struct log_fcb_batch_hdr hdr;
+    struct lzss_dec dec;
+    uint8_t chunk[32];
+    uint16_t off;
+    int dlen;
+    int rc;
+
+    if (loc->fe_data_len < LOG_FCB_BATCH_HDR_SIZE) {
+        return -1;
+    }
+    rc = flash_area_read(loc->fe_area, loc->fe_data_off, &hdr, sizeof(hdr));
+    if (rc) {
+        return -1;
+    }
+    if (hdr.lbh_raw_len > LOG_FCB_BATCH_SIZE) {
+        return -1;
+    }
+
+    if (!(hdr.lbh_flags & LOG_FCB_BATCH_F_LZSS)) {
+        if (loc->fe_data_len != hdr.lbh_raw_len + sizeof(hdr)) {
+            return -1;
+        }
+        rc = flash_area_read(loc->fe_area, loc->fe_data_off + sizeof(hdr),
+                             batch->lfb_work, hdr.lbh_raw_len);
+        if (rc) {
+            return -1;
+        }
+        return hdr.lbh_raw_len;
+    }
+
+    lzss_dec_init(&dec, batch->lfb_work, hdr.lbh_raw_len);
+    for (off = sizeof(hdr); off < loc->fe_data_len; off += dlen) {
+        dlen = min(loc->fe_data_len - off, sizeof(chunk));
+        rc = flash_area_read(loc->fe_area, loc->fe_data_off + off, chunk,
+                             dlen);
+        if (rc) {
+            return -1;
+        }
+        rc = lzss_dec_feed(&dec, chunk, dlen);
+        if (rc) {
+            return -1;
+        }
+    }
+    if (dec.ld_off != hdr.lbh_raw_len) {
+        return -1;
+    }
+
+    return hdr.lbh_raw_len;
+}
+
+/**
+ * Hands each entry in a decompressed batch to the walk function.  The
+ * entry pointer passed as dptr is what log_fcb_read() expects.
+ */
+static int
+log_fcb_batch_walk_buf(struct log *log, uint8_t *buf, int len,
+                       log_walk_func_t walk_func, void *arg)
+{
+    uint16_t elen;
+    int off;
+    int rc;
+
+    for (off = 0; off + 2 <= len; off += 2 + elen) {
+        elen = log_fcb_get_le16(buf + off);
+        if (off + 2 + elen > len) {
+            break;
+        }
+        rc = walk_func(log, arg, buf + off, elen);
+        if (rc) {
+            return rc;
+        }
+    }
+    return 0;
+}
+
+static int
+log_fcb_batch_walk(struct log *log, struct log_fcb_batch *batch,
+                   log_walk_func_t walk_func, void *arg)
+{
+    struct fcb *fcb;
+    struct fcb_entry loc;
+    int len;
+    int rc;
+
+    fcb = ((struct fcb_log *)log->l_log->log_arg)->fl_fcb;
+
+    rc = log_fcb_batch_lock(batch);
+    if (rc) {
+        return rc;
+    }
+    batch->lfb_walking = 1;
+
+    memset(&loc, 0, sizeof(loc));
+    while (fcb_getnext(fcb, &loc) == 0) {
+        len = log_fcb_batch_load(batch, &loc);
+        if (len < 0) {
+            /* Skip corrupt batches. */
+            continue;
+        }
+        rc = log_fcb_batch_walk_buf(log, batch->lfb_work, len, walk_func,
+                                    arg);
+        if (rc) {
+            goto done;
+        }
+    }
+
+    /* Entries not yet written to flash come last. */
+    rc = log_fcb_batch_walk_buf(log, batch->lfb_buf + LOG_FCB_BATCH_HDR_SIZE,
+                                batch->lfb_len, walk_func, arg);
+
+done:
+    batch->lfb_walking = 0;
+    log_fcb_batch_unlock(batch);
+    return (rc);
+}
+
+/**
+ * Writes any pending entries of a compressed FCB log to flash.
+ *
+ * @param log                   The log to commit.
+ *
+ * @return                      0 on success; non-zero on failure.
+ */
+int
+log_fcb_batch_commit(struct log *log)
+{
+    struct log_fcb_batch *batch;
+    int rc;
+
+    batch = ((struct fcb_log *)log->l_log->log_arg)->fl_batch;
+    if (batch == NULL) {
+        return 0;
+    }
+
+    rc = log_fcb_batch_lock(batch);
+    if (rc) {
+        return rc;
+    }
+    rc = log_fcb_batch_write(log, batch);
+    log_fcb_batch_unlock(batch);
+
+    return (rc);
+}
+
+#endif /* LOG_FCB_COMPRESS */
+
+static int
+log_fcb_append(struct log *log, void *buf, int len)
+{
+    struct fcb_entry loc;
+    struct fcb_log *fcb_log;
+    int rc;
+
+    fcb_log = (struct fcb_log *)log->l_log->log_arg;
+
+#ifdef LOG_FCB_COMPRESS
+    if (fcb_log->fl_batch) {
+        return log_fcb_batch_append(log, fcb_log->fl_batch, buf, len);
+    }
+#endif
+
+    rc = log_fcb_start_append(log, len, &loc);
+    if (rc) {
+        goto err;
+    }
+
     rc = flash_area_write(loc.fe_area, loc.fe_data_off, buf, len);
     if (rc) {
         goto err;
     }
 
-    rc = fcb_append_finish(fcb, &loc);
+    rc = fcb_append_finish(fcb_log->fl_fcb, &loc);
 
 err:
     return (rc);
@@ -85,6 +417,23 @@ log_fcb_read(struct log *log, void *dptr, void *buf, uint16_t offset,
     struct fcb_entry *loc;
     int rc;
 
+#ifdef LOG_FCB_COMPRESS
+    uint16_t elen;
+
+    /* Entries of compressed logs are walked from RAM. */
+    if (((struct fcb_log *)log->l_log->log_arg)->fl_batch) {
+        elen = log_fcb_get_le16(dptr);
+        if (offset >= elen) {
+            return 0;
+        }
+        if (offset + len > elen) {
+            len = elen - offset;
+        }
+        memcpy(buf, (uint8_t *)dptr + 2 + offset, len);
+        return len;
+    }
+#endif
+
     loc = (struct fcb_entry *)dptr;
 
     if (offset + len > loc->fe_data_len) {
@@ -105,6 +454,15 @@ log_fcb_walk(struct log *log, log_walk_func_t walk_func, void *arg)
     struct fcb_entry loc;
     int rc;
 
+#ifdef LOG_FCB_COMPRESS
+    struct log_fcb_batch *batch;
+
+    batch = ((struct fcb_log *)log->l_log->log_arg)->fl_batch;
+    if (batch) {
+        return log_fcb_batch_walk(log, batch, walk_func, arg);
+    }
+#endif
+
     rc = 0;
     fcb = ((struct fcb_log *)log->l_log->log_arg)->fl_fcb;
 
@@ -122,13 +480,31 @@ log_fcb_walk(struct log *log, log_walk_func_t walk_func, void *arg)
 static int
 log_fcb_flush(struct log *log)
 {
+#ifdef LOG_FCB_COMPRESS
+    struct log_fcb_batch *batch;
+    int rc;
+
+    batch = ((struct fcb_log *)log->l_log->log_arg)->fl_batch;
+    if (batch) {
+        rc = log_fcb_batch_lock(batch);
+        if (rc) {
+            return rc;
+        }
+        batch->lfb_len = 0;
+        rc = fcb_clear(((struct fcb_log *)log->l_log->log_arg)->fl_fcb);
+        log_fcb_batch_unlock(batch);
+        return rc;
+    }
+#endif
 
     return fcb_clear(((struct fcb_log *)log->l_log->log_arg)->fl_fcb);
 
 }
 
 /**
- * Copies one log entry from source fcb to destination fcb
+ * Copies one FCB element from source fcb to destination fcb.  The element
+ * is copied verbatim, so this works for both plain entries and compressed
+ * batches.
  * @param src_fcb, dst_fcb
  * @return 0 on success; non-zero on error
  */
@@ -136,45 +512,41 @@ static int
 log_fcb_copy_entry(struct log *log, struct fcb_entry *entry,
                    struct fcb *dst_fcb)
 {
-    struct log_entry_hdr ueh;
-    char data[LOG_PRINTF_MAX_ENTRY_LEN + sizeof(ueh)];
+    struct fcb_entry loc;
+    uint8_t data[32];
+    uint16_t off;
     int dlen;
     int rc;
-    struct fcb *fcb_tmp;
-    uint8_t entries_tmp;
-
-    rc = log_fcb_read(log, entry, &ueh, 0, sizeof(ueh));
-    if (rc != sizeof(ueh)) {
-        goto err;
-    }
-
-    dlen = min(entry->fe_data_len, LOG_PRINTF_MAX_ENTRY_LEN + sizeof(ueh));
 
-    rc = log_fcb_read(log, entry, data, 0, dlen);
-    if (rc < 0) {
-        goto err;
+    while (1) {
+        rc = fcb_append(dst_fcb, entry->fe_data_len, &loc);
+        if (rc != FCB_ERR_NOSPACE) {
+            break;
+        }
+        rc = fcb_rotate(dst_fcb);
+        if (rc) {
+            goto err;
+        }
     }
-    data[rc] = '\0';
-
-    /* Changing the fcb to be logged to be dst fcb */
-    fcb_tmp = ((struct fcb_log *)log->l_log->log_arg)->fl_fcb;
-
-    entries_tmp = ((struct fcb_log *)log->l_log->log_arg)->fl_entries;
-
-    rc = log_fcb_handler_init(log->l_log, dst_fcb, 0);
     if (rc) {
         goto err;
     }
 
-    rc = log_fcb_append(log, data, dlen);
-    if (rc) {
-        goto err;
+    for (off = 0; off < entry->fe_data_len; off += dlen) {
+        dlen = min(entry->fe_data_len - off, sizeof(data));
+        rc = flash_area_read(entry->fe_area, entry->fe_data_off + off, data,
+                             dlen);
+        if (rc) {
+            goto err;
+        }
+        rc = flash_area_write(loc.fe_area, loc.fe_data_off + off, data,
+                              dlen);
+        if (rc) {
+            goto err;
+        }
     }
 
-    rc = log_fcb_handler_init(log->l_log, fcb_tmp, entries_tmp);
-    if (rc) {
-        goto err;
-    }
+    rc = fcb_append_finish(dst_fcb, &loc);
 
 err:
     return (rc);
@@ -263,8 +635,8 @@ log_fcb_rtr_erase(struct log *log, void *arg)
         goto err;
     }
 
-    /* Flush log */
-    rc = log_fcb_flush(log);
+    /* Flush log; any pending batch is kept */
+    rc = fcb_clear(fcb);
     if (rc) {
         goto err;
     }
@@ -287,9 +659,46 @@ log_fcb_handler_init(struct log_handler *handler, struct fcb *fcb, uint8_t entri
     handler->log_rtr_erase = log_fcb_rtr_erase;
     fcb_log.fl_entries = entries;
     fcb_log.fl_fcb = fcb;
+#ifdef LOG_FCB_COMPRESS
+    fcb_log.fl_batch = NULL;
+#endif
     handler->log_arg = &fcb_log;
 
     return 0;
 }
 
+#ifdef LOG_FCB_COMPRESS
+/**
+ * Initializes an FCB log handler which stores entries in compressed
+ * batches.
+ *
+ * @param handler               The handler to initialize.
+ * @param fcb                   The FCB backing the log.
+ * @param entries               Number of FCB elements to keep when the log
+ *                                  wraps; with compression each element
+ *                                  is a batch of entries.
+ * @param batch                 RAM for collecting and decompressing
+ *                                  batches.
+ *
+ * @return                      0 on success; non-zero on failure.
+ */
+int
+log_fcb_compress_handler_init(struct log_handler *handler, struct fcb *fcb,
+                              uint8_t entries, struct log_fcb_batch *batch)
+{
+    int rc;
+
+    rc = log_fcb_handler_init(handler, fcb, entries);
+    if (rc) {
+        return rc;
+    }
+
+    memset(batch, 0, sizeof(*batch));
+    os_mutex_init(&batch->lfb_mtx);
+    fcb_log.fl_batch = batch;
+
+    return 0;
+}
+#endif
+
 #endif
@@ -45,8 +45,10 @@ static struct nmgr_group log_nmgr_group;
  * Each element represents the command ID, referenced from newtmgr.
  */
 static struct nmgr_handler log_nmgr_group_handlers[] = {
-    [LOGS_NMGR_OP_READ] = {log_nmgr_read, log_nmgr_read},
-    [LOGS_NMGR_OP_CLEAR] = {log_nmgr_clear, log_nmgr_clear},
+    [LOGS_NMGR_OP_READ] = {log_nmgr_read, log_nmgr_read,
+        NMGR_HANDLER_F_SLOW},
+    [LOGS_NMGR_OP_CLEAR] = {log_nmgr_clear, log_nmgr_clear,
+        NMGR_HANDLER_F_SLOW},
     [LOGS_NMGR_OP_MODULE_LIST] = {log_nmgr_module_list, NULL},
     [LOGS_NMGR_OP_LEVEL_LIST] = {log_nmgr_level_list, NULL},
     [LOGS_NMGR_OP_LOGS_LIST] = {log_nmgr_logs_list, NULL}
@@ -258,12 +260,12 @@ log_nmgr_read(struct nmgr_jbuf *njb)
         }
     };
 
-    rc = json_read_object(&njb->njb_buf, attr);
+    rc = nmgr_read_object(njb, attr);
     if (rc) {
         return rc;
     }
 
-    encoder = (struct json_encoder *) &nmgr_task_jbuf.njb_enc;
+    encoder = (struct json_encoder *) &njb->njb_enc;
 
     json_encode_object_start(encoder);
     json_encode_array_name(encoder, "logs");
@@ -325,7 +327,7 @@ log_nmgr_module_list(struct nmgr_jbuf *njb)
     int module;
     char *str;
 
-    encoder = (struct json_encoder *) &nmgr_task_jbuf.njb_enc;
+    encoder = (struct json_encoder *) &njb->njb_enc;
 
     json_encode_object_start(encoder);
     JSON_VALUE_INT(&jv, NMGR_ERR_EOK);
@@ -366,7 +368,7 @@ log_nmgr_logs_list(struct nmgr_jbuf *njb)
     struct json_encoder *encoder;
     struct log *log;
 
-    encoder = (struct json_encoder *) &nmgr_task_jbuf.njb_enc;
+    encoder = (struct json_encoder *) &njb->njb_enc;
 
     json_encode_object_start(encoder);
     JSON_VALUE_INT(&jv, NMGR_ERR_EOK);
@@ -408,7 +410,7 @@ log_nmgr_level_list(struct nmgr_jbuf *njb)
     int level;
     char *str;
 
-    encoder = (struct json_encoder *) &nmgr_task_jbuf.njb_enc;
+    encoder = (struct json_encoder *) &njb->njb_enc;
 
     json_encode_object_start(encoder);
     JSON_VALUE_INT(&jv, NMGR_ERR_EOK);
@@ -465,7 +467,7 @@ log_nmgr_clear(struct nmgr_jbuf *njb)
         }
     }
 
-    encoder = (struct json_encoder *) &nmgr_task_jbuf.njb_enc;
+    encoder = (struct json_encoder *) &njb->njb_enc;
 
     json_encode_object_start(encoder);
     json_encode_object_finish(encoder);
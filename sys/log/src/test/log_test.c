@@ -16,6 +16,7 @@
  * specific language governing permissions and limitations
  * under the License.
  */
+#include <stdio.h>
 #include <string.h>
 
 #include <os/os.h>
@@ -137,12 +138,228 @@ TEST_CASE(log_flush_fcb)
     TEST_ASSERT(rc == 0);
 }
 
+#ifdef LOG_FCB_COMPRESS
+
+static struct log_fcb_batch log_fcb_batch;
+static struct log my_clog;
+
+#define LOG_TEST_CLOG_CNT   200
+
+TEST_CASE(log_setup_fcb_compress)
+{
+    int rc;
+    int i;
+
+    for (i = 0; i < log_fcb.f_sector_cnt; i++) {
+        rc = flash_area_erase(&fcb_areas[i], 0, fcb_areas[i].fa_size);
+        TEST_ASSERT(rc == 0);
+    }
+    log_fcb.f_magic = 0x7EADBAD0;
+    rc = fcb_init(&log_fcb);
+    TEST_ASSERT(rc == 0);
+    rc = log_fcb_compress_handler_init(&log_fcb_handler, &log_fcb, 0,
+                                       &log_fcb_batch);
+    TEST_ASSERT(rc == 0);
+
+    log_register("clog", &my_clog, &log_fcb_handler);
+}
+
+TEST_CASE(log_append_fcb_compress)
+{
+    int i;
+
+    for (i = 0; i < LOG_TEST_CLOG_CNT; i++) {
+        log_printf(&my_clog, 0, 0, "conn_evt handle=%d seq=%d", i % 4, i);
+    }
+
+    /* Most entries are on flash, some are still pending in RAM. */
+    TEST_ASSERT(log_fcb_batch.lfb_raw_bytes > 0);
+    TEST_ASSERT(log_fcb_batch.lfb_len > 0);
+
+    /* Repetitive text must compress. */
+    TEST_ASSERT(log_fcb_batch.lfb_comp_bytes <
+                log_fcb_batch.lfb_raw_bytes / 2);
+}
+
+static int
+log_test_walk_compress(struct log *log, void *arg, void *dptr, uint16_t len)
+{
+    struct log_entry_hdr ueh;
+    char expected[64];
+    char data[64];
+    int *idx;
+    int dlen;
+    int rc;
+
+    idx = arg;
+
+    rc = log_read(log, dptr, &ueh, 0, sizeof(ueh));
+    TEST_ASSERT(rc == sizeof(ueh));
+
+    dlen = len - sizeof(ueh);
+    TEST_ASSERT_FATAL(dlen < sizeof(data));
+
+    rc = log_read(log, dptr, data, sizeof(ueh), dlen);
+    TEST_ASSERT(rc == dlen);
+    data[rc] = '\0';
+
+    sprintf(expected, "conn_evt handle=%d seq=%d", *idx % 4, *idx);
+    TEST_ASSERT(strcmp(data, expected) == 0);
+    (*idx)++;
+
+    return 0;
+}
+
+static int
+log_test_walk_cnt(struct log *log, void *arg, void *dptr, uint16_t len)
+{
+    (*(int *)arg)++;
+    return 0;
+}
+
+TEST_CASE(log_walk_fcb_compress)
+{
+    int idx;
+    int rc;
+
+    idx = 0;
+    rc = log_walk(&my_clog, log_test_walk_compress, &idx);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(idx == LOG_TEST_CLOG_CNT);
+
+    /* Same entries once everything has been written to flash. */
+    rc = log_fcb_batch_commit(&my_clog);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(log_fcb_batch.lfb_len == 0);
+
+    idx = 0;
+    rc = log_walk(&my_clog, log_test_walk_compress, &idx);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(idx == LOG_TEST_CLOG_CNT);
+}
+
+TEST_CASE(log_flush_fcb_compress)
+{
+    int rc;
+
+    log_printf(&my_clog, 0, 0, "pending");
+
+    rc = log_flush(&my_clog);
+    TEST_ASSERT(rc == 0);
+
+    rc = log_walk(&my_clog, log_test_walk2, NULL);
+    TEST_ASSERT(rc == 0);
+}
+
+static int
+log_test_walk_append(struct log *log, void *arg, void *dptr, uint16_t len)
+{
+    uint8_t buf[LOG_ENTRY_HDR_SIZE + 8];
+    int *cnt;
+    int rc;
+
+    cnt = arg;
+
+    /* The walk is reading out of the batch; it must be left alone. */
+    rc = log_append(log, 0, 0, buf, 8);
+    TEST_ASSERT(rc == OS_EINVAL);
+    rc = log_fcb_batch_commit(log);
+    TEST_ASSERT(rc == OS_EINVAL);
+    rc = log_walk(log, log_test_walk2, NULL);
+    TEST_ASSERT(rc == OS_EINVAL);
+
+    (*cnt)++;
+    return 0;
+}
+
+TEST_CASE(log_walk_append_fcb_compress)
+{
+    uint8_t buf[LOG_ENTRY_HDR_SIZE + 8];
+    int cnt1;
+    int cnt2;
+    int rc;
+
+    log_printf(&my_clog, 0, 0, "one");
+    log_printf(&my_clog, 0, 0, "two");
+
+    cnt1 = 0;
+    rc = log_walk(&my_clog, log_test_walk_append, &cnt1);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(cnt1 == 2);
+
+    /* Nothing was added, and appending works again once the walk is done. */
+    cnt2 = 0;
+    rc = log_walk(&my_clog, log_test_walk_cnt, &cnt2);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(cnt2 == cnt1);
+
+    memset(buf, 'a', sizeof(buf));
+    rc = log_append(&my_clog, 0, 0, buf, 8);
+    TEST_ASSERT(rc == 0);
+}
+
+TEST_CASE(log_append_fail_fcb_compress)
+{
+    uint8_t buf[LOG_ENTRY_HDR_SIZE + 32];
+    uint32_t entries;
+    int cnt;
+    int rc;
+    int i;
+
+    rc = log_fcb_batch_commit(&my_clog);
+    TEST_ASSERT_FATAL(rc == 0);
+
+    /* Fill the batch up to where the next entry forces a write. */
+    memset(buf, 'b', sizeof(buf));
+    while (log_fcb_batch.lfb_len + 2 + sizeof(buf) <= LOG_FCB_BATCH_SIZE) {
+        rc = log_append(&my_clog, 0, 0, buf, 32);
+        TEST_ASSERT_FATAL(rc == 0);
+    }
+
+    cnt = 0;
+    rc = log_walk(&my_clog, log_test_walk_cnt, &cnt);
+    TEST_ASSERT(rc == 0);
+
+    /* Writing the batch fails; the new entry is not appended either. */
+    for (i = 0; i < log_fcb.f_sector_cnt; i++) {
+        fcb_areas[i].fa_flash_id = 99;
+    }
+    entries = log_fcb_batch.lfb_entries;
+    rc = log_append(&my_clog, 0, 0, buf, 32);
+    TEST_ASSERT(rc != 0);
+    TEST_ASSERT(log_fcb_batch.lfb_len == 0);
+    TEST_ASSERT(log_fcb_batch.lfb_entries == entries);
+    for (i = 0; i < log_fcb.f_sector_cnt; i++) {
+        fcb_areas[i].fa_flash_id = 0;
+    }
+
+    /* The failed batch is gone; later appends start a new one. */
+    i = 0;
+    rc = log_walk(&my_clog, log_test_walk_cnt, &i);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(i < cnt);
+
+    rc = log_append(&my_clog, 0, 0, buf, 32);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(log_fcb_batch.lfb_len == 2 + sizeof(buf));
+}
+
+#endif
+
 TEST_SUITE(log_test_all)
 {
     log_setup_fcb();
     log_append_fcb();
     log_walk_fcb();
     log_flush_fcb();
+#ifdef LOG_FCB_COMPRESS
+    log_setup_fcb_compress();
+    log_append_fcb_compress();
+    log_walk_fcb_compress();
+    log_flush_fcb_compress();
+    log_walk_append_fcb_compress();
+    log_append_fail_fcb_compress();
+#endif
 }
 
 #ifdef MYNEWT_SELFTEST
@@ -57,10 +57,51 @@ STATS_SECT_DECL(__name) {                   \
 #define STATS_SIZE_32 (sizeof(uint32_t))
 #define STATS_SIZE_64 (sizeof(uint64_t))
 
+/*
+ * Gauges track the minimum, maximum and mean of recorded values.
+ * Histograms additionally count values in log2 buckets: bucket 0 holds
+ * zeros, bucket n holds values in [2^(n-1), 2^n), and the last bucket
+ * holds everything above.
+ *
+ * All entries of a section must be of the same kind; the entry size tells
+ * them apart.  Use e.g. STATS_SIZE_INIT_PARMS(sect, STATS_SIZE_HIST) for a
+ * section of histograms.
+ */
+/* Packed to 4-byte alignment so that entries follow the section header
+ * without padding.
+ */
+struct stats_gauge {
+    uint64_t sg_sum;
+    uint32_t sg_min;
+    uint32_t sg_max;
+    uint32_t sg_cnt;
+} __attribute__((packed, aligned(4)));
+
+#ifndef STATS_HIST_BUCKETS
+#define STATS_HIST_BUCKETS (16)
+#endif
+
+/* A 32-bit value never goes past bucket 32.  This also keeps the entry
+ * size within the 8-bit stats_hdr.s_size.
+ */
+#if STATS_HIST_BUCKETS < 2 || STATS_HIST_BUCKETS > 33
+#error "STATS_HIST_BUCKETS must be between 2 and 33"
+#endif
+
+struct stats_hist {
+    struct stats_gauge sh_gauge;
+    uint32_t sh_buckets[STATS_HIST_BUCKETS];
+};
+
+#define STATS_SIZE_GAUGE (sizeof(struct stats_gauge))
+#define STATS_SIZE_HIST (sizeof(struct stats_hist))
+
 #define STATS_SECT_ENTRY(__var) uint32_t STATS_SECT_VAR(__var);
 #define STATS_SECT_ENTRY16(__var) uint16_t STATS_SECT_VAR(__var);
 #define STATS_SECT_ENTRY32(__var) uint32_t STATS_SECT_VAR(__var);
 #define STATS_SECT_ENTRY64(__var) uint64_t STATS_SECT_VAR(__var);
+#define STATS_SECT_GAUGE(__var) struct stats_gauge STATS_SECT_VAR(__var);
+#define STATS_SECT_HIST(__var) struct stats_hist STATS_SECT_VAR(__var);
 
 #define STATS_SIZE_INIT_PARMS(__sectvarname, __size)                        \
     (__size),                                                               \
@@ -72,6 +113,25 @@ STATS_SECT_DECL(__name) {                   \
 #define STATS_INCN(__sectvarname, __var, __n)  \
     ((__sectvarname).STATS_SECT_VAR(__var) += (__n))
 
+#define STATS_GAUGE_RECORD(__sectvarname, __var, __val)                     \
+    stats_gauge_record(&(__sectvarname).STATS_SECT_VAR(__var), (__val))
+
+#define STATS_HIST_RECORD(__sectvarname, __var, __val)                      \
+    stats_hist_record(&(__sectvarname).STATS_SECT_VAR(__var), (__val))
+
+/*
+ * Time a code section into a histogram, in microseconds:
+ *     uint32_t t;
+ *
+ *     STATS_TIME_START(t);
+ *     ...
+ *     STATS_TIME_END(g_my_stats, op_usecs, t);
+ */
+#define STATS_TIME_START(__t) ((__t) = stats_time_start())
+
+#define STATS_TIME_END(__sectvarname, __var, __t)                           \
+    stats_time_end(&(__sectvarname).STATS_SECT_VAR(__var), (__t))
+
 #ifdef STATS_NAME_ENABLE
 
 #define STATS_NAME_MAP_NAME(__sectname) g_stats_map_ ## __sectname
@@ -103,6 +163,12 @@ int stats_module_init(void);
 void stats_module_reset(void);
 int stats_init(struct stats_hdr *shdr, uint8_t size, uint8_t cnt, 
     struct stats_name_map *map, uint8_t map_cnt);
+void stats_gauge_record(struct stats_gauge *gauge, uint32_t val);
+uint32_t stats_gauge_mean(struct stats_gauge *gauge);
+void stats_hist_record(struct stats_hist *hist, uint32_t val);
+uint32_t stats_hist_bucket_min(int bucket);
+uint32_t stats_time_start(void);
+void stats_time_end(struct stats_hist *hist, uint32_t start);
 int stats_register(char *name, struct stats_hdr *shdr);
 int stats_init_and_reg(struct stats_hdr *shdr, uint8_t size, uint8_t cnt,
                        struct stats_name_map *map, uint8_t map_cnt,
@@ -123,6 +189,8 @@ int stats_nmgr_register_group(void);
 #endif 
 #ifdef SHELL_PRESENT
 int stats_shell_register(void);
+int stats_shell_fmt_gauge(char *buf, int len, struct stats_gauge *gauge);
+int stats_shell_fmt_bucket(char *buf, int len, int bucket, uint32_t cnt);
 #endif
 
 #endif /* __UTIL_STATS_H__ */
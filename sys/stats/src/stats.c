@@ -18,6 +18,7 @@
  */
 
 #include <os/os.h>
+#include <hal/hal_cputime.h>
 
 #include <string.h>
 
@@ -161,6 +162,85 @@ stats_init(struct stats_hdr *shdr, uint8_t size, uint8_t cnt,
     return (0);
 }
 
+/**
+ * Records a value in a gauge.  Like the counters, gauges are not locked;
+ * concurrent updates may lose samples.
+ */
+void
+stats_gauge_record(struct stats_gauge *gauge, uint32_t val)
+{
+    if (gauge->sg_cnt == 0 || val < gauge->sg_min) {
+        gauge->sg_min = val;
+    }
+    if (val > gauge->sg_max) {
+        gauge->sg_max = val;
+    }
+    gauge->sg_cnt++;
+    gauge->sg_sum += val;
+}
+
+uint32_t
+stats_gauge_mean(struct stats_gauge *gauge)
+{
+    if (gauge->sg_cnt == 0) {
+        return (0);
+    }
+
+    return (gauge->sg_sum / gauge->sg_cnt);
+}
+
+/**
+ * Records a value in a histogram and its gauge.
+ */
+void
+stats_hist_record(struct stats_hist *hist, uint32_t val)
+{
+    int bucket;
+
+    stats_gauge_record(&hist->sh_gauge, val);
+
+    if (val == 0) {
+        bucket = 0;
+    } else {
+        bucket = 32 - __builtin_clz(val);
+        if (bucket >= STATS_HIST_BUCKETS) {
+            bucket = STATS_HIST_BUCKETS - 1;
+        }
+    }
+    hist->sh_buckets[bucket]++;
+}
+
+/**
+ * Returns the smallest value counted in the specified histogram bucket.
+ */
+uint32_t
+stats_hist_bucket_min(int bucket)
+{
+    if (bucket == 0) {
+        return (0);
+    }
+
+    return (1UL << (bucket - 1));
+}
+
+/**
+ * Returns the start time of a section timed with STATS_TIME_START().
+ */
+uint32_t
+stats_time_start(void)
+{
+    return (cputime_get32());
+}
+
+/**
+ * Records the microseconds elapsed since 'start' in a histogram.
+ */
+void
+stats_time_end(struct stats_hist *hist, uint32_t start)
+{
+    stats_hist_record(hist, cputime_ticks_to_usecs(cputime_get32() - start));
+}
+
 int
 stats_group_walk(stats_group_walk_func_t walk_func, void *arg)
 {
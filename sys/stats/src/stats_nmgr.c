@@ -20,34 +20,121 @@
 #include <os/os.h>
 
 #include <string.h>
-
 #include <stdio.h>
 
 #ifdef NEWTMGR_PRESENT
 
 #include "newtmgr/newtmgr.h"
 #include "json/json.h"
+#include "util/crc16.h"
 #include "stats/stats.h"
+#include "stats_priv.h"
 
 /* Source code is only included if the newtmgr library is enabled.  Otherwise
  * this file is compiled out for code size.
  */
 static int stats_nmgr_read(struct nmgr_jbuf *njb);
 static int stats_nmgr_list(struct nmgr_jbuf *njb);
+static int stats_nmgr_schema(struct nmgr_jbuf *njb);
+static int stats_nmgr_delta(struct nmgr_jbuf *njb);
 
 static struct nmgr_group shell_nmgr_group;
 
-#define STATS_NMGR_ID_READ  (0)
-#define STATS_NMGR_ID_LIST  (1)
+#define STATS_NMGR_ID_READ      (0)
+#define STATS_NMGR_ID_LIST      (1)
+#define STATS_NMGR_ID_SCHEMA    (2)
+#define STATS_NMGR_ID_DELTA     (3)
+
+#define STATS_NMGR_NAME_LEN     (32)
+
+/*
+ * Snapshots kept for delta reads, one per group that has been delta read.
+ * A snapshot is allocated the first time its group is delta read and is
+ * sized to that group, so the memory used follows the number and size of
+ * the groups a client polls.  Each new snapshot of a group replaces the
+ * previous one and gets the next generation number of that group.  The
+ * schema hash of the group is computed once, when its snapshot is
+ * allocated; a group's names, entry size and count don't change once it
+ * is registered.
+ */
+struct stats_nmgr_snap {
+    STAILQ_ENTRY(stats_nmgr_snap) sns_next;
+    struct stats_hdr *sns_hdr;
+    uint32_t sns_gen;
+    uint16_t sns_hash;
+    uint8_t sns_data[];
+};
+
+static STAILQ_HEAD(, stats_nmgr_snap) stats_nmgr_snaps =
+    STAILQ_HEAD_INITIALIZER(stats_nmgr_snaps);
+
+/* Response bytes are staged here and appended to the mbuf in chunks. */
+struct stats_nmgr_bin {
+    struct nmgr_jbuf *snb_njb;
+    uint8_t snb_buf[32];
+    uint8_t snb_len;
+    int snb_rc;
+};
 
 /* ORDER MATTERS HERE.
  * Each element represents the command ID, referenced from newtmgr.
  */
 static struct nmgr_handler shell_nmgr_group_handlers[] = {
     [STATS_NMGR_ID_READ] = {stats_nmgr_read, stats_nmgr_read},
-    [STATS_NMGR_ID_LIST] = {stats_nmgr_list, stats_nmgr_list}
+    [STATS_NMGR_ID_LIST] = {stats_nmgr_list, stats_nmgr_list},
+    [STATS_NMGR_ID_SCHEMA] = {stats_nmgr_schema, stats_nmgr_schema},
+    [STATS_NMGR_ID_DELTA] = {stats_nmgr_delta, stats_nmgr_delta}
 };
 
+static void
+stats_nmgr_encode_gauge(struct json_encoder *encoder,
+        struct stats_gauge *gauge)
+{
+    struct json_value jv;
+
+    JSON_VALUE_UINT(&jv, gauge->sg_min);
+    json_encode_object_entry(encoder, "min", &jv);
+    JSON_VALUE_UINT(&jv, gauge->sg_max);
+    json_encode_object_entry(encoder, "max", &jv);
+    JSON_VALUE_UINT(&jv, stats_gauge_mean(gauge));
+    json_encode_object_entry(encoder, "mean", &jv);
+    JSON_VALUE_UINT(&jv, gauge->sg_cnt);
+    json_encode_object_entry(encoder, "cnt", &jv);
+}
+
+/**
+ * Gauges and histograms are encoded as objects, e.g.
+ *     "lat": {"min":3,"max":90,"mean":12,"cnt":40,"buckets":[0,0,1,...]}
+ * where bucket n counts values in [2^(n-1), 2^n).
+ */
+static int
+stats_nmgr_encode_obj(struct json_encoder *encoder, char *sname,
+        struct stats_hdr *hdr, void *stat_val)
+{
+    struct stats_hist *hist;
+    struct json_value jv;
+    int i;
+
+    json_encode_object_key(encoder, sname);
+    json_encode_object_start(encoder);
+
+    if (hdr->s_size == sizeof(struct stats_gauge)) {
+        stats_nmgr_encode_gauge(encoder, stat_val);
+    } else {
+        hist = stat_val;
+        stats_nmgr_encode_gauge(encoder, &hist->sh_gauge);
+        json_encode_array_name(encoder, "buckets");
+        json_encode_array_start(encoder);
+        for (i = 0; i < STATS_HIST_BUCKETS; i++) {
+            JSON_VALUE_UINT(&jv, hist->sh_buckets[i]);
+            json_encode_array_value(encoder, &jv);
+        }
+        json_encode_array_finish(encoder);
+    }
+
+    return (json_encode_object_finish(encoder));
+}
+
 static int
 stats_nmgr_walk_func(struct stats_hdr *hdr, void *arg, char *sname,
         uint16_t stat_off)
@@ -71,6 +158,9 @@ stats_nmgr_walk_func(struct stats_hdr *hdr, void *arg, char *sname,
         case sizeof(uint64_t):
             JSON_VALUE_UINT(&jv, *(uint64_t *) stat_val);
             break;
+        case sizeof(struct stats_gauge):
+        case sizeof(struct stats_hist):
+            return (stats_nmgr_encode_obj(encoder, sname, hdr, stat_val));
     }
 
     rc = json_encode_object_entry(encoder, sname, &jv);
@@ -100,7 +190,6 @@ static int
 stats_nmgr_read(struct nmgr_jbuf *njb)
 {
     struct stats_hdr *hdr;
-#define STATS_NMGR_NAME_LEN (32)
     char stats_name[STATS_NMGR_NAME_LEN];
     struct json_attr_t attrs[] = {
         { "name", t_string, .addr.string = &stats_name[0],
@@ -110,7 +199,7 @@ stats_nmgr_read(struct nmgr_jbuf *njb)
     struct json_value jv;
     int rc;
 
-    rc = json_read_object((struct json_buffer *) njb, attrs);
+    rc = nmgr_read_object(njb, attrs);
     if (rc != 0) {
         rc = NMGR_ERR_EINVAL;
         goto err;
@@ -124,14 +213,14 @@ stats_nmgr_read(struct nmgr_jbuf *njb)
 
     json_encode_object_start(&njb->njb_enc);
     JSON_VALUE_INT(&jv, NMGR_ERR_EOK);
-    json_encode_object_entry(&nmgr_task_jbuf.njb_enc, "rc", &jv);
+    json_encode_object_entry(&njb->njb_enc, "rc", &jv);
     JSON_VALUE_STRINGN(&jv, stats_name, strlen(stats_name));
-    json_encode_object_entry(&nmgr_task_jbuf.njb_enc, "name", &jv);
+    json_encode_object_entry(&njb->njb_enc, "name", &jv);
     JSON_VALUE_STRINGN(&jv, "sys", sizeof("sys")-1);
-    json_encode_object_entry(&nmgr_task_jbuf.njb_enc, "group", &jv);
-    json_encode_object_key(&nmgr_task_jbuf.njb_enc, "fields");
-    json_encode_object_start(&nmgr_task_jbuf.njb_enc);
-    stats_walk(hdr, stats_nmgr_walk_func, &nmgr_task_jbuf.njb_enc);
+    json_encode_object_entry(&njb->njb_enc, "group", &jv);
+    json_encode_object_key(&njb->njb_enc, "fields");
+    json_encode_object_start(&njb->njb_enc);
+    stats_walk(hdr, stats_nmgr_walk_func, &njb->njb_enc);
     json_encode_object_finish(&njb->njb_enc);
     json_encode_object_finish(&njb->njb_enc);
 
@@ -149,16 +238,362 @@ stats_nmgr_list(struct nmgr_jbuf *njb)
 
     json_encode_object_start(&njb->njb_enc);
     JSON_VALUE_INT(&jv, NMGR_ERR_EOK);
-    json_encode_object_entry(&nmgr_task_jbuf.njb_enc, "rc", &jv);
-    json_encode_array_name(&nmgr_task_jbuf.njb_enc, "stat_list");
-    json_encode_array_start(&nmgr_task_jbuf.njb_enc);
-    stats_group_walk(stats_nmgr_encode_name, &nmgr_task_jbuf.njb_enc);
+    json_encode_object_entry(&njb->njb_enc, "rc", &jv);
+    json_encode_array_name(&njb->njb_enc, "stat_list");
+    json_encode_array_start(&njb->njb_enc);
+    stats_group_walk(stats_nmgr_encode_name, &njb->njb_enc);
     json_encode_array_finish(&njb->njb_enc);
     json_encode_object_finish(&njb->njb_enc);
 
     return (0);
 }
 
+/*
+ * Binary stats export.
+ *
+ * The JSON read repeats every name with every value.  The binary opcodes
+ * split that in two: the schema (names, in entry order) is fetched once
+ * and cached by the client under its hash, and delta reads then return
+ * only the entries that changed since a snapshot the client already holds.
+ * Multi-byte fixed fields are little endian; "varint" is LEB128.
+ *
+ * SCHEMA request:  group name
+ *        response: u8 rc, u16 hash, u8 entry size, u8 entry count,
+ *                  then per entry: u16 offset, u8 name length, name
+ *
+ * DELTA request:   u16 hash, u32 snapshot generation (0 = none),
+ *                  group name
+ *       response:  u8 rc, u32 new snapshot generation (0 = not kept),
+ *                  then per changed entry: varint index gap since the
+ *                  previous changed entry (or since -1), followed by its
+ *                  value; a gauge is sent as sum, min, max, cnt and a
+ *                  histogram as its gauge then its buckets, each a varint.
+ *
+ * Only the latest snapshot of a group is kept.  A delta request against
+ * any other generation (a lost response, or another client polling the
+ * same group in between) returns every entry.  A hash mismatch returns
+ * NMGR_ERR_EINVAL; the client must fetch the schema again.
+ */
+static void
+stats_nmgr_bin_flush(struct stats_nmgr_bin *bin)
+{
+    int rc;
+
+    if (bin->snb_len == 0 || bin->snb_rc != 0) {
+        return;
+    }
+
+    rc = nmgr_rsp_extend(bin->snb_njb->njb_hdr, bin->snb_njb->njb_out_m,
+            bin->snb_buf, bin->snb_len);
+    if (rc != 0) {
+        bin->snb_rc = rc;
+    }
+    bin->snb_len = 0;
+}
+
+static void
+stats_nmgr_bin_put(struct stats_nmgr_bin *bin, const void *data, int len)
+{
+    const uint8_t *u8p;
+    int i;
+
+    u8p = data;
+    for (i = 0; i < len; i++) {
+        if (bin->snb_len == sizeof(bin->snb_buf)) {
+            stats_nmgr_bin_flush(bin);
+        }
+        bin->snb_buf[bin->snb_len++] = u8p[i];
+    }
+}
+
+static void
+stats_nmgr_bin_put16(struct stats_nmgr_bin *bin, uint16_t val)
+{
+    uint8_t buf[2];
+
+    buf[0] = val;
+    buf[1] = val >> 8;
+    stats_nmgr_bin_put(bin, buf, sizeof(buf));
+}
+
+static void
+stats_nmgr_bin_varint(struct stats_nmgr_bin *bin, uint64_t val)
+{
+    uint8_t buf[10];
+    int len;
+
+    len = 0;
+    while (val >= 0x80) {
+        buf[len++] = (val & 0x7f) | 0x80;
+        val >>= 7;
+    }
+    buf[len++] = val;
+    stats_nmgr_bin_put(bin, buf, len);
+}
+
+/**
+ * Reads the group name that ends a binary request, starting at the given
+ * offset into the request payload.
+ */
+static struct stats_hdr *
+stats_nmgr_bin_group(struct nmgr_jbuf *njb, int off)
+{
+    char name[STATS_NMGR_NAME_LEN];
+    int len;
+
+    len = njb->njb_end - njb->njb_off - off;
+    if (len <= 0 || len >= sizeof(name)) {
+        return (NULL);
+    }
+    if (os_mbuf_copydata(njb->njb_in_m, njb->njb_off + off, len, name)) {
+        return (NULL);
+    }
+    name[len] = '\0';
+
+    return (stats_group_find(name));
+}
+
+static int
+stats_nmgr_hash_walk(struct stats_hdr *hdr, void *arg, char *sname,
+        uint16_t stat_off)
+{
+    uint16_t *crc;
+
+    crc = arg;
+    *crc = crc16_ccitt(*crc, sname, strlen(sname) + 1);
+
+    return (0);
+}
+
+static uint16_t
+stats_nmgr_hash(struct stats_hdr *hdr)
+{
+    uint16_t crc;
+
+    crc = crc16_ccitt(CRC16_INITIAL_CRC, &hdr->s_size, sizeof(hdr->s_size));
+    crc = crc16_ccitt(crc, &hdr->s_cnt, sizeof(hdr->s_cnt));
+    stats_walk(hdr, stats_nmgr_hash_walk, &crc);
+
+    return (crc);
+}
+
+static int
+stats_nmgr_schema_walk(struct stats_hdr *hdr, void *arg, char *sname,
+        uint16_t stat_off)
+{
+    struct stats_nmgr_bin *bin;
+    uint8_t len;
+
+    bin = arg;
+    len = strlen(sname);
+    stats_nmgr_bin_put16(bin, stat_off);
+    stats_nmgr_bin_put(bin, &len, sizeof(len));
+    stats_nmgr_bin_put(bin, sname, len);
+
+    return (0);
+}
+
+static int
+stats_nmgr_schema(struct nmgr_jbuf *njb)
+{
+    struct stats_nmgr_bin bin;
+    struct stats_hdr *hdr;
+    uint8_t rc;
+
+    memset(&bin, 0, sizeof(bin));
+    bin.snb_njb = njb;
+
+    hdr = stats_nmgr_bin_group(njb, 0);
+    if (!hdr) {
+        rc = NMGR_ERR_ENOENT;
+        stats_nmgr_bin_put(&bin, &rc, sizeof(rc));
+        goto done;
+    }
+
+    rc = NMGR_ERR_EOK;
+    stats_nmgr_bin_put(&bin, &rc, sizeof(rc));
+    stats_nmgr_bin_put16(&bin, stats_nmgr_hash(hdr));
+    stats_nmgr_bin_put(&bin, &hdr->s_size, sizeof(hdr->s_size));
+    stats_nmgr_bin_put(&bin, &hdr->s_cnt, sizeof(hdr->s_cnt));
+    stats_walk(hdr, stats_nmgr_schema_walk, &bin);
+
+done:
+    stats_nmgr_bin_flush(&bin);
+    return (bin.snb_rc);
+}
+
+static void
+stats_nmgr_delta_entry(struct stats_nmgr_bin *bin, uint8_t size,
+        void *stat_val)
+{
+    struct stats_gauge gauge;
+    uint32_t *buckets;
+    int i;
+
+    switch (size) {
+    case sizeof(uint16_t):
+        stats_nmgr_bin_varint(bin, *(uint16_t *)stat_val);
+        break;
+    case sizeof(uint32_t):
+        stats_nmgr_bin_varint(bin, *(uint32_t *)stat_val);
+        break;
+    case sizeof(uint64_t):
+        stats_nmgr_bin_varint(bin, *(uint64_t *)stat_val);
+        break;
+    case sizeof(struct stats_gauge):
+    case sizeof(struct stats_hist):
+        memcpy(&gauge, stat_val, sizeof(gauge));
+        stats_nmgr_bin_varint(bin, gauge.sg_sum);
+        stats_nmgr_bin_varint(bin, gauge.sg_min);
+        stats_nmgr_bin_varint(bin, gauge.sg_max);
+        stats_nmgr_bin_varint(bin, gauge.sg_cnt);
+        if (size == sizeof(struct stats_hist)) {
+            buckets = ((struct stats_hist *)stat_val)->sh_buckets;
+            for (i = 0; i < STATS_HIST_BUCKETS; i++) {
+                stats_nmgr_bin_varint(bin, buckets[i]);
+            }
+        }
+        break;
+    }
+}
+
+static struct stats_nmgr_snap *
+stats_nmgr_snap_find(struct stats_hdr *hdr)
+{
+    struct stats_nmgr_snap *snap;
+
+    STAILQ_FOREACH(snap, &stats_nmgr_snaps, sns_next) {
+        if (snap->sns_hdr == hdr) {
+            break;
+        }
+    }
+
+    return (snap);
+}
+
+/**
+ * Sets the generation of a group's snapshot, allocating the snapshot if
+ * needed; for unit tests.
+ */
+int
+stats_nmgr_snap_gen_set(struct stats_hdr *hdr, uint32_t gen)
+{
+    struct stats_nmgr_snap *snap;
+
+    snap = stats_nmgr_snap_find(hdr);
+    if (!snap) {
+        snap = os_malloc(sizeof(*snap) + hdr->s_size * hdr->s_cnt);
+        if (!snap) {
+            return (OS_ENOMEM);
+        }
+        memset(snap, 0, sizeof(*snap) + hdr->s_size * hdr->s_cnt);
+        snap->sns_hdr = hdr;
+        snap->sns_hash = stats_nmgr_hash(hdr);
+        STAILQ_INSERT_TAIL(&stats_nmgr_snaps, snap, sns_next);
+    }
+    snap->sns_gen = gen;
+
+    return (0);
+}
+
+static int
+stats_nmgr_delta(struct nmgr_jbuf *njb)
+{
+    struct stats_nmgr_snap *snap;
+    struct stats_nmgr_bin bin;
+    struct stats_hdr *hdr;
+    uint8_t req[6];
+    uint8_t *data;
+    uint8_t *cur;
+    uint32_t base;
+    uint32_t gen;
+    uint8_t rc;
+    int changed;
+    int prev;
+    int i;
+
+    memset(&bin, 0, sizeof(bin));
+    bin.snb_njb = njb;
+
+    if (njb->njb_end - njb->njb_off < sizeof(req) ||
+            os_mbuf_copydata(njb->njb_in_m, njb->njb_off, sizeof(req), req)) {
+        rc = NMGR_ERR_EINVAL;
+        goto err;
+    }
+    base = req[2] | (req[3] << 8) | (req[4] << 16) | ((uint32_t)req[5] << 24);
+
+    hdr = stats_nmgr_bin_group(njb, sizeof(req));
+    if (!hdr) {
+        rc = NMGR_ERR_ENOENT;
+        goto err;
+    }
+
+    snap = stats_nmgr_snap_find(hdr);
+    if (!snap) {
+        /* First delta read of this group; without memory for a snapshot,
+         * every read is a full one.
+         */
+        if (stats_nmgr_snap_gen_set(hdr, 0) == 0) {
+            snap = stats_nmgr_snap_find(hdr);
+        }
+    }
+    if ((snap ? snap->sns_hash : stats_nmgr_hash(hdr)) !=
+            (req[0] | (req[1] << 8))) {
+        rc = NMGR_ERR_EINVAL;
+        goto err;
+    }
+
+    data = (uint8_t *)(hdr + 1);
+
+    rc = NMGR_ERR_EOK;
+    stats_nmgr_bin_put(&bin, &rc, sizeof(rc));
+
+    gen = 0;
+    if (snap) {
+        /* Generation 0 means "no snapshot"; skip it on wrap. */
+        gen = snap->sns_gen + 1;
+        if (gen == 0) {
+            gen = 1;
+        }
+    }
+    stats_nmgr_bin_put16(&bin, gen);
+    stats_nmgr_bin_put16(&bin, gen >> 16);
+
+    prev = -1;
+    for (i = 0; i < hdr->s_cnt; i++) {
+        cur = data + i * hdr->s_size;
+
+        changed = 1;
+        if (snap && base != 0 && base == snap->sns_gen) {
+            changed = memcmp(snap->sns_data + i * hdr->s_size, cur,
+                             hdr->s_size);
+        }
+        if (!changed) {
+            continue;
+        }
+        if (snap) {
+            /* Encode the copy, so that the snapshot holds exactly what
+             * the client was sent.
+             */
+            memcpy(snap->sns_data + i * hdr->s_size, cur, hdr->s_size);
+            cur = snap->sns_data + i * hdr->s_size;
+        }
+        stats_nmgr_bin_varint(&bin, i - prev);
+        stats_nmgr_delta_entry(&bin, hdr->s_size, cur);
+        prev = i;
+    }
+    if (snap) {
+        snap->sns_gen = gen;
+    }
+
+    stats_nmgr_bin_flush(&bin);
+    return (bin.snb_rc);
+err:
+    stats_nmgr_bin_put(&bin, &rc, sizeof(rc));
+    stats_nmgr_bin_flush(&bin);
+    return (bin.snb_rc);
+}
+
 /**
  * Register nmgr group handlers
  */
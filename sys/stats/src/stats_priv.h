@@ -0,0 +1,32 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef __STATS_PRIV_H__
+#define __STATS_PRIV_H__
+
+#include <inttypes.h>
+
+struct stats_hdr;
+
+#ifdef NEWTMGR_PRESENT
+/* For unit tests. */
+int stats_nmgr_snap_gen_set(struct stats_hdr *hdr, uint32_t gen);
+#endif
+
+#endif /* __STATS_PRIV_H__ */
@@ -28,9 +28,16 @@
  */
 #ifdef SHELL_PRESENT
 
+#include <stdio.h>
 #include <shell/shell.h>
 #include <console/console.h>
 
+/*
+ * Longest formatted values: four labelled 10-digit gauge values.  Names are
+ * printed separately, so they are never cut short.
+ */
+#define STATS_SHELL_LINE_LEN    (64)
+
 static int shell_stats_display(int argc, char **argv);
 static struct shell_cmd shell_stats_cmd = {
     .sc_cmd = "stat",
@@ -38,6 +45,70 @@ static struct shell_cmd shell_stats_cmd = {
 };
 uint8_t stats_shell_registered;
 
+/**
+ * Formats the values of a gauge for the shell; the name is not included.
+ *
+ * @return                      The snprintf() result.
+ */
+int
+stats_shell_fmt_gauge(char *buf, int len, struct stats_gauge *gauge)
+{
+    return (snprintf(buf, len, "min=%lu max=%lu mean=%lu cnt=%lu",
+            (unsigned long) gauge->sg_min, (unsigned long) gauge->sg_max,
+            (unsigned long) stats_gauge_mean(gauge),
+            (unsigned long) gauge->sg_cnt));
+}
+
+/**
+ * Formats the shell line for a histogram bucket, without the trailing
+ * newline.  The bucket is labelled with the smallest value it counts.
+ *
+ * @return                      The snprintf() result.
+ */
+int
+stats_shell_fmt_bucket(char *buf, int len, int bucket, uint32_t cnt)
+{
+    return (snprintf(buf, len, "    >=%lu: %lu",
+            (unsigned long) stats_hist_bucket_min(bucket),
+            (unsigned long) cnt));
+}
+
+/**
+ * Writes "name: " to the console.  The name bypasses console_printf(), whose
+ * line buffer would cut long names short.
+ */
+static void
+stats_shell_display_name(char *name)
+{
+    console_write(name, strlen(name));
+    console_write(": ", 2);
+}
+
+static void
+stats_shell_display_gauge(char *name, struct stats_gauge *gauge)
+{
+    char buf[STATS_SHELL_LINE_LEN];
+
+    stats_shell_fmt_gauge(buf, sizeof(buf), gauge);
+    stats_shell_display_name(name);
+    console_printf("%s\n", buf);
+}
+
+static void
+stats_shell_display_hist(char *name, struct stats_hist *hist)
+{
+    char buf[STATS_SHELL_LINE_LEN];
+    int i;
+
+    stats_shell_display_gauge(name, &hist->sh_gauge);
+    for (i = 0; i < STATS_HIST_BUCKETS; i++) {
+        if (hist->sh_buckets[i] != 0) {
+            stats_shell_fmt_bucket(buf, sizeof(buf), i, hist->sh_buckets[i]);
+            console_printf("%s\n", buf);
+        }
+    }
+}
+
 static int 
 stats_shell_display_entry(struct stats_hdr *hdr, void *arg, char *name,
         uint16_t stat_off)
@@ -47,13 +118,22 @@ stats_shell_display_entry(struct stats_hdr *hdr, void *arg, char *name,
     stat_val = (uint8_t *)hdr + stat_off;
     switch (hdr->s_size) {
         case sizeof(uint16_t):
-            console_printf("%s: %u\n", name, *(uint16_t *) stat_val);
+            stats_shell_display_name(name);
+            console_printf("%u\n", *(uint16_t *) stat_val);
             break;
         case sizeof(uint32_t):
-            console_printf("%s: %lu\n", name, *(unsigned long *) stat_val);
+            stats_shell_display_name(name);
+            console_printf("%lu\n", *(unsigned long *) stat_val);
             break;
         case sizeof(uint64_t):
-            console_printf("%s: %llu\n", name, *(uint64_t *) stat_val);
+            stats_shell_display_name(name);
+            console_printf("%llu\n", *(uint64_t *) stat_val);
+            break;
+        case sizeof(struct stats_gauge):
+            stats_shell_display_gauge(name, stat_val);
+            break;
+        case sizeof(struct stats_hist):
+            stats_shell_display_hist(name, stat_val);
             break;
         default:
             console_printf("Unknown stat size for %s %u\n", name, 
@@ -67,7 +147,9 @@ stats_shell_display_entry(struct stats_hdr *hdr, void *arg, char *name,
 static int 
 stats_shell_display_group(struct stats_hdr *hdr, void *arg)
 {
-    console_printf("\t%s\n", hdr->s_name);
+    console_write("\t", 1);
+    console_write(hdr->s_name, strlen(hdr->s_name));
+    console_write("\n", 1);
     return (0);
 }
 
@@ -0,0 +1,606 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "testutil/testutil.h"
+#include "os/os.h"
+#include "os/endian.h"
+#include "newtmgr/newtmgr.h"
+#include "stats/stats.h"
+#include "../stats_priv.h"
+
+#define STATS_TEST_BUF_SIZE     (128)
+#define STATS_TEST_BUF_COUNT    (32)
+
+/* Groups polled round-robin in the delta tests. */
+#define STATS_TEST_POLL_CNT     (40)
+
+#define STATS_TEST_OP_SCHEMA    (2)
+#define STATS_TEST_OP_DELTA     (3)
+
+STATS_SECT_START(stats_test_cnt)
+    STATS_SECT_ENTRY(a)
+    STATS_SECT_ENTRY(b)
+    STATS_SECT_ENTRY(c)
+    STATS_SECT_ENTRY(d)
+STATS_SECT_END
+
+STATS_NAME_START(stats_test_cnt)
+    STATS_NAME(stats_test_cnt, a)
+    STATS_NAME(stats_test_cnt, b)
+    STATS_NAME(stats_test_cnt, c)
+    STATS_NAME(stats_test_cnt, d)
+STATS_NAME_END(stats_test_cnt)
+
+STATS_SECT_START(stats_test_gauge)
+    STATS_SECT_GAUGE(g0)
+    STATS_SECT_GAUGE(g1)
+STATS_SECT_END
+
+STATS_NAME_START(stats_test_gauge)
+    STATS_NAME(stats_test_gauge, g0)
+    STATS_NAME(stats_test_gauge, g1)
+STATS_NAME_END(stats_test_gauge)
+
+STATS_SECT_START(stats_test_hist)
+    STATS_SECT_HIST(lat)
+STATS_SECT_END
+
+STATS_NAME_START(stats_test_hist)
+    STATS_NAME(stats_test_hist, lat)
+STATS_NAME_END(stats_test_hist)
+
+static STATS_SECT_DECL(stats_test_cnt) stats_test_cnt;
+static STATS_SECT_DECL(stats_test_gauge) stats_test_gauge;
+static STATS_SECT_DECL(stats_test_hist) stats_test_hist;
+static STATS_SECT_DECL(stats_test_cnt) stats_test_poll[STATS_TEST_POLL_CNT];
+static char stats_test_poll_name[STATS_TEST_POLL_CNT][8];
+
+/* Requests come in on the shell (NLIP) transport. */
+extern struct nmgr_transport g_nmgr_shell_transport;
+
+static os_membuf_t stats_test_membuf[OS_MEMPOOL_SIZE(STATS_TEST_BUF_COUNT,
+        STATS_TEST_BUF_SIZE)];
+static struct os_mempool stats_test_mempool;
+static struct os_mbuf_pool stats_test_mbuf_pool;
+static os_stack_t stats_test_stack[OS_STACK_ALIGN(1024)];
+
+static uint8_t stats_test_rsp[NMGR_MAX_MTU];
+static int stats_test_rsp_len;
+
+static int
+stats_test_out(struct nmgr_transport *nt, struct os_mbuf *m)
+{
+    stats_test_rsp_len = OS_MBUF_PKTLEN(m);
+    TEST_ASSERT_FATAL(stats_test_rsp_len < sizeof(stats_test_rsp));
+    os_mbuf_copydata(m, 0, stats_test_rsp_len, stats_test_rsp);
+    stats_test_rsp[stats_test_rsp_len] = '\0';
+    os_mbuf_free_chain(m);
+
+    return 0;
+}
+
+/*
+ * Registers the test groups and newtmgr once; the stats registry can be
+ * reset, but newtmgr groups cannot be unregistered.
+ */
+static void
+stats_test_setup(void)
+{
+    static int initialized;
+    int rc;
+    int i;
+
+    if (initialized) {
+        return;
+    }
+    initialized = 1;
+
+    rc = os_mempool_init(&stats_test_mempool, STATS_TEST_BUF_COUNT,
+            STATS_TEST_BUF_SIZE, stats_test_membuf, "stats_test");
+    TEST_ASSERT_FATAL(rc == 0);
+    rc = os_mbuf_pool_init(&stats_test_mbuf_pool, &stats_test_mempool,
+            STATS_TEST_BUF_SIZE, STATS_TEST_BUF_COUNT);
+    TEST_ASSERT_FATAL(rc == 0);
+    rc = os_msys_register(&stats_test_mbuf_pool);
+    TEST_ASSERT_FATAL(rc == 0);
+
+    rc = nmgr_task_init(10, stats_test_stack,
+            sizeof(stats_test_stack) / sizeof(os_stack_t));
+    TEST_ASSERT_FATAL(rc == 0);
+    nmgr_jbuf_init(&nmgr_task_jbuf);
+    g_nmgr_shell_transport.nt_output = stats_test_out;
+
+    rc = stats_module_init();
+    TEST_ASSERT_FATAL(rc == 0);
+
+    rc = stats_init_and_reg(STATS_HDR(stats_test_cnt),
+            STATS_SIZE_INIT_PARMS(stats_test_cnt, STATS_SIZE_32),
+            STATS_NAME_INIT_PARMS(stats_test_cnt), "tcnt");
+    TEST_ASSERT_FATAL(rc == 0);
+    rc = stats_init_and_reg(STATS_HDR(stats_test_gauge),
+            STATS_SIZE_INIT_PARMS(stats_test_gauge, STATS_SIZE_GAUGE),
+            STATS_NAME_INIT_PARMS(stats_test_gauge), "tgauge");
+    TEST_ASSERT_FATAL(rc == 0);
+    rc = stats_init_and_reg(STATS_HDR(stats_test_hist),
+            STATS_SIZE_INIT_PARMS(stats_test_hist, STATS_SIZE_HIST),
+            STATS_NAME_INIT_PARMS(stats_test_hist), "thist");
+    TEST_ASSERT_FATAL(rc == 0);
+
+    for (i = 0; i < STATS_TEST_POLL_CNT; i++) {
+        snprintf(stats_test_poll_name[i], sizeof(stats_test_poll_name[i]),
+                "tpoll%d", i);
+        rc = stats_init_and_reg(STATS_HDR(stats_test_poll[i]),
+                STATS_SIZE_INIT_PARMS(stats_test_poll[i], STATS_SIZE_32),
+                STATS_NAME_INIT_PARMS(stats_test_cnt),
+                stats_test_poll_name[i]);
+        TEST_ASSERT_FATAL(rc == 0);
+    }
+}
+
+/*
+ * Sends a stats group request; returns the response payload, and its
+ * length in 'len'.
+ */
+static uint8_t *
+stats_test_req(uint8_t id, const void *payload, int payload_len, int *len)
+{
+    struct nmgr_hdr hdr;
+    struct os_mbuf *m;
+    int rc;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.nh_op = NMGR_OP_READ;
+    hdr.nh_len = htons(payload_len);
+    hdr.nh_group = htons(NMGR_GROUP_ID_STATS);
+    hdr.nh_id = id;
+
+    m = os_msys_get_pkthdr(0, 0);
+    TEST_ASSERT_FATAL(m != NULL);
+    rc = os_mbuf_append(m, &hdr, sizeof(hdr));
+    TEST_ASSERT_FATAL(rc == 0);
+    rc = os_mbuf_append(m, payload, payload_len);
+    TEST_ASSERT_FATAL(rc == 0);
+
+    stats_test_rsp_len = 0;
+    rc = nmgr_rx_req(&g_nmgr_shell_transport, m);
+    TEST_ASSERT_FATAL(rc == 0);
+    nmgr_process(&g_nmgr_shell_transport);
+
+    TEST_ASSERT_FATAL(stats_test_rsp_len >= sizeof(hdr));
+    memcpy(&hdr, stats_test_rsp, sizeof(hdr));
+    TEST_ASSERT_FATAL(hdr.nh_op == NMGR_OP_READ_RSP);
+    *len = ntohs(hdr.nh_len);
+    TEST_ASSERT_FATAL(*len == stats_test_rsp_len - sizeof(hdr));
+
+    return (stats_test_rsp + sizeof(hdr));
+}
+
+TEST_CASE(stats_test_gauge_record)
+{
+    struct stats_gauge *g;
+
+    stats_test_setup();
+    memset(&stats_test_gauge.sg0, 0, sizeof(stats_test_gauge.sg0));
+    g = &stats_test_gauge.sg0;
+
+    /* An empty gauge. */
+    TEST_ASSERT(g->sg_cnt == 0);
+    TEST_ASSERT(stats_gauge_mean(g) == 0);
+
+    /* The first value sets both bounds, even if above zero. */
+    STATS_GAUGE_RECORD(stats_test_gauge, g0, 50);
+    TEST_ASSERT(g->sg_min == 50);
+    TEST_ASSERT(g->sg_max == 50);
+    TEST_ASSERT(g->sg_cnt == 1);
+    TEST_ASSERT(stats_gauge_mean(g) == 50);
+
+    STATS_GAUGE_RECORD(stats_test_gauge, g0, 10);
+    STATS_GAUGE_RECORD(stats_test_gauge, g0, 90);
+    STATS_GAUGE_RECORD(stats_test_gauge, g0, 30);
+    TEST_ASSERT(g->sg_min == 10);
+    TEST_ASSERT(g->sg_max == 90);
+    TEST_ASSERT(g->sg_cnt == 4);
+    TEST_ASSERT(g->sg_sum == 180);
+    TEST_ASSERT(stats_gauge_mean(g) == 45);
+
+    /* The sum is wider than the values. */
+    STATS_GAUGE_RECORD(stats_test_gauge, g0, 0xffffffff);
+    STATS_GAUGE_RECORD(stats_test_gauge, g0, 0xffffffff);
+    TEST_ASSERT(g->sg_sum == 180 + 2 * 0xffffffffULL);
+    TEST_ASSERT(g->sg_max == 0xffffffff);
+
+    /* Other entries are untouched. */
+    TEST_ASSERT(stats_test_gauge.sg1.sg_cnt == 0);
+}
+
+TEST_CASE(stats_test_hist_buckets)
+{
+    struct stats_hist *h;
+    int last;
+    int i;
+
+    stats_test_setup();
+    memset(&stats_test_hist.slat, 0, sizeof(stats_test_hist.slat));
+    h = &stats_test_hist.slat;
+    last = STATS_HIST_BUCKETS - 1;
+
+    TEST_ASSERT(stats_hist_bucket_min(0) == 0);
+    TEST_ASSERT(stats_hist_bucket_min(1) == 1);
+    TEST_ASSERT(stats_hist_bucket_min(2) == 2);
+    TEST_ASSERT(stats_hist_bucket_min(last) == 1UL << (last - 1));
+
+    /* Bucket n counts [2^(n-1), 2^n); check both edges of each. */
+    STATS_HIST_RECORD(stats_test_hist, lat, 0);
+    TEST_ASSERT(h->sh_buckets[0] == 1);
+    for (i = 1; i < last; i++) {
+        STATS_HIST_RECORD(stats_test_hist, lat, stats_hist_bucket_min(i));
+        STATS_HIST_RECORD(stats_test_hist, lat,
+                stats_hist_bucket_min(i + 1) - 1);
+        TEST_ASSERT(h->sh_buckets[i] == 2);
+    }
+
+    /* The last bucket counts everything from its minimum up. */
+    STATS_HIST_RECORD(stats_test_hist, lat, stats_hist_bucket_min(last));
+    STATS_HIST_RECORD(stats_test_hist, lat,
+            (uint32_t)(stats_hist_bucket_min(last) * 2 - 1));
+    STATS_HIST_RECORD(stats_test_hist, lat, 0xffffffff);
+    TEST_ASSERT(h->sh_buckets[last] == 3);
+
+    /* The gauge sees every value. */
+    TEST_ASSERT(h->sh_gauge.sg_cnt == 1 + 2 * (last - 1) + 3);
+    TEST_ASSERT(h->sh_gauge.sg_min == 0);
+    TEST_ASSERT(h->sh_gauge.sg_max == 0xffffffff);
+}
+
+struct stats_test_walk_arg {
+    int cnt;
+    char names[4][12];
+    uint16_t offs[4];
+};
+
+static int
+stats_test_walk_cb(struct stats_hdr *hdr, void *arg, char *name,
+        uint16_t off)
+{
+    struct stats_test_walk_arg *wa;
+
+    wa = arg;
+    TEST_ASSERT_FATAL(wa->cnt < 4);
+    strcpy(wa->names[wa->cnt], name);
+    wa->offs[wa->cnt] = off;
+    wa->cnt++;
+
+    return 0;
+}
+
+TEST_CASE(stats_test_walk)
+{
+    struct stats_test_walk_arg wa;
+    int rc;
+
+    stats_test_setup();
+
+    memset(&wa, 0, sizeof(wa));
+    rc = stats_walk(STATS_HDR(stats_test_cnt), stats_test_walk_cb, &wa);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(wa.cnt == 4);
+    TEST_ASSERT(wa.offs[0] ==
+            offsetof(STATS_SECT_DECL(stats_test_cnt), sa));
+    TEST_ASSERT(wa.offs[3] ==
+            offsetof(STATS_SECT_DECL(stats_test_cnt), sd));
+#ifdef STATS_NAME_ENABLE
+    TEST_ASSERT(strcmp(wa.names[3], "d") == 0);
+#else
+    TEST_ASSERT(strcmp(wa.names[3], "s3") == 0);
+#endif
+
+    /* Gauge and histogram entries are walked whole. */
+    memset(&wa, 0, sizeof(wa));
+    rc = stats_walk(STATS_HDR(stats_test_gauge), stats_test_walk_cb, &wa);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(wa.cnt == 2);
+    TEST_ASSERT(wa.offs[0] ==
+            offsetof(STATS_SECT_DECL(stats_test_gauge), sg0));
+    TEST_ASSERT(wa.offs[1] ==
+            offsetof(STATS_SECT_DECL(stats_test_gauge), sg1));
+
+    memset(&wa, 0, sizeof(wa));
+    rc = stats_walk(STATS_HDR(stats_test_hist), stats_test_walk_cb, &wa);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(wa.cnt == 1);
+    TEST_ASSERT(stats_test_hist.s_hdr.s_size == STATS_SIZE_HIST);
+
+#ifdef STATS_NAME_ENABLE
+    TEST_ASSERT(strcmp(wa.names[0], "lat") == 0);
+#else
+    TEST_ASSERT(strcmp(wa.names[0], "s0") == 0);
+#endif
+}
+
+TEST_CASE(stats_test_shell_fmt)
+{
+#ifdef SHELL_PRESENT
+    struct stats_gauge g;
+    char buf[96];
+
+    memset(&g, 0, sizeof(g));
+    stats_gauge_record(&g, 3);
+    stats_gauge_record(&g, 9);
+
+    stats_shell_fmt_gauge(buf, sizeof(buf), &g);
+    TEST_ASSERT(strcmp(buf, "min=3 max=9 mean=6 cnt=2") == 0);
+
+    /* The largest values still fit the shell's line buffer. */
+    g.sg_min = 0xffffffff;
+    g.sg_max = 0xffffffff;
+    g.sg_cnt = 0xffffffff;
+    g.sg_sum = (uint64_t)0xffffffff * 0xffffffff;
+    TEST_ASSERT(stats_shell_fmt_gauge(buf, sizeof(buf), &g) < 64);
+    TEST_ASSERT(stats_shell_fmt_bucket(buf, sizeof(buf),
+                                       STATS_HIST_BUCKETS - 1,
+                                       0xffffffff) < 64);
+
+    stats_shell_fmt_bucket(buf, sizeof(buf), 0, 7);
+    TEST_ASSERT(strcmp(buf, "    >=0: 7") == 0);
+    stats_shell_fmt_bucket(buf, sizeof(buf), 5, 1);
+    TEST_ASSERT(strcmp(buf, "    >=16: 1") == 0);
+#endif
+}
+
+TEST_CASE(stats_test_nmgr_read)
+{
+    char exp[64];
+    char *rsp;
+    int len;
+    int i;
+
+    stats_test_setup();
+    memset(&stats_test_hist.slat, 0, sizeof(stats_test_hist.slat));
+    for (i = 0; i < 4; i++) {
+        STATS_HIST_RECORD(stats_test_hist, lat, 3);
+    }
+    STATS_HIST_RECORD(stats_test_hist, lat, 11);
+
+    rsp = (char *)stats_test_req(0, "{\"name\":\"thist\"}",
+            strlen("{\"name\":\"thist\"}"), &len);
+
+    TEST_ASSERT(strstr(rsp, "\"min\": 3") != NULL);
+    TEST_ASSERT(strstr(rsp, "\"max\": 11") != NULL);
+    TEST_ASSERT(strstr(rsp, "\"mean\": 4") != NULL);
+    TEST_ASSERT(strstr(rsp, "\"cnt\": 5") != NULL);
+
+    /* Values 3 land in bucket 2, 11 in bucket 4. */
+    snprintf(exp, sizeof(exp), "\"buckets\": [0,0,4,0,1,0");
+    TEST_ASSERT(strstr(rsp, exp) != NULL);
+}
+
+/*
+ * Sends a DELTA request for the named group against base generation
+ * 'gen'; returns the response payload past the rc and new generation.
+ */
+static uint8_t *
+stats_test_delta(char *name, uint32_t gen, uint32_t *new_gen, int *len)
+{
+    uint8_t req[6 + 16];
+    uint16_t hash;
+    uint8_t *rsp;
+    int name_len;
+
+    name_len = strlen(name);
+    TEST_ASSERT_FATAL(name_len <= 16);
+
+    /* The schema carries the hash the delta request must echo. */
+    rsp = stats_test_req(STATS_TEST_OP_SCHEMA, name, name_len, len);
+    TEST_ASSERT_FATAL(*len >= 3 && rsp[0] == 0);
+    hash = rsp[1] | (rsp[2] << 8);
+
+    req[0] = hash;
+    req[1] = hash >> 8;
+    req[2] = gen;
+    req[3] = gen >> 8;
+    req[4] = gen >> 16;
+    req[5] = gen >> 24;
+    memcpy(req + 6, name, name_len);
+
+    rsp = stats_test_req(STATS_TEST_OP_DELTA, req, 6 + name_len, len);
+    TEST_ASSERT_FATAL(*len >= 5 && rsp[0] == 0);
+    *new_gen = rsp[1] | (rsp[2] << 8) | (rsp[3] << 16) |
+        ((uint32_t)rsp[4] << 24);
+    *len -= 5;
+
+    return (rsp + 5);
+}
+
+TEST_CASE(stats_test_nmgr_schema)
+{
+    uint8_t *rsp;
+    int len;
+    int off;
+    int i;
+
+    stats_test_setup();
+
+    rsp = stats_test_req(STATS_TEST_OP_SCHEMA, "tcnt", 4, &len);
+    TEST_ASSERT_FATAL(len >= 5);
+    TEST_ASSERT(rsp[0] == 0);
+    TEST_ASSERT(rsp[3] == sizeof(uint32_t));
+    TEST_ASSERT(rsp[4] == 4);
+
+    off = 5;
+    for (i = 0; i < 4; i++) {
+        TEST_ASSERT_FATAL(off + 4 <= len);
+        TEST_ASSERT((rsp[off] | (rsp[off + 1] << 8)) ==
+                offsetof(STATS_SECT_DECL(stats_test_cnt), sa) +
+                i * sizeof(uint32_t));
+#ifdef STATS_NAME_ENABLE
+        TEST_ASSERT(rsp[off + 2] == 1);
+        TEST_ASSERT(rsp[off + 3] == 'a' + i);
+#endif
+        off += 3 + rsp[off + 2];
+    }
+    TEST_ASSERT(off == len);
+
+    rsp = stats_test_req(STATS_TEST_OP_SCHEMA, "nosuch", 6, &len);
+    TEST_ASSERT(len == 1 && rsp[0] == NMGR_ERR_ENOENT);
+}
+
+TEST_CASE(stats_test_nmgr_delta)
+{
+    uint8_t req[6 + 4];
+    uint32_t gen1;
+    uint32_t gen2;
+    uint32_t gen3;
+    uint8_t *rsp;
+    int len;
+
+    stats_test_setup();
+    memset(&stats_test_cnt.sa, 0, 4 * sizeof(uint32_t));
+    stats_test_cnt.sa = 1;
+    stats_test_cnt.sb = 2;
+    stats_test_cnt.sc = 300;
+
+    /* No base: every entry, as (gap, value). */
+    rsp = stats_test_delta("tcnt", 0, &gen1, &len);
+    TEST_ASSERT(gen1 != 0);
+    TEST_ASSERT(len == 9);
+    TEST_ASSERT(rsp[0] == 1 && rsp[1] == 1);
+    TEST_ASSERT(rsp[2] == 1 && rsp[3] == 2);
+    TEST_ASSERT(rsp[4] == 1 && rsp[5] == 0xac && rsp[6] == 0x02);
+    TEST_ASSERT(rsp[7] == 1 && rsp[8] == 0);
+
+    /* Nothing changed. */
+    rsp = stats_test_delta("tcnt", gen1, &gen2, &len);
+    TEST_ASSERT(gen2 != 0 && gen2 != gen1);
+    TEST_ASSERT(len == 0);
+
+    /* Only d changed; gap 4 from -1. */
+    stats_test_cnt.sd = 5;
+    rsp = stats_test_delta("tcnt", gen2, &gen3, &len);
+    TEST_ASSERT(len == 2);
+    TEST_ASSERT(rsp[0] == 4 && rsp[1] == 5);
+
+    /* A superseded base is answered with every entry. */
+    stats_test_cnt.sb = 3;
+    rsp = stats_test_delta("tcnt", gen2, &gen1, &len);
+    TEST_ASSERT(len == 9);
+    TEST_ASSERT(rsp[3] == 3);
+
+    /* A wrong schema hash is still refused once the hash is cached. */
+    rsp = stats_test_req(STATS_TEST_OP_SCHEMA, "tcnt", 4, &len);
+    TEST_ASSERT_FATAL(len >= 3 && rsp[0] == 0);
+    req[0] = rsp[1] ^ 0x01;
+    req[1] = rsp[2];
+    memset(req + 2, 0, 4);
+    memcpy(req + 6, "tcnt", 4);
+    rsp = stats_test_req(STATS_TEST_OP_DELTA, req, sizeof(req), &len);
+    TEST_ASSERT(len == 1 && rsp[0] == NMGR_ERR_EINVAL);
+}
+
+TEST_CASE(stats_test_nmgr_delta_many)
+{
+    uint32_t gen[STATS_TEST_POLL_CNT];
+    uint8_t *rsp;
+    int len;
+    int i;
+
+    stats_test_setup();
+
+    for (i = 0; i < STATS_TEST_POLL_CNT; i++) {
+        memset(&stats_test_poll[i].sa, 0, 4 * sizeof(uint32_t));
+        rsp = stats_test_delta(stats_test_poll_name[i], 0, &gen[i], &len);
+        TEST_ASSERT(gen[i] != 0);
+        TEST_ASSERT(len == 8);
+    }
+
+    /* Polling every other group in between does not cost a group its
+     * base.
+     */
+    for (i = 0; i < STATS_TEST_POLL_CNT; i++) {
+        stats_test_poll[i].sc = i + 1;
+        rsp = stats_test_delta(stats_test_poll_name[i], gen[i], &gen[i],
+                &len);
+        TEST_ASSERT(len == 2);
+        TEST_ASSERT(rsp[0] == 3 && rsp[1] == i + 1);
+    }
+}
+
+TEST_CASE(stats_test_nmgr_delta_wrap)
+{
+    uint32_t stale;
+    uint32_t gen;
+    uint8_t *rsp;
+    int rc;
+    int len;
+
+    stats_test_setup();
+    memset(&stats_test_cnt.sa, 0, 4 * sizeof(uint32_t));
+
+    rc = stats_nmgr_snap_gen_set(STATS_HDR(stats_test_cnt), 0xfffffffe);
+    TEST_ASSERT_FATAL(rc == 0);
+
+    rsp = stats_test_delta("tcnt", 0, &gen, &len);
+    TEST_ASSERT(gen == 0xffffffff);
+    TEST_ASSERT(len == 8);
+
+    /* The generation skips 0, which means "no base". */
+    rsp = stats_test_delta("tcnt", gen, &gen, &len);
+    TEST_ASSERT(gen == 1);
+    TEST_ASSERT(len == 0);
+    stale = gen;
+
+    rsp = stats_test_delta("tcnt", gen, &gen, &len);
+    TEST_ASSERT(gen == 2);
+    TEST_ASSERT(len == 0);
+
+    /* An old generation is never taken for the current one. */
+    rsp = stats_test_delta("tcnt", stale, &gen, &len);
+    TEST_ASSERT(gen == 3);
+    TEST_ASSERT(len == 8);
+}
+
+TEST_SUITE(stats_test_all)
+{
+    stats_test_gauge_record();
+    stats_test_hist_buckets();
+    stats_test_walk();
+    stats_test_shell_fmt();
+    stats_test_nmgr_read();
+    stats_test_nmgr_schema();
+    stats_test_nmgr_delta();
+    stats_test_nmgr_delta_many();
+    stats_test_nmgr_delta_wrap();
+}
+
+#ifdef MYNEWT_SELFTEST
+
+int
+main(int argc, char **argv)
+{
+    tu_config.tc_print_results = 1;
+    tu_init();
+
+    stats_test_all();
+
+    return tu_any_failed;
+}
+
+#endif